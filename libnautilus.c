@@ -0,0 +1,11488 @@
+// Date last modified: Wed 18 Dec 15:06:30 AEDT 2019
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>   
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <poll.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/sendfile.h>
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <linux/ioprio.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <spawn.h>
+#include <glob.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <math.h>
+#include <stdio_ext.h>
+#include <dlfcn.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+#include "nautilus.h"
+
+#define MAX_LINE_CHARS NAUTILUS_LINE_MAX
+#define DEFAULT_PATH "/bin:/usr/bin"
+#define WORD_SEPARATORS " \t\r\n"
+#define DEFAULT_HISTORY_SHOWN 10
+
+// Command substitution buffer sizes. Output is read in large blocks so a big
+// capture only costs a few syscalls per megabyte
+#define CAPTURE_PIPE_SIZE (1024 * 1024)
+#define CAPTURE_READ_SIZE (1024 * 1024)
+
+// Here-document sizes. A body that fits in an empty pipe is written into one
+// with a single write, a larger one is moved into a memfd in 1 MiB blocks
+#define HEREDOC_PIPE_LIMIT (64 * 1024)
+#define HEREDOC_SPILL_SIZE (1024 * 1024)
+#define HEREDOC_PROMPT "> "
+
+// A measured pipe that fills up and drains this many times without growing 
+// is limited by its size, so it is given a bigger one
+#define PIPE_GROW_EVENTS 16
+
+// States of a measured pipe, by what the shell is waiting on
+#define LINK_MOVING 0
+#define LINK_FULL 1
+#define LINK_EMPTY 2
+#define LINK_CLOSED 3
+
+// Seconds a timed out command gets to exit after SIGTERM before SIGKILL, and
+// the exit status reported for it, as with timeout(1)
+#define TIMEOUT_KILL_GRACE 2
+#define TIMEOUT_EXIT_STATUS 124
+// How often processes are checked on when pidfds aren't available
+#define DEADLINE_POLL_MS 10
+
+// Completion settings: how many possibilities are listed at most and how 
+// many directory listings are kept
+#define COMPLETION_LIST_LIMIT 200
+#define DIRECTORY_CACHE_SIZE 8
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// How many seconds the directories in PATH are trusted not to have changed 
+// for after they were last checked
+#define PATH_CHECK_INTERVAL 1.0
+
+// Default bound on the size of the memo store, which NAUTILUS_MEMO_SIZE 
+// overrides, and the block size output is copied in
+#define MEMO_STORE_SIZE (256ULL * 1024 * 1024)
+#define MEMO_COPY_SIZE (64 * 1024)
+
+// Size of the pipes of a fan-out, which is also how much is duplicated onto
+// every consumer at a time
+#define FANOUT_PIPE_SIZE (1024 * 1024)
+
+// Output sink settings: the size of each of a sink's two buffers, the size 
+// of the io_uring they are written through and how many appended files are 
+// kept open between commands
+#define SINK_BUFFER_SIZE (1024 * 1024)
+#define SINK_RING_ENTRIES 4
+#define SINK_CACHE_SIZE 8
+
+// Latency histograms count durations in microseconds. Up to 64us each has a
+// bucket, and every doubling after that is split into 32, so a bucket is 
+// never more than about 3% wide. The last bucket holds everything past 2^40us
+#define HISTOGRAM_LINEAR_BUCKETS 64
+#define HISTOGRAM_SUB_BUCKETS 32
+#define HISTOGRAM_BUCKETS (HISTOGRAM_LINEAR_BUCKETS + 35 * HISTOGRAM_SUB_BUCKETS)
+
+// Stack a program's setup runs on between being cloned and executing it
+#define SPAWN_STACK_SIZE (64 * 1024)
+
+// Changes that make watch run its command again, how long they have to stop
+// for before it does by default, and how much of them is read at a time
+#define WATCH_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+#define WATCH_DEBOUNCE_MS 10
+#define WATCH_BUFFER_SIZE (64 * 1024)
+
+// Builtin filters read and write in blocks that stay in the CPU's cache, 
+// with up to this many running at once and this many ranges in a cut list
+#define FILTER_BUFFER_SIZE (128 * 1024)
+#define FILTER_MAX_THREADS 64
+#define FILTER_MAX_RANGES 16
+// Kinds of builtin filter
+#define FILTER_COUNT_LINES 0
+#define FILTER_MATCH 1
+#define FILTER_HEAD 2
+#define FILTER_TAIL 3
+#define FILTER_CUT 4
+#define FILTER_SORT 5
+
+// The sort filter's default memory budget, beyond which sorted runs are 
+// spilled to temporary files, and how many of them are merged at once. 
+// Chunks are only split between threads in slices of at least a few 
+// thousand lines
+#define SORT_MEMORY (256 * 1024 * 1024)
+#define SORT_MAX_KEYS 8
+#define SORT_MAX_THREADS 64
+#define SORT_MERGE_WIDTH 64
+#define SORT_SLICE_LINES 4096
+#define SORT_INSERTION_LINES 16
+#define SORT_PREFIX_MAX_DIGITS 2047
+#define SORT_RUN_BUFFER_SIZE (1024 * 1024)
+
+// Directory jumping: the index of directories cd has been to, how quickly 
+// a visit's weight halves, and the weight below which a directory is 
+// forgotten. The index is rewritten once it has this many more lines than 
+// directories, keeping at most this many of them
+#define DIRECTORY_INDEX_FILE ".nautilus_dirs"
+#define DIRECTORY_HALF_LIFE (14 * 24 * 3600.0)
+#define DIRECTORY_MIN_SCORE (1.0 / 16)
+#define DIRECTORY_INDEX_SLACK 256
+#define DIRECTORY_INDEX_SIZE 1000
+
+// Fused filters: how many blocks can be in flight between two filters run
+// in the shell, and how many times one spins before sleeping on the other
+#define FILTER_RING_SLOTS 8
+#define FILTER_RING_SPINS 256
+
+// Compressed redirections: the formats a redirection can be in, with 
+// CODEC_AUTO going by the output file's name, how much is read and written 
+// at once and held by the pipe to the program, and how many files one 
+// command can have compressed or decompressed at once
+#define CODEC_NONE 0
+#define CODEC_AUTO 1
+#define CODEC_GZIP 2
+#define CODEC_ZSTD 3
+#define CODEC_BUFFER_SIZE (1024 * 1024)
+#define CODEC_PIPE_SIZE (1024 * 1024)
+#define CODEC_MAX_THREADS 8
+#define CODEC_GZIP_LEVEL 6
+#define CODEC_ZSTD_LEVEL 3
+// Values from zlib.h and zstd.h, as the libraries are only loaded when 
+// first needed
+#define ZLIB_NO_FLUSH 0
+#define ZLIB_FINISH 4
+#define ZLIB_OK 0
+#define ZLIB_STREAM_END 1
+#define ZLIB_BUF_ERROR (-5)
+#define ZLIB_DEFLATED 8
+#define ZLIB_GZIP_WINDOW (15 + 16)
+#define ZLIB_ANY_WINDOW (15 + 32)
+#define ZSTD_C_COMPRESSION_LEVEL 100
+#define ZSTD_C_NB_WORKERS 400
+#define ZSTD_E_CONTINUE 0
+#define ZSTD_E_END 2
+
+// Coprocesses: how many the shell keeps, how much of a response is read at
+// once, and how long one being stopped has to exit before it is killed
+#define COPROCESS_MAX 16
+#define COPROCESS_READ_SIZE (64 * 1024)
+#define COPROCESS_STOP_MS 500
+
+// Parallel stages: the most copies of a stage, the size of the chunks its 
+// input is split into, how much of it is read at once, and how long lines 
+// wait for more to make up a chunk before a copy is given them anyway
+#define PARALLEL_MAX_COPIES 64
+#define PARALLEL_CHUNK_SIZE (1024 * 1024)
+#define PARALLEL_READ_SIZE (256 * 1024)
+#define PARALLEL_FLUSH_MS 20
+
+// Flight recorder: how many of the latest events are kept, which has to be
+// a power of two, how much of a line or program name each keeps, and the 
+// stack its signal handler runs on, so it works after a stack overflow
+#define FLIGHT_EVENTS 4096
+#define FLIGHT_NAME_SIZE 40
+#define FLIGHT_STACK_SIZE (64 * 1024)
+#define FLIGHT_LINE 1
+#define FLIGHT_PARSE 2
+#define FLIGHT_LOOKUP_HIT 3
+#define FLIGHT_LOOKUP_MISS 4
+#define FLIGHT_SPAWN 5
+#define FLIGHT_SPAWN_FAILED 6
+#define FLIGHT_EXIT 7
+#define FLIGHT_KILL 8
+#define FLIGHT_SIGNAL 9
+#define FLIGHT_DONE 10
+
+// These characters are always returned as single words
+#define SPECIAL_CHARS "!><|"
+
+// Redirection flags
+#define NOT_REDIR 0 
+#define REDIR_OUTPUT 1
+#define REDIR_APPEND 2
+#define REDIR_INPUT 4
+
+// ===== Default functions ===== 
+static void execute_command(char **words, char **path, char **environment);
+static void do_exit(char **words);
+static int is_executable(char *pathname);
+static char **tokenize(char *s, char *separators, char *special_chars);
+
+// ===== My helper functions ===== 
+
+// Runs a single command line, as typed at the prompt
+static void runCommandLine(char *line, char **path, char **environment);
+
+// Returns true if the file at pathName is a directory
+static bool isDirectory(char *pathName);  
+
+// Given an array of directory pathnames, search for a target file and return 
+// the full pathname to target
+static char *findInPath(char **paths, char *target);  
+
+// Given an array of arguments, concatenates them all together with a white 
+// space between each argument and return the final single string
+static char *formString(char **words);  
+
+// Given an array of arguments, counts and returns the number of non-NULL
+// arguments
+static int getWordCount(char **words);  
+
+// Given an array of arguments, counts and returns the total number of 
+// characters 
+static int getCharCount(char **words);  
+
+// Checks if the input string is numeric. Returns true if it is
+static bool isNumber(char *argument);  
+
+// Handles error message printing for programs that weren't executable
+static void executionError(char **words, char *programPath);
+
+// Whether the file is_executable last looked at exists
+static bool lastExecutableExists = true;
+
+// Given a program name and an array of paths to search, form the absolute path
+// and return it
+static char *getPathToProgram(char *program, char **path);
+
+// Returns the current time in seconds from an arbitrary fixed point
+static double getMonotonicTime(void);
+
+// A bump allocator. Memory is handed out from large blocks and only given 
+// back all at once, or back to a mark taken earlier
+struct arenaBlock {
+    struct arenaBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+// Memory allocated elsewhere which is freed along with the arena
+struct arenaAdoption {
+    void *memory;
+    size_t size;
+};
+
+struct arena {
+    struct arenaBlock *blocks;
+    struct arenaAdoption *adopted;
+    int numberOfAdopted;
+    int adoptedCapacity;
+    // Bytes handed out, the most handed out since peak was last cleared, and
+    // the most ever handed out
+    size_t bytesUsed;
+    size_t peak;
+    size_t highWater;
+};
+
+// A point in an arena's allocations that it can be rewound to
+struct arenaMark {
+    struct arenaBlock *block;
+    size_t used;
+    int numberOfAdopted;
+    size_t bytesUsed;
+};
+
+// Everything the command being run allocates, given back once it finishes
+static struct arena commandArena;
+
+// Returns size bytes of memory from the arena
+static void *arenaAlloc(struct arena *arena, size_t size);
+
+// Returns a copy of the first length characters of s from the arena
+static char *arenaStrndup(struct arena *arena, char *s, size_t length);
+
+// Makes the arena responsible for freeing memory from malloc
+static void arenaAdopt(struct arena *arena, void *memory, size_t size);
+
+// Returns a mark for everything allocated from the arena so far
+static struct arenaMark arenaGetMark(struct arena *arena);
+
+// Frees everything allocated from the arena since the mark was taken
+static void arenaReset(struct arena *arena, struct arenaMark *mark);
+
+// Returns the number of bytes the arena holds, whether handed out or not
+static size_t getArenaSize(struct arena *arena);
+
+// Frees everything allocated from the arena
+static void arenaFree(struct arena *arena);
+
+// Appends word to a NULL terminated array of count words from the command 
+// arena, with room for capacity words, and returns the array. The array is 
+// moved to a bigger one when it is full
+static char **appendWord(char **words, int *count, int *capacity, char *word);
+
+// ===== Subset 0 - Builtin cd and pwd ===== 
+
+// Executes cd
+static void cd(char **words);
+
+// Executes pwd
+static void pwd(void);
+
+// ===== Subset 2 - History utilities ===== 
+
+// The history file, opened once for appending and reading, and how many
+// lines it had up to where it was last counted
+static FILE *historyFile = NULL;
+static int historyLineCount = 0;
+static off_t historyCountedSize = 0;
+
+// Opens $HOME/.nautilus_history the first time it is needed and returns the 
+// FILE *, which stays open
+static FILE *openHistory(void);  
+
+// Returns the number of lines in $HOME/.nautilus_history
+static int getHistoryLineCount(void); 
+
+// Prints the latest n entries in $HOME/.nautilus_history 
+static void printLatestHistory(int n); 
+
+// Appends the given command to $HOME/.nautilus_history
+static void writeHistory(char **words);  
+
+// Fetches the string corresponding to lineNumber in $HOME/.nautilus_history
+static char *getCommandFromHistory(int lineNumber); 
+
+// Called if ! or !n was typed. Retrieves the right command from history and 
+// tokenizes it before returning it 
+static char **getHistoryWords(char **words);  
+
+// ===== Subset 3 - Globbing utilities ===== 
+
+// Returns true if a wildcard symbol was found in line
+static bool hasWildcard(char *line);  
+
+// Given an array of strings, return the same array but with all wildcards 
+// expanded out fully
+static char **expandWildcards(char **words);  
+
+// ===== Subset 4 - I/O redirection ===== 
+
+// Separately handles redirection commands by cases
+static void executeRedirection(char **words, char **path, char **environ);
+
+// Returns true if the given argument is a builtin command
+static bool isBuiltin(char *argument); 
+
+// Given an array of arguments, returns true if a redirection symbol is present
+static bool isRedirectionCommand(char **words);
+
+// Returns true if the argument is a redirection symbol. This is useful for
+// checking if the redirection command string is valid
+static bool isRedirection(char *argument);
+
+// Returns true if the given command is determined to be a valid redirection
+// command
+static bool checkRedirValidity(char **words, int flags);
+
+// Returns an integer containing redirection flags REDIR_INPUT, REDIR_OUTPUT or
+// REDIR_APPEND if the given arguments form a valid I/O redirection command
+static int getRedirectionType(char **words);
+
+// Given an array of strings and a separator, returns a slice of that array
+// from argument 0 up to, but not including, the separator string
+// eg. leftPartition({"hello", "<", "world", NULL}, "<") returns {"hello", NULL}
+static char **leftPartition(char **words, char *separator);
+
+// Given an array of strings and a separator, returns a slice of that array
+// from argument 0 up to, but not including, the separator string
+// eg. rightPartition({"hello", "<", "world", NULL}, "<") returns {"world", NULL}
+static char **rightPartition(char **words, char *separator, bool stopLastOccurrence);
+
+// Exclusively handles commands of the form: "< filename command ..."
+static void executeRedirInput(char **words, char **path, char **environment);
+
+// Exclusively handles commands of the form: "command ... > filename"
+static void executeRedirOutput(char **words, char **path, char **environment);
+
+// Exclusively handles commands of the form: "command ... >> filename"
+static void executeRedirAppend(char **words, char **path, char **environment);
+
+// Exclusively handles commands of the form: "< filename command ... > filename"
+static void executeRedirInputAndOutput(char **words, char **path, char **environment);
+
+// Exclusively handles commands of the form: "< filename command ... >> filename"
+static void executeRedirInputAndAppend(char **words, char **path, char **environment);
+
+// Opens a file for the given kind of redirection: REDIR_INPUT, REDIR_OUTPUT
+// or REDIR_APPEND. Returns the descriptor, or -1 on failure
+static int openRedirectionFile(char *fileName, int redirectOption);
+
+// ===== Subset 5 - Piping between processes ===== 
+
+// Returns true if the given command was identified as a piping command
+static bool isPipeCommand(char **words);
+
+// Returns the number of pipes found in the command's arguments
+static int getNumberOfPipes(char **words);
+
+// Executes the piping command 
+static void executePiping(char **commandWords, char **path, char **environ);
+
+// Runs every process of a pipeline at once, each connected to the next by a
+// pipe. The first process reads from inputFD and the last writes to 
+// outputFilename, when they are given
+static void handlePiping(char **commandWords, char **path, char **environ, 
+                         int inputFD, int numberOfPipes, 
+                         int redirectOption, char *outputFilename);
+
+// ===== Subset 6 - Command substitution ===== 
+
+// Output captured from a $(...) substitution. Words split out of the output
+// point directly into data, so the buffer is handed to the command arena
+struct capture {
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+// Returns true if the given word contains a $(...) substitution
+static bool hasSubstitution(char *word);
+
+// Given a pointer to the "$(", "<(" or ">(" of a substitution, returns a 
+// pointer to the matching ")" or NULL if the parentheses are unbalanced
+static char *findClosingParen(char *s);
+
+// Returns the length of the token at s if it contains a $(...) substitution
+// or is a <(...) or >(...) one, which is kept whole even when the command 
+// inside has separators. Returns 0 if there is no substitution in the token
+static size_t getSubstitutionTokenLength(char *s, char *separators, char *special_chars);
+
+// Returns true if the argument is the name of a builtin command
+static bool isBuiltinName(char *argument);
+
+// Given an array of arguments, returns the same array but with every $(...) 
+// replaced by the words of that command's output
+static char **expandSubstitutions(char **words, char **path, char **environment);
+
+// Expands the substitutions in a single word, appending the resulting text 
+// onto output
+static void expandWord(char *word, struct capture *output, char **path, char **environment);
+
+// Runs the given command line and appends everything it writes to stdout onto
+// the end of output. Returns false if the command could not be run
+static bool captureOutput(char *commandLine, struct capture *output, char **path, char **environment);
+
+// Makes room for at least extra more bytes (plus a '\0') at the end of output.
+// Returns false if out of memory, with what output held freed and emptied
+static bool reserveCapture(struct capture *output, size_t extra);
+
+// ===== Subset 7 - Here-documents and here-strings ===== 
+
+// Returns the index of the "<" "<" starting a here-document or here-string, 
+// or -1 if the command doesn't have one
+static int findHereDocument(char **words);
+
+// Exclusively handles commands of the form: "command ... << DELIM" and 
+// "command ... <<< words ...", optionally followed by "> filename" or 
+// ">> filename"
+static void executeHereDocument(char **words, char **path, char **environment);
+
+// Reads lines from stdin into body until a line matching delimiter. Once the 
+// body outgrows a pipe it is moved into a memfd, which is returned. Otherwise
+// returns -1, with the whole body left in body
+static int readHereDocument(char *delimiter, struct capture *body);
+
+// Writes out and empties body onto the end of fd. Returns false on failure
+static bool spillHereDocument(struct capture *body, int fd);
+
+// Returns a sealed memfd that the body can be written into, or -1
+static int createHereDocumentFile(void);
+
+// Returns a descriptor from which the child reads the whole body as its stdin
+static int openHereDocumentInput(struct capture *body, int memfd);
+
+// ===== Subset 8 - Pipeline accounting ===== 
+
+// Throughput of one pipe in a measured pipeline, between two processes
+struct pipeLinkStats {
+    char *producer;
+    char *consumer;
+    size_t bytes;
+    // Time from the pipeline starting until the pipe was closed
+    double seconds;
+    // Time the pipe was full, leaving the producer blocked on the consumer
+    double fullSeconds;
+    // Time the pipe was empty, leaving the consumer waiting on the producer
+    double emptySeconds;
+    int pipeSize;
+    int resizes;
+};
+
+// Measurements of a whole pipeline, shown by pipestat
+struct pipeStats {
+    int numberOfLinks;
+    struct pipeLinkStats *links;
+    double seconds;
+};
+
+// A pipe size learned for a program that was held back by small pipes, 
+// applied to the program's output pipe in later pipelines
+struct learnedPipeSize {
+    char *program;
+    int size;
+};
+
+// Whether pipelines are run through the accounting probe
+static bool pipeAccounting = false;
+
+// Measurements of the last pipeline that ran with accounting on
+static struct pipeStats lastPipeStats = {0, NULL, 0};
+
+// Pipe sizes learned for programs that were held back by small pipes
+static struct learnedPipeSize *learnedPipeSizes = NULL;
+static int numberOfLearnedPipeSizes = 0;
+
+// Executes pipestat, which turns accounting on or off or reports on the last
+// measured pipeline
+static void pipestat(char **words);
+
+// Prints the measurements of the last measured pipeline
+static void printPipeStats(void);
+
+// Frees the measurements of the last measured pipeline
+static void clearPipeStats(void);
+
+// Splices the output of each process into the pipe of the next until every
+// pipe is closed, measuring the bytes and the time spent blocked on each
+static void probePipeline(int (*producerPipes)[2], int (*consumerPipes)[2], 
+                          struct pipeLinkStats *links, int numberOfLinks, 
+                          double startTime);
+
+// Tries to resize the pipe to the given size and returns the size it ends 
+// up with
+static int growPipe(int fd, int size);
+
+// Returns the pipe size learned for a program's output, or 0 if none
+static int getLearnedPipeSize(char *program);
+
+// Remembers a bigger pipe size for a program's output
+static void learnPipeSize(char *program, int size);
+
+// ===== Subset 9 - Timeouts and resource limits ===== 
+
+// Scheduling settings given to the programs of a command or pipeline stage 
+// by its @cpu=, @nice=, @io= and @par= prefixes
+struct processSettings {
+    bool hasCPUs;
+    cpu_set_t cpus;
+    bool hasNice;
+    int nice;
+    bool hasIOPriority;
+    int ioPriority;
+    // Subset 29: how many copies of the stage run at once with @par=, or 0,
+    // and whether their output may be given in any order
+    int copies;
+    bool isUnordered;
+};
+
+// Limits placed on every process of one command line by the timeout and 
+// limit prefixes, and the settings of the stage being started
+struct commandLimits {
+    // Seconds the command may run for, or 0 for no timeout
+    double timeout;
+    bool isLimited[RLIM_NLIMITS];
+    struct rlimit limits[RLIM_NLIMITS];
+    struct processSettings settings;
+    // Group holding the command's processes, once the first has started
+    pid_t processGroup;
+    // Fires at the deadline, then again at each step of killing the group 
+    int timerFD;
+    int signalsSent;
+    bool timedOut;
+    // True if the process group was given the terminal
+    bool hasTerminal;
+    // Subset 27: the format given by a compress prefix, and its level or 0,
+    // and whether a decompress prefix was given
+    int codec;
+    int codecLevel;
+    bool isDecompressing;
+};
+
+// Limits of the command currently being run
+static struct commandLimits commandLimits = {.timerFD = -1};
+
+// Given an array of arguments, strips off any leading "timeout DURATION", 
+// "limit cpu=...,mem=...,nofile=...", "compress FORMAT" and "decompress" 
+// prefixes, storing them in commandLimits, and returns the rest of the 
+// command. Returns no arguments if invalid
+static char **parseCommandLimits(char **words);
+
+// Parses a duration such as "30", "1.5s", "200ms", "2m" or "1h". Returns 
+// false if it isn't valid
+static bool parseDuration(char *text, double *seconds);
+
+// Parses a comma separated list of resource limits into commandLimits. 
+// Returns false if it isn't valid
+static bool parseLimits(char *specification);
+
+// The descriptors a program is given as its stdin, stdout and stderr, or -1
+// to share the shell's. A filter run in the shell can be given rings in 
+// place of its stdin and stdout instead
+struct spawnActions {
+    int fds[3];
+    struct filterRing *rings[2];
+};
+
+// Starts a spawnActions off with every descriptor shared with the shell
+static void initSpawnActions(struct spawnActions *actions);
+
+// Gives a program fd as the descriptor newFD
+static void addSpawnDup2(struct spawnActions *actions, int fd, int newFD);
+
+// Spawns a program like posix_spawn, placing it in the command's process 
+// group and applying the command's limits and settings
+static int spawnProgram(pid_t *pid, char *programPath, struct spawnActions *actions, 
+                        char **words, char **environment);
+
+// Waits for a program like waitpid, killing it if the deadline passes
+static int waitForProgram(pid_t pid, int *status);
+
+// Waits for all of the given programs, killing their whole process group if
+// the deadline passes. Returns -1 if any couldn't be waited for
+static int waitForPrograms(pid_t *pids, int numberOfPids, int *statuses);
+
+// Blocks until fd is readable, enforcing the deadline while waiting
+static void waitForInput(int fd);
+
+// Arms the timer for the command's deadline
+static void startDeadline(void);
+
+// Puts a copy of the shell forked for the command into the command's 
+// process group, starting the group and the deadline if it is the first of
+// its processes, as spawnProgram does for a program
+static void joinCommandGroup(pid_t pid);
+
+// Called when the deadline's timer fires. Sends the command's process group
+// the next signal in the escalation
+static void handleDeadline(void);
+
+// Makes the given process group the terminal's foreground group, so its 
+// processes can still read from the terminal
+static void giveTerminalTo(pid_t processGroup);
+
+// Converts a status from waitpid into an exit status to report
+static int getExitStatus(int status);
+
+// Clears the limits once the command has finished
+static void resetCommandLimits(void);
+
+// ===== Subset 10 - Line editing and tab completion ===== 
+
+// A node of a compressed prefix trie. Each edge is labelled with a run of 
+// characters rather than a single one
+struct trieNode {
+    // The characters on the edge leading into this node
+    char *label;
+    int labelLength;
+    // Sorted by the first character of their labels
+    struct trieNode **children;
+    int numberOfChildren;
+    // The index into PATH of the directory holding the name that ends at 
+    // this node, or -1 if no name ends here
+    int pathIndex;
+    // The number of names ending at or below this node
+    int numberOfNames;
+};
+
+// Every program name in PATH, kept until one of the directories changes
+struct commandTrie {
+    struct trieNode *root;
+    struct arena arena;
+    struct timespec *mtimes;
+    int numberOfPaths;
+    double checkedAt;
+};
+
+// A sorted listing of a directory, kept until the directory changes
+struct directoryListing {
+    char *path;
+    struct timespec mtime;
+    char **names;
+    bool *isDirectory;
+    int numberOfNames;
+    struct arena arena;
+    double lastUsed;
+};
+
+// Names offered by completion which aren't found in PATH
+static char *builtinNames[] = {"ask", "cd", "compress", "coproc", "dag", "decompress", "exit", "flightlog", "history", "j", "limit", "memo", "memstat", "pipestat", "pwd", "stats", "timeout", "watch", NULL};
+
+// Program names in PATH, used by both command lookup and completion
+static struct commandTrie commandTrie = {NULL, {NULL}, NULL, 0, 0};
+
+// Recently completed directories
+static struct directoryListing directoryCache[DIRECTORY_CACHE_SIZE];
+
+// Returns the trie of program names in PATH, rebuilding it first if any of
+// the directories have changed since it was built. They are checked at most
+// once every PATH_CHECK_INTERVAL seconds
+static struct trieNode *getCommandTrie(char **path);
+static struct trieNode *refreshCommandTrie(struct commandTrie *trie, char **path);
+
+// Adds a name to the trie, unless it is already there
+static void insertIntoTrie(struct trieNode *root, struct arena *arena, char *name, int pathIndex);
+
+// Returns the node at which the given prefix ends, or NULL if no name starts 
+// with it. Sets *matched to the number of characters of that node's label 
+// the prefix runs into
+static struct trieNode *findTrieNode(struct trieNode *root, char *prefix, int *matched);
+
+// Fills in numberOfNames for every node below root and returns the total
+static int countTrieNames(struct trieNode *root);
+
+// Appends the names below node to names, each prefixed by the given text, 
+// up to a maximum of limit names
+static void collectTrieNames(struct trieNode *node, char *prefix, int prefixLength, 
+                             char **names, int *numberOfNames, int limit);
+
+// Returns the listing of the given directory, reading it if it isn't cached
+// or has changed
+static struct directoryListing *getDirectoryListing(char *directoryPath);
+
+// Returns true if a word starting at wordStart would be a program name
+static bool isCommandPosition(const char *line, int wordStart);
+
+// Frees the children arrays of every node below node
+static void freeTrieChildren(struct trieNode *node);
+
+// Returns the child of node whose label starts with first, or NULL. Sets 
+// *index to where such a child is or would be inserted
+static struct trieNode *findTrieChild(struct trieNode *node, char first, int *index);
+
+// Returns the index into PATH of the directory holding name, or -1
+static int lookupTrie(struct trieNode *root, char *name);
+
+// Compares two names for qsort
+static int compareNames(const void *a, const void *b);
+
+// ===== Subset 11 - Per-command memory ===== 
+
+// The most the command arena held while running the last command
+static size_t lastCommandPeak = 0;
+
+// Gives back everything the command allocated by rewinding the command arena
+// to the mark taken before it started
+static void finishCommandMemory(struct arenaMark *commandStart);
+
+// Executes memstat, reporting how much memory the shell is holding
+static void memstat(char **words);
+
+// Returns the shell's resident set size in bytes, or 0 if it can't be read
+static size_t getResidentSize(void);
+
+// ===== Subset 12 - Command server ===== 
+
+// The exit status of the last command line run
+static int lastExitStatus = 0;
+
+// False when exit statuses are only recorded rather than printed, as when
+// running for -c or a server's client
+static bool isReportingStatus = true;
+
+// Prints a program's exit status and records it as the command's
+static void reportExitStatus(char *programPath, int exitStatus);
+
+// ===== Subset 13 - Dependency graphs ===== 
+
+// States of a node in a dag file
+#define DAG_WAITING 0
+#define DAG_RUNNING 1
+#define DAG_SUCCEEDED 2
+#define DAG_FAILED 3
+#define DAG_SKIPPED 4
+
+// A line of a dag file, of the form "label: after: a,b command ...". It is 
+// run once every node it comes after has succeeded
+struct dagNode {
+    char *label;
+    char *commandLine;
+    char **dependencyLabels;
+    int *dependencies;
+    int numberOfDependencies;
+    int *dependents;
+    int numberOfDependents;
+    // Dependencies which haven't finished yet
+    int waitingOn;
+    // The number of nodes on the longest chain starting here. Ready nodes 
+    // with the longest chains are started first
+    int height;
+    int state;
+    pid_t pid;
+    // A pidfd for the running node, or -1
+    int pidFD;
+    int exitStatus;
+    double startTime;
+    double endTime;
+    // The longest time taken by a chain of nodes ending here, and the node 
+    // before this one on it, or -1
+    double pathTime;
+    int pathPrevious;
+};
+
+// Executes dag, running the commands of a file in dependency order on up to
+// N processes at once
+static void dag(char **words, char **path, char **environment);
+
+// Reads the nodes of a dag file and links them together. Returns the 
+// number of nodes, or -1 if the file is invalid
+static int readDagFile(char *fileName, struct dagNode **nodes);
+
+// Parses one line of a dag file into node. Returns 0 for a blank line or 
+// comment, 1 for a node and -1 for an invalid line
+static int parseDagLine(char *line, int lineNumber, struct dagNode *node);
+
+// Links each node to its dependencies and dependents, and works out the 
+// heights. Returns false if a dependency is unknown or there is a cycle
+static bool linkDagNodes(struct dagNode *nodes, int numberOfNodes);
+
+// Forks a process running the node's command line
+static void startDagNode(struct dagNode *node, char **path, char **environment);
+
+// Marks everything downstream of a failed node as skipped. Returns how many
+// nodes were newly skipped
+static int skipDagDependents(struct dagNode *nodes, int index);
+
+// Prints each node's timings and the critical path
+static void printDagReport(struct dagNode *nodes, int numberOfNodes, double seconds, int jobs);
+
+// ===== Subset 14 - Memoized commands ===== 
+
+// A SHA-256 hash being computed
+struct sha256 {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char buffer[64];
+    size_t bufferLength;
+};
+
+// One of a memoized command's output streams while it is shown and stored
+struct memoOutput {
+    // Read end of the command's pipe, or -1 once it is closed
+    int pipeFD;
+    // Where the output is shown as it arrives
+    int echoFD;
+    // Temporary file in the store the output is written to
+    int fileFD;
+    char tempPath[PATH_MAX];
+    struct sha256 hash;
+    uint64_t size;
+    char digest[65];
+};
+
+// An action in the memo store, while it is being evicted
+struct memoAction {
+    char name[65];
+    struct timespec mtime;
+    char blobs[2][65];
+    uint64_t size;
+};
+
+// Executes memo, which replays a command's stored output if its arguments,
+// chosen environment variables and inputs are unchanged, and otherwise runs
+// it and stores its output
+static void memo(char **words, char **path, char **environment);
+
+// Puts the memo store's directory into directory, creating it if needed. 
+// Returns false if it can't be created
+static bool getMemoDirectory(char *directory, size_t size);
+
+// Creates the directory and any missing parents
+static bool makeDirectories(char *directoryPath);
+
+// Adds a named field to a key being hashed, so fields can't run together
+static void hashMemoField(struct sha256 *hash, char *name, void *data, size_t length);
+
+// Adds an input file to a key, by its contents or by its inode and times
+static void hashMemoInput(struct sha256 *hash, char *fileName, bool byContent);
+
+// Writes out the stored output of an action and reports its exit status. 
+// Returns false if the action isn't fully stored
+static bool replayMemo(char *directory, char *key, char *programPath);
+
+// Runs a command, showing its output while storing it under the action key
+static void runMemoized(char *directory, char *key, char *programPath, 
+                        char **words, char **environment);
+
+// Copies everything in the command's pipe into the store and out to where
+// it is shown. Returns false once the pipe is closed
+static bool pumpMemoOutput(struct memoOutput *output);
+
+// Moves a finished output into the store under its digest
+static bool storeMemoBlob(char *directory, struct memoOutput *output);
+
+// Removes the least recently used actions, and any output only they used, 
+// until the store is within its size bound
+static void evictMemoStore(char *directory);
+
+// Compare actions by when they were last used, and digests, for qsort
+static int compareMemoActions(const void *a, const void *b);
+static int compareDigests(const void *a, const void *b);
+
+// Parses a size with an optional K, M or G suffix
+static bool parseSize(char *text, unsigned long long *size);
+
+// Writes all of a buffer, retrying short writes. Returns false on error
+static bool writeAll(int fd, char *data, size_t length);
+
+// Starts, adds to and finishes a SHA-256 hash. The digest is written out as
+// 64 hex digits
+static void sha256Init(struct sha256 *hash);
+static void sha256Update(struct sha256 *hash, void *data, size_t length);
+static void sha256Final(struct sha256 *hash, char *digest);
+
+// Hashes one 64 byte block
+static void sha256Block(struct sha256 *hash, unsigned char *block);
+
+// ===== Subset 16 - Process substitution and fan-out ===== 
+
+// A <(...) or >(...) substitution, running until the command line it was 
+// part of has finished. fd is the shell's end of its pipe
+struct processSubstitution {
+    pid_t pid;
+    int fd;
+};
+
+// Substitutions of the command line being run
+static struct processSubstitution *processSubstitutions = NULL;
+static int numberOfProcessSubstitutions = 0;
+
+// Returns true if the word is a whole <(...) or >(...) substitution
+static bool isProcessSubstitution(char *word);
+
+// Given an array of arguments, returns the same array but with every <(...)
+// and >(...) started and replaced by the /dev/fd path of its pipe
+static char **expandProcessSubstitutions(char **words, char **path, char **environment);
+
+// Closes the shell's end of every substitution's pipe and waits for them
+static void finishProcessSubstitutions(void);
+
+// Forks a copy of the shell to run a command line with the given stdin and 
+// stdout, or the shell's own for -1, and without the given descriptors. 
+// Returns the copy's pid, or -1 if it couldn't be forked
+static pid_t forkCommandLine(char *commandLine, int inputFD, int outputFD, 
+                             int *closedFDs, int numberOfClosedFDs, 
+                             char **path, char **environment);
+
+// Returns true if the given command line contains the fan-out operator |+
+static bool isFanOutCommand(char **words);
+
+// Executes "producer |+ consumer |+ ...", which gives every consumer its own
+// copy of everything the producer writes
+static void executeFanOut(char **words, char **path, char **environment);
+
+// Duplicates everything from the input pipe onto every output pipe until the
+// input is closed or every output has been
+static void teeFanOut(int inputFD, int *outputFDs, int numberOfOutputs);
+
+// ===== Subset 17 - Output sinks ===== 
+
+// A file the shell writes its own output into. Output is gathered into one
+// buffer while the other is being written behind it, and is all written by
+// the time the sink is closed
+struct outputSink {
+    int fd;
+    bool isCached;
+    char *buffers[2];
+    // The buffer being filled and how much is in it
+    int filling;
+    size_t length;
+    // Whether the other buffer is being written by the io_uring
+    bool isWriting;
+    size_t writingLength;
+    // Bytes handed to the file so far, and how far past where the sink 
+    // started space has been reserved for them
+    off_t written;
+    off_t start;
+    off_t preallocated;
+    off_t preallocateSize;
+    int error;
+};
+
+// The mapped rings of the io_uring output sinks are written through
+struct outputRing {
+    int fd;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+};
+
+// A file appended to by an earlier command, kept open for the next ones 
+// while it is still the file at that path
+struct cachedAppendFile {
+    char *fileName;
+    int fd;
+    dev_t device;
+    ino_t inode;
+    unsigned long lastUse;
+};
+
+static struct outputRing outputRing = {.fd = -1};
+static bool isOutputRingUnavailable = false;
+
+static struct cachedAppendFile appendFileCache[SINK_CACHE_SIZE];
+static unsigned long appendFileUses = 0;
+
+// The sink the shell's stdout currently goes to, if any
+static struct outputSink *activeSink = NULL;
+
+// Executes a builtin whose output is redirected to a file, which is 
+// written through an output sink
+static void executeBuiltinRedirection(char **words, char **path, char **environment, int redirectOption);
+
+// Opens a sink onto the given file, truncating it or appending to it. 
+// Returns false if the file can't be opened
+static bool openOutputSink(struct outputSink *sink, char *fileName, int redirectOption);
+
+// Writes out everything left in the sink and closes it. Returns false, with
+// errno set, if any of the output couldn't be written
+static bool closeOutputSink(struct outputSink *sink);
+
+// Copies data into the sink, writing out its buffer whenever it fills up.
+// Used as the write function of the sink's stdio stream
+static ssize_t writeOutputSink(void *cookie, const char *data, size_t size);
+
+// Starts writing the buffer being filled, once the previous write is done
+static void submitOutputSink(struct outputSink *sink);
+
+// Waits for the sink's write in flight, if there is one
+static void waitForOutputSink(struct outputSink *sink);
+
+// Writes data at the file's current position without the io_uring
+static bool writeAtPosition(int fd, char *data, size_t length);
+
+// Sets up the io_uring. Returns false if io_uring isn't available
+static bool setupOutputRing(void);
+
+// Returns the open descriptor for appending to a file, from the cache if 
+// the file was appended to recently
+static int openAppendFile(char *fileName);
+
+// Writes out the active sink before the shell forks, so the copy's output 
+// lands after it
+static void flushSinkBeforeFork(void);
+
+// Stops a forked copy of the shell buffering output it would never write
+static void detachSinkAfterFork(void);
+
+// ===== Subset 18 - Program statistics ===== 
+
+// Counts of durations in microseconds, bucketed as described above
+struct histogram {
+    uint32_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+};
+
+// What the shell has measured about every run of one program
+struct programStats {
+    char *name;
+    unsigned long invocations;
+    double wallSeconds;
+    // Time from calling posix_spawn to it returning once the child has 
+    // executed the program
+    struct histogram spawn;
+    // Time from calling posix_spawn to the program being waited for
+    struct histogram run;
+};
+
+// A spawned program that hasn't been waited for yet
+struct runningProgram {
+    pid_t pid;
+    int statsIndex;
+    double startTime;
+};
+
+static struct programStats *programStats = NULL;
+static int numberOfProgramStats = 0;
+static struct runningProgram *runningPrograms = NULL;
+static int numberOfRunningPrograms = 0;
+
+// The shell the statistics belong to, rather than a forked copy of it
+static pid_t statsOwner = 0;
+
+// Executes stats, which prints the statistics of every program run so far,
+// as a table or as JSON with --json, or forgets them with clear
+static void stats(char **words);
+
+// Returns the index of the statistics of the program at the given path, 
+// adding them if the program hasn't been run before
+static int getProgramStats(char *programPath);
+
+// Records that a program was spawned between the two times
+static void recordProgramSpawn(pid_t pid, char *programPath, double startTime, double spawnedTime);
+
+// Records that a spawned program has been waited for
+static void recordProgramExit(pid_t pid);
+
+// Adds a duration to a histogram
+static void recordDuration(struct histogram *histogram, uint64_t microseconds);
+
+// Returns the highest duration in the given histogram bucket
+static uint64_t getBucketDuration(int bucket);
+
+// Returns the duration the given fraction of a histogram's durations are 
+// at or below
+static uint64_t getPercentile(struct histogram *histogram, double fraction);
+
+// Writes a duration in microseconds as text in the most readable unit
+static void formatDuration(char *text, size_t size, uint64_t microseconds);
+
+// Prints every program's statistics as a JSON document
+static void printProgramStatsJson(FILE *file);
+
+// Prints a histogram as a JSON object of its percentiles and buckets
+static void printHistogramJson(FILE *file, struct histogram *histogram);
+
+// Writes the statistics as JSON to the file NAUTILUS_STATS_JSON names, if 
+// it is set, when the shell exits
+static void dumpProgramStats(void);
+
+// Orders programs by the total time spent running them, longest first
+static int compareProgramStats(const void *a, const void *b);
+
+// ===== Subset 19 - Scheduling prefixes ===== 
+
+// What the clone of the shell that becomes a program has to set up first.
+// It shares the shell's memory, so the error it fails with is left here
+struct spawnSetup {
+    char *programPath;
+    struct spawnActions *actions;
+    pid_t processGroup;
+    char **words;
+    char **environment;
+    sigset_t signalMask;
+    int error;
+    char *failedStep;
+};
+
+// Given the arguments of a command or pipeline stage, strips off any leading
+// @cpu=, @nice=, @io= and @par= prefixes into settings and returns the 
+// rest. The previous stage's settings are used by @cpu=share. Returns no 
+// arguments if invalid
+static char **parseProcessSettings(char **words, struct processSettings *settings, 
+                                   struct processSettings *previous);
+
+// Parses the CPUs of an @cpu= prefix: a list such as "0-3,8", every CPU the
+// shell may use but a list with "^0-1", or "share" for CPUs sharing a cache
+// with the previous stage's. Returns false if it isn't valid
+static bool parseCPUs(char *word, char *value, struct processSettings *settings, 
+                      struct processSettings *previous);
+
+// Parses a list of CPUs such as "0-3,8". Returns false if it isn't valid
+static bool parseCPUList(char *text, cpu_set_t *cpus);
+
+// Finds the CPUs sharing the closest cache with the given ones that isn't 
+// used by them alone. Returns false if the caches can't be read
+static bool getCacheSharingCPUs(cpu_set_t *cpus, cpu_set_t *sharing);
+
+// Returns true if the command's programs have to be set up between being 
+// cloned and executing, for their limits or settings
+static bool needsSpawnSetup(void);
+
+// Starts a program with posix_spawn, or by cloning the shell when it has to
+// be set up before it executes. Returns 0 or the error it failed with
+static int startProgram(pid_t *pid, char *programPath, struct spawnActions *actions, 
+                        pid_t processGroup, char **words, char **environment);
+
+// Runs in the clone of the shell: applies the command's limits and the 
+// stage's settings, then executes the program
+static int runSpawnSetup(void *argument);
+
+// ===== Subset 20 - Watch ===== 
+
+// A directory being watched, either for changes to anything in it or only 
+// to the names in it matching a pattern. wd is -1 once it is gone
+struct watchedPath {
+    int wd;
+    char *pattern;
+};
+
+// Whether command lines are written to the history. The runs of a watched
+// command aren't
+static bool isWritingHistory = true;
+
+// Executes watch, which runs a command and then runs it again whenever one of
+// the watched paths changes, until SIGINT or SIGTERM
+static void watch(char **words, char **path, char **environment);
+
+// Watches each of the paths after expanding their wildcards, and puts what 
+// is watched into watched. Returns how many are watched
+static int addWatchedPaths(int inotifyFD, char **paths, struct watchedPath **watched);
+
+// Reads every pending change. Returns true if any is to a watched path
+static bool readWatchEvents(int inotifyFD, struct watchedPath *watched, int numberOfWatched);
+
+// Runs the command line in a copy of the shell and returns its exit status
+static int runWatchedCommand(char *commandLine, sigset_t *mask, int *closedFDs, 
+                             int numberOfClosedFDs, char **path, char **environment);
+
+// ===== Subset 21 - Session record ===== 
+
+// The file every line run is recorded in when NAUTILUS_RECORD is set, and 
+// what is measured about the line being run
+struct sessionRecorder {
+    int fd;
+    double startTime;
+    double monotonicStart;
+    // Time spent waiting for programs, so the rest is the shell's own
+    double programSeconds;
+    char cwd[PATH_MAX];
+};
+
+static struct sessionRecorder sessionRecorder = {.fd = -1};
+
+// Opens the file named by NAUTILUS_RECORD for recording, if it is set
+static void openSessionRecord(void);
+
+// Starts and finishes measuring a line typed into the shell, appending it 
+// to the session record when it is finished
+static void startRecordedLine(void);
+static void finishRecordedLine(char *line);
+
+// ===== Subset 22 - Builtin filters ===== 
+
+// One -k key of sort, from the start of one field to the end of another, or
+// of the line when endField is 0. Keys with modifiers of their own don't 
+// take the global ones
+struct sortKey {
+    long startField;
+    long endField;
+    bool hasModifiers;
+    bool isNumeric;
+    bool isReverse;
+    bool skipsBlanks;
+};
+
+// How the sort filter orders lines
+struct sortOrder {
+    bool isNumeric;
+    bool isReverse;
+    bool isUnique;
+    bool skipsBlanks;
+    // Whether lines are compared whole and byte by byte, so their prefixes
+    // can be compared first
+    bool isPlain;
+    // Separator of fields, or 0 for fields starting at runs of blanks
+    char separator;
+    int numberOfKeys;
+    struct sortKey keys[SORT_MAX_KEYS];
+    unsigned long long memory;
+    int numberOfThreads;
+};
+
+// A filter such as grep -F or wc -l that the shell runs itself, in a thread,
+// instead of spawning the program
+struct filter {
+    int type;
+    char *name;
+    // The file read, or NULL for stdin
+    char *fileName;
+    char *pattern;
+    size_t patternLength;
+    bool isInverted;
+    bool isCounting;
+    long lines;
+    char delimiter;
+    int numberOfRanges;
+    long ranges[FILTER_MAX_RANGES][2];
+    struct sortOrder sort;
+};
+
+// A running filter. It is waited for through a handle in place of a pid, 
+// with doneFD becoming readable once it has finished
+struct filterThread {
+    bool isUsed;
+    pthread_t thread;
+    struct filter filter;
+    int inputFD;
+    int outputFD;
+    int errorFD;
+    struct filterRing *inputRing;
+    struct filterRing *outputRing;
+    int doneFD;
+    bool isFinished;
+    int exitStatus;
+};
+
+// Input of a filter, from an fd or from the blocks of a ring. A block taken
+// from a ring is read where it is, and handed back once it has all been read
+struct filterInput {
+    int fd;
+    struct filterRing *ring;
+    char *block;
+    size_t length;
+    size_t position;
+};
+
+// Output of a filter, gathered into blocks, which are written to an fd or 
+// handed on whole to a ring. isBroken is set once the reader has gone away
+struct filterOutput {
+    int fd;
+    struct filterRing *ring;
+    char *buffer;
+    size_t used;
+    bool isBroken;
+};
+
+// Input of a filter read a block of whole lines at a time. The buffer grows
+// to fit lines longer than it
+struct lineReader {
+    struct filterInput *input;
+    char *buffer;
+    size_t size;
+    size_t used;
+    // Length of the block last handed out
+    size_t consumed;
+    bool isEnded;
+};
+
+// Vectorized kernels, chosen for the CPU the first time a filter starts
+struct filterKernels {
+    size_t (*countNewlines)(const char *data, size_t length);
+    const char *(*findSubstring)(const char *data, size_t length, const char *pattern, size_t patternLength);
+};
+
+static struct filterThread filterThreads[FILTER_MAX_THREADS];
+static struct filterKernels filterKernels;
+
+// Returns true if the command is one a builtin filter can stand in for, 
+// parsing its options into filter
+static bool parseFilter(char **words, struct filter *filter);
+
+// Returns true if the command would be run as a builtin filter, given the 
+// command's limits and the stage's settings
+static bool isRunAsFilter(char **words, struct filter *filter);
+
+// Parses the field list of cut. Returns false if it isn't valid
+static bool parseFieldList(char *list, struct filter *filter);
+
+// Starts a filter on a thread reading and writing the fds the program would
+// have been given. Returns 0 with a handle in pid, or an error
+static int startFilter(pid_t *pid, struct filter *filter, struct spawnActions *actions);
+
+// Returns true if the pid is the handle of a filter
+static bool isFilterHandle(pid_t pid);
+
+// Returns an fd that becomes readable once the program or filter has exited
+static int openProgramFD(pid_t pid);
+
+// Waits for a program or filter like waitpid. Returns 0 if WNOHANG is given
+// and it hasn't exited
+static pid_t reapProgram(pid_t pid, int *status, int options);
+
+// Runs a filter on its thread
+static void *runFilter(void *argument);
+
+// The filters themselves. Each returns its exit status
+static int countLines(struct filter *filter, struct filterInput *input, struct filterOutput *output);
+static int matchLines(struct filter *filter, struct filterInput *input, struct filterOutput *output);
+static int headLines(struct filter *filter, struct filterInput *input, struct filterOutput *output);
+static int tailLines(struct filter *filter, struct filterInput *input, struct filterOutput *output);
+static int cutFields(struct filter *filter, struct filterInput *input, struct filterOutput *output);
+
+// Reads from a filter's input into buffer like read
+static ssize_t readFilterInput(struct filterInput *input, char *buffer, size_t size);
+
+// Reads the next block of a filter's input, into buffer from an fd, or 
+// where it is in a ring. Returns its length like read
+static ssize_t readFilterBlock(struct filterInput *input, char *buffer, size_t size, char **block);
+
+// Reads the next block of whole lines, with the last line of the input 
+// given even without its newline. Returns the block's length, 0 at the end 
+// or -1 on error
+static ssize_t readLineBlock(struct lineReader *reader, char **block);
+
+// Finds where the last given number of lines of a block start
+static size_t findTailStart(const char *data, size_t length, long lines);
+
+// Sets up and frees a filter's output, to either an fd or a ring
+static void initFilterOutput(struct filterOutput *output, int fd, struct filterRing *ring);
+static void freeFilterOutput(struct filterOutput *output);
+
+// Adds to and flushes a filter's output. Return false once it is broken
+static bool writeFilterOutput(struct filterOutput *output, const char *data, size_t length);
+static bool flushFilterOutput(struct filterOutput *output);
+
+// Picks the kernels for the CPU
+static void initFilterKernels(void);
+
+// Newline counting and substring search kernels
+static size_t countNewlinesScalar(const char *data, size_t length);
+static const char *findSubstringScalar(const char *data, size_t length, const char *pattern, size_t patternLength);
+#if defined(__x86_64__)
+static size_t countNewlinesSSE2(const char *data, size_t length);
+static size_t countNewlinesAVX2(const char *data, size_t length);
+static const char *findSubstringSSE2(const char *data, size_t length, const char *pattern, size_t patternLength);
+static const char *findSubstringAVX2(const char *data, size_t length, const char *pattern, size_t patternLength);
+#endif
+
+// ===== Subset 23 - Sort ===== 
+
+// A line being sorted, by where it is in its chunk. The start of its first
+// key is kept as a number that orders the same way, so most comparisons 
+// don't look at the line itself, along with where the key is, so that isn't
+// found again for the rest
+struct sortLine {
+    uint64_t prefix;
+    uint32_t keyStart;
+    uint32_t keyEnd;
+    size_t offset;
+    size_t length;
+};
+
+// Lines of the input read into memory to be sorted
+struct sortChunk {
+    char *data;
+    size_t size;
+    size_t used;
+    struct sortLine *lines;
+    size_t numberOfLines;
+    size_t capacity;
+};
+
+// Part of a chunk sorted by one thread
+struct sortSlice {
+    struct sortOrder *order;
+    char *data;
+    struct sortLine *lines;
+    size_t numberOfLines;
+};
+
+// One of the sorted sequences being merged: a slice of a chunk in memory, 
+// or a run spilled to a file. line is NULL once it is used up
+struct mergeSource {
+    char *data;
+    struct sortLine *lines;
+    size_t numberOfLines;
+    size_t next;
+    struct filterInput input;
+    struct lineReader reader;
+    char *block;
+    size_t blockLength;
+    size_t position;
+    const char *line;
+    size_t length;
+};
+
+// A number at the start of a sort key, without its leading and trailing 
+// zeros, so numbers of any length compare exactly
+struct sortNumber {
+    bool isNegative;
+    const char *digits;
+    size_t numberOfDigits;
+    const char *fraction;
+    size_t fractionLength;
+};
+
+// Parses the options of sort from the given index on. Returns false for any
+// it doesn't handle
+static bool parseSortOptions(char **words, int *index, struct sortOrder *order);
+
+// Parses a key such as 2,3n. Returns false if it isn't valid
+static bool parseSortKey(char *text, struct sortKey *key);
+
+// Returns true if the locale sort would use compares byte by byte
+static bool isByteCollation(void);
+
+// Sorts the input in chunks that fit the memory budget, spilling each to a 
+// temporary file when there is more than one and merging them at the end.
+// Returns the exit status
+static int sortLines(struct filter *filter, struct filterInput *input, int errorFD, struct filterOutput *output);
+
+// Reads lines into a chunk until it is full or the input ends, which sets
+// *isEnded. *chunkEnd is set to where its last whole line ends. Returns 
+// false on a read error
+static bool readSortChunk(struct filterInput *input, struct sortChunk *chunk, struct sortOrder *order, 
+                          bool *isEnded, size_t *chunkEnd);
+
+// Adds the line between the given offsets of a chunk
+static void addSortLine(struct sortChunk *chunk, struct sortOrder *order, size_t start, size_t end);
+
+// Sorts a chunk in slices on a thread each, then merges them to output. 
+// Returns false if the output is broken
+static bool sortChunk(struct sortOrder *order, struct sortChunk *chunk, struct filterOutput *output);
+
+// Sorts one slice, on its own thread
+static void *sortSlice(void *argument);
+
+// Sorts lines with a merge sort of its own rather than qsort_r, so the 
+// comparison is inlined and lines with the same keys stay in the order they
+// were read, which -u relies on to keep the first. The sorted lines end up 
+// in the buffer if isToBuffer is set
+static void mergeSortLines(struct sortSlice *slice, struct sortLine *lines, size_t count, 
+                           struct sortLine *buffer, bool isToBuffer);
+
+// Sorts a chunk, or merges runs, to a new run. Returns its descriptor, or -1
+// if it couldn't be written
+static int writeSortRun(struct sortOrder *order, struct sortChunk *chunk, int *runs, int numberOfRuns);
+
+// Merges spilled runs to output. Returns false if the output is broken
+static bool mergeRuns(struct sortOrder *order, int *runs, int numberOfRuns, struct filterOutput *output);
+
+// Merges sorted sources to output with a loser tree, leaving out repeated 
+// lines for -u. Returns false if the output is broken
+static bool mergeSources(struct sortOrder *order, struct mergeSource *sources, int numberOfSources, 
+                         struct filterOutput *output);
+
+// Plays the sources under a node of the loser tree against each other, 
+// keeping the loser at the node. Returns the winner
+static int buildLoserTree(struct sortOrder *order, struct mergeSource *sources, int *tree, 
+                          int numberOfSources, int node);
+
+// Returns true if source a's line goes out before source b's
+static bool isMergedBefore(struct sortOrder *order, struct mergeSource *sources, int a, int b);
+
+// Moves a source on to its next line
+static void advanceMergeSource(struct mergeSource *source);
+
+// Opens an unnamed temporary file for a run. Returns -1 on error
+static int openSortRun(void);
+
+// Compares two lines of a chunk
+static int compareSortLines(struct sortOrder *order, const char *data, const struct sortLine *x, 
+                            const struct sortLine *y);
+
+// Returns the prefix of a line for a numeric key
+static uint64_t getNumberPrefix(const char *text, size_t length);
+
+// Compares two lines in the order given
+static int compareLines(struct sortOrder *order, const char *a, size_t aLength, const char *b, size_t bLength);
+
+// Compares lines by their keys from the given one on, then by their bytes 
+// unless the order is -u
+static int compareKeys(struct sortOrder *order, int firstKey, const char *a, size_t aLength, 
+                       const char *b, size_t bLength);
+
+// Compares one key of two lines, found between the given pointers
+static int compareKey(struct sortOrder *order, struct sortKey *key, const char *aStart, const char *aEnd, 
+                      const char *bStart, const char *bEnd);
+
+// Compares bytes, with a prefix of another string coming before it
+static int compareBytes(const char *a, size_t aLength, const char *b, size_t bLength);
+
+// Compares the numbers at the start of two strings, after any blanks, as 
+// sort -n does. Anything that isn't a number counts as zero
+static int compareNumbers(const char *a, size_t aLength, const char *b, size_t bLength);
+static void parseSortNumber(const char *text, size_t length, struct sortNumber *number);
+
+// Finds where a key starts and ends in a line
+static void findSortKey(struct sortOrder *order, struct sortKey *key, const char *line, size_t length, 
+                        const char **start, const char **end);
+
+// Returns where the given field starts, or the end of the line if it has 
+// fewer fields, and where the field starting at fieldStart ends
+static const char *findSortField(char separator, const char *line, const char *end, long field);
+static const char *findSortFieldEnd(char separator, const char *fieldStart, const char *end);
+
+// ===== Subset 24 - Embedding API ===== 
+
+// A warm shell for a host program, as declared in nautilus.h. It keeps its
+// own environment, directory and trie of PATH, so nothing is shared between
+// contexts; the lock only guards the trie against a context being used from
+// more than one thread at once
+struct nautilusContext {
+    char **environment;
+    char **path;
+    int directoryFD;
+    struct commandTrie commandTrie;
+    pthread_mutex_t lock;
+};
+
+// Returns a malloc'd copy of a NULL terminated array of strings, or NULL if 
+// out of memory
+static char **copyStrings(char *const strings[]);
+
+// Frees an array from copyStrings
+static void freeStrings(char **strings);
+
+// Returns the directories of PATH in an environment, or of DEFAULT_PATH if
+// it has none, as an array from copyStrings
+static char **splitPath(char **environment);
+
+// Runs a command line in a worker forked from the host with the given 
+// descriptors. Never returns
+static void runContextWorker(struct nautilusContext *context, const char *line, const int fds[3]);
+
+// The directories of PATH for lines run in this process by nautilusExecute,
+// and the mark each line's memory is given back to
+static char **shellPath = NULL;
+static struct arenaMark shellStart;
+
+// ===== Subset 25 - Directory jumping ===== 
+
+// A directory cd has been to. Its rank is the base 2 log of its frecency,
+// the sum of its visits' weights, each halving every DIRECTORY_HALF_LIFE 
+// seconds, plus the time in half-lives. Ranks order directories the way 
+// their frecencies do at any moment, so they never change as time passes
+struct visitedDirectory {
+    char *path;
+    double rank;
+    bool isDead;
+};
+
+// The directories in $HOME/.nautilus_dirs, sorted by path, and by rank for 
+// j. The file is a journal of ranks, with a line appended for each visit 
+// and lines for the same directory adding up, which is read as far as 
+// readSize and rewritten with a line per directory once it grows too long
+struct directoryIndex {
+    int fd;
+    dev_t device;
+    ino_t inode;
+    off_t readSize;
+    int numberOfLines;
+    struct visitedDirectory *directories;
+    int numberOfDirectories;
+    int capacity;
+    struct visitedDirectory **byRank;
+    bool isRanked;
+};
+
+static struct directoryIndex directoryIndex = {.fd = -1};
+
+// Executes j, which changes to the best ranked directory matching all the 
+// patterns, or lists the index without any
+static void jump(char **words);
+
+// Appends a visit to the working directory to the index
+static void recordDirectory(void);
+
+// Opens $HOME/.nautilus_dirs the first time it is needed, and keeps it 
+// open until another shell replaces it. Returns -1 if it can't be opened
+static int openDirectoryIndex(void);
+
+// Closes the index and forgets what was read from it
+static void closeDirectoryIndex(void);
+
+// Reads the lines added to the index since it was last read, by this shell
+// or any other, rewriting it if it has grown too long
+static void refreshDirectoryIndex(void);
+
+// Adds a rank to a directory's, adding the directory if it is new
+static void addDirectoryRank(char *path, size_t length, double rank);
+
+// Rewrites the index with a line for each directory still worth keeping
+static void compactDirectoryIndex(void);
+
+// Returns the rank of a visit now
+static double getVisitRank(void);
+
+// Returns true if the patterns are found in the path in order
+static bool matchesDirectory(char *path, char **patterns, bool isCaseless);
+
+// Orders directories by rank, highest first
+static int compareDirectoryRanks(const void *a, const void *b);
+
+// ===== Subset 26 - Fused filters ===== 
+
+// The link between two filters run next to each other in a pipeline. The 
+// writer fills a slot's buffer and hands it over by moving head on, and the
+// reader reads it where it is and hands it back by moving tail on, so no 
+// bytes are copied and nothing is locked. Each side sleeps on a futex of 
+// events the other bumps, but only once it has said it is waiting
+struct filterRing {
+    char *buffers[FILTER_RING_SLOTS];
+    size_t lengths[FILTER_RING_SLOTS];
+    uint32_t head;
+    uint32_t tail;
+    uint32_t readerEvents;
+    uint32_t writerEvents;
+    bool isReaderWaiting;
+    bool isWriterWaiting;
+    bool isWriterDone;
+    bool isReaderGone;
+    // The ring is freed once both sides have closed it
+    int users;
+};
+
+// Sets isFused for each link of a pipeline with stages either side that 
+// would be run as filters, which can be joined by a ring
+static void findFusedLinks(char ***stages, struct processSettings *settings, int numberOfStages, 
+                           bool *isFused);
+
+// Creates a ring with a reader and a writer still to close it. Returns NULL
+// if out of memory
+static struct filterRing *createFilterRing(void);
+
+// Closes one side of a ring, waking the other
+static void closeRingWriter(struct filterRing *ring);
+static void closeRingReader(struct filterRing *ring);
+
+// Lets go of a ring, freeing it once neither side uses it
+static void dropFilterRing(struct filterRing *ring);
+
+// Takes a free buffer for the output to fill, waiting for the reader if 
+// they are all full. Returns false, breaking the output, once the reader 
+// has gone
+static bool takeRingBuffer(struct filterOutput *output);
+
+// Hands the output's filled buffer on to the reader. Returns false, 
+// breaking the output, once the reader has gone
+static bool passRingBlock(struct filterOutput *output);
+
+// Hands the input's block back and takes the next one, waiting for the 
+// writer if there is none. Returns its length, or 0 once the writer is done
+static ssize_t takeRingBlock(struct filterInput *input);
+
+// readLineBlock for a ring. Lines are handed out where they are in the 
+// ring's blocks, with only those split between two copied
+static ssize_t readRingLineBlock(struct lineReader *reader, char **block);
+
+// Bumps a side's events and wakes it if it is waiting
+static void wakeRingSide(uint32_t *events, bool *isWaiting);
+
+// Spins and then sleeps until the ring is ready for a side
+static void waitForRingSide(struct filterRing *ring, uint32_t *events, bool *isWaiting, bool isReader);
+
+// Returns true if the ring is ready for the reader or the writer
+static bool isRingReady(struct filterRing *ring, bool isReader);
+
+// ===== Subset 27 - Compressed redirections ===== 
+
+// A file being decompressed into, or compressed from, the pipe a program 
+// was given in its place, on a thread of the shell's
+struct codecThread {
+    bool isUsed;
+    pthread_t thread;
+    int format;
+    int level;
+    bool isCompressing;
+    int fileFD;
+    int pipeFD;
+    char *fileName;
+    // What the program wrote first, read to see if it is compressed already
+    char *firstBlock;
+    size_t firstLength;
+};
+
+// z_stream, as laid out by every version of zlib since 1.2
+struct zlibStream {
+    const unsigned char *nextIn;
+    unsigned int availableIn;
+    unsigned long totalIn;
+    unsigned char *nextOut;
+    unsigned int availableOut;
+    unsigned long totalOut;
+    const char *message;
+    void *state;
+    void *allocate;
+    void *free;
+    void *opaque;
+    int dataType;
+    unsigned long adler;
+    unsigned long reserved;
+};
+
+// ZSTD_inBuffer and ZSTD_outBuffer
+struct zstdBuffer {
+    void *data;
+    size_t size;
+    size_t position;
+};
+
+// The functions used from zlib and libzstd, found with dlopen the first 
+// time a redirection needs them. Either can be missing
+struct codecLibraries {
+    bool isLoaded;
+    bool hasZlib;
+    bool hasZstd;
+    const char *(*zlibVersion)(void);
+    int (*deflateInit2)(struct zlibStream *stream, int level, int method, int windowBits, int memoryLevel, 
+                        int strategy, const char *version, int streamSize);
+    int (*deflate)(struct zlibStream *stream, int flush);
+    int (*deflateEnd)(struct zlibStream *stream);
+    int (*inflateInit2)(struct zlibStream *stream, int windowBits, const char *version, int streamSize);
+    int (*inflate)(struct zlibStream *stream, int flush);
+    int (*inflateReset)(struct zlibStream *stream);
+    int (*inflateEnd)(struct zlibStream *stream);
+    void *(*createDContext)(void);
+    size_t (*decompressStream)(void *context, struct zstdBuffer *output, struct zstdBuffer *input);
+    size_t (*freeDContext)(void *context);
+    void *(*createCContext)(void);
+    size_t (*setCParameter)(void *context, int parameter, int value);
+    size_t (*compressStream2)(void *context, struct zstdBuffer *output, struct zstdBuffer *input, int mode);
+    size_t (*freeCContext)(void *context);
+    unsigned (*isError)(size_t code);
+    const char *(*getErrorName)(size_t code);
+};
+
+static struct codecThread codecThreads[CODEC_MAX_THREADS];
+static struct codecLibraries codecLibraries;
+
+// Parses the operand of a compress prefix, such as auto, gzip, zstd:19 or 
+// none, into commandLimits. Returns false if it isn't valid
+static bool parseCodec(char *text);
+
+// Opens a file for a program's redirection like openRedirectionFile. A 
+// compressed file is opened on a thread of the shell's, which decompresses
+// it into, or compresses into it from, a pipe whose other end is returned
+static int openProgramRedirection(char *fileName, int redirectOption);
+
+// Returns the format to read or write a redirection's file in
+static int getCodecFormat(int fd, char *fileName, int redirectOption);
+
+// Returns the format whose magic bytes data starts with, or CODEC_NONE
+static int getMagicFormat(unsigned char *data, size_t length);
+
+// Loads zlib and libzstd, once. Returns false if the format's is missing
+static bool loadCodecLibrary(int format);
+
+// Starts a thread decompressing or compressing a file. Returns the 
+// program's end of its pipe, or -1
+static int startCodec(int fileFD, char *fileName, int format, bool isCompressing);
+
+// Waits for the command's files to be finished
+static void finishCodecs(void);
+
+// Runs a codec on its thread
+static void *runCodec(void *argument);
+
+// Decompress from the file to the pipe, and compress from the pipe to the 
+// file. Each returns false, having said why, if the data or the file is bad
+static bool inflateFile(struct codecThread *codec);
+static bool decompressZstdFile(struct codecThread *codec);
+static bool deflateFile(struct codecThread *codec);
+static bool compressZstdFile(struct codecThread *codec);
+
+// Copies what the program wrote to the file as it is, when it is already 
+// compressed. Returns false, having said why, if the file can't be written
+static bool storeFile(struct codecThread *codec);
+
+// Reads a block like read, retrying when interrupted
+static ssize_t readCodecBlock(int fd, void *buffer, size_t size);
+
+// Reads a block of what the program wrote, starting with the first block
+static ssize_t readCodecInput(struct codecThread *codec, void *buffer, size_t size);
+
+// ===== Subset 28 - Coprocesses ===== 
+
+// A program kept running for the life of the shell, which is sent a line 
+// on its stdin for each request and answers on its stdout with a line, or 
+// with lines up to one matching delimiter. It is started again with the 
+// same words whenever it is found to have exited
+struct coprocess {
+    char *name;
+    char **words;
+    char *delimiter;
+    pid_t pid;
+    int pidFD;
+    int requestFD;
+    int responseFD;
+    // What has been read past the end of the last response
+    struct capture pending;
+    int restarts;
+};
+
+static struct coprocess coprocesses[COPROCESS_MAX];
+static int numberOfCoprocesses = 0;
+
+// The shell the coprocesses belong to, rather than a forked copy of it
+static pid_t coprocessOwner = 0;
+
+// Executes coproc, which starts a coprocess, stops one with -k, or lists 
+// them without any arguments
+static void coproc(char **words, char **path, char **environment);
+
+// Executes ask, which sends the rest of its words to a coprocess as a line 
+// and prints the response
+static void ask(char **words, char **path, char **environment);
+
+// Sends a request to the coprocess named by words[1] and appends its 
+// response to response, restarting the coprocess first if it has exited. 
+// Returns false, having said why, if there is no response
+static bool askCoprocess(char **words, struct capture *response, char **path, char **environment);
+
+// Returns the coprocess with the given name, or NULL
+static struct coprocess *findCoprocess(char *name);
+
+// Starts the coprocess's program with a pipe each way. Returns false if it
+// can't be started
+static bool startCoprocess(struct coprocess *coprocess, char **path, char **environment);
+
+// Closes the coprocess's stdin and waits a moment for it to exit, killing
+// it if it hasn't
+static void stopCoprocess(struct coprocess *coprocess);
+
+// Stops every coprocess when the shell exits, so none are left behind
+static void stopCoprocesses(void);
+
+// Returns true if the coprocess is still running, reaping it if it isn't
+static bool isCoprocessRunning(struct coprocess *coprocess);
+
+// Finds the end of the first response waiting in the coprocess's pending 
+// output. Returns how much of it is used up, with the response's own length
+// in *length, or 0 if it isn't all there yet
+static size_t findResponseEnd(struct coprocess *coprocess, size_t *length);
+
+// ===== Subset 29 - Parallel stages ===== 
+
+// One chunk of a parallel stage's input, given to a copy of the stage's 
+// program of its own, and what the copy has written back
+struct parallelChunk {
+    bool isUsed;
+    uint64_t sequence;
+    // The last chunk's output may not end a line, so it is always written 
+    // last
+    bool isLast;
+    // -1 once the copy has been waited for
+    pid_t pid;
+    int status;
+    // -1 once the whole chunk has been written, and once the copy's output
+    // has ended
+    int requestFD;
+    int responseFD;
+    struct capture input;
+    size_t inputWritten;
+    struct capture output;
+    size_t outputWritten;
+};
+
+// A pipeline stage run as several copies of its program. The shell splits 
+// the stage's input into chunks of whole lines, gives each to the next copy
+// free, and writes their outputs to the stage's output whole, in the order 
+// of the input unless it was asked not to
+struct parallelStage {
+    char **words;
+    char *programPath;
+    struct processSettings settings;
+    // -1 once the input has ended, or the output has
+    int inputFD;
+    int outputFD;
+    // Read but not yet given to a copy, since when
+    struct capture pending;
+    double pendingSince;
+    // Twice as many as there are copies, so copies can go on with later 
+    // chunks while an earlier one's output waits to be written
+    struct parallelChunk *chunks;
+    int numberOfChunks;
+    int running;
+    uint64_t nextSequence;
+    // The chunk whose output is written next, by sequence when in order
+    uint64_t nextOutput;
+    struct parallelChunk *writing;
+    // The status of the copy that failed worst, or the lowest
+    int status;
+    bool hasStatus;
+    // The shell's signal mask, which copies are started with
+    sigset_t signalMask;
+};
+
+// Parses the operand of an @par= prefix, a number of copies optionally 
+// followed by ",unordered". Returns false if it isn't valid
+static bool parseCopies(char *word, char *value, struct processSettings *settings);
+
+// Sets a stage up to be run as copies, on its own copies of the fds its 
+// input and output would be given. Returns false if it can't be
+static bool startParallelStage(struct parallelStage *stage, char **words, char *programPath, 
+                               struct processSettings *settings, int inputFD, int outputFD, 
+                               bool isToNextStage);
+
+// Feeds and drains the copies of the parallel stages of a pipeline until
+// every one of them has reached the end of its input
+static void runParallelStages(struct parallelStage *stages, int numberOfStages, char **environment);
+
+// Gives the next chunk of the stage's input to a new copy of its program, 
+// if it has one ready and a copy may start. Returns false if not
+static bool startParallelChunk(struct parallelStage *stage, char **environment);
+
+// Handles an event on one of a parallel stage's fds
+static void readParallelInput(struct parallelStage *stage);
+static void writeParallelChunk(struct parallelChunk *chunk);
+static void readParallelOutput(struct parallelStage *stage, struct parallelChunk *chunk);
+static void writeParallelOutput(struct parallelStage *stage);
+
+// Finds the chunk whose output is written next, or NULL if none can be yet
+static struct parallelChunk *findNextOutput(struct parallelStage *stage);
+
+// Frees the chunks that are finished with
+static void retireParallelChunks(struct parallelStage *stage);
+
+// Stops taking input and writing output once the output has been closed
+static void breakParallelStage(struct parallelStage *stage);
+
+// Returns how long until the stage's partial chunk has to be given to a 
+// copy, in milliseconds, or -1 if it doesn't
+static int getParallelFlushTimeout(struct parallelStage *stage);
+
+// ===== Subset 30 - Flight recorder ===== 
+
+// One thing the shell did. Events are small and fixed in size, so 
+// recording one is only a clock read and a few stores
+struct flightEvent {
+    // Nanoseconds on the monotonic clock
+    uint64_t time;
+    uint32_t microseconds;
+    // Set last, so an event being written when the log is dumped is skipped
+    uint16_t type;
+    int32_t value;
+    int32_t extra;
+    char name[FLIGHT_NAME_SIZE];
+};
+
+// The latest events, overwritten oldest first. next only ever counts up
+struct flightRecorder {
+    struct flightEvent events[FLIGHT_EVENTS];
+    uint64_t next;
+};
+
+static struct flightRecorder flightRecorder;
+static char flightSignalStack[FLIGHT_STACK_SIZE];
+
+// Dumps the log on SIGUSR1, and before the shell dies of a fatal signal
+static void startFlightRecorder(void);
+
+// Records an event that took the given number of seconds. Safe to call from
+// a signal handler
+static void recordFlightEvent(int type, double seconds, int value, int extra, const char *name);
+
+// Records a program having been waited for, with how long it ran
+static void recordFlightExit(pid_t pid, int status);
+
+// Executes flightlog, which prints the log, or only its last N events
+static void flightlog(char **words);
+
+// Writes the last maxEvents events, or all of them with 0, to fd with only
+// async-signal-safe calls
+static void dumpFlightLog(int fd, long maxEvents);
+
+// Finds the first of the last maxEvents events still in the log. Returns 
+// how many there are from it
+static uint64_t findFlightEvents(long maxEvents, uint64_t *first);
+
+// Writes an event as a line of text, timed relative to now, without 
+// allocating or using stdio. Returns its length
+static size_t formatFlightEvent(struct flightEvent *event, uint64_t now, char *buffer, size_t size);
+
+// Appends text and numbers to a line being formatted
+static void appendFlightText(char *buffer, size_t size, size_t *length, const char *text);
+static void appendFlightNumber(char *buffer, size_t size, size_t *length, int64_t number, int width);
+static void appendFlightDuration(char *buffer, size_t size, size_t *length, uint64_t microseconds);
+
+// Returns the monotonic clock in nanoseconds
+static uint64_t getFlightTime(void);
+
+// Handles SIGUSR1 and the fatal signals
+static void handleFlightSignal(int signalNumber);
+
+static void execute_command(char **words, char **path, char **environment) {
+    assert(words != NULL);
+    assert(path != NULL);
+    assert(environment != NULL);
+    char *program = words[0];
+    if (program == NULL) { return; }
+    if (strcmp(program, "exit") == 0) {
+        do_exit(words);
+        return; 
+    }
+    int argc = getWordCount(words);
+    // Subset 0:
+    if (strcmp(program, "cd") == 0) {
+        if (argc > 2) {
+            fprintf(stderr, "%s: too many arguments\n", program);
+        } else {
+            cd(words);
+        }
+        return;
+    }
+    if (strcmp(program, "pwd") == 0) {
+        if (argc > 1) {
+            fprintf(stderr, "%s: too many arguments\n", program);
+        } else {
+            pwd();
+        }
+        return;
+    }
+    // Subset 8:
+    if (strcmp(program, "pipestat") == 0) {
+        pipestat(words);
+        return;
+    }
+    // Subset 11:
+    if (strcmp(program, "memstat") == 0) {
+        memstat(words);
+        return;
+    }
+    // Subset 13:
+    if (strcmp(program, "dag") == 0) {
+        dag(words, path, environment);
+        return;
+    }
+    // Subset 14:
+    if (strcmp(program, "memo") == 0) {
+        memo(words, path, environment);
+        return;
+    }
+    // Subset 18:
+    if (strcmp(program, "stats") == 0) {
+        stats(words);
+        return;
+    }
+    // Subset 20:
+    if (strcmp(program, "watch") == 0) {
+        watch(words, path, environment);
+        return;
+    }
+    // Subset 25:
+    if (strcmp(program, "j") == 0) {
+        jump(words);
+        return;
+    }
+    // Subset 28:
+    if (strcmp(program, "coproc") == 0) {
+        coproc(words, path, environment);
+        return;
+    }
+    if (strcmp(program, "ask") == 0) {
+        ask(words, path, environment);
+        return;
+    }
+    // Subset 30:
+    if (strcmp(program, "flightlog") == 0) {
+        flightlog(words);
+        return;
+    }
+    // Subset 2:
+    if (strcmp(program, "history") == 0) { 
+        if (argc == 1) {
+            printLatestHistory(DEFAULT_HISTORY_SHOWN);
+        } else if (argc == 2) {
+            if (isNumber(words[1])) {
+                printLatestHistory(atoi(words[1]));
+            } else {
+                fprintf(stderr, "%s: nonnumber: numeric argument required\n", program);
+            }
+        } else {
+            fprintf(stderr, "%s: too many arguments\n", program);
+        }
+        return;
+    }
+    // Run a non built-in program
+    char *programPath = getPathToProgram(words[0], path);
+    if (programPath != NULL && is_executable(programPath)) {
+        pid_t pid;
+        if (spawnProgram(&pid, programPath, NULL, words, environment) != 0) {
+            perror("spawn:");
+            return;
+        }
+        int exit_status;
+        if (waitForProgram(pid, &exit_status) == -1) {
+            perror("waitpid");
+            return;
+        }
+        exit_status = getExitStatus(exit_status); 
+        reportExitStatus(programPath, exit_status);
+    } else {
+        executionError(words, programPath);
+    }
+}
+
+// ================= Helper Functions =================
+
+static void runCommandLine(char *line, char **path, char **environment) {
+    lastExitStatus = 0;
+    // Subset 30:
+    double lineStart = getMonotonicTime();
+    recordFlightEvent(FLIGHT_LINE, 0, strlen(line), 0, line);
+    char **commandWords = tokenize(line, WORD_SEPARATORS, SPECIAL_CHARS);
+    // Make a copy the command arguments for history writing 
+    char **commandWordsCopy = tokenize(line, WORD_SEPARATORS, SPECIAL_CHARS);
+    recordFlightEvent(FLIGHT_PARSE, getMonotonicTime() - lineStart, getWordCount(commandWords), 0, NULL);
+    if (commandWords != NULL && commandWords[0] != NULL && isFanOutCommand(commandWords)) {
+        // Each side of a fan-out is a whole command line of its own
+        writeHistory(commandWordsCopy);
+        executeFanOut(commandWords, path, environment);
+        // The line is still finished like any other
+        commandWords[0] = NULL;
+    }
+    if (commandWords != NULL && commandWords[0] != NULL) {
+        commandWords = parseCommandLimits(commandWords);
+    }
+    if (commandWords != NULL && commandWords[0] != NULL && isPipeCommand(commandWords) == false) {
+        // Each stage of a pipeline has settings of its own
+        commandWords = parseProcessSettings(commandWords, &commandLimits.settings, NULL);
+        if (commandWords[0] != NULL && commandLimits.settings.copies > 0) {
+            // Subset 29: only a pipeline stage has a stream to split
+            fprintf(stderr, "@par=: only applies to a stage of a pipeline\n");
+            lastExitStatus = 2;
+            commandWords[0] = NULL;
+        }
+    }
+    if (commandWords != NULL && commandWords[0] != NULL) {
+        commandWords = expandProcessSubstitutions(commandWords, path, environment);
+        commandWords = expandSubstitutions(commandWords, path, environment);
+    }
+    if (commandWords != NULL && commandLimits.timedOut) {
+        // Subset 9: the deadline passed while substituting, so the command 
+        // itself isn't run
+        lastExitStatus = TIMEOUT_EXIT_STATUS;
+        commandWords[0] = NULL;
+    }
+    
+    if (commandWords != NULL && commandWords[0] != NULL) {
+        if (findHereDocument(commandWords) != -1) {
+            writeHistory(commandWordsCopy);
+            executeHereDocument(commandWords, path, environment);
+        } else if (isPipeCommand(commandWords)) {
+            writeHistory(commandWordsCopy); 
+            executePiping(commandWords, path, environment);
+        } else if (isRedirectionCommand(commandWords)) {
+            writeHistory(commandWordsCopy); 
+            executeRedirection(commandWords, path, environment);
+        } else if (strcmp(commandWords[0], "!") == 0) {
+            char **historyWords = getHistoryWords(commandWords);
+            if (historyWords != NULL) {
+                writeHistory(historyWords);
+                historyWords = parseCommandLimits(historyWords);
+                if (isPipeCommand(historyWords) == false) {
+                    historyWords = parseProcessSettings(historyWords, &commandLimits.settings, NULL);
+                }
+                historyWords = expandProcessSubstitutions(historyWords, path, environment);
+                historyWords = expandSubstitutions(historyWords, path, environment);
+                if (commandLimits.timedOut) {
+                    lastExitStatus = TIMEOUT_EXIT_STATUS;
+                } else {
+                    historyWords = expandWildcards(historyWords);
+                    execute_command(historyWords, path, environment);
+                }
+            }
+        } else {
+            commandWords = expandWildcards(commandWords);
+            execute_command(commandWords, path, environment);
+            writeHistory(commandWordsCopy);  
+        }
+    }
+    finishProcessSubstitutions();
+    // Subset 27:
+    finishCodecs();
+    resetCommandLimits();
+    // Subset 30:
+    recordFlightEvent(FLIGHT_DONE, getMonotonicTime() - lineStart, lastExitStatus, 0, NULL);
+}
+
+static bool isDirectory(char *pathName) {
+    struct stat s;
+    if (stat(pathName, &s) == 0 && S_ISDIR(s.st_mode)) {
+        return true;
+    }
+    return false;    
+}
+
+static char *findInPath(char **paths, char *target) {
+    // Names are looked up in the trie of PATH, which is only rebuilt when 
+    // one of the directories changes, rather than reading every directory
+    double lastChecked = commandTrie.checkedAt;
+    int pathIndex = lookupTrie(getCommandTrie(paths), target);
+    if (pathIndex == -1 && commandTrie.checkedAt == lastChecked) {
+        // The program might have been installed since PATH was last checked
+        commandTrie.checkedAt = 0;
+        pathIndex = lookupTrie(getCommandTrie(paths), target);
+    }
+    if (pathIndex == -1) {
+        return NULL;
+    }
+    char *path = paths[pathIndex];
+    int size = sizeof(char) * (strlen(path) + strlen(target)) + 1 + 1;
+    char *absPathToTarget = arenaAlloc(&commandArena, size);
+    strcpy(absPathToTarget, path);
+    strcat(absPathToTarget, "/");
+    strcat(absPathToTarget, target);
+    return absPathToTarget;
+}
+
+static char *formString(char **words) {
+    assert(words != NULL && words[0] != NULL);
+    int argc = getWordCount(words);
+    int charCount = getCharCount(words);
+    // String size calculation:
+    // charCount is the number of characters, not including spaces, '\n' and '\0'
+    // + (argc - 1) because that's how many spaces there are
+    // + 1 for \n and + 1 for the null terminator \0
+    char *result = malloc(sizeof(char) * (charCount + (argc - 1) + 1 + 1));  
+    strcpy(result, words[0]);
+    for (int i = 1; i < argc; i++) {
+        strcat(result, " ");
+        strcat(result, words[i]);
+    }
+    strcat(result, "\n");
+    return result;
+}
+
+static int getWordCount(char **words) {
+    int argc = 0;
+    assert(words != NULL);
+    while (words[argc] != NULL) {
+        argc++;
+    }
+    return argc;
+}
+
+static int getCharCount(char **words) {
+    int charCount = 0;
+    int i = 0;
+    while (words[i] != NULL) {
+        charCount += strlen(words[i]);
+        i++;
+    }
+    return charCount;
+}
+
+static bool isNumber(char *argument) {
+    for (int i = 0; i < strlen(argument); i++) {
+        char ch = argument[i];
+        if (ch == '-' && i == 0 && strlen(argument) > 1) {
+            // dash - indicates negative number when it's the first character of a string of more than 2 characters
+            // so ignore this iteration 
+            continue;  
+        }
+        if (!(ch >= '0' && ch <= '9')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void executionError(char **words, char *programPath) {
+    // is_executable has always just looked at programPath when it is given
+    if (programPath != NULL && lastExecutableExists == false) {
+        fprintf(stderr, "%s: command not found\n", programPath);
+        lastExitStatus = 127;
+    } else if (programPath == NULL) {
+        fprintf(stderr, "%s: command not found\n", words[0]);            
+        lastExitStatus = 127;
+    } else {
+        fprintf(stderr, "%s: Permission denied\n", programPath);
+        lastExitStatus = 126;
+    }
+}
+
+static char *getPathToProgram(char *program, char **path) {
+    char *programPath = program;
+    char *programName = NULL;
+    if ((programName = strrchr(programPath, '/')) == NULL) {
+        // Subset 30:
+        double lookupStart = getMonotonicTime();
+        programPath = findInPath(path, program);  
+        int type = (programPath != NULL) ? FLIGHT_LOOKUP_HIT : FLIGHT_LOOKUP_MISS;
+        recordFlightEvent(type, getMonotonicTime() - lookupStart, 0, 0, program);
+    }
+    return programPath;
+}
+
+static double getMonotonicTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void *arenaAlloc(struct arena *arena, size_t size) {
+    // Keep everything handed out aligned for any type
+    size = (size + 15) & ~((size_t) 15);
+    struct arenaBlock *block = arena->blocks;
+    if (block == NULL || block->used + size > block->size) {
+        size_t blockSize = ARENA_BLOCK_SIZE;
+        if (size > blockSize) {
+            blockSize = size;
+        }
+        block = malloc(sizeof(struct arenaBlock) + blockSize);
+        block->used = 0;
+        block->size = blockSize;
+        block->next = arena->blocks;
+        arena->blocks = block;
+    }
+    void *memory = block->data + block->used;
+    block->used += size;
+    arena->bytesUsed += size;
+    if (arena->bytesUsed > arena->peak) {
+        arena->peak = arena->bytesUsed;
+    }
+    if (arena->bytesUsed > arena->highWater) {
+        arena->highWater = arena->bytesUsed;
+    }
+    return memory;
+}
+
+static char *arenaStrndup(struct arena *arena, char *s, size_t length) {
+    char *copy = arenaAlloc(arena, length + 1);
+    memcpy(copy, s, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+static void arenaAdopt(struct arena *arena, void *memory, size_t size) {
+    if (arena->numberOfAdopted == arena->adoptedCapacity) {
+        arena->adoptedCapacity = (arena->adoptedCapacity == 0) ? 16 : arena->adoptedCapacity * 2;
+        arena->adopted = realloc(arena->adopted, sizeof(struct arenaAdoption) * arena->adoptedCapacity);
+    }
+    arena->adopted[arena->numberOfAdopted].memory = memory;
+    arena->adopted[arena->numberOfAdopted].size = size;
+    arena->numberOfAdopted++;
+    arena->bytesUsed += size;
+    if (arena->bytesUsed > arena->peak) {
+        arena->peak = arena->bytesUsed;
+    }
+    if (arena->bytesUsed > arena->highWater) {
+        arena->highWater = arena->bytesUsed;
+    }
+}
+
+static struct arenaMark arenaGetMark(struct arena *arena) {
+    struct arenaMark mark;
+    mark.block = arena->blocks;
+    mark.used = (arena->blocks != NULL) ? arena->blocks->used : 0;
+    mark.numberOfAdopted = arena->numberOfAdopted;
+    mark.bytesUsed = arena->bytesUsed;
+    return mark;
+}
+
+static void arenaReset(struct arena *arena, struct arenaMark *mark) {
+    // Blocks are only ever added at the front, so everything in front of the
+    // marked block is newer than the mark
+    while (arena->blocks != mark->block) {
+        struct arenaBlock *next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    if (arena->blocks != NULL) {
+        arena->blocks->used = mark->used;
+    }
+    for (int i = mark->numberOfAdopted; i < arena->numberOfAdopted; i++) {
+        free(arena->adopted[i].memory);
+    }
+    arena->numberOfAdopted = mark->numberOfAdopted;
+    arena->bytesUsed = mark->bytesUsed;
+}
+
+static size_t getArenaSize(struct arena *arena) {
+    size_t size = 0;
+    for (struct arenaBlock *block = arena->blocks; block != NULL; block = block->next) {
+        size += sizeof(struct arenaBlock) + block->size;
+    }
+    for (int i = 0; i < arena->numberOfAdopted; i++) {
+        size += arena->adopted[i].size;
+    }
+    return size;
+}
+
+static void arenaFree(struct arena *arena) {
+    struct arenaMark start = {NULL, 0, 0, 0};
+    arenaReset(arena, &start);
+    free(arena->adopted);
+    arena->adopted = NULL;
+    arena->adoptedCapacity = 0;
+}
+
+static char **appendWord(char **words, int *count, int *capacity, char *word) {
+    if (*count + 1 >= *capacity) {
+        // The old array stays in the arena until the command finishes, but
+        // doubling keeps that to less than the size of the new one
+        int newCapacity = (*capacity < 8) ? 16 : *capacity * 2;
+        char **newWords = arenaAlloc(&commandArena, sizeof(char *) * newCapacity);
+        if (*count > 0) {
+            memcpy(newWords, words, sizeof(char *) * *count);
+        }
+        words = newWords;
+        *capacity = newCapacity;
+    }
+    words[*count] = word;
+    (*count)++;
+    words[*count] = NULL;
+    return words;
+}
+
+// ===================== SUBSET 0 =====================
+static void cd(char **words) {
+    bool noDirectory = false;
+    if (words[1] != NULL) {
+        // chdir returns 0 on success
+        if (chdir(words[1]) != 0) {
+            noDirectory = true;
+        } else {
+            // Subset 25:
+            recordDirectory();
+        }
+    } else {
+        char *homePath = getenv("HOME");
+        if (chdir(homePath) != 0) {
+            perror("chdir:");
+        }
+    }    
+    if (noDirectory) {
+        fprintf(stderr, "cd: %s: No such file or directory\n", words[1]);
+        lastExitStatus = 1;
+    } 
+}
+
+static void pwd(void) {
+    char *cwd = malloc(sizeof (char) * MAX_LINE_CHARS);
+    getcwd(cwd, MAX_LINE_CHARS);
+    printf("current directory is '%s'\n", cwd);
+    free(cwd);
+}
+
+// ===================== SUBSET 2 =====================
+
+static FILE *openHistory(void) {
+    if (historyFile != NULL) {
+        return historyFile;
+    }
+    char *home = getenv("HOME");
+    char historyFilename[] = ".nautilus_history";
+    // + 1 for '/' and + 1 for '\0'
+    char *fullPath = malloc(sizeof(char) * (strlen(home) + strlen(historyFilename) + 1 + 1));  
+    strcpy(fullPath, home);
+    strcat(fullPath, "/");
+    strcat(fullPath, historyFilename);
+    historyFile = fopen(fullPath, "a+e");
+    free(fullPath);
+    return historyFile;
+}
+
+static int getHistoryLineCount() {
+    FILE *file = openHistory();
+    if (file == NULL) {
+        return 0;
+    }
+    struct stat s;
+    if (fstat(fileno(file), &s) != 0) {
+        return 0;
+    }
+    if (s.st_size < historyCountedSize) {
+        // The file was truncated, so count it all again
+        historyLineCount = 0;
+        historyCountedSize = 0;
+    }
+    if (s.st_size > historyCountedSize) {
+        // Only the lines added since the last count are read
+        fseeko(file, historyCountedSize, SEEK_SET);
+        char buffer[BUFSIZ];
+        size_t bytesRead;
+        while ((bytesRead = fread(buffer, 1, BUFSIZ, file)) > 0) {
+            for (char *newline = memchr(buffer, '\n', bytesRead); newline != NULL; 
+                 newline = memchr(newline + 1, '\n', buffer + bytesRead - newline - 1)) {
+                historyLineCount++;
+            }
+            historyCountedSize += bytesRead;
+        }
+    }
+    return historyLineCount;
+}
+
+static void printLatestHistory(int n) {
+    // Print lines (lineCount - n) to lineCount
+    int lineCount = getHistoryLineCount();
+    FILE *file = openHistory();
+    if (file == NULL) {
+        return;
+    }
+    if (n > lineCount) { 
+        n = lineCount;
+    }
+    rewind(file);
+    int currLine = 0;
+    char line[MAX_LINE_CHARS];
+    while (currLine < lineCount && fgets(line, MAX_LINE_CHARS, file) != NULL) {
+        if (currLine >= (lineCount - n)) {
+            printf("%d: %s", currLine, line);
+        }
+        currLine++;
+    }
+}
+
+static void writeHistory(char **words) {
+    if (isWritingHistory == false) {
+        return;
+    }
+    char *inputText = formString(words);
+    FILE *file = openHistory();
+    if (file != NULL) {
+        // The file is opened for appending, so a single write always lands at
+        // the end, even alongside other shells
+        if (write(fileno(file), inputText, strlen(inputText)) == -1) {
+            perror("history");
+        }
+    }
+    free(inputText);    
+}
+
+static char *getCommandFromHistory(int lineNumber) {
+    FILE *file = openHistory();
+    if (file == NULL) {
+        return NULL;  
+    }
+    rewind(file);
+    int currLine = 0;
+    char line[BUFSIZ];  
+    while (fgets(line, BUFSIZ, file) != NULL) { 
+        if (currLine == lineNumber) {
+            break;
+        }
+        currLine++;
+    }
+    // + 1 slot for NULL terminator '\0'
+    char *result = malloc(sizeof(char) * (strlen(line) + 1));  
+    strcpy(result, line); 
+    return result;
+}
+
+static char **getHistoryWords(char **words) {
+    int argc = getWordCount(words);
+    char **historyWords = NULL;
+    int lineCount = getHistoryLineCount();
+    if (argc == 1) {
+        if (lineCount > 0) { 
+            // -1 because history's lines are indexed starting from 0
+            char *command = getCommandFromHistory(lineCount - 1);  
+            printf("%s", command);
+            historyWords = tokenize(command, WORD_SEPARATORS, SPECIAL_CHARS);       
+            free(command);
+        } else {
+            fprintf(stderr, "%s: invalid history reference\n", words[0]);
+        }
+    } else if (argc == 2) {
+        if (isNumber(words[1])) {
+            int lineNumber = atoi(words[1]);
+            if (lineNumber > lineCount || lineNumber < 0) {
+                fprintf(stderr, "%s: invalid history reference\n", words[0]);
+            } else {
+                char *command = getCommandFromHistory(lineNumber);
+                printf("%s", command);
+                historyWords = tokenize(command, WORD_SEPARATORS, SPECIAL_CHARS);
+                free(command);
+            }
+        } else {
+            fprintf(stderr, "%s: %s: numeric argument required\n", words[0], words[1]);
+        }
+    } else {
+        fprintf(stderr, "%s: too many arguments\n", words[0]);
+    }
+    return historyWords;
+}
+
+// ===================== SUBSET 3 =====================
+
+static bool hasWildcard(char *line) {
+    for (int n = 0; line[n] != '\0'; n++) {
+        if (line[n] == '*' ||
+            line[n] == '?' ||
+            line[n] == '[' ||
+            line[n] == ']' ||
+            line[n] == '~') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static char **expandWildcards(char **words) {
+    int argc = getWordCount(words);
+    int i = 0;
+    while (i < argc && hasWildcard(words[i]) == false) {
+        i++;
+    }
+    if (i == argc) {
+        return words;
+    }
+    // The expanded words are built up in one pass, with the matches copied 
+    // into the command arena so glob's own memory can be given back at once
+    int newArgc = 0;
+    int capacity = argc + 1;
+    char **newWords = arenaAlloc(&commandArena, sizeof(char *) * capacity);
+    for (int n = 0; n < i; n++) {
+        newWords = appendWord(newWords, &newArgc, &capacity, words[n]);
+    }
+    for (; i < argc; i++) {
+        if (hasWildcard(words[i]) == false) {
+            newWords = appendWord(newWords, &newArgc, &capacity, words[i]);
+            continue;
+        }
+        glob_t matches;
+        int globResult = glob(words[i], GLOB_NOCHECK | GLOB_TILDE, NULL, &matches);    
+        if (globResult == 0) {  
+            // If globResult == 0, then glob has succeeded
+            for (int n = 0; n < matches.gl_pathc; n++) {
+                char *match = matches.gl_pathv[n];
+                newWords = appendWord(newWords, &newArgc, &capacity, 
+                                      arenaStrndup(&commandArena, match, strlen(match)));
+            }
+        } else {
+            newWords = appendWord(newWords, &newArgc, &capacity, words[i]);
+        }
+        globfree(&matches);
+    }
+    return newWords;
+}
+
+// ===================== SUBSET 4 =====================
+
+static void executeRedirection(char **words, char **path, char **environ) {
+    // If the command attempts to redirect I/O, then handle the
+    // command by the appropriate cases below:
+    int flags = getRedirectionType(words);
+    int redirectTypes = (REDIR_APPEND | REDIR_INPUT | REDIR_OUTPUT);
+    words = expandWildcards(words);
+    if ((flags & REDIR_INPUT) == 0 && (flags & (REDIR_OUTPUT | REDIR_APPEND)) != 0 &&
+        isBuiltinName(words[0]) && strcmp(words[0], "!") != 0) {
+        // The shell writes a builtin's output to the file itself
+        executeBuiltinRedirection(words, path, environ, flags & redirectTypes);
+        return;
+    }
+    if ((flags & redirectTypes) ==  REDIR_INPUT) {
+        executeRedirInput(words, path, environ);
+    } else if ((flags & redirectTypes) ==  REDIR_OUTPUT)  {
+        executeRedirOutput(words, path, environ);
+    } else if ((flags & redirectTypes) == REDIR_APPEND) {
+        executeRedirAppend(words, path, environ);
+    } else if ((flags & redirectTypes) ==  (REDIR_INPUT | REDIR_OUTPUT)) {
+        executeRedirInputAndOutput(words, path, environ);
+    } else if ((flags & redirectTypes) ==  (REDIR_INPUT | REDIR_APPEND)) {
+        executeRedirInputAndAppend(words, path, environ);
+    }
+}
+
+static bool isBuiltin(char *argument) {
+    if (isBuiltinName(argument)) {
+        fprintf(stderr, "%s: I/O redirection not permitted for builtin commands\n", argument);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+static bool isRedirectionCommand(char **words) {
+    for (int i = 0; words[i] != NULL; i++) {
+        if (strcmp(words[i], "<") == 0 ||
+            strcmp(words[i], ">") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool isRedirection(char *argument) {
+    if (strcmp(argument, "<") == 0 ||
+        strcmp(argument, ">") == 0) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+static bool checkRedirValidity(char **words, int flags) {
+    int redirectTypes = (REDIR_APPEND | REDIR_INPUT | REDIR_OUTPUT);
+    int argc = getWordCount(words);
+    
+    switch (flags & redirectTypes) {
+        case 0:
+            fprintf(stderr, "invalid input redirection\n");
+            return false;
+        case REDIR_INPUT:
+            // If <, > or | is detected in the rest of the commands, then invalid redirection
+            for (int i = 1; i < argc; i++) {
+                if (isRedirection(words[i]) == true) {
+                    fprintf(stderr, "invalid input redirection\n");
+                    return false;
+                }
+            }
+            break;
+        case REDIR_OUTPUT:
+            // Last argument must not be <, > or |
+            if (isRedirection(words[argc - 1]) == true) {
+                fprintf(stderr, "invalid input redirection\n");
+                return false;
+            }
+            // If <, > or | is detected from words[0] to words[argc - 2], then invalid redirection
+            for (int i = 0; i < argc - 2; i++) {
+                if (isRedirection(words[i]) == true) {
+                    fprintf(stderr, "invalid input redirection\n");
+                    return false;
+                }
+            }
+            break;
+        case REDIR_APPEND:
+            // Last argument must not be <, > or |
+            if (isRedirection(words[argc - 1]) == true) {
+                fprintf(stderr, "invalid input redirection\n");
+                return false;
+            }
+            // If <, > or | is detected from words[0] to words[argc - 3], then invalid redirection
+            for (int i = 1; i < argc - 3; i++) {
+                if (isRedirection(words[i]) == true) {
+                    fprintf(stderr, "invalid input redirection\n");
+                    return false;
+                }
+            }
+            break;
+        case (REDIR_INPUT | REDIR_OUTPUT):
+            // Commands must have a minimum of 5 arguments to be valid
+            // Eg. shortest possible format: < file1 program > file2
+            if (argc < 5) {
+                fprintf(stderr, "invalid input redirection\n");
+                return false;
+            }
+            // Last argument must not be <, > or |
+            if (isRedirection(words[argc - 1]) == true) {
+                fprintf(stderr, "invalid input redirection\n");
+                return false;
+            }
+            // If <, > or | is detected from words[1] to words[argc - 2], then invalid redirection
+            for (int i = 1; i < argc - 2; i++) {
+                if (isRedirection(words[i]) == true) {
+                    fprintf(stderr, "invalid input redirection\n");
+                    return false;
+                }
+            }
+            break;
+        case (REDIR_INPUT | REDIR_APPEND):
+            // Commands must have a minimum of 6 arguments to be valid
+            // Eg. shortest possible format: < file1 program > > file2
+            if (argc < 6) {
+                fprintf(stderr, "invalid input redirection\n");
+                return false;
+            }
+            // Last argument must not be <, > or |
+            if (isRedirection(words[argc - 1]) == true) {
+                fprintf(stderr, "invalid input redirection\n");
+                return false;
+            }
+            // If <, > or | is detected from words[1] to words[argc - 3], then invalid redirection
+            for (int i = 1; i < argc - 3; i++) {
+                if (isRedirection(words[i]) == true) {
+                    fprintf(stderr, "invalid input redirection\n");
+                    return false;
+                }
+            }
+            break;
+    }
+    return true;
+}
+
+static int getRedirectionType(char **words) {
+    assert(words != NULL && words[0] != NULL);
+    int argc = getWordCount(words);
+    int flags = 0;
+
+    if (argc <= 2) {
+        return NOT_REDIR;
+    }
+    if (strcmp(words[0], "<") == 0) {
+        flags = flags | REDIR_INPUT;
+    }
+    if (strcmp(words[argc - 3], ">") != 0 &&
+        strcmp(words[argc - 2], ">") == 0) {
+        flags = flags | REDIR_OUTPUT;
+    }
+    if (strcmp(words[argc - 3], ">") == 0 &&
+        strcmp(words[argc - 2], ">") == 0) {
+        flags = flags | REDIR_APPEND;
+    }
+
+    bool isValid = checkRedirValidity(words, flags);
+    if (isValid == true) {
+        return flags;
+    } else {
+        return 0;
+    }
+}
+
+static char **leftPartition(char **words, char *separator) {
+    char **leftWords = NULL;
+    int argc = getWordCount(words);
+    int separatorIndex = 0;
+    bool separatorFound = false;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(words[i], separator) == 0) {
+            // Reached the separator string
+            separatorFound = true;
+            break;
+        }
+        separatorIndex++;
+    }
+    if (separatorFound == false) {
+        // Return the same input if this function failed to find the separator
+        return words;
+    }
+    // (separatorIndex + 1) gives the size of the array slice (including NULL)
+    leftWords = arenaAlloc(&commandArena, sizeof(char *) * (separatorIndex + 1));  
+    // Copy contents of words
+    for (int i = 0; i < separatorIndex; i++) {
+        leftWords[i] = words[i];
+    }
+    // Set last element to be NULL
+    leftWords[separatorIndex] = NULL;
+    return leftWords;
+}
+
+static char **rightPartition(char **words, char *separator, bool stopLastOccurrence) {
+    char **rightWords = NULL;
+    int argc = getWordCount(words);
+    int separatorIndex = 0;
+    bool separatorFound = false;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(words[i], separator) == 0) {
+            // Reached the separator string 
+            separatorFound = true;
+            separatorIndex = i;
+            if (stopLastOccurrence == false) {
+                break;
+            }
+        }
+    }
+    if (separatorFound == false) {
+        // Return the same input if this function failed to find the separator
+        return words;
+    }
+    // (argc - separatorIndex) gives the size of the array slice (including NULL)
+    int size = (argc - separatorIndex);
+    rightWords = arenaAlloc(&commandArena, sizeof (char *) * size); 
+    // Copy contents of words
+    for (int i = separatorIndex + 1, n = 0; i <= argc; i++, n++) {
+        rightWords[n] = words[i];
+    }
+    // Set last element to be NULL
+    rightWords[size - 1] = NULL;
+    return rightWords;
+}
+
+static int openRedirectionFile(char *fileName, int redirectOption) {
+    if (redirectOption == REDIR_INPUT) {
+        return open(fileName, O_RDONLY | O_CLOEXEC);
+    } else if (redirectOption == REDIR_APPEND) {
+        return open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    } else {
+        return open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+}
+
+static void executeRedirInput(char **words, char **path, char **environment) {
+    assert(words != NULL && words[1] != NULL);
+    // Second argument is always supposed to be a filename
+    char *fileName = words[1]; 
+    // All arguments after the filename are for executing a program
+    char **rightWords = rightPartition(words, fileName, true);  
+
+    char *programName = rightWords[0];
+    char *programPath = getPathToProgram(programName, path);
+    if (isBuiltin(programName) == true) {
+        return;
+    }
+    if (programPath != NULL && is_executable(programPath)) {
+        // The input file is handed straight to the program as its stdin
+        int inputFD = openProgramRedirection(fileName, REDIR_INPUT);
+        if (inputFD == -1) {
+            fprintf(stderr, "%s: No such file or directory\n", fileName);
+            return;  
+        } 
+        struct spawnActions actions;
+        initSpawnActions(&actions);
+        addSpawnDup2(&actions, inputFD, 0);
+        pid_t pid;
+        int spawnResult = spawnProgram(&pid, programPath, &actions, rightWords, environment);
+        close(inputFD);
+        if (spawnResult != 0) {
+            perror("spawn:");
+            return;
+        }
+        int exit_status;
+        if (waitForProgram(pid, &exit_status) == -1) {
+            perror("waitpid");
+            return;
+        }
+        exit_status = getExitStatus(exit_status);
+        reportExitStatus(programPath, exit_status);
+    } else {
+        executionError(rightWords, programPath);
+    }
+}
+
+static void executeRedirOutput(char **words, char **path, char **environment) {
+    int argc = getWordCount(words);
+    // A filename is always expected as the last argument
+    char *fileName = words[argc - 1];  
+    char **leftWords = leftPartition(words, ">");
+    
+    char *programName = leftWords[0];
+    char *programPath = getPathToProgram(programName, path);
+    if (isBuiltin(programName) == true) {
+        return;
+    }
+    if (programPath != NULL && is_executable(programPath)) {
+        if (isDirectory(fileName)) {
+            fprintf(stderr, "%s: Is a directory\n", fileName);
+            return;
+        }
+        // The output file is handed straight to the program as its stdout
+        int outputFD = openProgramRedirection(fileName, REDIR_OUTPUT);
+        if (outputFD == -1) {
+            perror(fileName);
+            return;
+        }
+        struct spawnActions actions;
+        initSpawnActions(&actions);
+        addSpawnDup2(&actions, outputFD, 1);
+        pid_t pid;
+        int spawnResult = spawnProgram(&pid, programPath, &actions, leftWords, environment);
+        close(outputFD);
+        if (spawnResult != 0) {
+            perror("spawn:");
+            return;
+        }
+        int exit_status;
+        if (waitForProgram(pid, &exit_status) == -1) {
+            perror("waitpid");
+            return;
+        }
+        exit_status = getExitStatus(exit_status); 
+        reportExitStatus(programPath, exit_status);
+    } else {
+        executionError(leftWords, programPath);
+    }
+}
+
+static void executeRedirAppend(char **words, char **path, char **environment) {
+    int argc = getWordCount(words);
+    // A filename is always expected as the last argument
+    char *fileName = words[argc - 1]; 
+    char **leftWords = leftPartition(words, ">");
+    
+    char *programName = leftWords[0];
+    char *programPath = getPathToProgram(programName, path);
+    if (isBuiltin(programName) == true) {
+        return;
+    }
+    if (programPath != NULL && is_executable(programPath)) {
+        if (isDirectory(fileName)) {
+            fprintf(stderr, "%s: Is a directory\n", fileName);
+            return;
+        }
+        // The output file is handed straight to the program as its stdout
+        int outputFD = openProgramRedirection(fileName, REDIR_APPEND);
+        if (outputFD == -1) {
+            perror(fileName);
+            return;
+        }
+        struct spawnActions actions;
+        initSpawnActions(&actions);
+        addSpawnDup2(&actions, outputFD, 1);
+        pid_t pid;
+        int spawnResult = spawnProgram(&pid, programPath, &actions, leftWords, environment);
+        close(outputFD);
+        if (spawnResult != 0) {
+            perror("spawn:");
+            return;
+        }
+        int exit_status;
+        if (waitForProgram(pid, &exit_status) == -1) {
+            perror("waitpid");
+            return;
+        }
+        exit_status = getExitStatus(exit_status);  
+        reportExitStatus(programPath, exit_status);
+    } else {
+        executionError(leftWords, programPath);
+    }
+}
+
+static void executeRedirInputAndOutput(char **words, char **path, char **environment) {
+    assert(words != NULL && words[1] != NULL);
+    int argc = getWordCount(words);
+    char *inputFileName = words[1]; 
+    char *outputFileName = words[argc - 1];
+    char **rightWords = rightPartition(words, inputFileName, true); 
+    // The actual command arguments are between '< inputfile' and '> outputfile'
+    char **commandWords = leftPartition(rightWords, ">"); 
+
+    char *programName = commandWords[0];
+    char *programPath = getPathToProgram(programName, path);
+    if (isBuiltin(programName) == true) {
+        return;
+    }
+    if (programPath != NULL && is_executable(programPath)) {
+        int inputFD = openProgramRedirection(inputFileName, REDIR_INPUT);
+        if (inputFD == -1) {
+            fprintf(stderr, "%s: No such file or directory\n", inputFileName);
+            return;
+        }
+        if (isDirectory(outputFileName)) {
+            fprintf(stderr, "%s: Is a directory\n", outputFileName);
+            close(inputFD);
+            return;
+        }
+        int outputFD = openProgramRedirection(outputFileName, REDIR_OUTPUT);
+        if (outputFD == -1) {
+            perror(outputFileName);
+            close(inputFD);
+            return;
+        }
+        struct spawnActions actions;
+        initSpawnActions(&actions);
+        addSpawnDup2(&actions, inputFD, 0);
+        addSpawnDup2(&actions, outputFD, 1);
+        pid_t pid;
+        int spawnResult = spawnProgram(&pid, programPath, &actions, commandWords, environment);
+        close(inputFD);
+        close(outputFD);
+        if (spawnResult != 0) {
+            perror("spawn:");
+            return;
+        }
+        int exit_status;
+        if (waitForProgram(pid, &exit_status) == -1) {
+            perror("waitpid");
+            return;
+        }
+        exit_status = getExitStatus(exit_status);
+        reportExitStatus(programPath, exit_status);
+    } else {
+        executionError(commandWords, programPath);
+    }
+}
+
+static void executeRedirInputAndAppend(char **words, char **path, char **environment) {
+    assert(words != NULL && words[1] != NULL);
+    int argc = getWordCount(words);
+    char *inputFileName = words[1]; 
+    char *outputFileName = words[argc - 1];
+    char **rightWords = rightPartition(words, inputFileName, true);
+    // The actual command arguments are between '< inputfile' and '>> outputfile' 
+    char **commandWords = leftPartition(rightWords, ">"); 
+
+    char *programName = commandWords[0];
+    char *programPath = getPathToProgram(programName, path);
+    if (isBuiltin(programName) == true) {
+        return;
+    }
+    if (programPath != NULL && is_executable(programPath)) {
+        int inputFD = openProgramRedirection(inputFileName, REDIR_INPUT);
+        if (inputFD == -1) {
+            fprintf(stderr, "%s: No such file or directory\n", inputFileName);
+            return;
+        }
+        if (isDirectory(outputFileName)) {
+            fprintf(stderr, "%s: Is a directory\n", outputFileName);
+            close(inputFD);
+            return;
+        }
+        int outputFD = openProgramRedirection(outputFileName, REDIR_APPEND);
+        if (outputFD == -1) {
+            perror(outputFileName);
+            close(inputFD);
+            return;
+        }
+        struct spawnActions actions;
+        initSpawnActions(&actions);
+        addSpawnDup2(&actions, inputFD, 0);
+        addSpawnDup2(&actions, outputFD, 1);
+        pid_t pid;
+        int spawnResult = spawnProgram(&pid, programPath, &actions, commandWords, environment);
+        close(inputFD);
+        close(outputFD);
+        if (spawnResult != 0) {
+            perror("spawn:");
+            return;
+        }
+        int exit_status;
+        if (waitForProgram(pid, &exit_status) == -1) {
+            perror("waitpid");
+            return;
+        }
+        exit_status = getExitStatus(exit_status);
+        reportExitStatus(programPath, exit_status);
+    } else {
+        executionError(commandWords, programPath);
+    }
+}
+
+// ===================== SUBSET 5 =====================
+
+static bool isPipeCommand(char **words) {
+    int argc = getWordCount(words);
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(words[i], "|") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int getNumberOfPipes(char **words) {
+    int count = 0;
+    for (int i = 0; words[i] != NULL; i++) {
+        if (strcmp(words[i], "|") == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void executePiping(char **commandWords, char **path, char **environ) {
+    int argc = getWordCount(commandWords);
+    int numberOfPipes = getNumberOfPipes(commandWords);
+    int redirectOption = 0;
+    commandWords = expandWildcards(commandWords);
+    int inputFD = -1;
+    char *outputFilename = NULL;
+    if (isRedirectionCommand(commandWords) == true) {            
+        int flags = getRedirectionType(commandWords);
+        int redirTypes = REDIR_INPUT | REDIR_OUTPUT | REDIR_APPEND;
+        if ((flags & redirTypes) == 0) {
+            fprintf(stderr, "invalid input redirection\n");
+            return;
+        } 
+        if ((flags & REDIR_OUTPUT) == REDIR_OUTPUT) {
+            outputFilename = commandWords[argc - 1];
+            commandWords = leftPartition(commandWords, ">");
+            redirectOption = REDIR_OUTPUT;
+        }
+        if ((flags & REDIR_APPEND) == REDIR_APPEND) {
+            outputFilename = commandWords[argc - 1];
+            commandWords = leftPartition(commandWords, ">");
+            redirectOption = REDIR_APPEND;
+        }
+        if ((flags & REDIR_INPUT) == REDIR_INPUT) {
+            // The input file becomes the first process' stdin
+            char *inputFilename = commandWords[1];
+            inputFD = openProgramRedirection(inputFilename, REDIR_INPUT);
+            if (inputFD == -1) {
+                fprintf(stderr, "%s: No such file or directory\n", inputFilename);
+                return;
+            }
+            commandWords = rightPartition(commandWords, commandWords[1], false);
+        }
+    }
+    handlePiping(commandWords, path, environ, inputFD, numberOfPipes, redirectOption, outputFilename);
+    if (inputFD != -1) {
+        close(inputFD);
+    }
+}
+
+static void handlePiping(char **commandWords, char **path, char **environ, 
+                         int inputFD, int numberOfPipes, 
+                         int redirectOption, char *outputFilename) {
+    // Split the command into the arguments of each process
+    int numberOfStages = numberOfPipes + 1;
+    char ***stages = arenaAlloc(&commandArena, sizeof(char **) * numberOfStages);
+    char **programPaths = arenaAlloc(&commandArena, sizeof(char *) * numberOfStages);
+    struct processSettings *settings = arenaAlloc(&commandArena, sizeof(struct processSettings) * numberOfStages);
+    char **remaining = commandWords;
+    for (int i = 0; i < numberOfStages; i++) {
+        stages[i] = leftPartition(remaining, "|");
+        remaining = rightPartition(remaining, "|", false);
+        if (stages[i][0] == NULL || (i < numberOfPipes && remaining[0] == NULL)) {
+            printf("invalid pipe\n");
+            return;
+        }
+        stages[i] = parseProcessSettings(stages[i], &settings[i], (i > 0) ? &settings[i - 1] : NULL);
+        if (stages[i][0] == NULL) {
+            lastExitStatus = 2;
+            return;
+        }
+    }
+    // Every program is looked up before any are started, so a typo in one 
+    // stage doesn't leave the others running with nobody to talk to
+    for (int i = 0; i < numberOfStages; i++) {
+        programPaths[i] = getPathToProgram(stages[i][0], path);
+        if (programPaths[i] == NULL || is_executable(programPaths[i]) == false) {
+            executionError(stages[i], programPaths[i]);
+            return;
+        }
+    }
+    int outputFD = -1;
+    if (redirectOption != 0) {
+        outputFD = openProgramRedirection(outputFilename, redirectOption);
+        if (outputFD == -1) {
+            perror(outputFilename);
+            return;
+        }
+    }
+
+    // Subset 29: stages run as several copies are fed and drained by the 
+    // shell, which can't splice the links at the same time
+    struct parallelStage *parallelStages = arenaAlloc(&commandArena, sizeof(struct parallelStage) * numberOfStages);
+    int numberOfParallelStages = 0;
+    bool hasParallelStage = false;
+    for (int i = 0; i < numberOfStages; i++) {
+        hasParallelStage = hasParallelStage || settings[i].copies > 1;
+    }
+
+    // With accounting on, each link is made of two pipes and the shell 
+    // splices between them, so it sees every byte without copying it
+    bool isMeasured = pipeAccounting && hasParallelStage == false;
+    int numberOfLinks = numberOfPipes;
+    int (*producerPipes)[2] = arenaAlloc(&commandArena, sizeof(int[2]) * numberOfLinks);
+    int (*consumerPipes)[2] = arenaAlloc(&commandArena, sizeof(int[2]) * numberOfLinks);
+    // Subset 26: filters next to each other are joined by rings instead, 
+    // unless every byte is being counted
+    bool *isFused = arenaAlloc(&commandArena, sizeof(bool) * numberOfLinks);
+    struct filterRing **rings = arenaAlloc(&commandArena, sizeof(struct filterRing *) * numberOfLinks);
+    memset(isFused, 0, sizeof(bool) * numberOfLinks);
+    if (isMeasured == false) {
+        findFusedLinks(stages, settings, numberOfStages, isFused);
+    }
+    int numberOfMadeLinks = 0;
+    bool isLinked = true;
+    for (int i = 0; i < numberOfLinks && isLinked; i++) {
+        producerPipes[i][0] = producerPipes[i][1] = -1;
+        consumerPipes[i][0] = consumerPipes[i][1] = -1;
+        numberOfMadeLinks++;
+        if (isFused[i]) {
+            rings[i] = createFilterRing();
+            if (rings[i] != NULL) {
+                continue;
+            }
+            // Without a ring the filters are joined by a pipe like any others
+            isFused[i] = false;
+        }
+        if (pipe2(producerPipes[i], O_CLOEXEC) != 0) {
+            isLinked = false;
+            break;
+        }
+        int pipeSize = getLearnedPipeSize(stages[i][0]);
+        if (pipeSize > 0) {
+            fcntl(producerPipes[i][1], F_SETPIPE_SZ, pipeSize);
+        }
+        if (isMeasured) {
+            if (pipe2(consumerPipes[i], O_CLOEXEC) != 0) {
+                consumerPipes[i][0] = consumerPipes[i][1] = -1;
+                isLinked = false;
+                break;
+            }
+            if (pipeSize > 0) {
+                fcntl(consumerPipes[i][1], F_SETPIPE_SZ, pipeSize);
+            }
+        } else {
+            consumerPipes[i][0] = producerPipes[i][0];
+            consumerPipes[i][1] = -1;
+        }
+    }
+    if (isLinked == false) {
+        // Nothing has been started yet, so the pipeline is abandoned and 
+        // whatever links were made are let go
+        perror("pipe");
+        for (int i = 0; i < numberOfMadeLinks; i++) {
+            if (isFused[i]) {
+                closeRingWriter(rings[i]);
+                closeRingReader(rings[i]);
+                continue;
+            }
+            int fds[] = {producerPipes[i][0], producerPipes[i][1], 
+                         isMeasured ? consumerPipes[i][0] : -1, consumerPipes[i][1]};
+            for (int n = 0; n < 4; n++) {
+                if (fds[n] != -1) {
+                    close(fds[n]);
+                }
+            }
+        }
+        if (outputFD != -1) {
+            close(outputFD);
+        }
+        lastExitStatus = 1;
+        return;
+    }
+
+    double startTime = getMonotonicTime();
+    pid_t *pids = arenaAlloc(&commandArena, sizeof(pid_t) * numberOfStages);
+    int numberOfSpawned = 0;
+    for (int i = 0; i < numberOfStages; i++) {
+        struct spawnActions actions;
+        initSpawnActions(&actions);
+        int stdinFD = (i == 0) ? inputFD : consumerPipes[i - 1][0];
+        int stdoutFD = (i == numberOfStages - 1) ? outputFD : producerPipes[i][1];
+        if (stdinFD != -1) {
+            addSpawnDup2(&actions, stdinFD, 0);
+        }
+        if (stdoutFD != -1) {
+            addSpawnDup2(&actions, stdoutFD, 1);
+        }
+        if (i > 0 && isFused[i - 1]) {
+            actions.rings[0] = rings[i - 1];
+        }
+        if (i < numberOfLinks && isFused[i]) {
+            actions.rings[1] = rings[i];
+        }
+        // Subset 29:
+        if (settings[i].copies > 1) {
+            struct parallelStage *stage = &parallelStages[numberOfParallelStages];
+            if (startParallelStage(stage, stages[i], programPaths[i], &settings[i], 
+                                   stdinFD, stdoutFD, i < numberOfLinks) == false) {
+                perror("parallel stage");
+                break;
+            }
+            numberOfParallelStages++;
+            numberOfSpawned++;
+            continue;
+        }
+        commandLimits.settings = settings[i];
+        int spawnResult = spawnProgram(&pids[i], programPaths[i], &actions, stages[i], environ);
+        if (spawnResult != 0) {
+            perror("spawn:");
+            break;
+        }
+        numberOfSpawned++;
+    }
+    memset(&commandLimits.settings, 0, sizeof(struct processSettings));
+    // Only the children use these ends now
+    for (int i = 0; i < numberOfLinks; i++) {
+        if (isFused[i]) {
+            // A ring's sides are closed by the filters using them, so the 
+            // shell closes those it never started
+            if (i >= numberOfSpawned) {
+                closeRingWriter(rings[i]);
+            }
+            if (i + 1 >= numberOfSpawned) {
+                closeRingReader(rings[i]);
+            }
+            continue;
+        }
+        close(producerPipes[i][1]);
+        close(consumerPipes[i][0]);
+    }
+    if (outputFD != -1) {
+        close(outputFD);
+    }
+    if (isMeasured) {
+        struct pipeLinkStats *links = calloc(numberOfLinks, sizeof(struct pipeLinkStats));
+        for (int i = 0; i < numberOfLinks; i++) {
+            links[i].producer = strdup(stages[i][0]);
+            links[i].consumer = strdup(stages[i + 1][0]);
+        }
+        if (numberOfSpawned == numberOfStages) {
+            probePipeline(producerPipes, consumerPipes, links, numberOfLinks, startTime);
+        } else {
+            for (int i = 0; i < numberOfLinks; i++) {
+                close(producerPipes[i][0]);
+                close(consumerPipes[i][1]);
+            }
+        }
+        clearPipeStats();
+        lastPipeStats.links = links;
+        lastPipeStats.numberOfLinks = numberOfLinks;
+    }
+
+    int *statuses = arenaAlloc(&commandArena, sizeof(int) * numberOfStages);
+    // Subset 29: parallel stages are run to the end first, while the other
+    // stages run, and only the others' programs are waited for
+    int numberOfPrograms = numberOfSpawned;
+    if (numberOfParallelStages > 0) {
+        runParallelStages(parallelStages, numberOfParallelStages, environ);
+        numberOfPrograms = 0;
+        for (int i = 0; i < numberOfSpawned; i++) {
+            if (settings[i].copies < 2) {
+                pids[numberOfPrograms++] = pids[i];
+            }
+        }
+    }
+    if (waitForPrograms(pids, numberOfPrograms, statuses) == -1) {
+        perror("waitpid");
+    }
+    if (isMeasured) {
+        lastPipeStats.seconds = getMonotonicTime() - startTime;
+    }
+    if (numberOfSpawned == numberOfStages) {
+        int lastStatus = (settings[numberOfStages - 1].copies > 1) ? 
+                         parallelStages[numberOfParallelStages - 1].status : statuses[numberOfPrograms - 1];
+        int exit_status = getExitStatus(lastStatus);
+        reportExitStatus(programPaths[numberOfStages - 1], exit_status);
+    }
+}
+
+// ===================== SUBSET 6 =====================
+
+static bool hasSubstitution(char *word) {
+    return strstr(word, "$(") != NULL;
+}
+
+static char *findClosingParen(char *s) {
+    assert(s[1] == '(');
+    int depth = 0;
+    for (char *curr = s + 1; *curr != '\0'; curr++) {
+        if (*curr == '(') {
+            depth++;
+        } else if (*curr == ')') {
+            depth--;
+            if (depth == 0) {
+                return curr;
+            }
+        }
+    }
+    return NULL;
+}
+
+static size_t getSubstitutionTokenLength(char *s, char *separators, char *special_chars) {
+    if ((s[0] == '<' || s[0] == '>') && s[1] == '(') {
+        // A process substitution is a whole token
+        char *closingParen = findClosingParen(s);
+        if (closingParen != NULL) {
+            return closingParen - s + 1;
+        }
+    }
+    size_t length = 0;
+    bool foundSubstitution = false;
+    while (s[length] != '\0') {
+        if (s[length] == '$' && s[length + 1] == '(') {
+            char *closingParen = findClosingParen(&s[length]);
+            if (closingParen == NULL) {
+                // Unbalanced, so tokenize the rest normally
+                break;
+            }
+            length = closingParen - s + 1;
+            foundSubstitution = true;
+        } else if (strchr(separators, s[length]) != NULL ||
+                   strchr(special_chars, s[length]) != NULL) {
+            break;
+        } else {
+            length++;
+        }
+    }
+    if (foundSubstitution == false) {
+        return 0;
+    }
+    return length;
+}
+
+static bool isBuiltinName(char *argument) {
+    if (strcmp(argument, "history") == 0 ||
+        strcmp(argument, "cd") == 0 ||
+        strcmp(argument, "pwd") == 0 ||
+        strcmp(argument, "pipestat") == 0 ||
+        strcmp(argument, "memstat") == 0 ||
+        strcmp(argument, "dag") == 0 ||
+        strcmp(argument, "memo") == 0 ||
+        strcmp(argument, "stats") == 0 ||
+        strcmp(argument, "watch") == 0 ||
+        strcmp(argument, "j") == 0 ||
+        strcmp(argument, "coproc") == 0 ||
+        strcmp(argument, "ask") == 0 ||
+        strcmp(argument, "flightlog") == 0 ||
+        strcmp(argument, "!") == 0) {
+        return true;
+    } else {
+        return false;
+    }
+}
+
+static char **expandSubstitutions(char **words, char **path, char **environment) {
+    int argc = getWordCount(words);
+    bool foundSubstitution = false;
+    for (int i = 0; i < argc; i++) {
+        if (hasSubstitution(words[i])) {
+            foundSubstitution = true;
+            break;
+        }
+    }
+    if (foundSubstitution == false) {
+        return words;
+    }
+    // The output can split into any number of words, so grow the new array 
+    // geometrically rather than injecting words one at a time
+    int newCapacity = argc + 1;
+    int newCount = 0;
+    char **newWords = arenaAlloc(&commandArena, sizeof(char *) * newCapacity);
+    for (int i = 0; i < argc; i++) {
+        if (hasSubstitution(words[i]) == false) {
+            newWords = appendWord(newWords, &newCount, &newCapacity, words[i]);
+            continue;
+        }
+        struct capture output = {NULL, 0, 0};
+        expandWord(words[i], &output, path, environment);
+        if (output.data == NULL) {
+            continue;
+        }
+        // The words point into the buffer, so it lasts as long as they do
+        arenaAdopt(&commandArena, output.data, output.capacity);
+        // Split the output into words in place, so no word is copied out
+        char *s = output.data;
+        while (*s != '\0') {
+            s += strspn(s, WORD_SEPARATORS);
+            if (*s == '\0') {
+                break;
+            }
+            size_t wordLength = strcspn(s, WORD_SEPARATORS);
+            newWords = appendWord(newWords, &newCount, &newCapacity, s);
+            s += wordLength;
+            if (*s != '\0') {
+                *s = '\0';
+                s++;
+            }
+        }
+    }
+    newWords[newCount] = NULL;
+    return newWords;
+}
+
+static void expandWord(char *word, struct capture *output, char **path, char **environment) {
+    char *curr = word;
+    while (*curr != '\0') {
+        char *substitution = strstr(curr, "$(");
+        char *closingParen = NULL;
+        if (substitution != NULL) {
+            closingParen = findClosingParen(substitution);
+            if (closingParen == NULL) {
+                fprintf(stderr, "%s: missing closing parenthesis\n", word);
+                substitution = NULL;
+            }
+        }
+        // Copy the literal text leading up to the substitution
+        size_t literalLength = strlen(curr);
+        if (substitution != NULL) {
+            literalLength = substitution - curr;
+        }
+        if (reserveCapture(output, literalLength) == false) {
+            perror(word);
+            return;
+        }
+        memcpy(output->data + output->length, curr, literalLength);
+        output->length += literalLength;
+        output->data[output->length] = '\0';
+        if (substitution == NULL) {
+            break;
+        }
+        char *commandLine = arenaStrndup(&commandArena, substitution + 2, closingParen - substitution - 2);
+        size_t lengthBefore = output->length;
+        captureOutput(commandLine, output, path, environment);
+        if (output->data == NULL) {
+            // The output couldn't be held, so the word is dropped
+            return;
+        }
+        // Trailing newlines of the output are dropped, as in other shells
+        while (output->length > lengthBefore && output->data[output->length - 1] == '\n') {
+            output->length--;
+            output->data[output->length] = '\0';
+        }
+        curr = closingParen + 1;
+    }
+}
+
+static bool captureOutput(char *commandLine, struct capture *output, char **path, char **environment) {
+    char **words = tokenize(commandLine, WORD_SEPARATORS, SPECIAL_CHARS);
+    // Subset 9: nothing more is run once the command's deadline has passed
+    if (words[0] == NULL || commandLimits.timedOut) {
+        return false;
+    }
+    if (strcmp(words[0], "ask") == 0) {
+        // Subset 28: a coprocess's response is substituted without starting
+        // anything
+        words = expandSubstitutions(words, path, environment);
+        words = expandWildcards(words);
+        return askCoprocess(words, output, path, environment);
+    }
+    // Prefer a memfd for the child's stdout. The child writes straight into 
+    // it, so the whole output is picked up in one read once the child exits
+    int pipeFDs[2] = {-1, -1};
+    int outputFD = memfd_create("nautilus-capture", MFD_CLOEXEC);
+    bool isMemfd = (outputFD != -1);
+    if (isMemfd == false) {
+        if (pipe2(pipeFDs, O_CLOEXEC) != 0) {
+            perror("pipe");
+            return false;
+        }
+        fcntl(pipeFDs[1], F_SETPIPE_SZ, CAPTURE_PIPE_SIZE);
+        outputFD = pipeFDs[0];
+    }
+    // The line is run by a copy of the shell, so pipelines, redirections 
+    // and builtins can all be substituted
+    pid_t pid;
+    if (isMemfd) {
+        pid = forkCommandLine(commandLine, -1, outputFD, &outputFD, 1, path, environment);
+    } else {
+        pid = forkCommandLine(commandLine, -1, pipeFDs[1], pipeFDs, 2, path, environment);
+        close(pipeFDs[1]);
+    }
+    if (pid == -1) {
+        close(outputFD);
+        return false;
+    }
+
+    bool isCaptured = true;
+    if (isMemfd == false) {
+        // Drain the pipe in large blocks while the child is still running
+        while (1) {
+            isCaptured = reserveCapture(output, CAPTURE_READ_SIZE);
+            if (isCaptured == false) {
+                // Closing the pipe stops the child once it writes again
+                close(outputFD);
+                outputFD = -1;
+                break;
+            }
+            waitForInput(outputFD);
+            ssize_t bytesRead = read(outputFD, output->data + output->length, 
+                                     output->capacity - output->length - 1);
+            if (bytesRead <= 0) {
+                break;
+            }
+            output->length += bytesRead;
+        }
+    }
+    // The copy is waited for like a program, so it is killed if the deadline
+    // passes, which marks the command as timed out
+    int status;
+    if (waitForProgram(pid, &status) == -1) {
+        perror("waitpid");
+    }
+    if (isMemfd == true) {
+        struct stat s;
+        if (fstat(outputFD, &s) == 0 && s.st_size > 0) {
+            isCaptured = reserveCapture(output, s.st_size);
+            size_t total = 0;
+            while (isCaptured && total < (size_t) s.st_size) {
+                ssize_t bytesRead = pread(outputFD, output->data + output->length + total,
+                                          s.st_size - total, total);
+                if (bytesRead <= 0) {
+                    break;
+                }
+                total += bytesRead;
+            }
+            output->length += total;
+        }
+    }
+    if (outputFD != -1) {
+        close(outputFD);
+    }
+    if (isCaptured == false) {
+        fprintf(stderr, "%s: %s\n", commandLine, strerror(ENOMEM));
+        return false;
+    }
+    if (output->data != NULL) {
+        output->data[output->length] = '\0';
+    }
+    return true;
+}
+
+static bool reserveCapture(struct capture *output, size_t extra) {
+    // + 1 for the null terminator '\0'
+    size_t needed = output->length + extra + 1;
+    if (needed <= output->capacity) {
+        return true;
+    }
+    size_t newCapacity = output->capacity * 2;
+    if (newCapacity < needed) {
+        newCapacity = needed;
+    }
+    char *data = realloc(output->data, newCapacity);
+    if (data == NULL) {
+        free(output->data);
+        *output = (struct capture) {NULL, 0, 0};
+        return false;
+    }
+    output->data = data;
+    output->capacity = newCapacity;
+    return true;
+}
+
+// ===================== SUBSET 7 =====================
+
+static int findHereDocument(char **words) {
+    for (int i = 0; words[i] != NULL && words[i + 1] != NULL; i++) {
+        if (strcmp(words[i], "<") == 0 && strcmp(words[i + 1], "<") == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void executeHereDocument(char **words, char **path, char **environment) {
+    int hereIndex = findHereDocument(words);
+    int argc = getWordCount(words);
+    bool isHereString = (words[hereIndex + 2] != NULL && strcmp(words[hereIndex + 2], "<") == 0);
+    // The body or here-string runs up to an optional output redirection
+    int bodyStart = isHereString ? hereIndex + 3 : hereIndex + 2;
+    int bodyEnd = bodyStart;
+    while (bodyEnd < argc && strcmp(words[bodyEnd], ">") != 0) {
+        bodyEnd++;
+    }
+    int redirectOption = NOT_REDIR;
+    char *outputFilename = NULL;
+    if (bodyEnd + 2 == argc) {
+        redirectOption = REDIR_OUTPUT;
+        outputFilename = words[argc - 1];
+    } else if (bodyEnd + 3 == argc && strcmp(words[bodyEnd + 1], ">") == 0) {
+        redirectOption = REDIR_APPEND;
+        outputFilename = words[argc - 1];
+    }
+    bool isValid = (hereIndex > 0 && (bodyEnd == argc || redirectOption != NOT_REDIR));
+    if (isHereString == false && bodyEnd - bodyStart != 1) {
+        // A here-document takes exactly one delimiter word
+        isValid = false;
+    }
+    for (int i = 0; i < hereIndex; i++) {
+        if (isRedirection(words[i]) || strcmp(words[i], "|") == 0) {
+            isValid = false;
+        }
+    }
+    for (int i = bodyStart; i < bodyEnd; i++) {
+        if (strcmp(words[i], "<") == 0 || strcmp(words[i], "|") == 0) {
+            isValid = false;
+        }
+    }
+    if (isValid == false) {
+        fprintf(stderr, "invalid input redirection\n");
+        return;
+    }
+
+    // Collect the body before anything is run, so the lines of a 
+    // here-document are consumed even if the command turns out to be invalid
+    struct capture body = {NULL, 0, 0};
+    int memfd = -1;
+    if (isHereString) {
+        for (int i = bodyStart; i < bodyEnd; i++) {
+            size_t wordLength = strlen(words[i]);
+            // + 1 for the ' ' or '\n' following the word
+            reserveCapture(&body, wordLength + 1);
+            memcpy(body.data + body.length, words[i], wordLength);
+            body.length += wordLength;
+            body.data[body.length] = (i + 1 < bodyEnd) ? ' ' : '\n';
+            body.length++;
+        }
+        if (bodyStart == bodyEnd) {
+            reserveCapture(&body, 1);
+            body.data[body.length] = '\n';
+            body.length++;
+        }
+    } else {
+        memfd = readHereDocument(words[bodyStart], &body);
+    }
+
+    char **commandWords = leftPartition(words, "<");
+    char *programName = commandWords[0];
+    if (isBuiltin(programName) == true) {
+        free(body.data);
+        if (memfd != -1) {
+            close(memfd);
+        }
+        return;
+    }
+    char *programPath = getPathToProgram(programName, path);
+    if (programPath == NULL || is_executable(programPath) == false) {
+        executionError(commandWords, programPath);
+        free(body.data);
+        if (memfd != -1) {
+            close(memfd);
+        }
+        return;
+    }
+    int inputFD = openHereDocumentInput(&body, memfd);
+    free(body.data);
+    if (inputFD == -1) {
+        return;
+    }
+    int outputFD = -1;
+    if (redirectOption != NOT_REDIR) {
+        if (isDirectory(outputFilename)) {
+            fprintf(stderr, "%s: Is a directory\n", outputFilename);
+            close(inputFD);
+            return;
+        }
+        outputFD = openProgramRedirection(outputFilename, redirectOption);
+        if (outputFD == -1) {
+            perror(outputFilename);
+            close(inputFD);
+            return;
+        }
+    }
+    struct spawnActions actions;
+    initSpawnActions(&actions);
+    addSpawnDup2(&actions, inputFD, 0);
+    if (outputFD != -1) {
+        addSpawnDup2(&actions, outputFD, 1);
+    }
+    pid_t pid;
+    int spawnResult = spawnProgram(&pid, programPath, &actions, commandWords, environment);
+    close(inputFD);
+    if (outputFD != -1) {
+        close(outputFD);
+    }
+    if (spawnResult != 0) {
+        perror("spawn:");
+        return;
+    }
+    int exit_status;
+    if (waitForProgram(pid, &exit_status) == -1) {
+        perror("waitpid");
+        return;
+    }
+    exit_status = getExitStatus(exit_status);
+    reportExitStatus(programPath, exit_status);
+}
+
+static int readHereDocument(char *delimiter, struct capture *body) {
+    size_t delimiterLength = strlen(delimiter);
+    int memfd = -1;
+    bool atLineStart = true;
+    while (1) {
+        if (atLineStart && isatty(1)) {
+            fputs(HEREDOC_PROMPT, stdout);
+        }
+        // Lines are read straight into the body, so each byte is copied once
+        reserveCapture(body, MAX_LINE_CHARS);
+        char *line = body->data + body->length;
+        if (fgets(line, body->capacity - body->length, stdin) == NULL) {
+            fprintf(stderr, "warning: here-document delimited by end-of-file (wanted '%s')\n", delimiter);
+            break;
+        }
+        size_t lineLength = strlen(line);
+        if (atLineStart && 
+            strncmp(line, delimiter, delimiterLength) == 0 &&
+            (line[delimiterLength] == '\n' || line[delimiterLength] == '\0')) {
+            line[0] = '\0';
+            break;
+        }
+        atLineStart = (line[lineLength - 1] == '\n');
+        body->length += lineLength;
+
+        // Once the body is too big for a pipe, keep it in a memfd instead so 
+        // no more than one block of it is ever held by the shell
+        if (memfd == -1 && body->length > HEREDOC_PIPE_LIMIT) {
+            memfd = createHereDocumentFile();
+        }
+        if (memfd != -1 && body->length >= HEREDOC_SPILL_SIZE) {
+            spillHereDocument(body, memfd);
+        }
+    }
+    if (memfd != -1) {
+        spillHereDocument(body, memfd);
+    }
+    return memfd;
+}
+
+static bool spillHereDocument(struct capture *body, int fd) {
+    size_t total = 0;
+    while (total < body->length) {
+        ssize_t bytesWritten = write(fd, body->data + total, body->length - total);
+        if (bytesWritten <= 0) {
+            perror("here-document");
+            return false;
+        }
+        total += bytesWritten;
+    }
+    body->length = 0;
+    return true;
+}
+
+static int createHereDocumentFile(void) {
+    int fd = memfd_create("nautilus-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd == -1) {
+        // Without memfds, fall back to an unlinked temporary file
+        FILE *file = tmpfile();
+        if (file == NULL) {
+            perror("here-document");
+            return -1;
+        }
+        fd = fcntl(fileno(file), F_DUPFD_CLOEXEC, 0);
+        fclose(file);
+    }
+    return fd;
+}
+
+static int openHereDocumentInput(struct capture *body, int memfd) {
+    if (memfd == -1) {
+        int pipeFDs[2];
+        if (pipe2(pipeFDs, O_CLOEXEC) != 0) {
+            perror("pipe");
+            return -1;
+        }
+        // A body that fits in the pipe is written in one go without blocking,
+        // and the child sees end-of-file as soon as it has read it all
+        int pipeSize = fcntl(pipeFDs[1], F_GETPIPE_SZ);
+        if (pipeSize == -1) {
+            pipeSize = HEREDOC_PIPE_LIMIT;
+        }
+        if (body->length <= (size_t) pipeSize) {
+            if (body->length > 0 && write(pipeFDs[1], body->data, body->length) != (ssize_t) body->length) {
+                perror("here-document");
+            }
+            close(pipeFDs[1]);
+            return pipeFDs[0];
+        }
+        close(pipeFDs[0]);
+        close(pipeFDs[1]);
+        memfd = createHereDocumentFile();
+        if (memfd == -1) {
+            return -1;
+        }
+    }
+    if (spillHereDocument(body, memfd) == false) {
+        close(memfd);
+        return -1;
+    }
+    // Seal the body so the child can't modify it, then let the child read it
+    // from the start. Sealing fails harmlessly on the temporary file fallback
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(memfd, 0, SEEK_SET);
+    return memfd;
+}
+
+// ===================== SUBSET 8 =====================
+
+static void pipestat(char **words) {
+    int argc = getWordCount(words);
+    if (argc > 2) {
+        fprintf(stderr, "%s: too many arguments\n", words[0]);
+    } else if (argc == 2 && strcmp(words[1], "on") == 0) {
+        pipeAccounting = true;
+    } else if (argc == 2 && strcmp(words[1], "off") == 0) {
+        pipeAccounting = false;
+    } else if (argc == 2) {
+        fprintf(stderr, "%s: %s: expected 'on' or 'off'\n", words[0], words[1]);
+    } else if (lastPipeStats.links == NULL) {
+        if (pipeAccounting) {
+            printf("pipestat: no pipeline has been measured yet\n");
+        } else {
+            printf("pipestat: accounting is off, enable it with 'pipestat on'\n");
+        }
+    } else {
+        printPipeStats();
+    }
+}
+
+static void printPipeStats(void) {
+    printf("pipeline took %.3fs\n", lastPipeStats.seconds);
+    printf("%-4s %-24s %14s %10s %10s %10s %9s\n", 
+           "link", "producer -> consumer", "bytes", "MB/s", "full ms", "empty ms", "pipe size");
+    for (int i = 0; i < lastPipeStats.numberOfLinks; i++) {
+        struct pipeLinkStats *link = &lastPipeStats.links[i];
+        char names[MAX_LINE_CHARS];
+        snprintf(names, MAX_LINE_CHARS, "%s -> %s", link->producer, link->consumer);
+        double throughput = 0;
+        if (link->seconds > 0) {
+            throughput = link->bytes / link->seconds / (1024 * 1024);
+        }
+        printf("%-4d %-24s %14zu %10.2f %10.1f %10.1f %8dK%s\n", 
+               i, names, link->bytes, throughput, 
+               link->fullSeconds * 1000, link->emptySeconds * 1000, 
+               link->pipeSize / 1024, link->resizes > 0 ? " (grown)" : "");
+    }
+}
+
+static void clearPipeStats(void) {
+    for (int i = 0; i < lastPipeStats.numberOfLinks; i++) {
+        free(lastPipeStats.links[i].producer);
+        free(lastPipeStats.links[i].consumer);
+    }
+    free(lastPipeStats.links);
+    lastPipeStats.links = NULL;
+    lastPipeStats.numberOfLinks = 0;
+    lastPipeStats.seconds = 0;
+}
+
+static void probePipeline(int (*producerPipes)[2], int (*consumerPipes)[2], 
+                          struct pipeLinkStats *links, int numberOfLinks, 
+                          double startTime) {
+    // A consumer that exits early would raise SIGPIPE in the shell when a 
+    // splice hits its closed pipe. Hold it off until the pipeline is done
+    sigset_t pipeSignal;
+    sigset_t oldMask;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+
+    int *states = malloc(sizeof(int) * numberOfLinks);
+    int *fullEvents = calloc(numberOfLinks, sizeof(int));
+    int *emptyEvents = calloc(numberOfLinks, sizeof(int));
+    // + 1 for the deadline's timer
+    struct pollfd *pollFDs = malloc(sizeof(struct pollfd) * (numberOfLinks + 1));
+    int *polledLinks = malloc(sizeof(int) * numberOfLinks);
+    int openLinks = numberOfLinks;
+    for (int i = 0; i < numberOfLinks; i++) {
+        states[i] = LINK_MOVING;
+        links[i].pipeSize = fcntl(consumerPipes[i][1], F_GETPIPE_SZ);
+    }
+    while (openLinks > 0) {
+        // Move whatever each link can take right now without blocking
+        for (int i = 0; i < numberOfLinks; i++) {
+            while (states[i] != LINK_CLOSED) {
+                ssize_t bytesMoved = splice(producerPipes[i][0], NULL, consumerPipes[i][1], NULL, 
+                                            links[i].pipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (bytesMoved > 0) {
+                    links[i].bytes += bytesMoved;
+                    states[i] = LINK_MOVING;
+                    continue;
+                }
+                if (bytesMoved == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (bytesMoved == -1 && errno == EAGAIN) {
+                    // Either the producer hasn't written anything, or the
+                    // consumer's pipe is full and it has fallen behind
+                    int pending = 0;
+                    ioctl(producerPipes[i][0], FIONREAD, &pending);
+                    int newState = (pending > 0) ? LINK_FULL : LINK_EMPTY;
+                    if (newState == LINK_FULL && states[i] != LINK_FULL) {
+                        fullEvents[i]++;
+                    } else if (newState == LINK_EMPTY && states[i] != LINK_EMPTY) {
+                        emptyEvents[i]++;
+                    }
+                    states[i] = newState;
+                    break;
+                }
+                // End-of-file from the producer, or the consumer has exited
+                close(producerPipes[i][0]);
+                close(consumerPipes[i][1]);
+                links[i].seconds = getMonotonicTime() - startTime;
+                states[i] = LINK_CLOSED;
+                openLinks--;
+            }
+            // A link that keeps flipping between full and empty is being
+            // throttled by its pipes, so give it bigger ones
+            if (states[i] != LINK_CLOSED && 
+                fullEvents[i] >= PIPE_GROW_EVENTS && emptyEvents[i] >= PIPE_GROW_EVENTS) {
+                int newSize = growPipe(consumerPipes[i][1], links[i].pipeSize * 2);
+                growPipe(producerPipes[i][0], newSize);
+                if (newSize > links[i].pipeSize) {
+                    links[i].pipeSize = newSize;
+                    links[i].resizes++;
+                    learnPipeSize(links[i].producer, newSize);
+                }
+                fullEvents[i] = 0;
+                emptyEvents[i] = 0;
+            }
+        }
+        if (openLinks == 0) {
+            break;
+        }
+        // Wait until any link can make progress, charging the time to 
+        // whichever side each link is waiting on
+        int numberOfPollFDs = 0;
+        for (int i = 0; i < numberOfLinks; i++) {
+            if (states[i] == LINK_FULL) {
+                pollFDs[numberOfPollFDs].fd = consumerPipes[i][1];
+                pollFDs[numberOfPollFDs].events = POLLOUT;
+            } else if (states[i] == LINK_EMPTY) {
+                pollFDs[numberOfPollFDs].fd = producerPipes[i][0];
+                pollFDs[numberOfPollFDs].events = POLLIN;
+            } else {
+                continue;
+            }
+            polledLinks[numberOfPollFDs] = i;
+            numberOfPollFDs++;
+        }
+        pollFDs[numberOfPollFDs].fd = commandLimits.timerFD;
+        pollFDs[numberOfPollFDs].events = POLLIN;
+        pollFDs[numberOfPollFDs].revents = 0;
+        double waitStart = getMonotonicTime();
+        if (poll(pollFDs, numberOfPollFDs + 1, -1) == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        double waited = getMonotonicTime() - waitStart;
+        if (pollFDs[numberOfPollFDs].revents & POLLIN) {
+            handleDeadline();
+        }
+        for (int n = 0; n < numberOfPollFDs; n++) {
+            int i = polledLinks[n];
+            if (states[i] == LINK_FULL) {
+                links[i].fullSeconds += waited;
+            } else {
+                links[i].emptySeconds += waited;
+            }
+        }
+    }
+    for (int i = 0; i < numberOfLinks; i++) {
+        if (states[i] != LINK_CLOSED) {
+            close(producerPipes[i][0]);
+            close(consumerPipes[i][1]);
+        }
+    }
+    free(states);
+    free(fullEvents);
+    free(emptyEvents);
+    free(pollFDs);
+    free(polledLinks);
+
+    // Throw away a SIGPIPE raised by the probe before unblocking it again
+    struct timespec noWait = {0, 0};
+    while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+static int growPipe(int fd, int size) {
+    // Unprivileged processes can't go past /proc/sys/fs/pipe-max-size, so 
+    // fall back to the largest size that succeeds
+    while (size > 0) {
+        int newSize = fcntl(fd, F_SETPIPE_SZ, size);
+        if (newSize != -1) {
+            return newSize;
+        }
+        size /= 2;
+    }
+    return fcntl(fd, F_GETPIPE_SZ);
+}
+
+static int getLearnedPipeSize(char *program) {
+    for (int i = 0; i < numberOfLearnedPipeSizes; i++) {
+        if (strcmp(learnedPipeSizes[i].program, program) == 0) {
+            return learnedPipeSizes[i].size;
+        }
+    }
+    return 0;
+}
+
+static void learnPipeSize(char *program, int size) {
+    for (int i = 0; i < numberOfLearnedPipeSizes; i++) {
+        if (strcmp(learnedPipeSizes[i].program, program) == 0) {
+            if (size > learnedPipeSizes[i].size) {
+                learnedPipeSizes[i].size = size;
+            }
+            return;
+        }
+    }
+    learnedPipeSizes = realloc(learnedPipeSizes, sizeof(struct learnedPipeSize) * (numberOfLearnedPipeSizes + 1));
+    learnedPipeSizes[numberOfLearnedPipeSizes].program = strdup(program);
+    learnedPipeSizes[numberOfLearnedPipeSizes].size = size;
+    numberOfLearnedPipeSizes++;
+}
+
+// ===================== SUBSET 9 =====================
+
+static char **parseCommandLimits(char **words) {
+    int start = 0;
+    bool isValid = true;
+    while (words[start] != NULL && isValid) {
+        if (strcmp(words[start], "timeout") == 0) {
+            if (words[start + 1] == NULL) {
+                fprintf(stderr, "timeout: missing operand\n");
+                isValid = false;
+            } else if (parseDuration(words[start + 1], &commandLimits.timeout) == false) {
+                fprintf(stderr, "timeout: %s: invalid time interval\n", words[start + 1]);
+                isValid = false;
+            }
+        } else if (strcmp(words[start], "limit") == 0) {
+            if (words[start + 1] == NULL) {
+                fprintf(stderr, "limit: missing operand\n");
+                isValid = false;
+            } else if (parseLimits(words[start + 1]) == false) {
+                isValid = false;
+            }
+        } else if (strcmp(words[start], "compress") == 0) {
+            // Subset 27:
+            if (words[start + 1] == NULL) {
+                fprintf(stderr, "compress: missing operand\n");
+                isValid = false;
+            } else if (parseCodec(words[start + 1]) == false) {
+                fprintf(stderr, "compress: %s: expected auto, gzip, zstd or none, and a level\n", 
+                        words[start + 1]);
+                isValid = false;
+            }
+        } else if (strcmp(words[start], "decompress") == 0) {
+            // Subset 27: the only prefix without an operand
+            commandLimits.isDecompressing = true;
+            start++;
+            continue;
+        } else {
+            break;
+        }
+        start += 2;
+    }
+    if (start == 0) {
+        return words;
+    }
+    if (isValid && words[start] == NULL) {
+        fprintf(stderr, "%s: missing command\n", words[0]);
+        isValid = false;
+    }
+    int argc = getWordCount(words);
+    if (isValid == false) {
+        // Drop the whole command
+        start = argc;
+    }
+    // Remove the prefixes, shifting the command down to the start of words
+    int n = 0;
+    for (int i = start; i <= argc; i++, n++) {
+        words[n] = words[i];
+    }
+    words[n] = NULL;
+    return words;
+}
+
+static bool parseDuration(char *text, double *seconds) {
+    char *unit;
+    double value = strtod(text, &unit);
+    if (unit == text || value <= 0) {
+        return false;
+    }
+    if (strcmp(unit, "") == 0 || strcmp(unit, "s") == 0) {
+        *seconds = value;
+    } else if (strcmp(unit, "ms") == 0) {
+        *seconds = value / 1000;
+    } else if (strcmp(unit, "m") == 0) {
+        *seconds = value * 60;
+    } else if (strcmp(unit, "h") == 0) {
+        *seconds = value * 60 * 60;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static bool parseLimits(char *specification) {
+    char *copy = strdup(specification);
+    char *savePointer = NULL;
+    bool isValid = true;
+    for (char *limit = strtok_r(copy, ",", &savePointer); limit != NULL && isValid; 
+         limit = strtok_r(NULL, ",", &savePointer)) {
+        char *value = strchr(limit, '=');
+        if (value == NULL) {
+            fprintf(stderr, "limit: %s: expected name=value\n", limit);
+            isValid = false;
+            break;
+        }
+        *value = '\0';
+        value++;
+        int resource = -1;
+        bool isSize = false;
+        if (strcmp(limit, "cpu") == 0) {
+            resource = RLIMIT_CPU;
+        } else if (strcmp(limit, "mem") == 0) {
+            resource = RLIMIT_AS;
+            isSize = true;
+        } else if (strcmp(limit, "nofile") == 0) {
+            resource = RLIMIT_NOFILE;
+        } else if (strcmp(limit, "nproc") == 0) {
+            resource = RLIMIT_NPROC;
+        } else if (strcmp(limit, "fsize") == 0) {
+            resource = RLIMIT_FSIZE;
+            isSize = true;
+        } else if (strcmp(limit, "core") == 0) {
+            resource = RLIMIT_CORE;
+            isSize = true;
+        } else {
+            fprintf(stderr, "limit: %s: unknown limit (expected cpu, mem, nofile, nproc, fsize or core)\n", limit);
+            isValid = false;
+            break;
+        }
+        unsigned long long amount = 0;
+        if (isSize) {
+            isValid = parseSize(value, &amount);
+        } else {
+            char *unit;
+            amount = strtoull(value, &unit, 10);
+            isValid = (unit != value && strcmp(unit, "") == 0);
+        }
+        if (isValid == false) {
+            fprintf(stderr, "limit: %s: invalid value '%s'\n", limit, value);
+            break;
+        }
+        commandLimits.isLimited[resource] = true;
+        commandLimits.limits[resource].rlim_cur = amount;
+        commandLimits.limits[resource].rlim_max = amount;
+        if (resource == RLIMIT_CPU) {
+            // Leave a second between SIGXCPU and the kernel's SIGKILL
+            commandLimits.limits[resource].rlim_max = amount + 1;
+        }
+    }
+    free(copy);
+    return isValid;
+}
+
+static void initSpawnActions(struct spawnActions *actions) {
+    for (int i = 0; i < 3; i++) {
+        actions->fds[i] = -1;
+    }
+    actions->rings[0] = NULL;
+    actions->rings[1] = NULL;
+}
+
+static void addSpawnDup2(struct spawnActions *actions, int fd, int newFD) {
+    assert(newFD >= 0 && newFD < 3);
+    actions->fds[newFD] = fd;
+}
+
+static int spawnProgram(pid_t *pid, char *programPath, struct spawnActions *actions, 
+                        char **words, char **environment) {
+    bool hasDeadline = (commandLimits.timeout > 0);
+    // Every process of the command shares one group, so they can all be
+    // killed together when the deadline passes
+    pid_t processGroup = hasDeadline ? commandLimits.processGroup : -1;
+    double startTime = getMonotonicTime();
+    // Subset 22:
+    struct filter filter;
+    if (isRunAsFilter(words, &filter)) {
+        int filterResult = startFilter(pid, &filter, actions);
+        if (filterResult == 0) {
+            recordProgramSpawn(*pid, programPath, startTime, getMonotonicTime());
+            return 0;
+        }
+        // Subset 26:
+        if (actions != NULL && (actions->rings[0] != NULL || actions->rings[1] != NULL)) {
+            // Only a filter can read or write a ring
+            errno = filterResult;
+            return filterResult;
+        }
+    }
+    int spawnResult = startProgram(pid, programPath, actions, processGroup, words, environment);
+    if (spawnResult == EPERM && hasDeadline && commandLimits.processGroup != 0) {
+        // Everything in the group has already exited, so start a new one
+        commandLimits.processGroup = 0;
+        spawnResult = startProgram(pid, programPath, actions, 0, words, environment);
+    }
+    if (spawnResult != 0) {
+        // Subset 30:
+        recordFlightEvent(FLIGHT_SPAWN_FAILED, getMonotonicTime() - startTime, spawnResult, 0, words[0]);
+        errno = spawnResult;
+        return spawnResult;
+    }
+    recordProgramSpawn(*pid, programPath, startTime, getMonotonicTime());
+    if (hasDeadline && commandLimits.processGroup == 0) {
+        commandLimits.processGroup = *pid;
+        giveTerminalTo(*pid);
+        if (commandLimits.timerFD == -1) {
+            startDeadline();
+        }
+    }
+    return 0;
+}
+
+static int waitForProgram(pid_t pid, int *status) {
+    return waitForPrograms(&pid, 1, status);
+}
+
+static int waitForPrograms(pid_t *pids, int numberOfPids, int *statuses) {
+    int result = 0;
+    double waitStart = getMonotonicTime();
+    if (commandLimits.timerFD == -1) {
+        for (int i = 0; i < numberOfPids; i++) {
+            if (reapProgram(pids[i], &statuses[i], 0) == -1) {
+                result = -1;
+            }
+            recordProgramExit(pids[i]);
+        }
+        sessionRecorder.programSeconds += getMonotonicTime() - waitStart;
+        return result;
+    }
+    // Wait on a pidfd for each process alongside the deadline's timer
+    struct pollfd *pollFDs = malloc(sizeof(struct pollfd) * (numberOfPids + 1));
+    int *pidIndexes = malloc(sizeof(int) * numberOfPids);
+    int *pidFDs = malloc(sizeof(int) * numberOfPids);
+    int remaining = 0;
+    for (int i = 0; i < numberOfPids; i++) {
+        // Without pidfds, this falls back to checking on the process regularly
+        pidFDs[i] = openProgramFD(pids[i]);
+        remaining++;
+    }
+    bool *isReaped = calloc(numberOfPids, sizeof(bool));
+    while (remaining > 0) {
+        int numberOfPollFDs = 0;
+        bool hasPidFD = true;
+        for (int i = 0; i < numberOfPids; i++) {
+            if (isReaped[i]) {
+                continue;
+            }
+            if (pidFDs[i] == -1) {
+                hasPidFD = false;
+                continue;
+            }
+            pollFDs[numberOfPollFDs].fd = pidFDs[i];
+            pollFDs[numberOfPollFDs].events = POLLIN;
+            pidIndexes[numberOfPollFDs] = i;
+            numberOfPollFDs++;
+        }
+        pollFDs[numberOfPollFDs].fd = commandLimits.timerFD;
+        pollFDs[numberOfPollFDs].events = POLLIN;
+        int pollResult = poll(pollFDs, numberOfPollFDs + 1, hasPidFD ? -1 : DEADLINE_POLL_MS);
+        if (pollResult == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        if (pollFDs[numberOfPollFDs].revents & POLLIN) {
+            handleDeadline();
+        }
+        for (int i = 0; i < numberOfPids; i++) {
+            if (isReaped[i]) {
+                continue;
+            }
+            // A pidfd becomes readable once its process has exited
+            int options = WNOHANG;
+            for (int n = 0; n < numberOfPollFDs; n++) {
+                if (pidIndexes[n] == i && (pollFDs[n].revents & POLLIN)) {
+                    options = 0;
+                }
+            }
+            pid_t reaped = reapProgram(pids[i], &statuses[i], options);
+            if (reaped == pids[i] || reaped == -1) {
+                if (reaped == -1) {
+                    result = -1;
+                }
+                recordProgramExit(pids[i]);
+                isReaped[i] = true;
+                remaining--;
+                if (pidFDs[i] != -1) {
+                    close(pidFDs[i]);
+                }
+            }
+        }
+    }
+    free(isReaped);
+    free(pidFDs);
+    free(pidIndexes);
+    free(pollFDs);
+    sessionRecorder.programSeconds += getMonotonicTime() - waitStart;
+    return result;
+}
+
+static void waitForInput(int fd) {
+    if (commandLimits.timerFD == -1) {
+        return;
+    }
+    while (1) {
+        struct pollfd pollFDs[2] = {
+            {fd, POLLIN, 0},
+            {commandLimits.timerFD, POLLIN, 0}
+        };
+        if (poll(pollFDs, 2, -1) == -1 && errno != EINTR) {
+            return;
+        }
+        if (pollFDs[1].revents & POLLIN) {
+            handleDeadline();
+        }
+        if (pollFDs[0].revents != 0) {
+            return;
+        }
+    }
+}
+
+static void startDeadline(void) {
+    commandLimits.timerFD = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (commandLimits.timerFD == -1) {
+        perror("timeout");
+        return;
+    }
+    struct itimerspec deadline = {{0, 0}, {0, 0}};
+    deadline.it_value.tv_sec = (time_t) commandLimits.timeout;
+    deadline.it_value.tv_nsec = (long) ((commandLimits.timeout - deadline.it_value.tv_sec) * 1e9);
+    if (deadline.it_value.tv_sec == 0 && deadline.it_value.tv_nsec == 0) {
+        deadline.it_value.tv_nsec = 1;
+    }
+    timerfd_settime(commandLimits.timerFD, 0, &deadline, NULL);
+}
+
+static void joinCommandGroup(pid_t pid) {
+    pid_t processGroup = commandLimits.processGroup;
+    if (processGroup != 0 && setpgid(pid, processGroup) != 0) {
+        // Everything in the group has already exited, so start a new one
+        processGroup = 0;
+    }
+    if (processGroup == 0) {
+        setpgid(pid, pid);
+        commandLimits.processGroup = pid;
+        giveTerminalTo(pid);
+    }
+    if (commandLimits.timerFD == -1) {
+        startDeadline();
+    }
+}
+
+static void handleDeadline(void) {
+    uint64_t expirations;
+    if (read(commandLimits.timerFD, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    // Ask politely first, then stop asking once the grace period is over
+    int escalation[] = {SIGTERM, SIGKILL};
+    int numberOfSignals = sizeof(escalation) / sizeof(escalation[0]);
+    if (commandLimits.signalsSent >= numberOfSignals || commandLimits.processGroup == 0) {
+        return;
+    }
+    if (commandLimits.signalsSent == 0) {
+        fprintf(stderr, "timeout: command timed out after %gs\n", commandLimits.timeout);
+        commandLimits.timedOut = true;
+    }
+    kill(-commandLimits.processGroup, escalation[commandLimits.signalsSent]);
+    // Subset 30:
+    recordFlightEvent(FLIGHT_KILL, 0, escalation[commandLimits.signalsSent], commandLimits.processGroup, NULL);
+    commandLimits.signalsSent++;
+    if (commandLimits.signalsSent < numberOfSignals) {
+        struct itimerspec grace = {{0, 0}, {TIMEOUT_KILL_GRACE, 0}};
+        timerfd_settime(commandLimits.timerFD, 0, &grace, NULL);
+    }
+}
+
+static void giveTerminalTo(pid_t processGroup) {
+    if (isatty(0) == false || tcgetpgrp(0) != getpgrp()) {
+        return;
+    }
+    // The shell is briefly a background process while doing this, which 
+    // would otherwise stop it with SIGTTOU
+    sigset_t terminalSignal;
+    sigset_t oldMask;
+    sigemptyset(&terminalSignal);
+    sigaddset(&terminalSignal, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &terminalSignal, &oldMask);
+    if (tcsetpgrp(0, processGroup) == 0) {
+        commandLimits.hasTerminal = true;
+        // Wake up anything stopped for reading the terminal before it was given
+        kill(-processGroup, SIGCONT);
+    }
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+static int getExitStatus(int status) {
+    if (commandLimits.timedOut) {
+        return TIMEOUT_EXIT_STATUS;
+    }
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+static void resetCommandLimits(void) {
+    if (commandLimits.timerFD != -1) {
+        close(commandLimits.timerFD);
+    }
+    if (commandLimits.hasTerminal) {
+        sigset_t terminalSignal;
+        sigset_t oldMask;
+        sigemptyset(&terminalSignal);
+        sigaddset(&terminalSignal, SIGTTOU);
+        sigprocmask(SIG_BLOCK, &terminalSignal, &oldMask);
+        tcsetpgrp(0, getpgrp());
+        sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    }
+    memset(&commandLimits, 0, sizeof(commandLimits));
+    commandLimits.timerFD = -1;
+}
+
+// ===================== SUBSET 10 =====================
+
+static struct trieNode *getCommandTrie(char **path) {
+    return refreshCommandTrie(&commandTrie, path);
+}
+
+static struct trieNode *refreshCommandTrie(struct commandTrie *trie, char **path) {
+    int numberOfPaths = getWordCount(path);
+    bool isStale = (trie->root == NULL || trie->numberOfPaths != numberOfPaths);
+    double now = getMonotonicTime();
+    if (isStale == false && now - trie->checkedAt < PATH_CHECK_INTERVAL) {
+        return trie->root;
+    }
+    trie->checkedAt = now;
+    struct timespec *mtimes = malloc(sizeof(struct timespec) * (numberOfPaths + 1));
+    for (int i = 0; i < numberOfPaths; i++) {
+        struct stat s;
+        mtimes[i].tv_sec = 0;
+        mtimes[i].tv_nsec = 0;
+        if (stat(path[i], &s) == 0) {
+            mtimes[i] = s.st_mtim;
+        }
+        if (isStale == false && 
+            (mtimes[i].tv_sec != trie->mtimes[i].tv_sec || 
+             mtimes[i].tv_nsec != trie->mtimes[i].tv_nsec)) {
+            isStale = true;
+        }
+    }
+    if (isStale == false) {
+        free(mtimes);
+        return trie->root;
+    }
+    // Something was added to or removed from PATH, so start over
+    freeTrieChildren(trie->root);
+    arenaFree(&trie->arena);
+    free(trie->mtimes);
+    trie->mtimes = mtimes;
+    trie->numberOfPaths = numberOfPaths;
+    trie->root = arenaAlloc(&trie->arena, sizeof(struct trieNode));
+    memset(trie->root, 0, sizeof(struct trieNode));
+    trie->root->label = "";
+    trie->root->pathIndex = -1;
+    for (int i = 0; i < numberOfPaths; i++) {
+        DIR *curr = opendir(path[i]);
+        if (curr == NULL) {
+            continue;
+        }
+        struct dirent *dir;
+        while ((dir = readdir(curr)) != NULL) {
+            if (dir->d_type == DT_DIR || dir->d_name[0] == '.') {
+                continue;
+            }
+            // Earlier directories in PATH take precedence
+            insertIntoTrie(trie->root, &trie->arena, dir->d_name, i);
+        }
+        closedir(curr);
+    }
+    countTrieNames(trie->root);
+    return trie->root;
+}
+
+static void freeTrieChildren(struct trieNode *node) {
+    if (node == NULL) {
+        return;
+    }
+    for (int i = 0; i < node->numberOfChildren; i++) {
+        freeTrieChildren(node->children[i]);
+    }
+    free(node->children);
+}
+
+static struct trieNode *findTrieChild(struct trieNode *node, char first, int *index) {
+    // Binary search over the children's first characters
+    int low = 0;
+    int high = node->numberOfChildren;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        unsigned char curr = node->children[middle]->label[0];
+        if (curr < (unsigned char) first) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *index = low;
+    if (low < node->numberOfChildren && node->children[low]->label[0] == first) {
+        return node->children[low];
+    }
+    return NULL;
+}
+
+static void insertIntoTrie(struct trieNode *root, struct arena *arena, char *name, int pathIndex) {
+    struct trieNode *node = root;
+    char *s = name;
+    while (*s != '\0') {
+        int index;
+        struct trieNode *child = findTrieChild(node, *s, &index);
+        if (child == NULL) {
+            // Nothing shares this prefix, so the rest of the name is one edge
+            struct trieNode *leaf = arenaAlloc(arena, sizeof(struct trieNode));
+            leaf->labelLength = strlen(s);
+            leaf->label = arenaStrndup(arena, s, leaf->labelLength);
+            leaf->children = NULL;
+            leaf->numberOfChildren = 0;
+            leaf->pathIndex = pathIndex;
+            leaf->numberOfNames = 0;
+            node->children = realloc(node->children, sizeof(struct trieNode *) * (node->numberOfChildren + 1));
+            memmove(&node->children[index + 1], &node->children[index], 
+                    sizeof(struct trieNode *) * (node->numberOfChildren - index));
+            node->children[index] = leaf;
+            node->numberOfChildren++;
+            return;
+        }
+        int common = 0;
+        while (common < child->labelLength && s[common] == child->label[common]) {
+            common++;
+        }
+        if (common < child->labelLength) {
+            // The name leaves the edge part way along, so split the edge
+            struct trieNode *middle = arenaAlloc(arena, sizeof(struct trieNode));
+            middle->label = child->label;
+            middle->labelLength = common;
+            middle->children = malloc(sizeof(struct trieNode *));
+            middle->children[0] = child;
+            middle->numberOfChildren = 1;
+            middle->pathIndex = -1;
+            middle->numberOfNames = 0;
+            child->label += common;
+            child->labelLength -= common;
+            node->children[index] = middle;
+            child = middle;
+        }
+        node = child;
+        s += common;
+    }
+    if (node->pathIndex == -1) {
+        node->pathIndex = pathIndex;
+    }
+}
+
+static struct trieNode *findTrieNode(struct trieNode *root, char *prefix, int *matched) {
+    struct trieNode *node = root;
+    char *s = prefix;
+    *matched = node->labelLength;
+    while (*s != '\0') {
+        int index;
+        struct trieNode *child = findTrieChild(node, *s, &index);
+        if (child == NULL) {
+            return NULL;
+        }
+        int common = 0;
+        while (common < child->labelLength && s[common] != '\0' && s[common] == child->label[common]) {
+            common++;
+        }
+        if (s[common] != '\0' && common < child->labelLength) {
+            return NULL;
+        }
+        node = child;
+        s += common;
+        *matched = common;
+    }
+    return node;
+}
+
+static int countTrieNames(struct trieNode *root) {
+    int count = (root->pathIndex != -1) ? 1 : 0;
+    for (int i = 0; i < root->numberOfChildren; i++) {
+        count += countTrieNames(root->children[i]);
+    }
+    root->numberOfNames = count;
+    return count;
+}
+
+static void collectTrieNames(struct trieNode *node, char *prefix, int prefixLength, 
+                             char **names, int *numberOfNames, int limit) {
+    if (*numberOfNames >= limit || prefixLength + node->labelLength >= MAX_LINE_CHARS) {
+        return;
+    }
+    char name[MAX_LINE_CHARS];
+    memcpy(name, prefix, prefixLength);
+    memcpy(name + prefixLength, node->label, node->labelLength);
+    int nameLength = prefixLength + node->labelLength;
+    name[nameLength] = '\0';
+    if (node->pathIndex != -1) {
+        names[*numberOfNames] = strdup(name);
+        (*numberOfNames)++;
+    }
+    for (int i = 0; i < node->numberOfChildren; i++) {
+        collectTrieNames(node->children[i], name, nameLength, names, numberOfNames, limit);
+    }
+}
+
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char **) a, *(char **) b);
+}
+
+static struct directoryListing *getDirectoryListing(char *directoryPath) {
+    struct stat s;
+    if (stat(directoryPath, &s) != 0 || S_ISDIR(s.st_mode) == false) {
+        return NULL;
+    }
+    // Reuse the cached listing if the directory hasn't changed, otherwise 
+    // replace the least recently used one
+    struct directoryListing *listing = &directoryCache[0];
+    for (int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        struct directoryListing *curr = &directoryCache[i];
+        if (curr->path != NULL && strcmp(curr->path, directoryPath) == 0) {
+            listing = curr;
+            break;
+        }
+        if (curr->lastUsed < listing->lastUsed) {
+            listing = curr;
+        }
+    }
+    listing->lastUsed = getMonotonicTime();
+    if (listing->path != NULL && strcmp(listing->path, directoryPath) == 0 &&
+        listing->mtime.tv_sec == s.st_mtim.tv_sec && listing->mtime.tv_nsec == s.st_mtim.tv_nsec) {
+        return listing;
+    }
+    free(listing->path);
+    free(listing->names);
+    free(listing->isDirectory);
+    arenaFree(&listing->arena);
+    listing->path = strdup(directoryPath);
+    listing->mtime = s.st_mtim;
+    listing->names = NULL;
+    listing->isDirectory = NULL;
+    listing->numberOfNames = 0;
+
+    DIR *curr = opendir(directoryPath);
+    if (curr == NULL) {
+        return listing;
+    }
+    int capacity = 0;
+    struct dirent *dir;
+    while ((dir = readdir(curr)) != NULL) {
+        if (strcmp(dir->d_name, ".") == 0 || strcmp(dir->d_name, "..") == 0) {
+            continue;
+        }
+        if (listing->numberOfNames == capacity) {
+            capacity = (capacity == 0) ? 64 : capacity * 2;
+            listing->names = realloc(listing->names, sizeof(char *) * capacity);
+        }
+        // Directories are marked with a trailing '/', so they sort and are 
+        // completed along with it
+        size_t nameLength = strlen(dir->d_name);
+        bool isDir = (dir->d_type == DT_DIR);
+        char *name = arenaAlloc(&listing->arena, nameLength + 2);
+        memcpy(name, dir->d_name, nameLength);
+        name[nameLength] = isDir ? '/' : '\0';
+        name[nameLength + 1] = '\0';
+        listing->names[listing->numberOfNames] = name;
+        listing->numberOfNames++;
+    }
+    closedir(curr);
+    qsort(listing->names, listing->numberOfNames, sizeof(char *), compareNames);
+    return listing;
+}
+
+static int lookupTrie(struct trieNode *root, char *name) {
+    int matched;
+    struct trieNode *node = findTrieNode(root, name, &matched);
+    if (node == NULL || matched != node->labelLength) {
+        return -1;
+    }
+    return node->pathIndex;
+}
+
+static bool isCommandPosition(const char *line, int wordStart) {
+    // Look back over the words before this one. A program name comes first,
+    // after a pipe, or after the timeout and limit prefixes
+    char before[MAX_LINE_CHARS];
+    memcpy(before, line, wordStart);
+    before[wordStart] = '\0';
+    // The words are only needed here, so they are given straight back
+    struct arenaMark mark = arenaGetMark(&commandArena);
+    char **words = tokenize(before, WORD_SEPARATORS, SPECIAL_CHARS);
+    int start = 0;
+    for (int i = 0; words[i] != NULL; i++) {
+        if (strcmp(words[i], "|") == 0) {
+            start = i + 1;
+        }
+    }
+    while (words[start] != NULL && words[start + 1] != NULL &&
+           (strcmp(words[start], "timeout") == 0 || strcmp(words[start], "limit") == 0)) {
+        start += 2;
+    }
+    bool isCommand = (words[start] == NULL);
+    arenaReset(&commandArena, &mark);
+    return isCommand;
+}
+
+// ===================== SUBSET 11 =====================
+
+static void finishCommandMemory(struct arenaMark *commandStart) {
+    lastCommandPeak = commandArena.peak - commandStart->bytesUsed;
+    arenaReset(&commandArena, commandStart);
+    commandArena.peak = commandArena.bytesUsed;
+}
+
+static void memstat(char **words) {
+    if (getWordCount(words) > 1) {
+        fprintf(stderr, "%s: too many arguments\n", words[0]);
+        return;
+    }
+    printf("command arena: %zuK held, %zuK in use, last command peaked at %zuK, high-water %zuK\n",
+           getArenaSize(&commandArena) / 1024, commandArena.bytesUsed / 1024, 
+           lastCommandPeak / 1024, commandArena.highWater / 1024);
+    size_t trieSize = getArenaSize(&commandTrie.arena);
+    int numberOfNames = (commandTrie.root != NULL) ? commandTrie.root->numberOfNames : 0;
+    printf("command names: %zuK held for %d names\n", trieSize / 1024, numberOfNames);
+    size_t cacheSize = 0;
+    int numberOfListings = 0;
+    for (int i = 0; i < DIRECTORY_CACHE_SIZE; i++) {
+        if (directoryCache[i].path != NULL) {
+            cacheSize += getArenaSize(&directoryCache[i].arena);
+            numberOfListings++;
+        }
+    }
+    printf("completion cache: %zuK held for %d directories\n", cacheSize / 1024, numberOfListings);
+    // ru_maxrss is in kilobytes on Linux
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("resident set: %zuK now, %ldK peak\n", getResidentSize() / 1024, usage.ru_maxrss);
+}
+
+static size_t getResidentSize(void) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm == NULL) {
+        return 0;
+    }
+    size_t totalPages = 0;
+    size_t residentPages = 0;
+    if (fscanf(statm, "%zu %zu", &totalPages, &residentPages) != 2) {
+        residentPages = 0;
+    }
+    fclose(statm);
+    return residentPages * sysconf(_SC_PAGESIZE);
+}
+
+// ===================== SUBSET 12 =====================
+
+static void reportExitStatus(char *programPath, int exitStatus) {
+    lastExitStatus = exitStatus;
+    if (isReportingStatus) {
+        printf("%s exit status = %d\n", programPath, exitStatus);
+    }
+}
+
+// ===================== SUBSET 13 =====================
+
+static void dag(char **words, char **path, char **environment) {
+    int argc = getWordCount(words);
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    char *fileName = NULL;
+    if (argc == 2) {
+        fileName = words[1];
+    } else if (argc == 4 && strcmp(words[1], "-j") == 0) {
+        char *end;
+        jobs = strtol(words[2], &end, 10);
+        if (*end != '\0' || jobs < 1) {
+            fprintf(stderr, "%s: %s: invalid number of jobs\n", words[0], words[2]);
+            lastExitStatus = 2;
+            return;
+        }
+        fileName = words[3];
+    } else {
+        fprintf(stderr, "usage: %s [-j N] FILE\n", words[0]);
+        lastExitStatus = 2;
+        return;
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    struct dagNode *nodes;
+    int numberOfNodes = readDagFile(fileName, &nodes);
+    if (numberOfNodes == -1) {
+        lastExitStatus = 2;
+        return;
+    }
+
+    double startTime = getMonotonicTime();
+    struct pollfd *pollFDs = malloc(sizeof(struct pollfd) * (numberOfNodes + 1));
+    int running = 0;
+    int finished = 0;
+    while (finished < numberOfNodes) {
+        // Fill the free slots with ready nodes, longest chain first
+        while (running < jobs) {
+            int next = -1;
+            for (int i = 0; i < numberOfNodes; i++) {
+                if (nodes[i].state == DAG_WAITING && nodes[i].waitingOn == 0 &&
+                    (next == -1 || nodes[i].height > nodes[next].height)) {
+                    next = i;
+                }
+            }
+            if (next == -1) {
+                break;
+            }
+            startDagNode(&nodes[next], path, environment);
+            if (nodes[next].state == DAG_RUNNING) {
+                running++;
+            } else {
+                finished++;
+                finished += skipDagDependents(nodes, next);
+            }
+        }
+        if (running == 0) {
+            break;
+        }
+        // Only the nodes are waited on, so other children of the shell such
+        // as coprocesses are left to their owners. Without pidfds, the nodes
+        // are checked on regularly
+        int numberOfPollFDs = 0;
+        bool hasPidFD = true;
+        for (int i = 0; i < numberOfNodes; i++) {
+            if (nodes[i].state != DAG_RUNNING) {
+                continue;
+            }
+            if (nodes[i].pidFD == -1) {
+                hasPidFD = false;
+                continue;
+            }
+            pollFDs[numberOfPollFDs].fd = nodes[i].pidFD;
+            pollFDs[numberOfPollFDs].events = POLLIN;
+            numberOfPollFDs++;
+        }
+        if (poll(pollFDs, numberOfPollFDs, hasPidFD ? -1 : DEADLINE_POLL_MS) == -1 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        for (int index = 0; index < numberOfNodes; index++) {
+            struct dagNode *node = &nodes[index];
+            int status;
+            if (node->state != DAG_RUNNING || waitpid(node->pid, &status, WNOHANG) != node->pid) {
+                continue;
+            }
+            if (node->pidFD != -1) {
+                close(node->pidFD);
+            }
+            node->endTime = getMonotonicTime();
+            node->exitStatus = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+            running--;
+            finished++;
+            // Every dependency has finished by now, so the longest chain 
+            // ending here is known
+            node->pathTime = 0;
+            node->pathPrevious = -1;
+            for (int i = 0; i < node->numberOfDependencies; i++) {
+                struct dagNode *dependency = &nodes[node->dependencies[i]];
+                if (dependency->pathTime > node->pathTime) {
+                    node->pathTime = dependency->pathTime;
+                    node->pathPrevious = node->dependencies[i];
+                }
+            }
+            node->pathTime += node->endTime - node->startTime;
+            if (node->exitStatus == 0) {
+                node->state = DAG_SUCCEEDED;
+                for (int i = 0; i < node->numberOfDependents; i++) {
+                    nodes[node->dependents[i]].waitingOn--;
+                }
+            } else {
+                node->state = DAG_FAILED;
+                finished += skipDagDependents(nodes, index);
+            }
+        }
+    }
+    free(pollFDs);
+    printDagReport(nodes, numberOfNodes, getMonotonicTime() - startTime, jobs);
+}
+
+static int readDagFile(char *fileName, struct dagNode **nodes) {
+    FILE *file = fopen(fileName, "r");
+    if (file == NULL) {
+        fprintf(stderr, "dag: %s: No such file or directory\n", fileName);
+        return -1;
+    }
+    int numberOfNodes = 0;
+    int capacity = 16;
+    *nodes = arenaAlloc(&commandArena, sizeof(struct dagNode) * capacity);
+    char line[MAX_LINE_CHARS];
+    int lineNumber = 0;
+    bool isValid = true;
+    while (fgets(line, MAX_LINE_CHARS, file) != NULL) {
+        lineNumber++;
+        if (numberOfNodes == capacity) {
+            struct dagNode *moved = arenaAlloc(&commandArena, sizeof(struct dagNode) * capacity * 2);
+            memcpy(moved, *nodes, sizeof(struct dagNode) * capacity);
+            *nodes = moved;
+            capacity *= 2;
+        }
+        int result = parseDagLine(line, lineNumber, &(*nodes)[numberOfNodes]);
+        if (result == -1) {
+            fprintf(stderr, "dag: %s:%d: expected 'label: [after: a,b] command'\n", fileName, lineNumber);
+            isValid = false;
+        } else if (result == 1) {
+            numberOfNodes++;
+        }
+    }
+    fclose(file);
+    if (isValid == false || linkDagNodes(*nodes, numberOfNodes) == false) {
+        return -1;
+    }
+    return numberOfNodes;
+}
+
+static int parseDagLine(char *line, int lineNumber, struct dagNode *node) {
+    memset(node, 0, sizeof(struct dagNode));
+    node->pathPrevious = -1;
+    char *s = line + strspn(line, WORD_SEPARATORS);
+    if (*s == '\0' || *s == '#') {
+        return 0;
+    }
+    // Lines without a label can't be depended on, but still run
+    size_t wordLength = strcspn(s, WORD_SEPARATORS);
+    if (wordLength > 1 && s[wordLength - 1] == ':' && strncmp(s, "after:", wordLength) != 0) {
+        node->label = arenaStrndup(&commandArena, s, wordLength - 1);
+        s += wordLength;
+        s += strspn(s, WORD_SEPARATORS);
+    } else {
+        char label[MAX_LINE_CHARS];
+        snprintf(label, MAX_LINE_CHARS, "line%d", lineNumber);
+        node->label = arenaStrndup(&commandArena, label, strlen(label));
+    }
+    if (strncmp(s, "after:", strlen("after:")) == 0) {
+        s += strlen("after:");
+        s += strspn(s, WORD_SEPARATORS);
+        size_t listLength = strcspn(s, WORD_SEPARATORS);
+        if (listLength == 0) {
+            return -1;
+        }
+        char *list = arenaStrndup(&commandArena, s, listLength);
+        s += listLength;
+        node->dependencyLabels = tokenize(list, ",", "");
+        node->numberOfDependencies = getWordCount(node->dependencyLabels);
+    }
+    s += strspn(s, WORD_SEPARATORS);
+    size_t commandLength = strlen(s);
+    while (commandLength > 0 && strchr(WORD_SEPARATORS, s[commandLength - 1]) != NULL) {
+        commandLength--;
+    }
+    if (commandLength == 0) {
+        return -1;
+    }
+    node->commandLine = arenaStrndup(&commandArena, s, commandLength);
+    return 1;
+}
+
+static bool linkDagNodes(struct dagNode *nodes, int numberOfNodes) {
+    for (int i = 0; i < numberOfNodes; i++) {
+        for (int j = 0; j < i; j++) {
+            if (strcmp(nodes[i].label, nodes[j].label) == 0) {
+                fprintf(stderr, "dag: %s: label used more than once\n", nodes[i].label);
+                return false;
+            }
+        }
+    }
+    int *numberOfDependents = arenaAlloc(&commandArena, sizeof(int) * (numberOfNodes + 1));
+    memset(numberOfDependents, 0, sizeof(int) * (numberOfNodes + 1));
+    for (int i = 0; i < numberOfNodes; i++) {
+        struct dagNode *node = &nodes[i];
+        node->dependencies = arenaAlloc(&commandArena, sizeof(int) * (node->numberOfDependencies + 1));
+        for (int d = 0; d < node->numberOfDependencies; d++) {
+            int found = 0;
+            while (found < numberOfNodes && strcmp(nodes[found].label, node->dependencyLabels[d]) != 0) {
+                found++;
+            }
+            if (found == numberOfNodes) {
+                fprintf(stderr, "dag: %s: unknown dependency '%s'\n", node->label, node->dependencyLabels[d]);
+                return false;
+            }
+            node->dependencies[d] = found;
+            numberOfDependents[found]++;
+        }
+        node->waitingOn = node->numberOfDependencies;
+    }
+    for (int i = 0; i < numberOfNodes; i++) {
+        nodes[i].dependents = arenaAlloc(&commandArena, sizeof(int) * (numberOfDependents[i] + 1));
+    }
+    for (int i = 0; i < numberOfNodes; i++) {
+        for (int d = 0; d < nodes[i].numberOfDependencies; d++) {
+            struct dagNode *dependency = &nodes[nodes[i].dependencies[d]];
+            dependency->dependents[dependency->numberOfDependents] = i;
+            dependency->numberOfDependents++;
+        }
+    }
+    // Put the nodes in dependency order, which only fails if there is a 
+    // cycle, then work out the heights from the bottom up
+    int *order = arenaAlloc(&commandArena, sizeof(int) * (numberOfNodes + 1));
+    int *waitingOn = arenaAlloc(&commandArena, sizeof(int) * (numberOfNodes + 1));
+    int numberOfOrdered = 0;
+    for (int i = 0; i < numberOfNodes; i++) {
+        waitingOn[i] = nodes[i].numberOfDependencies;
+        if (waitingOn[i] == 0) {
+            order[numberOfOrdered] = i;
+            numberOfOrdered++;
+        }
+    }
+    for (int n = 0; n < numberOfOrdered; n++) {
+        struct dagNode *node = &nodes[order[n]];
+        for (int i = 0; i < node->numberOfDependents; i++) {
+            waitingOn[node->dependents[i]]--;
+            if (waitingOn[node->dependents[i]] == 0) {
+                order[numberOfOrdered] = node->dependents[i];
+                numberOfOrdered++;
+            }
+        }
+    }
+    if (numberOfOrdered < numberOfNodes) {
+        for (int i = 0; i < numberOfNodes; i++) {
+            if (waitingOn[i] > 0) {
+                fprintf(stderr, "dag: %s: dependency cycle\n", nodes[i].label);
+                return false;
+            }
+        }
+    }
+    for (int n = numberOfOrdered - 1; n >= 0; n--) {
+        struct dagNode *node = &nodes[order[n]];
+        node->height = 1;
+        for (int i = 0; i < node->numberOfDependents; i++) {
+            if (nodes[node->dependents[i]].height + 1 > node->height) {
+                node->height = nodes[node->dependents[i]].height + 1;
+            }
+        }
+    }
+    return true;
+}
+
+static void startDagNode(struct dagNode *node, char **path, char **environment) {
+    fflush(stdout);
+    fflush(stderr);
+    node->startTime = getMonotonicTime();
+    pid_t pid = fork();
+    if (pid == 0) {
+        // The node's line runs exactly as if it were typed, but its status 
+        // goes into the report instead
+        isReportingStatus = false;
+        runCommandLine(node->commandLine, path, environment);
+        // The shell's atexit handlers are the dag's, not the node's
+        fflush(stdout);
+        _exit(lastExitStatus);
+    }
+    if (pid == -1) {
+        perror("fork");
+        node->endTime = node->startTime;
+        node->exitStatus = 127;
+        node->state = DAG_FAILED;
+        return;
+    }
+    node->pid = pid;
+    node->pidFD = syscall(SYS_pidfd_open, pid, 0);
+    node->state = DAG_RUNNING;
+}
+
+static int skipDagDependents(struct dagNode *nodes, int index) {
+    int numberOfSkipped = 0;
+    struct dagNode *node = &nodes[index];
+    for (int i = 0; i < node->numberOfDependents; i++) {
+        struct dagNode *dependent = &nodes[node->dependents[i]];
+        if (dependent->state == DAG_WAITING) {
+            dependent->state = DAG_SKIPPED;
+            numberOfSkipped++;
+            numberOfSkipped += skipDagDependents(nodes, node->dependents[i]);
+        }
+    }
+    return numberOfSkipped;
+}
+
+static void printDagReport(struct dagNode *nodes, int numberOfNodes, double seconds, int jobs) {
+    int numberOfSucceeded = 0;
+    int numberOfFailed = 0;
+    int numberOfSkipped = 0;
+    double startTime = getMonotonicTime() - seconds;
+    printf("%-20s %8s %10s %10s\n", "node", "status", "start", "time");
+    for (int i = 0; i < numberOfNodes; i++) {
+        struct dagNode *node = &nodes[i];
+        if (node->state == DAG_SUCCEEDED || node->state == DAG_FAILED) {
+            printf("%-20s %8d %9.3fs %9.3fs\n", node->label, node->exitStatus, 
+                   node->startTime - startTime, node->endTime - node->startTime);
+        } else {
+            printf("%-20s %8s\n", node->label, "skipped");
+        }
+        if (node->state == DAG_SUCCEEDED) {
+            numberOfSucceeded++;
+        } else if (node->state == DAG_FAILED) {
+            numberOfFailed++;
+        } else {
+            numberOfSkipped++;
+        }
+    }
+    // The critical path is the chain of nodes that took longest, ending at
+    // the node whose chain finished last
+    int last = -1;
+    for (int i = 0; i < numberOfNodes; i++) {
+        if ((nodes[i].state == DAG_SUCCEEDED || nodes[i].state == DAG_FAILED) &&
+            (last == -1 || nodes[i].pathTime > nodes[last].pathTime)) {
+            last = i;
+        }
+    }
+    if (last != -1) {
+        int *chain = arenaAlloc(&commandArena, sizeof(int) * (numberOfNodes + 1));
+        int chainLength = 0;
+        for (int i = last; i != -1; i = nodes[i].pathPrevious) {
+            chain[chainLength] = i;
+            chainLength++;
+        }
+        printf("critical path %.3fs:", nodes[last].pathTime);
+        for (int i = chainLength - 1; i >= 0; i--) {
+            printf(" %s%s", nodes[chain[i]].label, (i > 0) ? " ->" : "");
+        }
+        printf("\n");
+    }
+    printf("dag took %.3fs with %d jobs: %d succeeded, %d failed, %d skipped\n", 
+           seconds, jobs, numberOfSucceeded, numberOfFailed, numberOfSkipped);
+    lastExitStatus = (numberOfFailed + numberOfSkipped > 0) ? 1 : 0;
+}
+
+// ===================== SUBSET 14 =====================
+
+static void memo(char **words, char **path, char **environment) {
+    int argc = getWordCount(words);
+    char **inputs = arenaAlloc(&commandArena, sizeof(char *) * (argc + 1));
+    int numberOfInputs = 0;
+    char **variables = arenaAlloc(&commandArena, sizeof(char *) * (argc + 1));
+    int numberOfVariables = 0;
+    bool byContent = false;
+    int start = 1;
+    while (start < argc && strncmp(words[start], "--", 2) == 0) {
+        if (strcmp(words[start], "--") == 0) {
+            start++;
+            break;
+        } else if (strcmp(words[start], "--content") == 0) {
+            byContent = true;
+            start++;
+        } else if (strcmp(words[start], "--env") == 0 && start + 1 < argc) {
+            variables[numberOfVariables] = words[start + 1];
+            numberOfVariables++;
+            start += 2;
+        } else if (strcmp(words[start], "--inputs") == 0) {
+            // The inputs run up to the "--" before the command
+            int end = start + 1;
+            while (end < argc && strcmp(words[end], "--") != 0) {
+                inputs[numberOfInputs] = words[end];
+                numberOfInputs++;
+                end++;
+            }
+            if (end == argc) {
+                fprintf(stderr, "%s: --inputs must be followed by -- and the command\n", words[0]);
+                lastExitStatus = 2;
+                return;
+            }
+            start = end + 1;
+            break;
+        } else {
+            fprintf(stderr, "%s: %s: unknown option\n", words[0], words[start]);
+            lastExitStatus = 2;
+            return;
+        }
+    }
+    char **commandWords = &words[start];
+    if (commandWords[0] == NULL) {
+        fprintf(stderr, "usage: %s [--content] [--env VAR]... [--inputs FILE... --] command ...\n", words[0]);
+        lastExitStatus = 2;
+        return;
+    }
+    if (isBuiltinName(commandWords[0]) || strcmp(commandWords[0], "exit") == 0) {
+        fprintf(stderr, "%s: %s: only programs can be memoized\n", words[0], commandWords[0]);
+        lastExitStatus = 2;
+        return;
+    }
+    char *programPath = getPathToProgram(commandWords[0], path);
+    if (programPath == NULL || is_executable(programPath) == false) {
+        executionError(commandWords, programPath);
+        return;
+    }
+    // Half a path leaves room for the names of everything under it
+    char directory[PATH_MAX / 2];
+    if (getMemoDirectory(directory, sizeof(directory)) == false) {
+        return;
+    }
+
+    // The key covers everything the output is assumed to depend on. A new 
+    // build of the program changes its inode or mtime, so it counts too
+    struct sha256 hash;
+    sha256Init(&hash);
+    hashMemoField(&hash, "version", "1", 1);
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) != NULL) {
+        hashMemoField(&hash, "cwd", cwd, strlen(cwd));
+    }
+    hashMemoInput(&hash, programPath, false);
+    for (int i = 0; commandWords[i] != NULL; i++) {
+        hashMemoField(&hash, "argument", commandWords[i], strlen(commandWords[i]));
+    }
+    for (int i = 0; i < numberOfVariables; i++) {
+        char *value = getenv(variables[i]);
+        hashMemoField(&hash, "variable", variables[i], strlen(variables[i]));
+        if (value != NULL) {
+            hashMemoField(&hash, "value", value, strlen(value));
+        } else {
+            hashMemoField(&hash, "unset", "", 0);
+        }
+    }
+    for (int i = 0; i < numberOfInputs; i++) {
+        hashMemoInput(&hash, inputs[i], byContent);
+    }
+    char key[65];
+    sha256Final(&hash, key);
+
+    if (replayMemo(directory, key, programPath) == false) {
+        runMemoized(directory, key, programPath, commandWords, environment);
+        evictMemoStore(directory);
+    }
+}
+
+static bool getMemoDirectory(char *directory, size_t size) {
+    char *cacheHome = getenv("XDG_CACHE_HOME");
+    char *home = getenv("HOME");
+    int length;
+    if (cacheHome != NULL && cacheHome[0] != '\0') {
+        length = snprintf(directory, size, "%s/nautilus/memo", cacheHome);
+    } else if (home != NULL) {
+        length = snprintf(directory, size, "%s/.cache/nautilus/memo", home);
+    } else {
+        fprintf(stderr, "memo: neither XDG_CACHE_HOME nor HOME is set\n");
+        return false;
+    }
+    if ((size_t) length >= size) {
+        fprintf(stderr, "memo: cache directory path too long\n");
+        return false;
+    }
+    char subdirectory[PATH_MAX];
+    snprintf(subdirectory, sizeof(subdirectory), "%s/actions", directory);
+    bool isMade = makeDirectories(subdirectory);
+    snprintf(subdirectory, sizeof(subdirectory), "%s/blobs", directory);
+    isMade = isMade && makeDirectories(subdirectory);
+    if (isMade == false) {
+        perror(directory);
+    }
+    return isMade;
+}
+
+static bool makeDirectories(char *directoryPath) {
+    char partial[PATH_MAX];
+    snprintf(partial, sizeof(partial), "%s", directoryPath);
+    for (char *slash = strchr(partial + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        *slash = '\0';
+        if (mkdir(partial, 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+        *slash = '/';
+    }
+    return mkdir(partial, 0755) == 0 || errno == EEXIST;
+}
+
+static void hashMemoField(struct sha256 *hash, char *name, void *data, size_t length) {
+    uint64_t fieldLength = length;
+    sha256Update(hash, name, strlen(name) + 1);
+    sha256Update(hash, &fieldLength, sizeof(fieldLength));
+    sha256Update(hash, data, length);
+}
+
+static void hashMemoInput(struct sha256 *hash, char *fileName, bool byContent) {
+    hashMemoField(hash, "input", fileName, strlen(fileName));
+    struct stat s;
+    int fd = open(fileName, O_RDONLY | O_CLOEXEC);
+    if (fd == -1 || fstat(fd, &s) != 0) {
+        hashMemoField(hash, "missing", "", 0);
+        if (fd != -1) {
+            close(fd);
+        }
+        return;
+    }
+    if (byContent && S_ISREG(s.st_mode)) {
+        struct sha256 contents;
+        sha256Init(&contents);
+        char buffer[MEMO_COPY_SIZE];
+        ssize_t bytesRead;
+        while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0) {
+            sha256Update(&contents, buffer, bytesRead);
+        }
+        char digest[65];
+        sha256Final(&contents, digest);
+        hashMemoField(hash, "contents", digest, 64);
+    } else {
+        // The inode, size and both times change whenever the file is 
+        // replaced or written, without reading it
+        uint64_t identity[6] = {
+            s.st_dev, s.st_ino, s.st_size, 
+            s.st_mtim.tv_sec * 1000000000ULL + s.st_mtim.tv_nsec,
+            s.st_ctim.tv_sec * 1000000000ULL + s.st_ctim.tv_nsec,
+            s.st_mode
+        };
+        hashMemoField(hash, "identity", identity, sizeof(identity));
+    }
+    close(fd);
+}
+
+static bool replayMemo(char *directory, char *key, char *programPath) {
+    char actionPath[PATH_MAX];
+    snprintf(actionPath, sizeof(actionPath), "%s/actions/%s", directory, key);
+    FILE *action = fopen(actionPath, "r");
+    if (action == NULL) {
+        return false;
+    }
+    int exitStatus;
+    char blobs[2][65];
+    unsigned long long sizes[2];
+    bool isValid = (fscanf(action, "%d %64s %llu %64s %llu", &exitStatus, 
+                           blobs[0], &sizes[0], blobs[1], &sizes[1]) == 5);
+    // Open both outputs before writing either, so a half evicted action is
+    // run again rather than half replayed
+    int blobFDs[2] = {-1, -1};
+    for (int i = 0; i < 2 && isValid; i++) {
+        char blobPath[PATH_MAX];
+        snprintf(blobPath, sizeof(blobPath), "%s/blobs/%s", directory, blobs[i]);
+        blobFDs[i] = open(blobPath, O_RDONLY | O_CLOEXEC);
+        struct stat s;
+        if (blobFDs[i] == -1 || fstat(blobFDs[i], &s) != 0 || (unsigned long long) s.st_size != sizes[i]) {
+            isValid = false;
+        }
+    }
+    if (isValid) {
+        // Touching the action keeps it from being evicted first
+        futimens(fileno(action), NULL);
+        fflush(stdout);
+        fflush(stderr);
+        sigset_t pipeSignal;
+        sigset_t oldMask;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+        for (int i = 0; i < 2; i++) {
+            off_t offset = 0;
+            while (offset < (off_t) sizes[i]) {
+                ssize_t sent = sendfile(i + 1, blobFDs[i], &offset, sizes[i] - offset);
+                if (sent > 0) {
+                    continue;
+                }
+                // Not every output can be sent to directly, so copy the rest
+                char buffer[MEMO_COPY_SIZE];
+                ssize_t bytesRead = pread(blobFDs[i], buffer, sizeof(buffer), offset);
+                if (bytesRead <= 0 || writeAll(i + 1, buffer, bytesRead) == false) {
+                    break;
+                }
+                offset += bytesRead;
+            }
+        }
+        // Throw away a SIGPIPE from a reader that went away before unblocking
+        struct timespec noWait = {0, 0};
+        while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+        sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (blobFDs[i] != -1) {
+            close(blobFDs[i]);
+        }
+    }
+    fclose(action);
+    if (isValid == false) {
+        unlink(actionPath);
+        return false;
+    }
+    reportExitStatus(programPath, exitStatus);
+    return true;
+}
+
+static void runMemoized(char *directory, char *key, char *programPath, 
+                        char **words, char **environment) {
+    struct memoOutput outputs[2];
+    int writeFDs[2];
+    for (int i = 0; i < 2; i++) {
+        int pipeFDs[2];
+        if (pipe2(pipeFDs, O_CLOEXEC) != 0) {
+            perror("pipe");
+            for (int j = 0; j < i; j++) {
+                close(outputs[j].pipeFD);
+                close(writeFDs[j]);
+            }
+            return;
+        }
+        // Only the shell's end is non-blocking, so it can drain whichever 
+        // pipe has something without stalling on the other
+        fcntl(pipeFDs[0], F_SETFL, O_NONBLOCK);
+        outputs[i].pipeFD = pipeFDs[0];
+        writeFDs[i] = pipeFDs[1];
+        outputs[i].echoFD = i + 1;
+        outputs[i].size = 0;
+        sha256Init(&outputs[i].hash);
+        snprintf(outputs[i].tempPath, sizeof(outputs[i].tempPath), "%s/blobs/.tmp-XXXXXX", directory);
+        outputs[i].fileFD = mkostemp(outputs[i].tempPath, O_CLOEXEC);
+        if (outputs[i].fileFD == -1) {
+            perror(outputs[i].tempPath);
+        }
+    }
+    struct spawnActions actions;
+    initSpawnActions(&actions);
+    addSpawnDup2(&actions, writeFDs[0], 1);
+    addSpawnDup2(&actions, writeFDs[1], 2);
+    pid_t pid;
+    int spawnResult = spawnProgram(&pid, programPath, &actions, words, environment);
+    close(writeFDs[0]);
+    close(writeFDs[1]);
+    bool isStored = (spawnResult == 0);
+    if (spawnResult != 0) {
+        perror("spawn:");
+    } else {
+        // Output is shown as it arrives. A reader of the shell's output 
+        // going away mustn't kill the shell, so hold off SIGPIPE meanwhile
+        sigset_t pipeSignal;
+        sigset_t oldMask;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+        fflush(stdout);
+        fflush(stderr);
+        int openPipes = 2;
+        while (openPipes > 0) {
+            struct pollfd pollFDs[3];
+            int polledOutputs[2];
+            int numberOfPollFDs = 0;
+            for (int i = 0; i < 2; i++) {
+                if (outputs[i].pipeFD != -1) {
+                    pollFDs[numberOfPollFDs] = (struct pollfd) {outputs[i].pipeFD, POLLIN, 0};
+                    polledOutputs[numberOfPollFDs] = i;
+                    numberOfPollFDs++;
+                }
+            }
+            int numberOfPipeFDs = numberOfPollFDs;
+            if (commandLimits.timerFD != -1) {
+                pollFDs[numberOfPollFDs] = (struct pollfd) {commandLimits.timerFD, POLLIN, 0};
+                numberOfPollFDs++;
+            }
+            if (poll(pollFDs, numberOfPollFDs, -1) == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("poll");
+                break;
+            }
+            if (numberOfPollFDs > numberOfPipeFDs && (pollFDs[numberOfPipeFDs].revents & POLLIN)) {
+                handleDeadline();
+            }
+            for (int i = 0; i < numberOfPipeFDs; i++) {
+                struct memoOutput *output = &outputs[polledOutputs[i]];
+                if (pollFDs[i].revents != 0 && pumpMemoOutput(output) == false) {
+                    close(output->pipeFD);
+                    output->pipeFD = -1;
+                    openPipes--;
+                }
+            }
+        }
+        int status;
+        if (waitForProgram(pid, &status) == -1) {
+            perror("waitpid");
+            isStored = false;
+        }
+        struct timespec noWait = {0, 0};
+        while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+        sigprocmask(SIG_SETMASK, &oldMask, NULL);
+        // A killed or timed out run says nothing about the command's output
+        if (isStored && (WIFEXITED(status) == false || commandLimits.timedOut)) {
+            isStored = false;
+        }
+        int exitStatus = getExitStatus(status);
+        for (int i = 0; i < 2; i++) {
+            if (isStored && outputs[i].fileFD != -1) {
+                isStored = storeMemoBlob(directory, &outputs[i]);
+            } else {
+                isStored = false;
+            }
+        }
+        if (isStored) {
+            char tempPath[PATH_MAX];
+            char actionPath[PATH_MAX];
+            snprintf(tempPath, sizeof(tempPath), "%s/actions/.tmp-XXXXXX", directory);
+            snprintf(actionPath, sizeof(actionPath), "%s/actions/%s", directory, key);
+            int actionFD = mkostemp(tempPath, O_CLOEXEC);
+            if (actionFD != -1) {
+                dprintf(actionFD, "%d %s %llu %s %llu\n", exitStatus, 
+                        outputs[0].digest, (unsigned long long) outputs[0].size,
+                        outputs[1].digest, (unsigned long long) outputs[1].size);
+                close(actionFD);
+                if (rename(tempPath, actionPath) != 0) {
+                    unlink(tempPath);
+                }
+            }
+        }
+        reportExitStatus(programPath, exitStatus);
+    }
+    for (int i = 0; i < 2; i++) {
+        if (outputs[i].pipeFD != -1) {
+            close(outputs[i].pipeFD);
+        }
+        if (outputs[i].fileFD != -1) {
+            close(outputs[i].fileFD);
+            unlink(outputs[i].tempPath);
+        }
+    }
+}
+
+static bool pumpMemoOutput(struct memoOutput *output) {
+    char buffer[MEMO_COPY_SIZE];
+    while (1) {
+        ssize_t bytesRead = read(output->pipeFD, buffer, sizeof(buffer));
+        if (bytesRead == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead == -1 && errno == EAGAIN) {
+            return true;
+        }
+        if (bytesRead <= 0) {
+            return false;
+        }
+        // Nobody reading the output doesn't stop it being stored
+        writeAll(output->echoFD, buffer, bytesRead);
+        if (output->fileFD != -1 && writeAll(output->fileFD, buffer, bytesRead) == false) {
+            perror(output->tempPath);
+            close(output->fileFD);
+            unlink(output->tempPath);
+            output->fileFD = -1;
+        }
+        sha256Update(&output->hash, buffer, bytesRead);
+        output->size += bytesRead;
+    }
+}
+
+static bool storeMemoBlob(char *directory, struct memoOutput *output) {
+    sha256Final(&output->hash, output->digest);
+    close(output->fileFD);
+    output->fileFD = -1;
+    // Output that is already stored is simply replaced by the same bytes
+    char blobPath[PATH_MAX];
+    snprintf(blobPath, sizeof(blobPath), "%s/blobs/%s", directory, output->digest);
+    if (rename(output->tempPath, blobPath) != 0) {
+        perror(blobPath);
+        unlink(output->tempPath);
+        return false;
+    }
+    return true;
+}
+
+static int compareMemoActions(const void *a, const void *b) {
+    const struct memoAction *first = a;
+    const struct memoAction *second = b;
+    if (first->mtime.tv_sec != second->mtime.tv_sec) {
+        return (first->mtime.tv_sec < second->mtime.tv_sec) ? -1 : 1;
+    }
+    if (first->mtime.tv_nsec != second->mtime.tv_nsec) {
+        return (first->mtime.tv_nsec < second->mtime.tv_nsec) ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compareDigests(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void evictMemoStore(char *directory) {
+    unsigned long long limit = MEMO_STORE_SIZE;
+    char *setting = getenv("NAUTILUS_MEMO_SIZE");
+    if (setting != NULL && parseSize(setting, &limit) == false) {
+        fprintf(stderr, "memo: NAUTILUS_MEMO_SIZE: invalid size '%s'\n", setting);
+        limit = MEMO_STORE_SIZE;
+    }
+    char blobsPath[PATH_MAX];
+    char actionsPath[PATH_MAX];
+    snprintf(blobsPath, sizeof(blobsPath), "%s/blobs", directory);
+    snprintf(actionsPath, sizeof(actionsPath), "%s/actions", directory);
+    DIR *blobs = opendir(blobsPath);
+    if (blobs == NULL) {
+        return;
+    }
+    unsigned long long total = 0;
+    struct dirent *entry;
+    while ((entry = readdir(blobs)) != NULL) {
+        struct stat s;
+        if (entry->d_name[0] != '.' && fstatat(dirfd(blobs), entry->d_name, &s, 0) == 0) {
+            total += s.st_size;
+        }
+    }
+    if (total <= limit) {
+        closedir(blobs);
+        return;
+    }
+    DIR *actions = opendir(actionsPath);
+    if (actions == NULL) {
+        closedir(blobs);
+        return;
+    }
+    int capacity = 64;
+    int numberOfActions = 0;
+    struct memoAction *list = arenaAlloc(&commandArena, sizeof(struct memoAction) * capacity);
+    while ((entry = readdir(actions)) != NULL) {
+        struct stat s;
+        if (entry->d_name[0] == '.' || strlen(entry->d_name) != 64 ||
+            fstatat(dirfd(actions), entry->d_name, &s, 0) != 0) {
+            continue;
+        }
+        if (numberOfActions == capacity) {
+            struct memoAction *moved = arenaAlloc(&commandArena, sizeof(struct memoAction) * capacity * 2);
+            memcpy(moved, list, sizeof(struct memoAction) * capacity);
+            list = moved;
+            capacity *= 2;
+        }
+        struct memoAction *action = &list[numberOfActions];
+        int actionFD = openat(dirfd(actions), entry->d_name, O_RDONLY | O_CLOEXEC);
+        FILE *file = (actionFD != -1) ? fdopen(actionFD, "r") : NULL;
+        int exitStatus;
+        unsigned long long sizes[2];
+        if (file != NULL && fscanf(file, "%d %64s %llu %64s %llu", &exitStatus, action->blobs[0], 
+                                   &sizes[0], action->blobs[1], &sizes[1]) == 5) {
+            strcpy(action->name, entry->d_name);
+            action->mtime = s.st_mtim;
+            action->size = sizes[0] + sizes[1];
+            numberOfActions++;
+        }
+        if (file != NULL) {
+            fclose(file);
+        } else if (actionFD != -1) {
+            close(actionFD);
+        }
+    }
+    // Drop the least recently used actions until the rest fit. Output shared
+    // by several actions is counted for each, so a little more may go
+    qsort(list, numberOfActions, sizeof(struct memoAction), compareMemoActions);
+    unsigned long long remaining = 0;
+    for (int i = 0; i < numberOfActions; i++) {
+        remaining += list[i].size;
+    }
+    int firstKept = 0;
+    while (firstKept < numberOfActions && remaining > limit) {
+        unlinkat(dirfd(actions), list[firstKept].name, 0);
+        remaining -= list[firstKept].size;
+        firstKept++;
+    }
+    closedir(actions);
+    // Then remove every output no remaining action refers to
+    int numberOfKept = numberOfActions - firstKept;
+    char **kept = arenaAlloc(&commandArena, sizeof(char *) * (numberOfKept * 2 + 1));
+    for (int i = 0; i < numberOfKept; i++) {
+        kept[i * 2] = list[firstKept + i].blobs[0];
+        kept[i * 2 + 1] = list[firstKept + i].blobs[1];
+    }
+    qsort(kept, numberOfKept * 2, sizeof(char *), compareDigests);
+    rewinddir(blobs);
+    while ((entry = readdir(blobs)) != NULL) {
+        char *name = entry->d_name;
+        if (name[0] != '.' && 
+            bsearch(&name, kept, numberOfKept * 2, sizeof(char *), compareDigests) == NULL) {
+            unlinkat(dirfd(blobs), name, 0);
+        }
+    }
+    closedir(blobs);
+}
+
+static bool parseSize(char *text, unsigned long long *size) {
+    char *unit;
+    unsigned long long amount = strtoull(text, &unit, 10);
+    if (unit == text) {
+        return false;
+    } else if (strcmp(unit, "K") == 0 || strcmp(unit, "k") == 0) {
+        amount *= 1024;
+    } else if (strcmp(unit, "M") == 0) {
+        amount *= 1024 * 1024;
+    } else if (strcmp(unit, "G") == 0) {
+        amount *= 1024 * 1024 * 1024;
+    } else if (strcmp(unit, "") != 0) {
+        return false;
+    }
+    *size = amount;
+    return true;
+}
+
+static bool writeAll(int fd, char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static const uint32_t sha256Constants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static void sha256Init(struct sha256 *hash) {
+    static const uint32_t initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(hash->state, initial, sizeof(initial));
+    hash->length = 0;
+    hash->bufferLength = 0;
+}
+
+static void sha256Update(struct sha256 *hash, void *data, size_t length) {
+    unsigned char *bytes = data;
+    hash->length += length;
+    if (hash->bufferLength > 0) {
+        size_t needed = 64 - hash->bufferLength;
+        size_t taken = (length < needed) ? length : needed;
+        memcpy(hash->buffer + hash->bufferLength, bytes, taken);
+        hash->bufferLength += taken;
+        bytes += taken;
+        length -= taken;
+        if (hash->bufferLength < 64) {
+            return;
+        }
+        sha256Block(hash, hash->buffer);
+        hash->bufferLength = 0;
+    }
+    while (length >= 64) {
+        sha256Block(hash, bytes);
+        bytes += 64;
+        length -= 64;
+    }
+    memcpy(hash->buffer, bytes, length);
+    hash->bufferLength = length;
+}
+
+static void sha256Final(struct sha256 *hash, char *digest) {
+    uint64_t bits = hash->length * 8;
+    unsigned char padding[72] = {0x80};
+    size_t paddingLength = (hash->bufferLength < 56) ? 56 - hash->bufferLength : 120 - hash->bufferLength;
+    for (int i = 0; i < 8; i++) {
+        padding[paddingLength + i] = (unsigned char) (bits >> (56 - i * 8));
+    }
+    sha256Update(hash, padding, paddingLength + 8);
+    for (int i = 0; i < 8; i++) {
+        sprintf(digest + i * 8, "%08x", hash->state[i]);
+    }
+}
+
+#define ROTATE_RIGHT(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256Block(struct sha256 *hash, unsigned char *block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = ((uint32_t) block[i * 4] << 24) | ((uint32_t) block[i * 4 + 1] << 16) | 
+               ((uint32_t) block[i * 4 + 2] << 8) | block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROTATE_RIGHT(w[i - 15], 7) ^ ROTATE_RIGHT(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROTATE_RIGHT(w[i - 2], 17) ^ ROTATE_RIGHT(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = hash->state[0], b = hash->state[1], c = hash->state[2], d = hash->state[3];
+    uint32_t e = hash->state[4], f = hash->state[5], g = hash->state[6], h = hash->state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t s1 = ROTATE_RIGHT(e, 6) ^ ROTATE_RIGHT(e, 11) ^ ROTATE_RIGHT(e, 25);
+        uint32_t choice = (e & f) ^ (~e & g);
+        uint32_t temp1 = h + s1 + choice + sha256Constants[i] + w[i];
+        uint32_t s0 = ROTATE_RIGHT(a, 2) ^ ROTATE_RIGHT(a, 13) ^ ROTATE_RIGHT(a, 22);
+        uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t temp2 = s0 + majority;
+        h = g;
+        g = f;
+        f = e;
+        e = d + temp1;
+        d = c;
+        c = b;
+        b = a;
+        a = temp1 + temp2;
+    }
+    hash->state[0] += a;
+    hash->state[1] += b;
+    hash->state[2] += c;
+    hash->state[3] += d;
+    hash->state[4] += e;
+    hash->state[5] += f;
+    hash->state[6] += g;
+    hash->state[7] += h;
+}
+
+// ===================== SUBSET 16 =====================
+
+static bool isProcessSubstitution(char *word) {
+    if ((word[0] != '<' && word[0] != '>') || word[1] != '(') {
+        return false;
+    }
+    char *closingParen = findClosingParen(word);
+    return closingParen != NULL && closingParen[1] == '\0';
+}
+
+static char **expandProcessSubstitutions(char **words, char **path, char **environment) {
+    for (int i = 0; words[i] != NULL; i++) {
+        if (isProcessSubstitution(words[i]) == false) {
+            continue;
+        }
+        bool isInput = (words[i][0] == '<');
+        char *commandLine = arenaStrndup(&commandArena, words[i] + 2, strlen(words[i]) - 3);
+        int pipeFDs[2];
+        if (pipe2(pipeFDs, O_CLOEXEC) != 0) {
+            perror("pipe");
+            continue;
+        }
+        // The command writes into <(...) and reads from >(...), leaving the
+        // other end to whatever is given the /dev/fd path
+        int shellFD = isInput ? pipeFDs[0] : pipeFDs[1];
+        int commandFD = isInput ? pipeFDs[1] : pipeFDs[0];
+        pid_t pid = forkCommandLine(commandLine, isInput ? -1 : commandFD, isInput ? commandFD : -1, 
+                                    pipeFDs, 2, path, environment);
+        close(commandFD);
+        if (pid == -1) {
+            close(shellFD);
+            continue;
+        }
+        // The programs of the command line inherit the shell's end
+        fcntl(shellFD, F_SETFD, 0);
+        processSubstitutions = realloc(processSubstitutions, 
+                                       sizeof(struct processSubstitution) * (numberOfProcessSubstitutions + 1));
+        processSubstitutions[numberOfProcessSubstitutions].pid = pid;
+        processSubstitutions[numberOfProcessSubstitutions].fd = shellFD;
+        numberOfProcessSubstitutions++;
+        char fdPath[32];
+        snprintf(fdPath, sizeof(fdPath), "/dev/fd/%d", shellFD);
+        words[i] = arenaStrndup(&commandArena, fdPath, strlen(fdPath));
+    }
+    return words;
+}
+
+static void finishProcessSubstitutions(void) {
+    // Closing the pipes first lets a >(...) see end-of-file, and stops a 
+    // <(...) whose output was never read in full
+    for (int i = 0; i < numberOfProcessSubstitutions; i++) {
+        close(processSubstitutions[i].fd);
+    }
+    for (int i = 0; i < numberOfProcessSubstitutions; i++) {
+        while (waitpid(processSubstitutions[i].pid, NULL, 0) == -1 && errno == EINTR);
+    }
+    numberOfProcessSubstitutions = 0;
+}
+
+static pid_t forkCommandLine(char *commandLine, int inputFD, int outputFD, 
+                             int *closedFDs, int numberOfClosedFDs, 
+                             char **path, char **environment) {
+    fflush(stdout);
+    fflush(stderr);
+    bool hasDeadline = (commandLimits.timeout > 0);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (hasDeadline) {
+            // Subset 9: the copy is killed along with the rest of the 
+            // command's process group, by the shell that forked it, so it 
+            // runs its line without a deadline of its own
+            if (commandLimits.processGroup == 0 || setpgid(0, commandLimits.processGroup) != 0) {
+                setpgid(0, 0);
+            }
+            if (commandLimits.timerFD != -1) {
+                close(commandLimits.timerFD);
+            }
+            memset(&commandLimits, 0, sizeof(commandLimits));
+            commandLimits.timerFD = -1;
+        }
+        if (inputFD != -1) {
+            dup2(inputFD, 0);
+        }
+        if (outputFD != -1) {
+            dup2(outputFD, 1);
+        }
+        // Holding on to another command's pipe would keep it from ever 
+        // seeing end-of-file
+        for (int i = 0; i < numberOfClosedFDs; i++) {
+            close(closedFDs[i]);
+        }
+        for (int i = 0; i < numberOfProcessSubstitutions; i++) {
+            close(processSubstitutions[i].fd);
+        }
+        numberOfProcessSubstitutions = 0;
+        // The line is part of one already in the history
+        isReportingStatus = false;
+        isWritingHistory = false;
+        runCommandLine(commandLine, path, environment);
+        // exit() would move the shared offset of a script being read on stdin
+        // back to where this copy's buffer had got to
+        fflush(stdout);
+        fflush(stderr);
+        _exit(lastExitStatus);
+    }
+    if (pid == -1) {
+        perror("fork");
+    } else if (hasDeadline) {
+        joinCommandGroup(pid);
+    }
+    return pid;
+}
+
+static bool isFanOutCommand(char **words) {
+    for (int i = 0; words[i] != NULL; i++) {
+        if (strcmp(words[i], "|+") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void executeFanOut(char **words, char **path, char **environment) {
+    // The producer is the first command line and every other is a consumer
+    int numberOfSides = 1;
+    for (int i = 0; words[i] != NULL; i++) {
+        if (strcmp(words[i], "|+") == 0) {
+            numberOfSides++;
+        }
+    }
+    char **commandLines = arenaAlloc(&commandArena, sizeof(char *) * numberOfSides);
+    char **remaining = words;
+    for (int i = 0; i < numberOfSides; i++) {
+        char **side = leftPartition(remaining, "|+");
+        remaining = rightPartition(remaining, "|+", false);
+        if (side[0] == NULL || (i < numberOfSides - 1 && remaining[0] == NULL)) {
+            fprintf(stderr, "invalid fan-out\n");
+            lastExitStatus = 2;
+            return;
+        }
+        char *commandLine = formString(side);
+        commandLines[i] = arenaStrndup(&commandArena, commandLine, strlen(commandLine));
+        free(commandLine);
+    }
+
+    // Every consumer has a pipe of its own, as tee(2) only duplicates 
+    // between pipes. pipeFDs[0] is the producer's
+    int numberOfPipes = numberOfSides;
+    int *pipeFDs = arenaAlloc(&commandArena, sizeof(int) * numberOfPipes * 2);
+    for (int i = 0; i < numberOfPipes; i++) {
+        if (pipe2(&pipeFDs[i * 2], O_CLOEXEC) != 0) {
+            perror("pipe");
+            for (int j = 0; j < i * 2; j++) {
+                close(pipeFDs[j]);
+            }
+            lastExitStatus = 1;
+            return;
+        }
+        growPipe(pipeFDs[i * 2 + 1], FANOUT_PIPE_SIZE);
+    }
+    pid_t *pids = arenaAlloc(&commandArena, sizeof(pid_t) * numberOfSides);
+    pids[0] = forkCommandLine(commandLines[0], -1, pipeFDs[1], pipeFDs, numberOfPipes * 2, path, environment);
+    for (int i = 1; i < numberOfSides; i++) {
+        pids[i] = forkCommandLine(commandLines[i], pipeFDs[i * 2], -1, pipeFDs, numberOfPipes * 2, 
+                                  path, environment);
+    }
+    // Only the shell's ends are left: the producer's read end and every 
+    // consumer's write end
+    close(pipeFDs[1]);
+    int *outputFDs = arenaAlloc(&commandArena, sizeof(int) * (numberOfSides - 1));
+    for (int i = 1; i < numberOfSides; i++) {
+        close(pipeFDs[i * 2]);
+        outputFDs[i - 1] = pipeFDs[i * 2 + 1];
+    }
+    teeFanOut(pipeFDs[0], outputFDs, numberOfSides - 1);
+    close(pipeFDs[0]);
+    for (int i = 0; i < numberOfSides - 1; i++) {
+        if (outputFDs[i] != -1) {
+            close(outputFDs[i]);
+        }
+    }
+
+    // The fan-out fails if any side of it does, with the first failure's 
+    // status
+    int failed = -1;
+    int failedStatus = 0;
+    for (int i = 0; i < numberOfSides; i++) {
+        int status;
+        if (pids[i] == -1) {
+            status = 127;
+        } else {
+            while (waitpid(pids[i], &status, 0) == -1 && errno == EINTR);
+            status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        }
+        if (status != 0 && failed == -1) {
+            failed = i;
+            failedStatus = status;
+        }
+    }
+    // The status is reported for the program at the end of that side, by 
+    // its path as for any other command
+    char **sideWords = tokenize(commandLines[failed == -1 ? numberOfSides - 1 : failed], 
+                                WORD_SEPARATORS, SPECIAL_CHARS);
+    int start = 0;
+    for (int i = 0; sideWords[i] != NULL; i++) {
+        if (strcmp(sideWords[i], "|") == 0) {
+            start = i + 1;
+        }
+    }
+    if (strcmp(sideWords[start], "<") == 0 && sideWords[start + 1] != NULL && sideWords[start + 2] != NULL) {
+        start += 2;
+    }
+    char *programPath = getPathToProgram(sideWords[start], path);
+    reportExitStatus((programPath != NULL) ? programPath : sideWords[start], failedStatus);
+}
+
+static void teeFanOut(int inputFD, int *outputFDs, int numberOfOutputs) {
+    // A consumer that exits early would raise SIGPIPE in the shell. It is 
+    // dropped from the fan-out instead
+    sigset_t pipeSignal;
+    sigset_t oldMask;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+
+    ssize_t *duplicated = malloc(sizeof(ssize_t) * numberOfOutputs);
+    char *buffer = NULL;
+    int openOutputs = numberOfOutputs;
+    bool isFinished = false;
+    while (isFinished == false && openOutputs > 0) {
+        int last = numberOfOutputs - 1;
+        while (outputFDs[last] == -1) {
+            last--;
+        }
+        // Duplicate the data waiting in the input onto every output but the
+        // last, which is then given the data itself. The first tee decides 
+        // how much is handled this round
+        ssize_t length = 0;
+        bool isPartial = false;
+        for (int i = 0; i < last && isFinished == false; i++) {
+            if (outputFDs[i] == -1) {
+                continue;
+            }
+            ssize_t bytes = tee(inputFD, outputFDs[i], (length > 0) ? length : FANOUT_PIPE_SIZE, 0);
+            if (bytes == -1 && errno == EINTR) {
+                i--;
+                continue;
+            }
+            if (bytes == -1) {
+                // The consumer has exited
+                close(outputFDs[i]);
+                outputFDs[i] = -1;
+                openOutputs--;
+                continue;
+            }
+            if (bytes == 0) {
+                isFinished = true;
+                break;
+            }
+            if (length == 0) {
+                length = bytes;
+            }
+            duplicated[i] = bytes;
+            if (bytes < length) {
+                // The consumer's pipe filled up part way through
+                isPartial = true;
+            }
+        }
+        if (isFinished) {
+            break;
+        }
+        if (isPartial == false) {
+            // Move exactly what the others were given into the last output,
+            // or as much as there is if it's the only one
+            ssize_t remaining = (length > 0) ? length : FANOUT_PIPE_SIZE;
+            bool isMeasuring = (length == 0);
+            while (remaining > 0) {
+                ssize_t bytes = splice(inputFD, NULL, outputFDs[last], NULL, remaining, SPLICE_F_MOVE);
+                if (bytes == -1 && errno == EINTR) {
+                    continue;
+                }
+                if (bytes == 0) {
+                    isFinished = true;
+                    break;
+                }
+                if (bytes == -1) {
+                    close(outputFDs[last]);
+                    outputFDs[last] = -1;
+                    openOutputs--;
+                    break;
+                }
+                remaining -= bytes;
+                if (isMeasuring) {
+                    break;
+                }
+            }
+            if (outputFDs[last] != -1 || remaining <= 0 || isMeasuring) {
+                continue;
+            }
+            // The last consumer exited, but the others already have copies 
+            // of the rest, so it still has to be taken out of the input
+            length = remaining;
+            last = -1;
+        }
+        // Fall back to copying this round through the shell, as the data 
+        // can only be duplicated from the start of the input pipe
+        if (buffer == NULL) {
+            buffer = malloc(FANOUT_PIPE_SIZE);
+        }
+        ssize_t bufferLength = 0;
+        while (bufferLength < length) {
+            ssize_t bytes = read(inputFD, buffer + bufferLength, length - bufferLength);
+            if (bytes == -1 && errno == EINTR) {
+                continue;
+            }
+            if (bytes <= 0) {
+                break;
+            }
+            bufferLength += bytes;
+        }
+        for (int i = 0; i <= last; i++) {
+            if (outputFDs[i] == -1) {
+                continue;
+            }
+            ssize_t alreadySent = (i < last) ? duplicated[i] : 0;
+            if (alreadySent < bufferLength && 
+                writeAll(outputFDs[i], buffer + alreadySent, bufferLength - alreadySent) == false) {
+                close(outputFDs[i]);
+                outputFDs[i] = -1;
+                openOutputs--;
+            }
+        }
+    }
+    free(buffer);
+    free(duplicated);
+
+    // Throw away a SIGPIPE raised by a closed consumer before unblocking it
+    struct timespec noWait = {0, 0};
+    while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+// ===================== SUBSET 17 =====================
+
+static void executeBuiltinRedirection(char **words, char **path, char **environment, int redirectOption) {
+    int argc = getWordCount(words);
+    char *fileName = words[argc - 1];
+    char **leftWords = leftPartition(words, ">");
+    if (isDirectory(fileName)) {
+        fprintf(stderr, "%s: Is a directory\n", fileName);
+        lastExitStatus = 1;
+        return;
+    }
+    struct outputSink sink;
+    if (openOutputSink(&sink, fileName, redirectOption) == false) {
+        perror(fileName);
+        lastExitStatus = 1;
+        return;
+    }
+    // Programs the builtin starts write to the file directly, while what the
+    // builtin prints itself goes through the sink
+    fflush(stdout);
+    int savedFD = fcntl(1, F_DUPFD_CLOEXEC, 10);
+    dup2(sink.fd, 1);
+    cookie_io_functions_t functions = {NULL, writeOutputSink, NULL, NULL};
+    FILE *sinkFile = fopencookie(&sink, "w", functions);
+    FILE *savedStdout = stdout;
+    if (sinkFile != NULL) {
+        // The sink's buffers are the only buffering needed
+        setvbuf(sinkFile, NULL, _IONBF, 0);
+        stdout = sinkFile;
+        activeSink = &sink;
+    }
+    execute_command(leftWords, path, environment);
+    if (sinkFile != NULL) {
+        fclose(sinkFile);
+        stdout = savedStdout;
+        activeSink = NULL;
+    }
+    if (closeOutputSink(&sink) == false) {
+        perror(fileName);
+        lastExitStatus = 1;
+    }
+    dup2(savedFD, 1);
+    close(savedFD);
+}
+
+static bool openOutputSink(struct outputSink *sink, char *fileName, int redirectOption) {
+    static bool isForkHandled = false;
+    if (isForkHandled == false) {
+        pthread_atfork(flushSinkBeforeFork, NULL, detachSinkAfterFork);
+        isForkHandled = true;
+    }
+    memset(sink, 0, sizeof(struct outputSink));
+    if (redirectOption == REDIR_APPEND) {
+        sink->fd = openAppendFile(fileName);
+        sink->isCached = true;
+    } else {
+        sink->fd = openRedirectionFile(fileName, REDIR_OUTPUT);
+    }
+    if (sink->fd == -1) {
+        return false;
+    }
+    // Space can be reserved ahead of the output, so a big file isn't grown
+    // in small pieces
+    char *preallocate = getenv("NAUTILUS_PREALLOCATE");
+    unsigned long long preallocateSize;
+    if (preallocate != NULL && parseSize(preallocate, &preallocateSize)) {
+        sink->preallocateSize = preallocateSize;
+        sink->start = lseek(sink->fd, 0, (redirectOption == REDIR_APPEND) ? SEEK_END : SEEK_CUR);
+    }
+    sink->buffers[0] = malloc(SINK_BUFFER_SIZE);
+    sink->buffers[1] = malloc(SINK_BUFFER_SIZE);
+    return true;
+}
+
+static bool closeOutputSink(struct outputSink *sink) {
+    submitOutputSink(sink);
+    waitForOutputSink(sink);
+    if (sink->preallocated > sink->written && sink->isCached == false) {
+        // Give back what was reserved but not used, which a file that is 
+        // appended to keeps for the next command
+        if (ftruncate(sink->fd, sink->start + sink->written) != 0 && sink->error == 0) {
+            sink->error = errno;
+        }
+    }
+    if (sink->isCached == false) {
+        close(sink->fd);
+    }
+    free(sink->buffers[0]);
+    free(sink->buffers[1]);
+    if (sink->error != 0) {
+        errno = sink->error;
+        return false;
+    }
+    return true;
+}
+
+static ssize_t writeOutputSink(void *cookie, const char *data, size_t size) {
+    struct outputSink *sink = cookie;
+    if (sink != activeSink) {
+        // This is a forked copy of the shell, and its stdout is the file
+        writeAll(1, (char *) data, size);
+        return size;
+    }
+    size_t remaining = size;
+    while (remaining > 0) {
+        size_t space = SINK_BUFFER_SIZE - sink->length;
+        size_t copied = (remaining < space) ? remaining : space;
+        memcpy(sink->buffers[sink->filling] + sink->length, data, copied);
+        sink->length += copied;
+        data += copied;
+        remaining -= copied;
+        if (sink->length == SINK_BUFFER_SIZE) {
+            submitOutputSink(sink);
+        }
+    }
+    return size;
+}
+
+static void submitOutputSink(struct outputSink *sink) {
+    if (sink->length == 0) {
+        return;
+    }
+    waitForOutputSink(sink);
+    char *data = sink->buffers[sink->filling];
+    size_t length = sink->length;
+    if (sink->preallocateSize > 0 && sink->written + (off_t) length > sink->preallocated) {
+        off_t size = sink->preallocateSize;
+        if (size < (off_t) length) {
+            size = length;
+        }
+        if (fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, sink->start + sink->written, size) == 0) {
+            sink->preallocated = sink->written + size;
+        } else {
+            // Not every filesystem can
+            sink->preallocateSize = 0;
+        }
+    }
+    sink->written += length;
+    sink->filling = 1 - sink->filling;
+    sink->length = 0;
+    if (isOutputRingUnavailable || (outputRing.fd == -1 && setupOutputRing() == false)) {
+        if (writeAtPosition(sink->fd, data, length) == false && sink->error == 0) {
+            sink->error = errno;
+        }
+        return;
+    }
+    // An offset of -1 writes at the file's position, so output from programs
+    // the builtin starts stays in order with the sink's
+    unsigned tail = *outputRing.sqTail;
+    unsigned index = tail & *outputRing.sqMask;
+    struct io_uring_sqe *sqe = &outputRing.sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = sink->fd;
+    sqe->addr = (uintptr_t) data;
+    sqe->len = length;
+    sqe->off = (uint64_t) -1;
+    outputRing.sqArray[index] = index;
+    __atomic_store_n(outputRing.sqTail, tail + 1, __ATOMIC_RELEASE);
+    int submitted;
+    do {
+        submitted = syscall(SYS_io_uring_enter, outputRing.fd, 1, 0, 0, NULL, 0);
+    } while (submitted == -1 && errno == EINTR);
+    if (submitted != 1) {
+        // Take the entry back and stop using the ring
+        __atomic_store_n(outputRing.sqTail, tail, __ATOMIC_RELEASE);
+        isOutputRingUnavailable = true;
+        if (writeAtPosition(sink->fd, data, length) == false && sink->error == 0) {
+            sink->error = errno;
+        }
+        return;
+    }
+    sink->isWriting = true;
+    sink->writingLength = length;
+}
+
+static void waitForOutputSink(struct outputSink *sink) {
+    if (sink->isWriting == false) {
+        return;
+    }
+    unsigned head = *outputRing.cqHead;
+    while (head == __atomic_load_n(outputRing.cqTail, __ATOMIC_ACQUIRE)) {
+        if (syscall(SYS_io_uring_enter, outputRing.fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) == -1 &&
+            errno != EINTR) {
+            sink->error = errno;
+            sink->isWriting = false;
+            return;
+        }
+    }
+    int result = outputRing.cqes[head & *outputRing.cqMask].res;
+    __atomic_store_n(outputRing.cqHead, head + 1, __ATOMIC_RELEASE);
+    sink->isWriting = false;
+    char *data = sink->buffers[1 - sink->filling];
+    if (result < 0) {
+        if (sink->error == 0) {
+            sink->error = -result;
+        }
+    } else if ((size_t) result < sink->writingLength) {
+        // Finish a short write without the ring
+        if (writeAtPosition(sink->fd, data + result, sink->writingLength - result) == false && 
+            sink->error == 0) {
+            sink->error = errno;
+        }
+    }
+}
+
+static bool writeAtPosition(int fd, char *data, size_t length) {
+    while (length > 0) {
+        struct iovec vector = {data, length};
+        ssize_t written = pwritev2(fd, &vector, 1, -1, 0);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+static bool setupOutputRing(void) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ringFD = syscall(SYS_io_uring_setup, SINK_RING_ENTRIES, &params);
+    // Writing at the file's position needs IORING_FEAT_RW_CUR_POS
+    unsigned features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_RW_CUR_POS;
+    if (ringFD == -1 || (params.features & features) != features) {
+        if (ringFD != -1) {
+            close(ringFD);
+        }
+        isOutputRingUnavailable = true;
+        return false;
+    }
+    size_t sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cqSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t ringSize = (sqSize > cqSize) ? sqSize : cqSize;
+    char *ring = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+                      ringFD, IORING_OFF_SQ_RING);
+    struct io_uring_sqe *sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), 
+                                     PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, 
+                                     ringFD, IORING_OFF_SQES);
+    if (ring == MAP_FAILED || sqes == MAP_FAILED) {
+        close(ringFD);
+        isOutputRingUnavailable = true;
+        return false;
+    }
+    fcntl(ringFD, F_SETFD, FD_CLOEXEC);
+    outputRing.fd = ringFD;
+    outputRing.sqHead = (unsigned *) (ring + params.sq_off.head);
+    outputRing.sqTail = (unsigned *) (ring + params.sq_off.tail);
+    outputRing.sqMask = (unsigned *) (ring + params.sq_off.ring_mask);
+    outputRing.sqArray = (unsigned *) (ring + params.sq_off.array);
+    outputRing.cqHead = (unsigned *) (ring + params.cq_off.head);
+    outputRing.cqTail = (unsigned *) (ring + params.cq_off.tail);
+    outputRing.cqMask = (unsigned *) (ring + params.cq_off.ring_mask);
+    outputRing.cqes = (struct io_uring_cqe *) (ring + params.cq_off.cqes);
+    outputRing.sqes = sqes;
+    return true;
+}
+
+static int openAppendFile(char *fileName) {
+    struct stat s;
+    bool exists = (stat(fileName, &s) == 0);
+    int leastRecent = 0;
+    appendFileUses++;
+    for (int i = 0; i < SINK_CACHE_SIZE; i++) {
+        struct cachedAppendFile *cached = &appendFileCache[i];
+        if (cached->fileName != NULL && strcmp(cached->fileName, fileName) == 0) {
+            // A file that was removed or replaced, say by log rotation, is 
+            // opened again
+            if (exists && cached->device == s.st_dev && cached->inode == s.st_ino) {
+                cached->lastUse = appendFileUses;
+                return cached->fd;
+            }
+            leastRecent = i;
+            break;
+        }
+        if (cached->lastUse < appendFileCache[leastRecent].lastUse) {
+            leastRecent = i;
+        }
+    }
+    int fd = openRedirectionFile(fileName, REDIR_APPEND);
+    if (fd == -1 || fstat(fd, &s) != 0) {
+        if (fd != -1) {
+            close(fd);
+        }
+        return -1;
+    }
+    struct cachedAppendFile *cached = &appendFileCache[leastRecent];
+    if (cached->fileName != NULL) {
+        close(cached->fd);
+        free(cached->fileName);
+    }
+    cached->fileName = strdup(fileName);
+    cached->fd = fd;
+    cached->device = s.st_dev;
+    cached->inode = s.st_ino;
+    cached->lastUse = appendFileUses;
+    return fd;
+}
+
+static void flushSinkBeforeFork(void) {
+    if (activeSink != NULL) {
+        submitOutputSink(activeSink);
+        waitForOutputSink(activeSink);
+    }
+}
+
+static void detachSinkAfterFork(void) {
+    activeSink = NULL;
+}
+
+// ===================== SUBSET 18 =====================
+
+static void stats(char **words) {
+    int argc = getWordCount(words);
+    if (argc > 2) {
+        fprintf(stderr, "%s: too many arguments\n", words[0]);
+        lastExitStatus = 2;
+        return;
+    }
+    if (argc == 2 && strcmp(words[1], "--json") == 0) {
+        printProgramStatsJson(stdout);
+        return;
+    }
+    if (argc == 2 && strcmp(words[1], "clear") == 0) {
+        free(runningPrograms);
+        runningPrograms = NULL;
+        numberOfRunningPrograms = 0;
+        for (int i = 0; i < numberOfProgramStats; i++) {
+            free(programStats[i].name);
+        }
+        free(programStats);
+        programStats = NULL;
+        numberOfProgramStats = 0;
+        return;
+    }
+    if (argc == 2) {
+        fprintf(stderr, "%s: %s: expected '--json' or 'clear'\n", words[0], words[1]);
+        lastExitStatus = 2;
+        return;
+    }
+    if (numberOfProgramStats == 0) {
+        printf("stats: no programs have been run yet\n");
+        return;
+    }
+    struct programStats **sorted = malloc(sizeof(struct programStats *) * numberOfProgramStats);
+    for (int i = 0; i < numberOfProgramStats; i++) {
+        sorted[i] = &programStats[i];
+    }
+    qsort(sorted, numberOfProgramStats, sizeof(struct programStats *), compareProgramStats);
+    printf("%-20s %6s %10s  %8s %8s %8s  %8s %8s %8s\n", "program", "runs", "total", 
+           "spawn50", "spawn99", "spawnmax", "run50", "run99", "runmax");
+    for (int i = 0; i < numberOfProgramStats; i++) {
+        struct programStats *program = sorted[i];
+        struct histogram *histograms[2] = {&program->spawn, &program->run};
+        char durations[6][16];
+        for (int n = 0; n < 2; n++) {
+            formatDuration(durations[n * 3], 16, getPercentile(histograms[n], 0.50));
+            formatDuration(durations[n * 3 + 1], 16, getPercentile(histograms[n], 0.99));
+            formatDuration(durations[n * 3 + 2], 16, histograms[n]->max);
+        }
+        printf("%-20s %6lu %9.3fs  %8s %8s %8s  %8s %8s %8s\n", program->name, 
+               program->invocations, program->wallSeconds, durations[0], durations[1], 
+               durations[2], durations[3], durations[4], durations[5]);
+    }
+    free(sorted);
+}
+
+static int getProgramStats(char *programPath) {
+    char *name = strrchr(programPath, '/');
+    name = (name == NULL) ? programPath : name + 1;
+    for (int i = 0; i < numberOfProgramStats; i++) {
+        if (strcmp(programStats[i].name, name) == 0) {
+            return i;
+        }
+    }
+    programStats = realloc(programStats, sizeof(struct programStats) * (numberOfProgramStats + 1));
+    struct programStats *program = &programStats[numberOfProgramStats];
+    memset(program, 0, sizeof(struct programStats));
+    program->name = strdup(name);
+    return numberOfProgramStats++;
+}
+
+static void recordProgramSpawn(pid_t pid, char *programPath, double startTime, double spawnedTime) {
+    int index = getProgramStats(programPath);
+    programStats[index].invocations++;
+    recordDuration(&programStats[index].spawn, (spawnedTime - startTime) * 1e6);
+    // Subset 30:
+    char *programName = strrchr(programPath, '/');
+    recordFlightEvent(FLIGHT_SPAWN, spawnedTime - startTime, pid, 0, (programName != NULL) ? programName + 1 : programPath);
+    runningPrograms = realloc(runningPrograms, sizeof(struct runningProgram) * (numberOfRunningPrograms + 1));
+    runningPrograms[numberOfRunningPrograms].pid = pid;
+    runningPrograms[numberOfRunningPrograms].statsIndex = index;
+    runningPrograms[numberOfRunningPrograms].startTime = startTime;
+    numberOfRunningPrograms++;
+}
+
+static void recordProgramExit(pid_t pid) {
+    for (int i = 0; i < numberOfRunningPrograms; i++) {
+        if (runningPrograms[i].pid != pid) {
+            continue;
+        }
+        double seconds = getMonotonicTime() - runningPrograms[i].startTime;
+        struct programStats *program = &programStats[runningPrograms[i].statsIndex];
+        program->wallSeconds += seconds;
+        recordDuration(&program->run, seconds * 1e6);
+        runningPrograms[i] = runningPrograms[numberOfRunningPrograms - 1];
+        numberOfRunningPrograms--;
+        return;
+    }
+}
+
+static void recordDuration(struct histogram *histogram, uint64_t microseconds) {
+    int bucket;
+    if (microseconds < HISTOGRAM_LINEAR_BUCKETS) {
+        bucket = microseconds;
+    } else {
+        // The top 6 bits of the duration pick the bucket within its doubling
+        int highestBit = 63 - __builtin_clzll(microseconds);
+        int shift = highestBit - 5;
+        bucket = HISTOGRAM_LINEAR_BUCKETS + (shift - 1) * HISTOGRAM_SUB_BUCKETS + 
+                 (microseconds >> shift) - HISTOGRAM_SUB_BUCKETS;
+        if (bucket >= HISTOGRAM_BUCKETS) {
+            bucket = HISTOGRAM_BUCKETS - 1;
+        }
+    }
+    histogram->counts[bucket]++;
+    histogram->total++;
+    if (microseconds > histogram->max) {
+        histogram->max = microseconds;
+    }
+}
+
+static uint64_t getBucketDuration(int bucket) {
+    if (bucket < HISTOGRAM_LINEAR_BUCKETS) {
+        return bucket;
+    }
+    int shift = (bucket - HISTOGRAM_LINEAR_BUCKETS) / HISTOGRAM_SUB_BUCKETS + 1;
+    uint64_t top = (bucket - HISTOGRAM_LINEAR_BUCKETS) % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+    return ((top + 1) << shift) - 1;
+}
+
+static uint64_t getPercentile(struct histogram *histogram, double fraction) {
+    if (histogram->total == 0) {
+        return 0;
+    }
+    uint64_t rank = fraction * histogram->total;
+    if (rank < fraction * histogram->total || rank == 0) {
+        rank++;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            uint64_t duration = getBucketDuration(i);
+            return (duration < histogram->max) ? duration : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+static void formatDuration(char *text, size_t size, uint64_t microseconds) {
+    if (microseconds < 1000) {
+        snprintf(text, size, "%luus", (unsigned long) microseconds);
+    } else if (microseconds < 1000000) {
+        snprintf(text, size, "%.1fms", microseconds / 1e3);
+    } else {
+        snprintf(text, size, "%.2fs", microseconds / 1e6);
+    }
+}
+
+static void printProgramStatsJson(FILE *file) {
+    fprintf(file, "{\"programs\": [");
+    for (int i = 0; i < numberOfProgramStats; i++) {
+        struct programStats *program = &programStats[i];
+        fprintf(file, "%s\n  {\"name\": \"", (i > 0) ? "," : "");
+        for (char *c = program->name; *c != '\0'; c++) {
+            if (*c == '"' || *c == '\\') {
+                fprintf(file, "\\%c", *c);
+            } else if ((unsigned char) *c < 0x20) {
+                fprintf(file, "\\u%04x", *c);
+            } else {
+                fputc(*c, file);
+            }
+        }
+        fprintf(file, "\", \"invocations\": %lu, \"wall_seconds\": %.6f,\n   \"spawn_us\": ", 
+                program->invocations, program->wallSeconds);
+        printHistogramJson(file, &program->spawn);
+        fprintf(file, ",\n   \"run_us\": ");
+        printHistogramJson(file, &program->run);
+        fprintf(file, "}");
+    }
+    fprintf(file, "\n]}\n");
+}
+
+static void printHistogramJson(FILE *file, struct histogram *histogram) {
+    // Buckets are given as [highest duration, count], so histograms from 
+    // many shells can be merged
+    fprintf(file, "{\"p50\": %lu, \"p99\": %lu, \"max\": %lu, \"buckets\": [", 
+            (unsigned long) getPercentile(histogram, 0.50), 
+            (unsigned long) getPercentile(histogram, 0.99), (unsigned long) histogram->max);
+    bool isFirst = true;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (histogram->counts[i] > 0) {
+            fprintf(file, "%s[%lu, %u]", isFirst ? "" : ", ", 
+                    (unsigned long) getBucketDuration(i), histogram->counts[i]);
+            isFirst = false;
+        }
+    }
+    fprintf(file, "]}");
+}
+
+static void dumpProgramStats(void) {
+    char *fileName = getenv("NAUTILUS_STATS_JSON");
+    if (fileName == NULL || getpid() != statsOwner) {
+        return;
+    }
+    FILE *file = fopen(fileName, "w");
+    if (file == NULL) {
+        perror(fileName);
+        return;
+    }
+    printProgramStatsJson(file);
+    fclose(file);
+}
+
+static int compareProgramStats(const void *a, const void *b) {
+    struct programStats *first = *(struct programStats **) a;
+    struct programStats *second = *(struct programStats **) b;
+    if (first->wallSeconds != second->wallSeconds) {
+        return (first->wallSeconds < second->wallSeconds) ? 1 : -1;
+    }
+    return strcmp(first->name, second->name);
+}
+
+// ===================== SUBSET 19 =====================
+
+static char **parseProcessSettings(char **words, struct processSettings *settings, 
+                                   struct processSettings *previous) {
+    memset(settings, 0, sizeof(struct processSettings));
+    int start = 0;
+    bool isValid = true;
+    while (words[start] != NULL && words[start][0] == '@' && isValid) {
+        char *word = words[start];
+        char *value = strchr(word, '=');
+        value = (value == NULL) ? "" : value + 1;
+        char *end;
+        if (strncmp(word, "@cpu=", 5) == 0) {
+            isValid = parseCPUs(word, value, settings, previous);
+        } else if (strncmp(word, "@nice=", 6) == 0) {
+            settings->nice = strtol(value, &end, 10);
+            settings->hasNice = true;
+            if (*value == '\0' || *end != '\0' || settings->nice < -20 || settings->nice > 19) {
+                fprintf(stderr, "%s: expected a niceness from -20 to 19\n", word);
+                isValid = false;
+            }
+        } else if (strncmp(word, "@io=", 4) == 0) {
+            // A class, with a level from 0 (highest) to 7 for the two that 
+            // have them
+            char *levelText = strchr(value, ':');
+            long level = 4;
+            size_t classLength = (levelText == NULL) ? strlen(value) : (size_t) (levelText - value);
+            if (levelText != NULL) {
+                level = strtol(levelText + 1, &end, 10);
+                if (levelText[1] == '\0' || *end != '\0' || level < 0 || level >= IOPRIO_BE_NR) {
+                    level = -1;
+                }
+            }
+            settings->hasIOPriority = true;
+            if (classLength == 4 && strncmp(value, "idle", 4) == 0 && levelText == NULL) {
+                settings->ioPriority = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+            } else if (classLength == 2 && strncmp(value, "be", 2) == 0 && level != -1) {
+                settings->ioPriority = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, level);
+            } else if (classLength == 2 && strncmp(value, "rt", 2) == 0 && level != -1) {
+                settings->ioPriority = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_RT, level);
+            } else {
+                fprintf(stderr, "%s: expected idle, be[:0-7] or rt[:0-7]\n", word);
+                isValid = false;
+            }
+        } else if (strncmp(word, "@par=", 5) == 0) {
+            // Subset 29:
+            isValid = parseCopies(word, value, settings);
+        } else {
+            fprintf(stderr, "%s: expected @cpu=, @nice=, @io= or @par=\n", word);
+            isValid = false;
+        }
+        start++;
+    }
+    if (start == 0) {
+        return words;
+    }
+    if (isValid && words[start] == NULL) {
+        fprintf(stderr, "%s: missing command\n", words[0]);
+        isValid = false;
+    }
+    int argc = getWordCount(words);
+    if (isValid == false) {
+        // Drop the whole command
+        start = argc;
+    }
+    int n = 0;
+    for (int i = start; i <= argc; i++, n++) {
+        words[n] = words[i];
+    }
+    words[n] = NULL;
+    return words;
+}
+
+static bool parseCPUs(char *word, char *value, struct processSettings *settings, 
+                      struct processSettings *previous) {
+    CPU_ZERO(&settings->cpus);
+    if (strcmp(value, "share") == 0) {
+        if (previous == NULL || previous->hasCPUs == false) {
+            fprintf(stderr, "%s: only follows a pipeline stage with @cpu=\n", word);
+            return false;
+        }
+        if (getCacheSharingCPUs(&previous->cpus, &settings->cpus) == false) {
+            fprintf(stderr, "%s: the CPU caches can't be read\n", word);
+            return false;
+        }
+    } else if (value[0] == '^') {
+        // Batch work can be kept off the CPUs latency-critical work uses
+        cpu_set_t excluded;
+        if (parseCPUList(value + 1, &excluded) == false) {
+            fprintf(stderr, "%s: invalid list of CPUs\n", word);
+            return false;
+        }
+        sched_getaffinity(0, sizeof(cpu_set_t), &settings->cpus);
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &excluded)) {
+                CPU_CLR(cpu, &settings->cpus);
+            }
+        }
+    } else if (parseCPUList(value, &settings->cpus) == false) {
+        fprintf(stderr, "%s: invalid list of CPUs\n", word);
+        return false;
+    } else {
+        long numberOfCPUs = sysconf(_SC_NPROCESSORS_CONF);
+        for (int cpu = numberOfCPUs; cpu > 0 && cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &settings->cpus)) {
+                fprintf(stderr, "%s: there is no CPU %d\n", word, cpu);
+                return false;
+            }
+        }
+    }
+    if (CPU_COUNT(&settings->cpus) == 0) {
+        fprintf(stderr, "%s: no CPUs left to run on\n", word);
+        return false;
+    }
+    settings->hasCPUs = true;
+    return true;
+}
+
+static bool parseCPUList(char *text, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    char *curr = text;
+    while (*curr != '\0' && *curr != '\n') {
+        char *end;
+        long first = strtol(curr, &end, 10);
+        long last = first;
+        if (end == curr) {
+            return false;
+        }
+        if (*end == '-') {
+            curr = end + 1;
+            last = strtol(curr, &end, 10);
+            if (end == curr) {
+                return false;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+        curr = end;
+        if (*curr == ',') {
+            curr++;
+        } else if (*curr != '\0' && *curr != '\n') {
+            return false;
+        }
+    }
+    return CPU_COUNT(cpus) > 0;
+}
+
+static bool getCacheSharingCPUs(cpu_set_t *cpus, cpu_set_t *sharing) {
+    int firstCPU = 0;
+    while (CPU_ISSET(firstCPU, cpus) == false) {
+        firstCPU++;
+    }
+    // The caches are listed from the closest out, so the first that reaches
+    // past the given CPUs is the one a producer and consumer share best
+    bool isFound = false;
+    for (int index = 0; ; index++) {
+        char fileName[PATH_MAX];
+        snprintf(fileName, sizeof(fileName), "/sys/devices/system/cpu/cpu%d/cache/index%d/type", 
+                 firstCPU, index);
+        FILE *file = fopen(fileName, "re");
+        if (file == NULL) {
+            break;
+        }
+        char type[32] = "";
+        bool isRead = (fgets(type, sizeof(type), file) != NULL);
+        fclose(file);
+        if (isRead == false || strncmp(type, "Instruction", 11) == 0) {
+            continue;
+        }
+        snprintf(fileName, sizeof(fileName), 
+                 "/sys/devices/system/cpu/cpu%d/cache/index%d/shared_cpu_list", firstCPU, index);
+        file = fopen(fileName, "re");
+        if (file == NULL) {
+            continue;
+        }
+        char list[4096];
+        cpu_set_t shared;
+        isRead = (fgets(list, sizeof(list), file) != NULL && parseCPUList(list, &shared));
+        fclose(file);
+        if (isRead == false) {
+            continue;
+        }
+        *sharing = shared;
+        isFound = true;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, cpus)) {
+                CPU_CLR(cpu, &shared);
+            }
+        }
+        if (CPU_COUNT(&shared) > 0) {
+            // Leave the given CPUs to the stage using them
+            *sharing = shared;
+            return true;
+        }
+    }
+    return isFound;
+}
+
+static bool needsSpawnSetup(void) {
+    struct processSettings *settings = &commandLimits.settings;
+    bool needsSetup = (settings->hasCPUs || settings->hasNice || settings->hasIOPriority);
+    for (int resource = 0; resource < RLIM_NLIMITS; resource++) {
+        needsSetup = needsSetup || commandLimits.isLimited[resource];
+    }
+    return needsSetup;
+}
+
+static int startProgram(pid_t *pid, char *programPath, struct spawnActions *actions, 
+                        pid_t processGroup, char **words, char **environment) {
+    if (needsSpawnSetup() == false) {
+        posix_spawn_file_actions_t fileActions;
+        posix_spawn_file_actions_init(&fileActions);
+        for (int i = 0; actions != NULL && i < 3; i++) {
+            if (actions->fds[i] != -1) {
+                posix_spawn_file_actions_adddup2(&fileActions, actions->fds[i], i);
+            }
+        }
+        posix_spawnattr_t attributes;
+        posix_spawnattr_init(&attributes);
+        if (processGroup != -1) {
+            posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP);
+            posix_spawnattr_setpgroup(&attributes, processGroup);
+        }
+        int spawnResult = posix_spawn(pid, programPath, &fileActions, &attributes, words, environment);
+        posix_spawnattr_destroy(&attributes);
+        posix_spawn_file_actions_destroy(&fileActions);
+        return spawnResult;
+    }
+
+    // posix_spawn can't run anything in the child before it executes, so 
+    // clone the shell the way it does and set the program up in the clone. 
+    // The shell is suspended until the clone executes the program or fails
+    static char stack[SPAWN_STACK_SIZE] __attribute__((aligned(16)));
+    // No signal is handled in the clone until it has no handlers to run
+    sigset_t allSignals;
+    sigset_t oldMask;
+    sigfillset(&allSignals);
+    sigprocmask(SIG_BLOCK, &allSignals, &oldMask);
+    struct spawnSetup setup = {programPath, actions, processGroup, words, environment, oldMask, 0, NULL};
+    pid_t child = clone(runSpawnSetup, stack + SPAWN_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &setup);
+    int cloneError = errno;
+    sigprocmask(SIG_SETMASK, &setup.signalMask, NULL);
+    if (child == -1) {
+        return cloneError;
+    }
+    if (setup.error != 0) {
+        waitpid(child, NULL, 0);
+        if (setup.failedStep != NULL) {
+            fprintf(stderr, "%s: %s\n", setup.failedStep, strerror(setup.error));
+        }
+        return setup.error;
+    }
+    *pid = child;
+    return 0;
+}
+
+static int runSpawnSetup(void *argument) {
+    // Only system calls are made here, as the shell's memory is shared
+    struct spawnSetup *setup = argument;
+    struct processSettings *settings = &commandLimits.settings;
+    if (setup->processGroup != -1 && setpgid(0, setup->processGroup) != 0) {
+        setup->error = errno;
+        _exit(127);
+    }
+    for (int i = 0; setup->actions != NULL && i < 3; i++) {
+        int fd = setup->actions->fds[i];
+        if (fd == i) {
+            fcntl(fd, F_SETFD, 0);
+        } else if (fd != -1) {
+            dup2(fd, i);
+        }
+    }
+    for (int resource = 0; resource < RLIM_NLIMITS; resource++) {
+        if (commandLimits.isLimited[resource] && 
+            setrlimit(resource, &commandLimits.limits[resource]) != 0) {
+            setup->failedStep = "limit";
+            setup->error = errno;
+            _exit(127);
+        }
+    }
+    if (settings->hasCPUs && sched_setaffinity(0, sizeof(cpu_set_t), &settings->cpus) != 0) {
+        setup->failedStep = "@cpu";
+        setup->error = errno;
+        _exit(127);
+    }
+    if (settings->hasNice && setpriority(PRIO_PROCESS, 0, settings->nice) != 0) {
+        setup->failedStep = "@nice";
+        setup->error = errno;
+        _exit(127);
+    }
+    if (settings->hasIOPriority && 
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, settings->ioPriority) != 0) {
+        setup->failedStep = "@io";
+        setup->error = errno;
+        _exit(127);
+    }
+    // The shell's handlers would run on the shell's memory, so they are 
+    // reset, as posix_spawn does, before any signal can be taken
+    for (int signal = 1; signal < NSIG; signal++) {
+        struct sigaction action;
+        if (sigaction(signal, NULL, &action) == 0 && 
+            action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+            action.sa_handler = SIG_DFL;
+            action.sa_flags = 0;
+            sigaction(signal, &action, NULL);
+        }
+    }
+    sigprocmask(SIG_SETMASK, &setup->signalMask, NULL);
+    execve(setup->programPath, setup->words, setup->environment);
+    setup->error = errno;
+    _exit(127);
+}
+
+// ===================== SUBSET 20 =====================
+
+static void watch(char **words, char **path, char **environment) {
+    int argc = getWordCount(words);
+    char **paths = arenaAlloc(&commandArena, sizeof(char *) * (argc + 2));
+    int numberOfPaths = 0;
+    int debounce = WATCH_DEBOUNCE_MS;
+    int start = 1;
+    while (start < argc && strncmp(words[start], "--", 2) == 0) {
+        if (strcmp(words[start], "--") == 0) {
+            start++;
+            break;
+        } else if (strcmp(words[start], "--debounce") == 0 && start + 1 < argc && isNumber(words[start + 1])) {
+            debounce = atoi(words[start + 1]);
+            start += 2;
+        } else if (strcmp(words[start], "--paths") == 0) {
+            // The paths run up to the "--" before the command
+            int end = start + 1;
+            while (end < argc && strcmp(words[end], "--") != 0) {
+                paths[numberOfPaths] = words[end];
+                numberOfPaths++;
+                end++;
+            }
+            if (end == argc || numberOfPaths == 0) {
+                fprintf(stderr, "%s: --paths must be followed by paths, -- and the command\n", words[0]);
+                lastExitStatus = 2;
+                return;
+            }
+            start = end + 1;
+            break;
+        } else {
+            fprintf(stderr, "%s: %s: unknown option\n", words[0], words[start]);
+            lastExitStatus = 2;
+            return;
+        }
+    }
+    char **commandWords = &words[start];
+    if (commandWords[0] == NULL) {
+        fprintf(stderr, "usage: %s [--debounce MS] [--paths PATH... --] command ...\n", words[0]);
+        lastExitStatus = 2;
+        return;
+    }
+    if (numberOfPaths == 0) {
+        paths[numberOfPaths] = ".";
+        numberOfPaths++;
+    }
+    paths[numberOfPaths] = NULL;
+    int inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFD == -1) {
+        perror(words[0]);
+        lastExitStatus = 1;
+        return;
+    }
+    struct watchedPath *watched;
+    int numberOfWatched = addWatchedPaths(inotifyFD, paths, &watched);
+    if (numberOfWatched == 0) {
+        close(inotifyFD);
+        lastExitStatus = 1;
+        return;
+    }
+
+    // SIGINT and SIGTERM end the watch rather than the shell. The command 
+    // gets the old mask back, so SIGINT still stops whatever it is running
+    sigset_t stopSignals;
+    sigset_t oldMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, &oldMask);
+    int signalFD = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    struct pollfd pollFDs[] = {{inotifyFD, POLLIN, 0}, {signalFD, POLLIN, 0}};
+    int watchFDs[] = {inotifyFD, signalFD};
+    char *commandLine = formString(commandWords);
+    int exitStatus = 0;
+    bool isWatching = true;
+    while (isWatching) {
+        exitStatus = runWatchedCommand(commandLine, &oldMask, watchFDs, 2, path, environment);
+        // Changes made while the command ran, such as by the command itself, 
+        // don't run it again
+        readWatchEvents(inotifyFD, watched, numberOfWatched);
+        // Nothing is checked until the kernel has a change to report
+        bool isChanged = false;
+        while (isWatching && isChanged == false) {
+            if (poll(pollFDs, 2, -1) == -1) {
+                isWatching = (errno == EINTR);
+                continue;
+            }
+            if (pollFDs[1].revents != 0) {
+                isWatching = false;
+                continue;
+            }
+            isChanged = readWatchEvents(inotifyFD, watched, numberOfWatched);
+            bool hasWatched = false;
+            for (int i = 0; i < numberOfWatched; i++) {
+                hasWatched = hasWatched || (watched[i].wd != -1);
+            }
+            if (hasWatched == false) {
+                fprintf(stderr, "%s: nothing is left to watch\n", words[0]);
+                isWatching = false;
+            }
+        }
+        // A burst of changes, such as a build writing many files, leads to 
+        // one run once it is over
+        while (isWatching && poll(pollFDs, 2, debounce) > 0) {
+            if (pollFDs[1].revents != 0) {
+                isWatching = false;
+            } else {
+                readWatchEvents(inotifyFD, watched, numberOfWatched);
+            }
+        }
+    }
+    // The signal that ended the watch is taken, so it isn't delivered once 
+    // the old mask is back
+    struct signalfd_siginfo signalInfo;
+    while (read(signalFD, &signalInfo, sizeof(signalInfo)) > 0);
+    close(signalFD);
+    close(inotifyFD);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    free(commandLine);
+    lastExitStatus = exitStatus;
+}
+
+static int addWatchedPaths(int inotifyFD, char **paths, struct watchedPath **watched) {
+    paths = expandWildcards(paths);
+    int numberOfPaths = getWordCount(paths);
+    *watched = arenaAlloc(&commandArena, sizeof(struct watchedPath) * numberOfPaths);
+    int numberOfWatched = 0;
+    for (int i = 0; i < numberOfPaths; i++) {
+        // Files are watched through their directory, so a file replaced by 
+        // renaming another over it, as editors do, is still seen. A pattern
+        // that matched nothing yet matches the files created later
+        char *directory = paths[i];
+        char *pattern = NULL;
+        if (isDirectory(paths[i]) == false) {
+            char *slash = strrchr(paths[i], '/');
+            if (slash == NULL) {
+                directory = ".";
+                pattern = paths[i];
+            } else {
+                size_t length = (slash == paths[i]) ? 1 : slash - paths[i];
+                directory = arenaStrndup(&commandArena, paths[i], length);
+                pattern = slash + 1;
+            }
+        }
+        int wd = inotify_add_watch(inotifyFD, directory, WATCH_EVENTS);
+        if (wd == -1) {
+            fprintf(stderr, "watch: %s: %s\n", directory, strerror(errno));
+            continue;
+        }
+        (*watched)[numberOfWatched].wd = wd;
+        (*watched)[numberOfWatched].pattern = pattern;
+        numberOfWatched++;
+    }
+    return numberOfWatched;
+}
+
+static bool readWatchEvents(int inotifyFD, struct watchedPath *watched, int numberOfWatched) {
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool isChanged = false;
+    ssize_t length;
+    while ((length = read(inotifyFD, buffer, sizeof(buffer))) > 0) {
+        char *curr = buffer;
+        while (curr < buffer + length) {
+            struct inotify_event *event = (struct inotify_event *) curr;
+            curr += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Too much changed to say what, so assume it matters
+                isChanged = true;
+                continue;
+            }
+            for (int i = 0; i < numberOfWatched; i++) {
+                if (watched[i].wd != event->wd) {
+                    continue;
+                }
+                if (event->mask & IN_IGNORED) {
+                    watched[i].wd = -1;
+                } else if (watched[i].pattern == NULL || 
+                           (event->len > 0 && fnmatch(watched[i].pattern, event->name, 0) == 0)) {
+                    isChanged = true;
+                }
+            }
+        }
+    }
+    return isChanged;
+}
+
+static int runWatchedCommand(char *commandLine, sigset_t *mask, int *closedFDs, 
+                             int numberOfClosedFDs, char **path, char **environment) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (int i = 0; i < numberOfClosedFDs; i++) {
+            close(closedFDs[i]);
+        }
+        sigprocmask(SIG_SETMASK, mask, NULL);
+        isWritingHistory = false;
+        runCommandLine(commandLine, path, environment);
+        fflush(stdout);
+        fflush(stderr);
+        _exit(lastExitStatus);
+    }
+    if (pid == -1) {
+        perror("fork");
+        return 127;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+    return getExitStatus(status);
+}
+
+// ===================== SUBSET 21 =====================
+
+static void openSessionRecord(void) {
+    char *fileName = getenv("NAUTILUS_RECORD");
+    if (fileName == NULL || fileName[0] == '\0') {
+        return;
+    }
+    sessionRecorder.fd = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (sessionRecorder.fd == -1) {
+        perror(fileName);
+        return;
+    }
+    struct stat s;
+    if (fstat(sessionRecorder.fd, &s) == 0 && s.st_size == 0) {
+        char header[] = "# start\tseconds\tprogram_seconds\tstatus\tcwd\tline\n";
+        writeAll(sessionRecorder.fd, header, strlen(header));
+    }
+}
+
+static void startRecordedLine(void) {
+    if (sessionRecorder.fd == -1) {
+        return;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    sessionRecorder.startTime = now.tv_sec + now.tv_nsec / 1e9;
+    sessionRecorder.monotonicStart = getMonotonicTime();
+    sessionRecorder.programSeconds = 0;
+    if (getcwd(sessionRecorder.cwd, sizeof(sessionRecorder.cwd)) == NULL) {
+        strcpy(sessionRecorder.cwd, "?");
+    }
+}
+
+static void finishRecordedLine(char *line) {
+    // Forked copies of the shell leave the recording to the shell itself
+    if (sessionRecorder.fd == -1 || getpid() != statsOwner) {
+        return;
+    }
+    size_t length = strcspn(line, "\n");
+    if (strspn(line, WORD_SEPARATORS) >= length) {
+        return;
+    }
+    double seconds = getMonotonicTime() - sessionRecorder.monotonicStart;
+    char *entry;
+    int entryLength = asprintf(&entry, "%.6f\t%.6f\t%.6f\t%d\t%s\t%.*s\n", sessionRecorder.startTime, 
+                               seconds, sessionRecorder.programSeconds, lastExitStatus, 
+                               sessionRecorder.cwd, (int) length, line);
+    if (entryLength == -1) {
+        return;
+    }
+    // Each line goes in with a single append, so shells can share a record
+    writeAll(sessionRecorder.fd, entry, entryLength);
+    free(entry);
+}
+
+// ===================== SUBSET 22 =====================
+
+static bool parseFilter(char **words, struct filter *filter) {
+    memset(filter, 0, sizeof(struct filter));
+    filter->name = words[0];
+    int argc = getWordCount(words);
+    int i = 1;
+    char *end;
+    if (strcmp(words[0], "wc") == 0) {
+        if (i == argc || strcmp(words[i], "-l") != 0) {
+            return false;
+        }
+        filter->type = FILTER_COUNT_LINES;
+        i++;
+    } else if (strcmp(words[0], "grep") == 0) {
+        // Only fixed strings are searched for, so -F has to be given
+        bool isFixed = false;
+        while (i < argc && words[i][0] == '-' && words[i][1] != '\0') {
+            if (strcmp(words[i], "--") == 0) {
+                i++;
+                break;
+            }
+            for (char *c = words[i] + 1; *c != '\0'; c++) {
+                if (*c == 'F') {
+                    isFixed = true;
+                } else if (*c == 'v') {
+                    filter->isInverted = true;
+                } else if (*c == 'c') {
+                    filter->isCounting = true;
+                } else {
+                    return false;
+                }
+            }
+            i++;
+        }
+        if (isFixed == false || i == argc) {
+            return false;
+        }
+        filter->type = FILTER_MATCH;
+        filter->pattern = words[i];
+        filter->patternLength = strlen(words[i]);
+        i++;
+    } else if (strcmp(words[0], "head") == 0 || strcmp(words[0], "tail") == 0) {
+        filter->type = (words[0][0] == 'h') ? FILTER_HEAD : FILTER_TAIL;
+        filter->lines = 10;
+        char *count = NULL;
+        if (i + 1 < argc && strcmp(words[i], "-n") == 0) {
+            count = words[i + 1];
+            i += 2;
+        } else if (i < argc && strncmp(words[i], "-n", 2) == 0 && words[i][2] != '\0') {
+            count = words[i] + 2;
+            i++;
+        } else if (i < argc && words[i][0] == '-' && isdigit((unsigned char) words[i][1])) {
+            // The traditional -N
+            count = words[i] + 1;
+            i++;
+        }
+        if (count != NULL) {
+            filter->lines = strtol(count, &end, 10);
+            if (isdigit((unsigned char) count[0]) == false || *end != '\0') {
+                return false;
+            }
+        }
+    } else if (strcmp(words[0], "sort") == 0) {
+        // Subset 23:
+        if (isByteCollation() == false || parseSortOptions(words, &i, &filter->sort) == false) {
+            return false;
+        }
+        filter->type = FILTER_SORT;
+    } else if (strcmp(words[0], "cut") == 0) {
+        filter->type = FILTER_CUT;
+        filter->delimiter = '\t';
+        while (i < argc && words[i][0] == '-' && (words[i][1] == 'd' || words[i][1] == 'f')) {
+            // Values can be attached, as in -d, or given separately
+            char option = words[i][1];
+            char *value = words[i] + 2;
+            if (*value == '\0') {
+                if (i + 1 == argc) {
+                    return false;
+                }
+                i++;
+                value = words[i];
+            }
+            if (option == 'd') {
+                if (strlen(value) != 1) {
+                    return false;
+                }
+                filter->delimiter = value[0];
+            } else if (parseFieldList(value, filter) == false) {
+                return false;
+            }
+            i++;
+        }
+        if (filter->numberOfRanges == 0) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    if (i < argc) {
+        // Options the filter doesn't know are left to the program, but a
+        // lone - is stdin
+        if (words[i][0] == '-' && words[i][1] != '\0') {
+            return false;
+        }
+        filter->fileName = words[i];
+        i++;
+    }
+    return i == argc;
+}
+
+static bool isRunAsFilter(char **words, struct filter *filter) {
+    // Programs with a deadline or set up before they execute are left alone
+    bool hasDeadline = (commandLimits.timeout > 0);
+    return hasDeadline == false && needsSpawnSetup() == false && parseFilter(words, filter);
+}
+
+static bool parseFieldList(char *list, struct filter *filter) {
+    char *curr = list;
+    while (*curr != '\0') {
+        if (filter->numberOfRanges == FILTER_MAX_RANGES) {
+            return false;
+        }
+        // Fields are numbered from 1, and a range without an end runs on to
+        // the last field
+        char *end;
+        long first = 1;
+        long last;
+        if (*curr != '-') {
+            first = strtol(curr, &end, 10);
+            if (end == curr || first < 1) {
+                return false;
+            }
+            curr = end;
+        }
+        last = first;
+        if (*curr == '-') {
+            curr++;
+            last = LONG_MAX;
+            if (isdigit((unsigned char) *curr)) {
+                last = strtol(curr, &end, 10);
+                curr = end;
+            }
+            if (last < first) {
+                return false;
+            }
+        }
+        filter->ranges[filter->numberOfRanges][0] = first;
+        filter->ranges[filter->numberOfRanges][1] = last;
+        filter->numberOfRanges++;
+        if (*curr == ',') {
+            curr++;
+        } else if (*curr != '\0') {
+            return false;
+        }
+    }
+    return filter->numberOfRanges > 0;
+}
+
+static int startFilter(pid_t *pid, struct filter *filter, struct spawnActions *actions) {
+    int slot = 0;
+    while (slot < FILTER_MAX_THREADS && filterThreads[slot].isUsed) {
+        slot++;
+    }
+    if (slot == FILTER_MAX_THREADS) {
+        return EAGAIN;
+    }
+    initFilterKernels();
+    // The thread gets its own copies of the fds, as the caller closes its 
+    // own once the program has started. A ring stands in for the fd
+    struct filterThread *filterThread = &filterThreads[slot];
+    struct filterRing *rings[3] = {NULL, NULL, NULL};
+    if (actions != NULL) {
+        rings[0] = actions->rings[0];
+        rings[1] = actions->rings[1];
+    }
+    int fds[3];
+    bool isDuplicated = true;
+    for (int i = 0; i < 3; i++) {
+        int fd = (actions != NULL && actions->fds[i] != -1) ? actions->fds[i] : i;
+        fds[i] = (rings[i] == NULL) ? fcntl(fd, F_DUPFD_CLOEXEC, 3) : -1;
+        isDuplicated = isDuplicated && (fds[i] != -1 || rings[i] != NULL);
+    }
+    filterThread->doneFD = eventfd(0, EFD_CLOEXEC);
+    if (isDuplicated == false || filterThread->doneFD == -1) {
+        int error = errno;
+        for (int i = 0; i < 3; i++) {
+            if (fds[i] != -1) {
+                close(fds[i]);
+            }
+        }
+        if (filterThread->doneFD != -1) {
+            close(filterThread->doneFD);
+        }
+        return error;
+    }
+    filterThread->filter = *filter;
+    if (filter->pattern != NULL) {
+        filterThread->filter.pattern = strdup(filter->pattern);
+    }
+    if (filter->fileName != NULL) {
+        filterThread->filter.fileName = strdup(filter->fileName);
+    }
+    filterThread->inputFD = fds[0];
+    filterThread->outputFD = fds[1];
+    filterThread->errorFD = fds[2];
+    filterThread->inputRing = rings[0];
+    filterThread->outputRing = rings[1];
+    filterThread->isFinished = false;
+    filterThread->isUsed = true;
+    // Signals are left to the shell's own thread. A write to a closed pipe
+    // then only fails, rather than raising SIGPIPE in the shell
+    sigset_t allSignals;
+    sigset_t oldMask;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &oldMask);
+    int result = pthread_create(&filterThread->thread, NULL, runFilter, filterThread);
+    pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+    if (result != 0) {
+        for (int i = 0; i < 3; i++) {
+            if (fds[i] != -1) {
+                close(fds[i]);
+            }
+        }
+        close(filterThread->doneFD);
+        free(filterThread->filter.pattern);
+        free(filterThread->filter.fileName);
+        filterThread->isUsed = false;
+        return result;
+    }
+    // Handles count down from -2, so none is a pid or -1
+    *pid = -2 - slot;
+    return 0;
+}
+
+static bool isFilterHandle(pid_t pid) {
+    return pid <= -2 && pid > -2 - FILTER_MAX_THREADS;
+}
+
+static int openProgramFD(pid_t pid) {
+    if (isFilterHandle(pid)) {
+        return fcntl(filterThreads[-2 - pid].doneFD, F_DUPFD_CLOEXEC, 0);
+    }
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
+static pid_t reapProgram(pid_t pid, int *status, int options) {
+    if (isFilterHandle(pid) == false) {
+        pid_t reaped = waitpid(pid, status, options);
+        // Subset 30:
+        if (reaped == pid) {
+            recordFlightExit(pid, *status);
+        }
+        return reaped;
+    }
+    struct filterThread *filterThread = &filterThreads[-2 - pid];
+    if ((options & WNOHANG) && __atomic_load_n(&filterThread->isFinished, __ATOMIC_ACQUIRE) == false) {
+        return 0;
+    }
+    pthread_join(filterThread->thread, NULL);
+    *status = (filterThread->exitStatus & 0xff) << 8;
+    close(filterThread->doneFD);
+    free(filterThread->filter.pattern);
+    free(filterThread->filter.fileName);
+    filterThread->isUsed = false;
+    recordFlightExit(pid, *status);
+    return pid;
+}
+
+static void *runFilter(void *argument) {
+    struct filterThread *filterThread = argument;
+    struct filter *filter = &filterThread->filter;
+    struct filterOutput output;
+    initFilterOutput(&output, filterThread->outputFD, filterThread->outputRing);
+    struct filterInput input = {filterThread->inputFD, filterThread->inputRing, NULL, 0, 0};
+    int exitStatus = 0;
+    bool isOpen = true;
+    // A lone - names stdin, as it does for the tools
+    bool isFile = (filter->fileName != NULL && strcmp(filter->fileName, "-") != 0);
+    if (isFile) {
+        input.fd = open(filter->fileName, O_RDONLY | O_CLOEXEC);
+        input.ring = NULL;
+        // A directory opens, but reading it fails as it would for the tools
+        struct stat s;
+        if (input.fd != -1 && fstat(input.fd, &s) == 0 && S_ISDIR(s.st_mode)) {
+            close(input.fd);
+            input.fd = -1;
+            errno = EISDIR;
+        }
+        if (input.fd == -1) {
+            dprintf(filterThread->errorFD, "%s: %s: %s\n", filter->name, filter->fileName, strerror(errno));
+            exitStatus = (filter->type == FILTER_MATCH) ? 2 : 1;
+            isOpen = false;
+        }
+    }
+    if (isOpen) {
+        if (filter->type == FILTER_COUNT_LINES) {
+            exitStatus = countLines(filter, &input, &output);
+        } else if (filter->type == FILTER_MATCH) {
+            exitStatus = matchLines(filter, &input, &output);
+        } else if (filter->type == FILTER_HEAD) {
+            exitStatus = headLines(filter, &input, &output);
+        } else if (filter->type == FILTER_TAIL) {
+            exitStatus = tailLines(filter, &input, &output);
+        } else if (filter->type == FILTER_CUT) {
+            exitStatus = cutFields(filter, &input, &output);
+        } else {
+            exitStatus = sortLines(filter, &input, filterThread->errorFD, &output);
+        }
+        if (flushFilterOutput(&output) == false) {
+            // As a program killed by SIGPIPE would report
+            exitStatus = 128 + SIGPIPE;
+        }
+    }
+    if (isFile && input.fd != -1) {
+        close(input.fd);
+    }
+    freeFilterOutput(&output);
+    // Closing the ends of the pipes is what lets the stages either side 
+    // finish, so it happens before the shell is told
+    if (filterThread->inputRing != NULL) {
+        // Subset 26:
+        closeRingReader(filterThread->inputRing);
+    } else {
+        close(filterThread->inputFD);
+    }
+    if (filterThread->outputRing != NULL) {
+        closeRingWriter(filterThread->outputRing);
+    } else {
+        close(filterThread->outputFD);
+    }
+    close(filterThread->errorFD);
+    filterThread->exitStatus = exitStatus;
+    __atomic_store_n(&filterThread->isFinished, true, __ATOMIC_RELEASE);
+    uint64_t one = 1;
+    if (write(filterThread->doneFD, &one, sizeof(one)) == -1) {
+        perror("eventfd");
+    }
+    return NULL;
+}
+
+static int countLines(struct filter *filter, struct filterInput *input, struct filterOutput *output) {
+    char *buffer = malloc(FILTER_BUFFER_SIZE);
+    char *block;
+    size_t count = 0;
+    ssize_t length;
+    while ((length = readFilterBlock(input, buffer, FILTER_BUFFER_SIZE, &block)) != 0) {
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            break;
+        }
+        count += filterKernels.countNewlines(block, length);
+    }
+    free(buffer);
+    char text[PATH_MAX + 32];
+    int textLength;
+    if (filter->fileName != NULL) {
+        textLength = snprintf(text, sizeof(text), "%zu %s\n", count, filter->fileName);
+    } else {
+        textLength = snprintf(text, sizeof(text), "%zu\n", count);
+    }
+    writeFilterOutput(output, text, (textLength < (int) sizeof(text)) ? textLength : (int) sizeof(text) - 1);
+    return (length == -1) ? 1 : 0;
+}
+
+static int matchLines(struct filter *filter, struct filterInput *input, struct filterOutput *output) {
+    struct lineReader reader = {input, malloc(FILTER_BUFFER_SIZE), FILTER_BUFFER_SIZE, 0, 0, false};
+    char *block;
+    ssize_t length = 0;
+    size_t numberOfSelected = 0;
+    bool isWriting = (filter->isCounting == false);
+    while (output->isBroken == false && (length = readLineBlock(&reader, &block)) > 0) {
+        // Each match is found across the whole block, then widened to its 
+        // line, so lines without one are never looked at one by one
+        bool hasNewline = (block[length - 1] == '\n');
+        char *curr = block;
+        char *blockEnd = block + length;
+        while (curr < blockEnd) {
+            const char *match = filterKernels.findSubstring(curr, blockEnd - curr, filter->pattern, 
+                                                            filter->patternLength);
+            char *lineStart = blockEnd;
+            char *lineEnd = blockEnd;
+            if (match != NULL) {
+                char *newline = memrchr(curr, '\n', match - curr);
+                lineStart = (newline != NULL) ? newline + 1 : curr;
+                newline = memchr(match, '\n', blockEnd - match);
+                lineEnd = (newline != NULL) ? newline + 1 : blockEnd;
+            }
+            if (filter->isInverted) {
+                // Everything up to the matching line is selected
+                size_t skipped = filterKernels.countNewlines(curr, lineStart - curr);
+                if (lineStart == blockEnd && hasNewline == false && lineStart > curr) {
+                    skipped++;
+                }
+                numberOfSelected += skipped;
+                if (isWriting && lineStart > curr) {
+                    writeFilterOutput(output, curr, lineStart - curr);
+                    if (lineStart == blockEnd && hasNewline == false) {
+                        writeFilterOutput(output, "\n", 1);
+                    }
+                }
+            } else if (match != NULL) {
+                numberOfSelected++;
+                if (isWriting) {
+                    writeFilterOutput(output, lineStart, lineEnd - lineStart);
+                    if (lineEnd[-1] != '\n') {
+                        writeFilterOutput(output, "\n", 1);
+                    }
+                }
+            }
+            curr = lineEnd;
+        }
+    }
+    free(reader.buffer);
+    if (length == -1) {
+        return 2;
+    }
+    if (filter->isCounting) {
+        char text[32];
+        int textLength = snprintf(text, sizeof(text), "%zu\n", numberOfSelected);
+        writeFilterOutput(output, text, textLength);
+    }
+    return (numberOfSelected > 0) ? 0 : 1;
+}
+
+static int headLines(struct filter *filter, struct filterInput *input, struct filterOutput *output) {
+    char *buffer = malloc(FILTER_BUFFER_SIZE);
+    char *block;
+    long remaining = filter->lines;
+    ssize_t length = 0;
+    while (remaining > 0 && output->isBroken == false) {
+        length = readFilterBlock(input, buffer, FILTER_BUFFER_SIZE, &block);
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length <= 0) {
+            break;
+        }
+        // Whole blocks are counted at once until the last line is in one
+        size_t count = filterKernels.countNewlines(block, length);
+        if (count < (size_t) remaining) {
+            writeFilterOutput(output, block, length);
+            remaining -= count;
+            continue;
+        }
+        char *end = block;
+        while (remaining > 0) {
+            end = (char *) memchr(end, '\n', block + length - end) + 1;
+            remaining--;
+        }
+        writeFilterOutput(output, block, end - block);
+    }
+    // The rest of the input is left unread, so the stage before sees the 
+    // pipe close as it would for head
+    free(buffer);
+    return (length == -1) ? 1 : 0;
+}
+
+static int tailLines(struct filter *filter, struct filterInput *input, struct filterOutput *output) {
+    // A ring has no fd, so its input is always kept in memory
+    int inputFD = input->fd;
+    struct stat s;
+    off_t fileSize = (inputFD != -1 && fstat(inputFD, &s) == 0 && S_ISREG(s.st_mode)) ? s.st_size : -1;
+    if (fileSize > 0 && lseek(inputFD, 0, SEEK_CUR) == 0 && filter->lines > 0) {
+        // A file is read backwards from its end until enough lines are found,
+        // however big it is
+        char *buffer = malloc(FILTER_BUFFER_SIZE);
+        off_t start = fileSize;
+        long linesNeeded = filter->lines;
+        bool isStartFound = false;
+        char last;
+        bool skipsNewline = (pread(inputFD, &last, 1, fileSize - 1) == 1 && last == '\n');
+        while (start > 0 && isStartFound == false) {
+            off_t blockStart = (start > FILTER_BUFFER_SIZE) ? start - FILTER_BUFFER_SIZE : 0;
+            ssize_t length = pread(inputFD, buffer, start - blockStart, blockStart);
+            if (length != start - blockStart) {
+                break;
+            }
+            if (skipsNewline && start == fileSize) {
+                length--;
+            }
+            while (length > 0) {
+                char *newline = memrchr(buffer, '\n', length);
+                if (newline == NULL) {
+                    break;
+                }
+                length = newline - buffer;
+                linesNeeded--;
+                if (linesNeeded == 0) {
+                    blockStart += length + 1;
+                    isStartFound = true;
+                    break;
+                }
+            }
+            start = blockStart;
+        }
+        ssize_t length = 0;
+        while (output->isBroken && start < fileSize && 
+               (length = pread(inputFD, buffer, FILTER_BUFFER_SIZE, start)) > 0) {
+            start += length;
+        }
+        while (output->isBroken == false && start < fileSize &&
+               (length = pread(inputFD, buffer, FILTER_BUFFER_SIZE, start)) > 0) {
+            writeFilterOutput(output, buffer, length);
+            start += length;
+        }
+        free(buffer);
+        return (length == -1) ? 1 : 0;
+    }
+    // Anything else is kept in memory, cut back to the last lines whenever 
+    // it has doubled
+    size_t size = FILTER_BUFFER_SIZE;
+    char *buffer = malloc(size);
+    size_t used = 0;
+    size_t trimmedAt = size / 2;
+    ssize_t length;
+    while ((length = readFilterInput(input, buffer + used, size - used)) != 0) {
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            break;
+        }
+        used += length;
+        if (used >= trimmedAt * 2) {
+            size_t start = findTailStart(buffer, used, filter->lines);
+            memmove(buffer, buffer + start, used - start);
+            used -= start;
+            trimmedAt = (used > FILTER_BUFFER_SIZE / 2) ? used : FILTER_BUFFER_SIZE / 2;
+        }
+        if (used == size) {
+            size *= 2;
+            buffer = realloc(buffer, size);
+        }
+    }
+    size_t start = findTailStart(buffer, used, filter->lines);
+    writeFilterOutput(output, buffer + start, used - start);
+    free(buffer);
+    return (length == -1) ? 1 : 0;
+}
+
+static size_t findTailStart(const char *data, size_t length, long lines) {
+    if (lines == 0) {
+        return length;
+    }
+    // A last line without a newline still counts as a line
+    size_t end = (length > 0 && data[length - 1] == '\n') ? length - 1 : length;
+    while (end > 0) {
+        const char *newline = memrchr(data, '\n', end);
+        if (newline == NULL) {
+            return 0;
+        }
+        end = newline - data;
+        lines--;
+        if (lines == 0) {
+            return end + 1;
+        }
+    }
+    return 0;
+}
+
+static int cutFields(struct filter *filter, struct filterInput *input, struct filterOutput *output) {
+    struct lineReader reader = {input, malloc(FILTER_BUFFER_SIZE), FILTER_BUFFER_SIZE, 0, 0, false};
+    char *block;
+    ssize_t length = 0;
+    while (output->isBroken == false && (length = readLineBlock(&reader, &block)) > 0) {
+        char *lineStart = block;
+        char *blockEnd = block + length;
+        while (lineStart < blockEnd) {
+            char *newline = memchr(lineStart, '\n', blockEnd - lineStart);
+            char *lineEnd = (newline != NULL) ? newline : blockEnd;
+            if (memchr(lineStart, filter->delimiter, lineEnd - lineStart) == NULL) {
+                // A line without the delimiter is passed on whole, as cut does
+                writeFilterOutput(output, lineStart, lineEnd - lineStart);
+            } else {
+                bool isFirst = true;
+                long field = 1;
+                char *fieldStart = lineStart;
+                while (fieldStart <= lineEnd) {
+                    char *delimiter = memchr(fieldStart, filter->delimiter, lineEnd - fieldStart);
+                    char *fieldEnd = (delimiter != NULL) ? delimiter : lineEnd;
+                    bool isSelected = false;
+                    for (int i = 0; i < filter->numberOfRanges; i++) {
+                        if (field >= filter->ranges[i][0] && field <= filter->ranges[i][1]) {
+                            isSelected = true;
+                        }
+                    }
+                    if (isSelected) {
+                        if (isFirst == false) {
+                            writeFilterOutput(output, &filter->delimiter, 1);
+                        }
+                        writeFilterOutput(output, fieldStart, fieldEnd - fieldStart);
+                        isFirst = false;
+                    }
+                    fieldStart = fieldEnd + 1;
+                    field++;
+                }
+            }
+            writeFilterOutput(output, "\n", 1);
+            lineStart = lineEnd + 1;
+        }
+    }
+    free(reader.buffer);
+    return (length == -1) ? 1 : 0;
+}
+
+static ssize_t readLineBlock(struct lineReader *reader, char **block) {
+    if (reader->input->ring != NULL) {
+        // Subset 26:
+        return readRingLineBlock(reader, block);
+    }
+    // What followed the last block's final newline moves to the front
+    memmove(reader->buffer, reader->buffer + reader->consumed, reader->used - reader->consumed);
+    reader->used -= reader->consumed;
+    reader->consumed = 0;
+    while (reader->isEnded == false) {
+        ssize_t length = read(reader->input->fd, reader->buffer + reader->used, reader->size - reader->used);
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            return -1;
+        }
+        if (length == 0) {
+            // Whatever is left is the last line
+            reader->isEnded = true;
+            break;
+        }
+        char *newline = memrchr(reader->buffer + reader->used, '\n', length);
+        reader->used += length;
+        if (newline != NULL) {
+            reader->consumed = newline - reader->buffer + 1;
+            *block = reader->buffer;
+            return reader->consumed;
+        }
+        if (reader->used == reader->size) {
+            reader->size *= 2;
+            reader->buffer = realloc(reader->buffer, reader->size);
+        }
+    }
+    reader->consumed = reader->used;
+    *block = reader->buffer;
+    return reader->used;
+}
+
+static ssize_t readFilterInput(struct filterInput *input, char *buffer, size_t size) {
+    char *block;
+    ssize_t length = readFilterBlock(input, buffer, size, &block);
+    if (length > 0 && block != buffer) {
+        memcpy(buffer, block, length);
+    }
+    return length;
+}
+
+static ssize_t readFilterBlock(struct filterInput *input, char *buffer, size_t size, char **block) {
+    if (input->ring == NULL) {
+        *block = buffer;
+        return read(input->fd, buffer, size);
+    }
+    // Subset 26:
+    if (input->position == input->length && takeRingBlock(input) == 0) {
+        return 0;
+    }
+    size_t length = input->length - input->position;
+    if (length > size) {
+        length = size;
+    }
+    *block = input->block + input->position;
+    input->position += length;
+    return length;
+}
+
+static void initFilterOutput(struct filterOutput *output, int fd, struct filterRing *ring) {
+    output->fd = fd;
+    output->ring = ring;
+    // A ring's own buffers are written into, taken as they are needed
+    output->buffer = (ring == NULL) ? malloc(FILTER_BUFFER_SIZE) : NULL;
+    output->used = 0;
+    output->isBroken = false;
+}
+
+static void freeFilterOutput(struct filterOutput *output) {
+    if (output->ring == NULL) {
+        free(output->buffer);
+    }
+}
+
+static bool writeFilterOutput(struct filterOutput *output, const char *data, size_t length) {
+    if (output->isBroken) {
+        return false;
+    }
+    if (output->ring != NULL) {
+        // Subset 26: blocks are filled right up, and handed on as they fill
+        while (length > 0) {
+            if (output->buffer == NULL && takeRingBuffer(output) == false) {
+                return false;
+            }
+            size_t copied = FILTER_BUFFER_SIZE - output->used;
+            if (copied > length) {
+                copied = length;
+            }
+            memcpy(output->buffer + output->used, data, copied);
+            output->used += copied;
+            data += copied;
+            length -= copied;
+            if (output->used == FILTER_BUFFER_SIZE && passRingBlock(output) == false) {
+                return false;
+            }
+        }
+        return true;
+    }
+    if (output->used + length > FILTER_BUFFER_SIZE && flushFilterOutput(output) == false) {
+        return false;
+    }
+    if (length >= FILTER_BUFFER_SIZE) {
+        // Big writes go straight out rather than through the buffer
+        if (writeAll(output->fd, (char *) data, length) == false) {
+            output->isBroken = true;
+            return false;
+        }
+        return true;
+    }
+    memcpy(output->buffer + output->used, data, length);
+    output->used += length;
+    return true;
+}
+
+static bool flushFilterOutput(struct filterOutput *output) {
+    if (output->isBroken) {
+        return false;
+    }
+    if (output->ring != NULL) {
+        // Subset 26:
+        return output->used == 0 || passRingBlock(output);
+    }
+    if (output->used > 0 && writeAll(output->fd, output->buffer, output->used) == false) {
+        output->isBroken = true;
+        return false;
+    }
+    output->used = 0;
+    return true;
+}
+
+static void initFilterKernels(void) {
+    if (filterKernels.countNewlines != NULL) {
+        return;
+    }
+    filterKernels.countNewlines = countNewlinesScalar;
+    filterKernels.findSubstring = findSubstringScalar;
+#if defined(__x86_64__)
+    // SSE2 is always there on x86-64, AVX2 has to be checked for
+    filterKernels.countNewlines = countNewlinesSSE2;
+    filterKernels.findSubstring = findSubstringSSE2;
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        filterKernels.countNewlines = countNewlinesAVX2;
+        filterKernels.findSubstring = findSubstringAVX2;
+    }
+#endif
+}
+
+static size_t countNewlinesScalar(const char *data, size_t length) {
+    size_t count = 0;
+    const char *end = data + length;
+    while ((data = memchr(data, '\n', end - data)) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+static const char *findSubstringScalar(const char *data, size_t length, const char *pattern, size_t patternLength) {
+    return memmem(data, length, pattern, patternLength);
+}
+
+#if defined(__x86_64__)
+static size_t countNewlinesSSE2(const char *data, size_t length) {
+    // Matches are counted in byte lanes, which are added up before any of 
+    // them can overflow
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 16 <= length) {
+        __m128i counts = _mm_setzero_si128();
+        for (int n = 0; n < 255 && i + 16 <= length; n++, i += 16) {
+            __m128i block = _mm_loadu_si128((const __m128i *) (data + i));
+            counts = _mm_sub_epi8(counts, _mm_cmpeq_epi8(block, newline));
+        }
+        __m128i sums = _mm_sad_epu8(counts, _mm_setzero_si128());
+        count += _mm_cvtsi128_si64(sums) + _mm_cvtsi128_si64(_mm_srli_si128(sums, 8));
+    }
+    return count + countNewlinesScalar(data + i, length - i);
+}
+
+__attribute__((target("avx2")))
+static size_t countNewlinesAVX2(const char *data, size_t length) {
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 32 <= length) {
+        __m256i counts = _mm256_setzero_si256();
+        for (int n = 0; n < 255 && i + 32 <= length; n++, i += 32) {
+            __m256i block = _mm256_loadu_si256((const __m256i *) (data + i));
+            counts = _mm256_sub_epi8(counts, _mm256_cmpeq_epi8(block, newline));
+        }
+        __m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+        count += _mm256_extract_epi64(sums, 0) + _mm256_extract_epi64(sums, 1) + 
+                 _mm256_extract_epi64(sums, 2) + _mm256_extract_epi64(sums, 3);
+    }
+    return count + countNewlinesScalar(data + i, length - i);
+}
+
+static const char *findSubstringSSE2(const char *data, size_t length, const char *pattern, size_t patternLength) {
+    if (patternLength < 2 || length < patternLength + 16) {
+        return findSubstringScalar(data, length, pattern, patternLength);
+    }
+    // Candidates are where both the first and last bytes of the pattern are
+    // in place, and only those are compared in full
+    const __m128i first = _mm_set1_epi8(pattern[0]);
+    const __m128i last = _mm_set1_epi8(pattern[patternLength - 1]);
+    size_t i = 0;
+    for (; i + patternLength - 1 + 16 <= length; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i *) (data + i + patternLength - 1));
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), 
+                                                            _mm_cmpeq_epi8(blockLast, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, pattern + 1, patternLength - 2) == 0) {
+                return data + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSubstringScalar(data + i, length - i, pattern, patternLength);
+}
+
+__attribute__((target("avx2")))
+static const char *findSubstringAVX2(const char *data, size_t length, const char *pattern, size_t patternLength) {
+    if (patternLength < 2 || length < patternLength + 32) {
+        return findSubstringScalar(data, length, pattern, patternLength);
+    }
+    const __m256i first = _mm256_set1_epi8(pattern[0]);
+    const __m256i last = _mm256_set1_epi8(pattern[patternLength - 1]);
+    size_t i = 0;
+    for (; i + patternLength - 1 + 32 <= length; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i *) (data + i + patternLength - 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), 
+                                                                  _mm256_cmpeq_epi8(blockLast, last)));
+        while (mask != 0) {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(data + i + bit + 1, pattern + 1, patternLength - 2) == 0) {
+                return data + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return findSubstringScalar(data + i, length - i, pattern, patternLength);
+}
+#endif
+
+// ===================== SUBSET 23 =====================
+
+static bool parseSortOptions(char **words, int *index, struct sortOrder *order) {
+    int argc = getWordCount(words);
+    order->memory = SORT_MEMORY;
+    order->numberOfThreads = sysconf(_SC_NPROCESSORS_ONLN);
+    while (*index < argc && words[*index][0] == '-' && words[*index][1] != '\0') {
+        char *word = words[*index];
+        if (strcmp(word, "--") == 0) {
+            (*index)++;
+            break;
+        }
+        if (strncmp(word, "--parallel=", 11) == 0) {
+            char *end;
+            order->numberOfThreads = strtol(word + 11, &end, 10);
+            if (word[11] == '\0' || *end != '\0' || order->numberOfThreads < 1) {
+                return false;
+            }
+            (*index)++;
+            continue;
+        }
+        if (word[1] == '-') {
+            return false;
+        }
+        // Flags can be run together, and -k, -t and -S take their value 
+        // attached or as the next word
+        for (char *c = word + 1; *c != '\0'; c++) {
+            if (*c == 'n') {
+                order->isNumeric = true;
+            } else if (*c == 'r') {
+                order->isReverse = true;
+            } else if (*c == 'u') {
+                order->isUnique = true;
+            } else if (*c == 'b') {
+                order->skipsBlanks = true;
+            } else if (*c == 'k' || *c == 't' || *c == 'S') {
+                char *value = c + 1;
+                if (*value == '\0') {
+                    if (*index + 1 == argc) {
+                        return false;
+                    }
+                    (*index)++;
+                    value = words[*index];
+                }
+                if (*c == 'k') {
+                    if (order->numberOfKeys == SORT_MAX_KEYS || 
+                        parseSortKey(value, &order->keys[order->numberOfKeys]) == false) {
+                        return false;
+                    }
+                    order->numberOfKeys++;
+                } else if (*c == 't') {
+                    if (strlen(value) != 1) {
+                        return false;
+                    }
+                    order->separator = value[0];
+                } else if (parseSize(value, &order->memory) == false || order->memory == 0) {
+                    return false;
+                }
+                break;
+            } else {
+                return false;
+            }
+        }
+        (*index)++;
+    }
+    if (order->numberOfThreads < 1) {
+        order->numberOfThreads = 1;
+    } else if (order->numberOfThreads > SORT_MAX_THREADS) {
+        order->numberOfThreads = SORT_MAX_THREADS;
+    }
+    order->isPlain = (order->numberOfKeys == 0 && order->isNumeric == false && order->skipsBlanks == false);
+    return true;
+}
+
+static bool parseSortKey(char *text, struct sortKey *key) {
+    memset(key, 0, sizeof(struct sortKey));
+    long *fields[2] = {&key->startField, &key->endField};
+    for (int i = 0; i < 2; i++) {
+        char *end;
+        *fields[i] = strtol(text, &end, 10);
+        if (end == text || *fields[i] < 1) {
+            return false;
+        }
+        text = end;
+        while (*text != '\0' && strchr("nrb", *text) != NULL) {
+            key->isNumeric = key->isNumeric || (*text == 'n');
+            key->isReverse = key->isReverse || (*text == 'r');
+            key->skipsBlanks = key->skipsBlanks || (*text == 'b');
+            key->hasModifiers = true;
+            text++;
+        }
+        if (*text != ',') {
+            break;
+        }
+        text++;
+    }
+    // Character positions such as 2.3 are left to sort itself
+    return *text == '\0';
+}
+
+static bool isByteCollation(void) {
+    char *variables[] = {"LC_ALL", "LC_COLLATE", "LANG"};
+    for (int i = 0; i < 3; i++) {
+        char *value = getenv(variables[i]);
+        if (value != NULL && value[0] != '\0') {
+            return strcmp(value, "C") == 0 || strcmp(value, "POSIX") == 0 || strncmp(value, "C.", 2) == 0;
+        }
+    }
+    return true;
+}
+
+static int sortLines(struct filter *filter, struct filterInput *input, int errorFD, struct filterOutput *output) {
+    struct sortOrder *order = &filter->sort;
+    struct sortChunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+    chunk.size = (order->memory < SORT_RUN_BUFFER_SIZE) ? order->memory : SORT_RUN_BUFFER_SIZE;
+    chunk.data = malloc(chunk.size);
+    int runs[SORT_MERGE_WIDTH];
+    int numberOfRuns = 0;
+    int exitStatus = 0;
+    bool isEnded = false;
+    while (isEnded == false) {
+        size_t chunkEnd;
+        if (readSortChunk(input, &chunk, order, &isEnded, &chunkEnd) == false) {
+            dprintf(errorFD, "%s: read failed: %s\n", filter->name, strerror(errno));
+            exitStatus = 2;
+            break;
+        }
+        if (isEnded && numberOfRuns == 0) {
+            // It all fits in memory, so it goes straight out
+            sortChunk(order, &chunk, output);
+            break;
+        }
+        int runFD = writeSortRun(order, &chunk, NULL, 0);
+        if (runFD != -1 && numberOfRuns == SORT_MERGE_WIDTH - 1) {
+            // Runs are merged into one as they pile up, so only so many 
+            // files are open at once
+            runs[numberOfRuns] = runFD;
+            runFD = writeSortRun(order, NULL, runs, SORT_MERGE_WIDTH);
+            for (int i = 0; i < SORT_MERGE_WIDTH; i++) {
+                close(runs[i]);
+            }
+            numberOfRuns = 0;
+        }
+        if (runFD == -1) {
+            dprintf(errorFD, "%s: couldn't write a temporary file: %s\n", filter->name, strerror(errno));
+            exitStatus = 2;
+            break;
+        }
+        runs[numberOfRuns] = runFD;
+        numberOfRuns++;
+        // The unfinished last line starts the next chunk
+        memmove(chunk.data, chunk.data + chunkEnd, chunk.used - chunkEnd);
+        chunk.used -= chunkEnd;
+        chunk.numberOfLines = 0;
+    }
+    free(chunk.data);
+    free(chunk.lines);
+    if (exitStatus == 0 && numberOfRuns > 0) {
+        mergeRuns(order, runs, numberOfRuns, output);
+    }
+    for (int i = 0; i < numberOfRuns; i++) {
+        close(runs[i]);
+    }
+    return exitStatus;
+}
+
+static int writeSortRun(struct sortOrder *order, struct sortChunk *chunk, int *runs, int numberOfRuns) {
+    int fd = openSortRun();
+    if (fd == -1) {
+        return -1;
+    }
+    struct filterOutput output;
+    initFilterOutput(&output, fd, NULL);
+    if (chunk != NULL) {
+        sortChunk(order, chunk, &output);
+    } else {
+        mergeRuns(order, runs, numberOfRuns, &output);
+    }
+    bool isWritten = flushFilterOutput(&output);
+    freeFilterOutput(&output);
+    if (isWritten == false) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool readSortChunk(struct filterInput *input, struct sortChunk *chunk, struct sortOrder *order, 
+                          bool *isEnded, size_t *chunkEnd) {
+    // Whatever was carried over from the last chunk has no newline yet
+    size_t lineStart = 0;
+    while (1) {
+        if (chunk->used == chunk->size) {
+            chunk->size *= 2;
+            chunk->data = realloc(chunk->data, chunk->size);
+        }
+        ssize_t length = readFilterInput(input, chunk->data + chunk->used, chunk->size - chunk->used);
+        if (length == -1 && errno == EINTR) {
+            continue;
+        }
+        if (length == -1) {
+            return false;
+        }
+        size_t end = chunk->used + length;
+        if (length == 0) {
+            *isEnded = true;
+        }
+        // Lines are found as they are read, with the last line of the input
+        // counted even without a newline
+        char *curr = chunk->data + chunk->used;
+        char *newline;
+        while ((newline = memchr(curr, '\n', length)) != NULL) {
+            addSortLine(chunk, order, lineStart, newline - chunk->data);
+            lineStart = newline - chunk->data + 1;
+            length -= newline + 1 - curr;
+            curr = newline + 1;
+        }
+        if (*isEnded && lineStart < end) {
+            addSortLine(chunk, order, lineStart, end);
+            lineStart = end;
+        }
+        chunk->used = end;
+        size_t footprint = chunk->used + chunk->numberOfLines * sizeof(struct sortLine);
+        if (*isEnded || (footprint >= order->memory && chunk->numberOfLines > 0)) {
+            *chunkEnd = lineStart;
+            return true;
+        }
+    }
+}
+
+static void addSortLine(struct sortChunk *chunk, struct sortOrder *order, size_t start, size_t end) {
+    if (chunk->numberOfLines == chunk->capacity) {
+        chunk->capacity = (chunk->capacity == 0) ? 1024 : chunk->capacity * 2;
+        chunk->lines = realloc(chunk->lines, sizeof(struct sortLine) * chunk->capacity);
+    }
+    struct sortLine *line = &chunk->lines[chunk->numberOfLines];
+    line->offset = start;
+    line->length = end - start;
+    const char *text = chunk->data + start;
+    const char *keyStart = text;
+    const char *keyEnd = text + line->length;
+    bool isNumeric = order->isNumeric;
+    if (order->numberOfKeys > 0) {
+        findSortKey(order, &order->keys[0], text, line->length, &keyStart, &keyEnd);
+        isNumeric = order->keys[0].hasModifiers ? order->keys[0].isNumeric : order->isNumeric;
+    } else {
+        while (order->skipsBlanks && keyStart < keyEnd && (*keyStart == ' ' || *keyStart == '\t')) {
+            keyStart++;
+        }
+    }
+    line->keyStart = keyStart - text;
+    line->keyEnd = keyEnd - text;
+    if (isNumeric) {
+        line->prefix = getNumberPrefix(keyStart, keyEnd - keyStart);
+    } else {
+        line->prefix = 0;
+        for (size_t i = 0; i < 8; i++) {
+            line->prefix = (line->prefix << 8) | ((keyStart + i < keyEnd) ? (unsigned char) keyStart[i] : 0);
+        }
+    }
+    chunk->numberOfLines++;
+}
+
+static bool sortChunk(struct sortOrder *order, struct sortChunk *chunk, struct filterOutput *output) {
+    size_t numberOfSlices = chunk->numberOfLines / SORT_SLICE_LINES + 1;
+    if (numberOfSlices > (size_t) order->numberOfThreads) {
+        numberOfSlices = order->numberOfThreads;
+    }
+    if (numberOfSlices == 0) {
+        numberOfSlices = 1;
+    }
+    struct sortSlice slices[SORT_MAX_THREADS];
+    pthread_t threads[SORT_MAX_THREADS];
+    bool isThreaded[SORT_MAX_THREADS];
+    size_t start = 0;
+    for (size_t i = 0; i < numberOfSlices; i++) {
+        size_t count = (chunk->numberOfLines - start) / (numberOfSlices - i);
+        slices[i].order = order;
+        slices[i].data = chunk->data;
+        slices[i].lines = chunk->lines + start;
+        slices[i].numberOfLines = count;
+        start += count;
+    }
+    // This thread sorts the first slice while the others are sorted
+    for (size_t i = 1; i < numberOfSlices; i++) {
+        isThreaded[i] = (pthread_create(&threads[i], NULL, sortSlice, &slices[i]) == 0);
+        if (isThreaded[i] == false) {
+            sortSlice(&slices[i]);
+        }
+    }
+    sortSlice(&slices[0]);
+    for (size_t i = 1; i < numberOfSlices; i++) {
+        if (isThreaded[i]) {
+            pthread_join(threads[i], NULL);
+        }
+    }
+    struct mergeSource *sources = calloc(numberOfSlices, sizeof(struct mergeSource));
+    for (size_t i = 0; i < numberOfSlices; i++) {
+        sources[i].data = chunk->data;
+        sources[i].lines = slices[i].lines;
+        sources[i].numberOfLines = slices[i].numberOfLines;
+        advanceMergeSource(&sources[i]);
+    }
+    bool isWritten = mergeSources(order, sources, numberOfSlices, output);
+    free(sources);
+    return isWritten;
+}
+
+static void *sortSlice(void *argument) {
+    struct sortSlice *slice = argument;
+    struct sortLine *buffer = malloc(sizeof(struct sortLine) * (slice->numberOfLines + 1));
+    mergeSortLines(slice, slice->lines, slice->numberOfLines, buffer, false);
+    free(buffer);
+    return NULL;
+}
+
+static void mergeSortLines(struct sortSlice *slice, struct sortLine *lines, size_t count, 
+                           struct sortLine *buffer, bool isToBuffer) {
+    if (count <= SORT_INSERTION_LINES) {
+        for (size_t i = 1; i < count; i++) {
+            struct sortLine line = lines[i];
+            size_t j = i;
+            while (j > 0 && compareSortLines(slice->order, slice->data, &lines[j - 1], &line) > 0) {
+                lines[j] = lines[j - 1];
+                j--;
+            }
+            lines[j] = line;
+        }
+        if (isToBuffer) {
+            memcpy(buffer, lines, sizeof(struct sortLine) * count);
+        }
+        return;
+    }
+    // Each half is sorted into the other array, so the merge of them lands
+    // where it should without copying
+    size_t half = count / 2;
+    mergeSortLines(slice, lines, half, buffer, isToBuffer == false);
+    mergeSortLines(slice, lines + half, count - half, buffer + half, isToBuffer == false);
+    struct sortLine *from = isToBuffer ? lines : buffer;
+    struct sortLine *to = isToBuffer ? buffer : lines;
+    size_t i = 0;
+    size_t j = half;
+    size_t k = 0;
+    while (i < half && j < count) {
+        to[k++] = (compareSortLines(slice->order, slice->data, &from[j], &from[i]) < 0) ? from[j++] : from[i++];
+    }
+    memcpy(&to[k], &from[i], sizeof(struct sortLine) * (half - i));
+    k += half - i;
+    memcpy(&to[k], &from[j], sizeof(struct sortLine) * (count - j));
+}
+
+static bool mergeRuns(struct sortOrder *order, int *runs, int numberOfRuns, struct filterOutput *output) {
+    struct mergeSource *sources = calloc(numberOfRuns, sizeof(struct mergeSource));
+    for (int i = 0; i < numberOfRuns; i++) {
+        lseek(runs[i], 0, SEEK_SET);
+        sources[i].input.fd = runs[i];
+        sources[i].reader.input = &sources[i].input;
+        sources[i].reader.buffer = malloc(SORT_RUN_BUFFER_SIZE);
+        sources[i].reader.size = SORT_RUN_BUFFER_SIZE;
+        advanceMergeSource(&sources[i]);
+    }
+    bool isWritten = mergeSources(order, sources, numberOfRuns, output);
+    for (int i = 0; i < numberOfRuns; i++) {
+        free(sources[i].reader.buffer);
+    }
+    free(sources);
+    return isWritten;
+}
+
+static bool mergeSources(struct sortOrder *order, struct mergeSource *sources, int numberOfSources, 
+                         struct filterOutput *output) {
+    // Each node keeps the source that lost there, and tree[0] the winner, 
+    // so each line out costs one comparison per level
+    int *tree = malloc(sizeof(int) * numberOfSources);
+    tree[0] = (numberOfSources == 1) ? 0 : buildLoserTree(order, sources, tree, numberOfSources, 1);
+    char *last = NULL;
+    size_t lastLength = 0;
+    size_t lastSize = 0;
+    bool hasLast = false;
+    while (sources[tree[0]].line != NULL && output->isBroken == false) {
+        struct mergeSource *winner = &sources[tree[0]];
+        if (order->isUnique == false || hasLast == false || 
+            compareLines(order, last, lastLength, winner->line, winner->length) != 0) {
+            writeFilterOutput(output, winner->line, winner->length);
+            writeFilterOutput(output, "\n", 1);
+            if (order->isUnique) {
+                // A run's lines are overwritten as it is read, so the last 
+                // line out is kept to compare the next ones with
+                if (winner->length > lastSize) {
+                    lastSize = winner->length * 2;
+                    last = realloc(last, lastSize);
+                }
+                memcpy(last, winner->line, winner->length);
+                lastLength = winner->length;
+                hasLast = true;
+            }
+        }
+        advanceMergeSource(winner);
+        int current = tree[0];
+        for (int node = (current + numberOfSources) / 2; node >= 1; node /= 2) {
+            if (isMergedBefore(order, sources, tree[node], current)) {
+                int loser = current;
+                current = tree[node];
+                tree[node] = loser;
+            }
+        }
+        tree[0] = current;
+    }
+    free(last);
+    free(tree);
+    return output->isBroken == false;
+}
+
+static int buildLoserTree(struct sortOrder *order, struct mergeSource *sources, int *tree, 
+                          int numberOfSources, int node) {
+    // The sources are the leaves, numbered on from the last inner node
+    if (node >= numberOfSources) {
+        return node - numberOfSources;
+    }
+    int left = buildLoserTree(order, sources, tree, numberOfSources, node * 2);
+    int right = buildLoserTree(order, sources, tree, numberOfSources, node * 2 + 1);
+    if (isMergedBefore(order, sources, left, right)) {
+        tree[node] = right;
+        return left;
+    }
+    tree[node] = left;
+    return right;
+}
+
+static bool isMergedBefore(struct sortOrder *order, struct mergeSource *sources, int a, int b) {
+    if (sources[a].line == NULL) {
+        return false;
+    }
+    if (sources[b].line == NULL) {
+        return true;
+    }
+    int result;
+    if (sources[a].lines != NULL && sources[b].lines != NULL) {
+        // Slices of a chunk still have their lines' prefixes
+        result = compareSortLines(order, sources[a].data, &sources[a].lines[sources[a].next - 1], 
+                                  &sources[b].lines[sources[b].next - 1]);
+        return result < 0 || (result == 0 && a < b);
+    }
+    result = compareLines(order, sources[a].line, sources[a].length, sources[b].line, sources[b].length);
+    return result < 0 || (result == 0 && a < b);
+}
+
+static void advanceMergeSource(struct mergeSource *source) {
+    if (source->lines != NULL || source->reader.buffer == NULL) {
+        if (source->next == source->numberOfLines) {
+            source->line = NULL;
+            return;
+        }
+        struct sortLine *line = &source->lines[source->next];
+        source->next++;
+        source->line = source->data + line->offset;
+        source->length = line->length;
+        return;
+    }
+    if (source->position >= source->blockLength) {
+        ssize_t length = readLineBlock(&source->reader, &source->block);
+        if (length <= 0) {
+            source->line = NULL;
+            return;
+        }
+        source->blockLength = length;
+        source->position = 0;
+    }
+    char *start = source->block + source->position;
+    char *newline = memchr(start, '\n', source->blockLength - source->position);
+    source->line = start;
+    source->length = ((newline != NULL) ? newline : source->block + source->blockLength) - start;
+    source->position += source->length + 1;
+}
+
+static int openSortRun(void) {
+    char *directory = getenv("TMPDIR");
+    if (directory == NULL || directory[0] == '\0') {
+        directory = "/tmp";
+    }
+    // Runs have no name, so none are left behind however the shell exits
+    int fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        char fileName[PATH_MAX];
+        snprintf(fileName, sizeof(fileName), "%s/nautilus-sort-XXXXXX", directory);
+        fd = mkostemp(fileName, O_CLOEXEC);
+        if (fd != -1) {
+            unlink(fileName);
+        }
+    }
+    return fd;
+}
+
+static int compareSortLines(struct sortOrder *order, const char *data, const struct sortLine *x, 
+                            const struct sortLine *y) {
+    int result;
+    if (x->prefix != y->prefix) {
+        bool isReverse = order->isReverse;
+        if (order->numberOfKeys > 0 && order->keys[0].hasModifiers) {
+            isReverse = order->keys[0].isReverse;
+        }
+        result = (x->prefix < y->prefix) ? -1 : 1;
+        return isReverse ? -result : result;
+    }
+    const char *a = data + x->offset;
+    const char *b = data + y->offset;
+    if (order->isPlain) {
+        // Lines that share a prefix are only compared past it, and a line
+        // no longer than it is the start of the other
+        if (x->length <= 8 || y->length <= 8) {
+            result = (x->length < y->length) ? -1 : (x->length > y->length);
+        } else {
+            result = compareBytes(a + 8, x->length - 8, b + 8, y->length - 8);
+        }
+        return order->isReverse ? -result : result;
+    }
+    if (order->numberOfKeys > 0 && x->length <= UINT32_MAX && y->length <= UINT32_MAX) {
+        result = compareKey(order, &order->keys[0], a + x->keyStart, a + x->keyEnd, b + y->keyStart, b + y->keyEnd);
+        if (result != 0) {
+            return result;
+        }
+        return compareKeys(order, 1, a, x->length, b, y->length);
+    }
+    return compareLines(order, a, x->length, b, y->length);
+}
+
+static uint64_t getNumberPrefix(const char *text, size_t length) {
+    struct sortNumber number;
+    parseSortNumber(text, length, &number);
+    // The sign comes first, then the number of digits before the point, 
+    // then as many of the digits as fit, four bits each. Numbers too long 
+    // to count all share a prefix
+    uint64_t prefix = (1ULL << 63);
+    if (number.numberOfDigits >= SORT_PREFIX_MAX_DIGITS) {
+        prefix |= (1ULL << 63) - 1;
+    } else {
+        prefix |= (uint64_t) number.numberOfDigits << 52;
+        for (size_t i = 0; i < 13; i++) {
+            uint64_t digit = 0;
+            if (i < number.numberOfDigits) {
+                digit = number.digits[i] - '0';
+            } else if (i - number.numberOfDigits < number.fractionLength) {
+                digit = number.fraction[i - number.numberOfDigits] - '0';
+            }
+            prefix |= digit << (48 - i * 4);
+        }
+    }
+    // Negative numbers go the other way, below all the others
+    return number.isNegative ? ~prefix : prefix;
+}
+
+static int compareLines(struct sortOrder *order, const char *a, size_t aLength, const char *b, size_t bLength) {
+    int result = 0;
+    if (order->numberOfKeys == 0) {
+        // The whole line is the key
+        const char *aStart = a;
+        const char *bStart = b;
+        while (order->skipsBlanks && aStart < a + aLength && (*aStart == ' ' || *aStart == '\t')) {
+            aStart++;
+        }
+        while (order->skipsBlanks && bStart < b + bLength && (*bStart == ' ' || *bStart == '\t')) {
+            bStart++;
+        }
+        if (order->isNumeric) {
+            result = compareNumbers(aStart, a + aLength - aStart, bStart, b + bLength - bStart);
+        } else {
+            result = compareBytes(aStart, a + aLength - aStart, bStart, b + bLength - bStart);
+        }
+        if (result != 0) {
+            return order->isReverse ? -result : result;
+        }
+    }
+    return compareKeys(order, 0, a, aLength, b, bLength);
+}
+
+static int compareKeys(struct sortOrder *order, int firstKey, const char *a, size_t aLength, 
+                       const char *b, size_t bLength) {
+    int result;
+    for (int i = firstKey; i < order->numberOfKeys; i++) {
+        const char *aStart;
+        const char *aEnd;
+        const char *bStart;
+        const char *bEnd;
+        findSortKey(order, &order->keys[i], a, aLength, &aStart, &aEnd);
+        findSortKey(order, &order->keys[i], b, bLength, &bStart, &bEnd);
+        result = compareKey(order, &order->keys[i], aStart, aEnd, bStart, bEnd);
+        if (result != 0) {
+            return result;
+        }
+    }
+    // Lines with equal keys are put in byte order as a last resort, except 
+    // with -u, where they are the same line as far as it is concerned
+    if (order->isUnique) {
+        return 0;
+    }
+    result = compareBytes(a, aLength, b, bLength);
+    return order->isReverse ? -result : result;
+}
+
+static int compareKey(struct sortOrder *order, struct sortKey *key, const char *aStart, const char *aEnd, 
+                      const char *bStart, const char *bEnd) {
+    bool isNumeric = key->hasModifiers ? key->isNumeric : order->isNumeric;
+    bool isReverse = key->hasModifiers ? key->isReverse : order->isReverse;
+    int result;
+    if (isNumeric) {
+        result = compareNumbers(aStart, aEnd - aStart, bStart, bEnd - bStart);
+    } else {
+        result = compareBytes(aStart, aEnd - aStart, bStart, bEnd - bStart);
+    }
+    return isReverse ? -result : result;
+}
+
+static int compareBytes(const char *a, size_t aLength, const char *b, size_t bLength) {
+    int result = memcmp(a, b, (aLength < bLength) ? aLength : bLength);
+    if (result != 0) {
+        return (result < 0) ? -1 : 1;
+    }
+    if (aLength != bLength) {
+        return (aLength < bLength) ? -1 : 1;
+    }
+    return 0;
+}
+
+static int compareNumbers(const char *a, size_t aLength, const char *b, size_t bLength) {
+    struct sortNumber x;
+    struct sortNumber y;
+    parseSortNumber(a, aLength, &x);
+    parseSortNumber(b, bLength, &y);
+    if (x.isNegative != y.isNegative) {
+        return x.isNegative ? -1 : 1;
+    }
+    int result;
+    if (x.numberOfDigits != y.numberOfDigits) {
+        result = (x.numberOfDigits < y.numberOfDigits) ? -1 : 1;
+    } else {
+        result = compareBytes(x.digits, x.numberOfDigits, y.digits, y.numberOfDigits);
+        if (result == 0) {
+            result = compareBytes(x.fraction, x.fractionLength, y.fraction, y.fractionLength);
+        }
+    }
+    return x.isNegative ? -result : result;
+}
+
+static void parseSortNumber(const char *text, size_t length, struct sortNumber *number) {
+    const char *end = text + length;
+    while (text < end && (*text == ' ' || *text == '\t')) {
+        text++;
+    }
+    number->isNegative = (text < end && *text == '-');
+    if (number->isNegative) {
+        text++;
+    }
+    while (text < end && *text == '0') {
+        text++;
+    }
+    number->digits = text;
+    while (text < end && *text >= '0' && *text <= '9') {
+        text++;
+    }
+    number->numberOfDigits = text - number->digits;
+    number->fraction = text;
+    number->fractionLength = 0;
+    if (text < end && *text == '.') {
+        text++;
+        number->fraction = text;
+        while (text < end && *text >= '0' && *text <= '9') {
+            text++;
+        }
+        number->fractionLength = text - number->fraction;
+        while (number->fractionLength > 0 && number->fraction[number->fractionLength - 1] == '0') {
+            number->fractionLength--;
+        }
+    }
+    if (number->numberOfDigits == 0 && number->fractionLength == 0) {
+        // -0 is just 0
+        number->isNegative = false;
+    }
+}
+
+static void findSortKey(struct sortOrder *order, struct sortKey *key, const char *line, size_t length, 
+                        const char **start, const char **end) {
+    const char *lineEnd = line + length;
+    const char *fieldStart = findSortField(order->separator, line, lineEnd, key->startField);
+    *start = fieldStart;
+    bool skipsBlanks = key->hasModifiers ? key->skipsBlanks : order->skipsBlanks;
+    while (skipsBlanks && *start < lineEnd && (**start == ' ' || **start == '\t')) {
+        (*start)++;
+    }
+    *end = lineEnd;
+    if (key->endField >= key->startField) {
+        // The end field is found from the start one rather than the line's
+        fieldStart = findSortField(order->separator, fieldStart, lineEnd, key->endField - key->startField + 1);
+        *end = findSortFieldEnd(order->separator, fieldStart, lineEnd);
+    } else if (key->endField != 0) {
+        *end = *start;
+    }
+    if (*end < *start) {
+        *end = *start;
+    }
+}
+
+static const char *findSortField(char separator, const char *line, const char *end, long field) {
+    const char *curr = line;
+    for (long i = 1; i < field && curr < end; i++) {
+        if (separator != 0) {
+            const char *next = memchr(curr, separator, end - curr);
+            curr = (next != NULL) ? next + 1 : end;
+        } else {
+            // Without a separator, each field starts with the blanks before it
+            while (curr < end && (*curr == ' ' || *curr == '\t')) {
+                curr++;
+            }
+            while (curr < end && *curr != ' ' && *curr != '\t') {
+                curr++;
+            }
+        }
+    }
+    return curr;
+}
+
+static const char *findSortFieldEnd(char separator, const char *fieldStart, const char *end) {
+    if (separator != 0) {
+        const char *next = memchr(fieldStart, separator, end - fieldStart);
+        return (next != NULL) ? next : end;
+    }
+    const char *curr = fieldStart;
+    while (curr < end && (*curr == ' ' || *curr == '\t')) {
+        curr++;
+    }
+    while (curr < end && *curr != ' ' && *curr != '\t') {
+        curr++;
+    }
+    return curr;
+}
+
+// ===================== SUBSET 24 =====================
+
+struct nautilusContext *nautilusCreate(char *const environment[], const char *directory) {
+    extern char **environ;
+    struct nautilusContext *context = calloc(1, sizeof(struct nautilusContext));
+    if (context == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&context->lock, NULL);
+    context->environment = copyStrings((environment != NULL) ? environment : environ);
+    context->path = (context->environment != NULL) ? splitPath(context->environment) : NULL;
+    context->directoryFD = open((directory != NULL) ? directory : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (context->path == NULL || context->directoryFD == -1) {
+        int error = errno;
+        nautilusDestroy(context);
+        errno = error;
+        return NULL;
+    }
+    // PATH is read up front, so the first line is as quick as the rest
+    refreshCommandTrie(&context->commandTrie, context->path);
+    return context;
+}
+
+int nautilusRun(struct nautilusContext *context, const char *line, const int fds[3], 
+                struct nautilusResult *result) {
+    if (strlen(line) >= MAX_LINE_CHARS) {
+        errno = E2BIG;
+        return -1;
+    }
+    // The trie is brought up to date here rather than in the worker, so the
+    // context keeps it for the next line, and the worker is forked before 
+    // another thread can change it
+    pthread_mutex_lock(&context->lock);
+    refreshCommandTrie(&context->commandTrie, context->path);
+    pid_t pid = fork();
+    pthread_mutex_unlock(&context->lock);
+    if (pid == 0) {
+        runContextWorker(context, line, fds);
+    }
+    if (pid == -1) {
+        return -1;
+    }
+    int status;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    pid_t waited;
+    do {
+        waited = wait4(pid, &status, 0, &usage);
+    } while (waited == -1 && errno == EINTR);
+    if (waited == -1) {
+        return -1;
+    }
+    if (result != NULL) {
+        // The worker's usage includes every process it waited for
+        result->exitStatus = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        result->usage = usage;
+    }
+    return 0;
+}
+
+void nautilusDestroy(struct nautilusContext *context) {
+    if (context == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&context->lock);
+    freeTrieChildren(context->commandTrie.root);
+    arenaFree(&context->commandTrie.arena);
+    free(context->commandTrie.mtimes);
+    freeStrings(context->environment);
+    freeStrings(context->path);
+    if (context->directoryFD != -1) {
+        close(context->directoryFD);
+    }
+    free(context);
+}
+
+static void runContextWorker(struct nautilusContext *context, const char *line, const int fds[3]) {
+    // Whatever the host had buffered is its own to write, not the worker's
+    __fpurge(stdout);
+    __fpurge(stderr);
+    // A descriptor that is already one of 0 to 2 but belongs elsewhere is
+    // copied above them first, so the dup2 of another onto it can't close it
+    int sources[3];
+    for (int i = 0; i < 3; i++) {
+        sources[i] = fds[i];
+        if (fds[i] >= 0 && fds[i] <= 2 && fds[i] != i) {
+            sources[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, 3);
+            if (sources[i] == -1) {
+                _exit(126);
+            }
+        }
+    }
+    for (int i = 0; i < 3; i++) {
+        if (sources[i] != i && dup2(sources[i], i) == -1) {
+            _exit(126);
+        }
+    }
+    if (fchdir(context->directoryFD) != 0) {
+        _exit(126);
+    }
+    // Programs start the way they would from a shell, whatever the host 
+    // blocks or ignores
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigprocmask(SIG_SETMASK, &mask, NULL);
+    signal(SIGPIPE, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    commandTrie = context->commandTrie;
+    isReportingStatus = false;
+    isWritingHistory = false;
+    char commandLine[MAX_LINE_CHARS];
+    strcpy(commandLine, line);
+    runCommandLine(commandLine, context->path, context->environment);
+    fflush(stdout);
+    fflush(stderr);
+    // The host's atexit handlers aren't the worker's to run
+    _exit(lastExitStatus);
+}
+
+static char **copyStrings(char *const strings[]) {
+    int count = 0;
+    while (strings[count] != NULL) {
+        count++;
+    }
+    char **copy = calloc(count + 1, sizeof(char *));
+    for (int i = 0; copy != NULL && i < count; i++) {
+        copy[i] = strdup(strings[i]);
+        if (copy[i] == NULL) {
+            freeStrings(copy);
+            return NULL;
+        }
+    }
+    return copy;
+}
+
+static void freeStrings(char **strings) {
+    for (int i = 0; strings != NULL && strings[i] != NULL; i++) {
+        free(strings[i]);
+    }
+    free(strings);
+}
+
+static char **splitPath(char **environment) {
+    char *value = DEFAULT_PATH;
+    for (int i = 0; environment[i] != NULL; i++) {
+        if (strncmp(environment[i], "PATH=", 5) == 0) {
+            value = environment[i] + 5;
+            break;
+        }
+    }
+    char *directories = strdup(value);
+    if (directories == NULL) {
+        return NULL;
+    }
+    char *parts[strlen(value) / 2 + 2];
+    int count = 0;
+    char *save;
+    for (char *part = strtok_r(directories, ":", &save); part != NULL; part = strtok_r(NULL, ":", &save)) {
+        parts[count] = part;
+        count++;
+    }
+    parts[count] = NULL;
+    char **path = copyStrings(parts);
+    free(directories);
+    return path;
+}
+
+void nautilusStart(void) {
+    setlinebuf(stdout);
+    // Subset 18:
+    statsOwner = getpid();
+    atexit(dumpProgramStats);
+    // Subset 30:
+    startFlightRecorder();
+    // Subset 21:
+    openSessionRecord();
+    char *pathp;  
+    if ((pathp = getenv("PATH")) == NULL) {
+        pathp = DEFAULT_PATH;  
+    }
+    shellPath = tokenize(pathp, ":", "");
+    // Each command's memory is given back by rewinding the arena to here
+    shellStart = arenaGetMark(&commandArena);
+}
+
+char **nautilusParse(const char *line) {
+    // The words are copied out, so the arena is given straight back
+    struct arenaMark mark = arenaGetMark(&commandArena);
+    char *text = arenaStrndup(&commandArena, (char *) line, strlen(line));
+    char **words = copyStrings(tokenize(text, WORD_SEPARATORS, SPECIAL_CHARS));
+    arenaReset(&commandArena, &mark);
+    return words;
+}
+
+void nautilusFreeWords(char **words) {
+    freeStrings(words);
+}
+
+int nautilusExecute(const char *line, int flags) {
+    extern char **environ;
+    isReportingStatus = ((flags & NAUTILUS_REPORT_STATUS) != 0);
+    bool isRecorded = ((flags & NAUTILUS_RECORD_LINE) != 0);
+    char *commandLine = arenaStrndup(&commandArena, (char *) line, strlen(line));
+    // Subset 21:
+    if (isRecorded) {
+        startRecordedLine();
+    }
+    runCommandLine(commandLine, shellPath, environ);
+    if (isRecorded) {
+        finishRecordedLine(commandLine);
+    }
+    finishCommandMemory(&shellStart);
+    return lastExitStatus;
+}
+
+void nautilusReadPath(void) {
+    getCommandTrie(shellPath);
+}
+
+int nautilusComplete(const char *line, int cursor, struct nautilusCompletion *completion) {
+    int wordStart = cursor;
+    while (wordStart > 0 && strchr(WORD_SEPARATORS SPECIAL_CHARS, line[wordStart - 1]) == NULL) {
+        wordStart--;
+    }
+    char word[MAX_LINE_CHARS];
+    int wordLength = cursor - wordStart;
+    memcpy(word, &line[wordStart], wordLength);
+    word[wordLength] = '\0';
+
+    // Work out what the word can be completed to: the longest extension
+    // shared by every match, and how many matches there are
+    char extension[MAX_LINE_CHARS + 1] = "";
+    int numberOfMatches = 0;
+    bool isDirectoryMatch = false;
+    char **names = calloc(COMPLETION_LIST_LIMIT, sizeof(char *));
+    int numberOfNames = 0;
+    if (names == NULL) {
+        return -1;
+    }
+    if (isCommandPosition(line, wordStart) && strchr(word, '/') == NULL) {
+        bool hasExtension = false;
+        int matched;
+        struct trieNode *node = findTrieNode(getCommandTrie(shellPath), word, &matched);
+        if (node != NULL) {
+            // Follow the trie down while there is only one way to go
+            int extensionLength = 0;
+            struct trieNode *curr = node;
+            int labelStart = matched;
+            while (1) {
+                int labelRemaining = curr->labelLength - labelStart;
+                if (extensionLength + labelRemaining >= MAX_LINE_CHARS) {
+                    break;
+                }
+                memcpy(&extension[extensionLength], &curr->label[labelStart], labelRemaining);
+                extensionLength += labelRemaining;
+                if (curr->pathIndex != -1 || curr->numberOfChildren != 1) {
+                    break;
+                }
+                curr = curr->children[0];
+                labelStart = 0;
+            }
+            extension[extensionLength] = '\0';
+            hasExtension = true;
+            numberOfMatches += node->numberOfNames;
+        }
+        for (int i = 0; builtinNames[i] != NULL; i++) {
+            if (strncmp(builtinNames[i], word, wordLength) != 0 || 
+                (node != NULL && lookupTrie(getCommandTrie(shellPath), builtinNames[i]) != -1)) {
+                continue;
+            }
+            char *rest = builtinNames[i] + wordLength;
+            if (hasExtension == false) {
+                strcpy(extension, rest);
+                hasExtension = true;
+            } else {
+                int common = 0;
+                while (extension[common] != '\0' && extension[common] == rest[common]) {
+                    common++;
+                }
+                extension[common] = '\0';
+            }
+            numberOfMatches++;
+            if (numberOfNames < COMPLETION_LIST_LIMIT) {
+                names[numberOfNames] = strdup(builtinNames[i]);
+                numberOfNames++;
+            }
+        }
+        if (node != NULL) {
+            char prefix[MAX_LINE_CHARS];
+            int prefixLength = wordLength - matched;
+            memcpy(prefix, word, prefixLength);
+            collectTrieNames(node, prefix, prefixLength, names, &numberOfNames, COMPLETION_LIST_LIMIT);
+        }
+    } else {
+        // Complete against the listing of the directory the word is in
+        char directoryPath[MAX_LINE_CHARS] = ".";
+        char *base = word;
+        char *lastSlash = strrchr(word, '/');
+        if (lastSlash != NULL) {
+            base = lastSlash + 1;
+            if (word[0] == '~' && (word[1] == '/' || word + 1 == lastSlash) && getenv("HOME") != NULL) {
+                snprintf(directoryPath, MAX_LINE_CHARS, "%s%.*s", getenv("HOME"), (int) (lastSlash - word - 1), word + 1);
+            } else if (lastSlash == word) {
+                strcpy(directoryPath, "/");
+            } else {
+                snprintf(directoryPath, MAX_LINE_CHARS, "%.*s", (int) (lastSlash - word), word);
+            }
+        }
+        struct directoryListing *listing = getDirectoryListing(directoryPath);
+        int baseLength = strlen(base);
+        if (listing != NULL) {
+            // Binary search for the first name starting with base
+            int low = 0;
+            int high = listing->numberOfNames;
+            while (low < high) {
+                int middle = (low + high) / 2;
+                if (strncmp(listing->names[middle], base, baseLength) < 0) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            int first = low;
+            int last = first;
+            while (last < listing->numberOfNames && strncmp(listing->names[last], base, baseLength) == 0) {
+                if (base[0] != '.' && listing->names[last][0] == '.') {
+                    // Hidden files only match when asked for
+                    last++;
+                    continue;
+                }
+                if (numberOfMatches == 0) {
+                    strcpy(extension, listing->names[last] + baseLength);
+                } else {
+                    char *rest = listing->names[last] + baseLength;
+                    int common = 0;
+                    while (extension[common] != '\0' && extension[common] == rest[common]) {
+                        common++;
+                    }
+                    extension[common] = '\0';
+                }
+                if (numberOfNames < COMPLETION_LIST_LIMIT) {
+                    names[numberOfNames] = strdup(listing->names[last]);
+                    numberOfNames++;
+                }
+                numberOfMatches++;
+                last++;
+            }
+            if (numberOfMatches == 1) {
+                int extensionLength = strlen(extension);
+                isDirectoryMatch = (extensionLength > 0 && extension[extensionLength - 1] == '/');
+            }
+        }
+    }
+    if (numberOfMatches == 1 && isDirectoryMatch == false) {
+        // A complete word, so move on to the next one
+        strcat(extension, " ");
+    }
+    completion->extension = strdup(extension);
+    completion->numberOfMatches = numberOfMatches;
+    completion->names = names;
+    completion->numberOfNames = numberOfNames;
+    if (completion->extension == NULL) {
+        nautilusFreeCompletion(completion);
+        return -1;
+    }
+    return 0;
+}
+
+void nautilusFreeCompletion(struct nautilusCompletion *completion) {
+    for (int i = 0; i < completion->numberOfNames; i++) {
+        free(completion->names[i]);
+    }
+    free(completion->names);
+    free(completion->extension);
+}
+
+// ===================== SUBSET 25 =====================
+
+static void jump(char **words) {
+    if (openDirectoryIndex() == -1) {
+        fprintf(stderr, "%s: can't open $HOME/%s\n", words[0], DIRECTORY_INDEX_FILE);
+        lastExitStatus = 1;
+        return;
+    }
+    refreshDirectoryIndex();
+    if (directoryIndex.isRanked == false) {
+        for (int i = 0; i < directoryIndex.numberOfDirectories; i++) {
+            directoryIndex.byRank[i] = &directoryIndex.directories[i];
+        }
+        qsort(directoryIndex.byRank, directoryIndex.numberOfDirectories, sizeof(struct visitedDirectory *), 
+              compareDirectoryRanks);
+        directoryIndex.isRanked = true;
+    }
+    double minimumRank = getVisitRank() + log2(DIRECTORY_MIN_SCORE);
+    if (words[1] == NULL) {
+        for (int i = directoryIndex.numberOfDirectories - 1; i >= 0; i--) {
+            struct visitedDirectory *directory = directoryIndex.byRank[i];
+            if (directory->isDead == false && directory->rank >= minimumRank) {
+                printf("%10.2f  %s\n", exp2(directory->rank - getVisitRank()), directory->path);
+            }
+        }
+        return;
+    }
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        cwd[0] = '\0';
+    }
+    // Case only matters if some directory matches with it
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < directoryIndex.numberOfDirectories; i++) {
+            struct visitedDirectory *directory = directoryIndex.byRank[i];
+            if (directory->rank < minimumRank) {
+                break;
+            }
+            if (directory->isDead || strcmp(directory->path, cwd) == 0 || 
+                matchesDirectory(directory->path, words + 1, pass == 1) == false) {
+                continue;
+            }
+            // Directories that have gone are only noticed when they match,
+            // and are left out when the index is next rewritten
+            if (isDirectory(directory->path) == false || chdir(directory->path) != 0) {
+                directory->isDead = true;
+                continue;
+            }
+            recordDirectory();
+            return;
+        }
+    }
+    fprintf(stderr, "%s: no directory matches", words[0]);
+    for (int i = 1; words[i] != NULL; i++) {
+        fprintf(stderr, " %s", words[i]);
+    }
+    fprintf(stderr, "\n");
+    lastExitStatus = 1;
+}
+
+static void recordDirectory(void) {
+    char line[PATH_MAX + 32];
+    int length = snprintf(line, sizeof(line), "%.6f\t", getVisitRank());
+    if (isWritingHistory == false || openDirectoryIndex() == -1 || 
+        getcwd(line + length, sizeof(line) - length - 1) == NULL) {
+        return;
+    }
+    length += strlen(line + length);
+    line[length] = '\n';
+    // A single append lands whole at the end, alongside any other shell's
+    if (write(directoryIndex.fd, line, length + 1) == -1) {
+        perror(DIRECTORY_INDEX_FILE);
+    }
+}
+
+static int openDirectoryIndex(void) {
+    char *home = getenv("HOME");
+    if (home == NULL) {
+        return -1;
+    }
+    char fileName[PATH_MAX];
+    snprintf(fileName, sizeof(fileName), "%s/%s", home, DIRECTORY_INDEX_FILE);
+    struct stat s;
+    if (directoryIndex.fd != -1) {
+        // An index rewritten by another shell is opened again, so visits 
+        // aren't appended to the file it replaced
+        if (stat(fileName, &s) == 0 && s.st_dev == directoryIndex.device && s.st_ino == directoryIndex.inode) {
+            return directoryIndex.fd;
+        }
+        closeDirectoryIndex();
+    }
+    directoryIndex.fd = open(fileName, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (directoryIndex.fd != -1 && fstat(directoryIndex.fd, &s) == 0) {
+        directoryIndex.device = s.st_dev;
+        directoryIndex.inode = s.st_ino;
+    }
+    return directoryIndex.fd;
+}
+
+static void closeDirectoryIndex(void) {
+    for (int i = 0; i < directoryIndex.numberOfDirectories; i++) {
+        free(directoryIndex.directories[i].path);
+    }
+    directoryIndex.numberOfDirectories = 0;
+    directoryIndex.numberOfLines = 0;
+    directoryIndex.readSize = 0;
+    close(directoryIndex.fd);
+    directoryIndex.fd = -1;
+}
+
+static void refreshDirectoryIndex(void) {
+    struct stat s;
+    if (fstat(directoryIndex.fd, &s) != 0 || s.st_size <= directoryIndex.readSize) {
+        return;
+    }
+    // Only what was added since the last read is read, up to the last 
+    // whole line
+    size_t size = s.st_size - directoryIndex.readSize;
+    char *buffer = malloc(size);
+    ssize_t length = pread(directoryIndex.fd, buffer, size, directoryIndex.readSize);
+    char *curr = buffer;
+    char *newline;
+    while (length > 0 && (newline = memchr(curr, '\n', buffer + length - curr)) != NULL) {
+        char *end;
+        double rank = strtod(curr, &end);
+        if (end != curr && *end == '\t' && end[1] == '/') {
+            addDirectoryRank(end + 1, newline - end - 1, rank);
+        }
+        directoryIndex.numberOfLines++;
+        curr = newline + 1;
+    }
+    directoryIndex.readSize += curr - buffer;
+    free(buffer);
+    if (directoryIndex.numberOfLines > directoryIndex.numberOfDirectories + DIRECTORY_INDEX_SLACK) {
+        compactDirectoryIndex();
+    }
+}
+
+static void addDirectoryRank(char *path, size_t length, double rank) {
+    // Binary search for the path, or where it goes
+    int low = 0;
+    int high = directoryIndex.numberOfDirectories;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        int result = strncmp(directoryIndex.directories[middle].path, path, length);
+        if (result == 0 && directoryIndex.directories[middle].path[length] != '\0') {
+            result = 1;
+        }
+        if (result == 0) {
+            // Adding weights is adding the powers of two of the ranks
+            struct visitedDirectory *directory = &directoryIndex.directories[middle];
+            double highest = (directory->rank > rank) ? directory->rank : rank;
+            double lowest = (directory->rank > rank) ? rank : directory->rank;
+            directory->rank = highest + log2(1 + exp2(lowest - highest));
+            directory->isDead = false;
+            directoryIndex.isRanked = false;
+            return;
+        }
+        if (result < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (directoryIndex.numberOfDirectories == directoryIndex.capacity) {
+        directoryIndex.capacity = (directoryIndex.capacity == 0) ? 64 : directoryIndex.capacity * 2;
+        directoryIndex.directories = realloc(directoryIndex.directories, 
+                                             sizeof(struct visitedDirectory) * directoryIndex.capacity);
+        directoryIndex.byRank = realloc(directoryIndex.byRank, 
+                                        sizeof(struct visitedDirectory *) * directoryIndex.capacity);
+    }
+    memmove(&directoryIndex.directories[low + 1], &directoryIndex.directories[low], 
+            sizeof(struct visitedDirectory) * (directoryIndex.numberOfDirectories - low));
+    directoryIndex.directories[low].path = strndup(path, length);
+    directoryIndex.directories[low].rank = rank;
+    directoryIndex.directories[low].isDead = false;
+    directoryIndex.numberOfDirectories++;
+    directoryIndex.isRanked = false;
+}
+
+static void compactDirectoryIndex(void) {
+    char *home = getenv("HOME");
+    char fileName[PATH_MAX];
+    char newFileName[PATH_MAX + 16];
+    snprintf(fileName, sizeof(fileName), "%s/%s", home, DIRECTORY_INDEX_FILE);
+    snprintf(newFileName, sizeof(newFileName), "%s.%d", fileName, getpid());
+    // The new file is private to the user like the one it replaces, and 
+    // never one left behind or linked there by someone else
+    unlink(newFileName);
+    int fd = open(newFileName, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    FILE *file = (fd == -1) ? NULL : fdopen(fd, "w");
+    if (file == NULL) {
+        if (fd != -1) {
+            close(fd);
+            unlink(newFileName);
+        }
+        return;
+    }
+    // Directories that have faded or gone are dropped, as are the lowest 
+    // ranked past the size of the index
+    for (int i = 0; i < directoryIndex.numberOfDirectories; i++) {
+        directoryIndex.byRank[i] = &directoryIndex.directories[i];
+    }
+    qsort(directoryIndex.byRank, directoryIndex.numberOfDirectories, sizeof(struct visitedDirectory *), 
+          compareDirectoryRanks);
+    double minimumRank = getVisitRank() + log2(DIRECTORY_MIN_SCORE);
+    int numberOfKept = 0;
+    for (int i = 0; i < directoryIndex.numberOfDirectories && numberOfKept < DIRECTORY_INDEX_SIZE; i++) {
+        struct visitedDirectory *directory = directoryIndex.byRank[i];
+        if (directory->isDead == false && directory->rank >= minimumRank) {
+            fprintf(file, "%.6f\t%s\n", directory->rank, directory->path);
+            numberOfKept++;
+        }
+    }
+    if (fclose(file) != 0 || rename(newFileName, fileName) != 0) {
+        unlink(newFileName);
+        return;
+    }
+    // Visits other shells appended to the old file since it was read, 
+    // before they noticed it was replaced, are carried over to the new one
+    struct stat s;
+    if (fstat(directoryIndex.fd, &s) == 0 && s.st_size > directoryIndex.readSize) {
+        size_t size = s.st_size - directoryIndex.readSize;
+        char *buffer = malloc(size);
+        ssize_t length = pread(directoryIndex.fd, buffer, size, directoryIndex.readSize);
+        char *end = (length > 0) ? memrchr(buffer, '\n', length) : NULL;
+        fd = open(fileName, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (end != NULL && fd != -1) {
+            writeAll(fd, buffer, end + 1 - buffer);
+        }
+        if (fd != -1) {
+            close(fd);
+        }
+        free(buffer);
+    }
+    // The index is read again from the new file
+    closeDirectoryIndex();
+    if (openDirectoryIndex() != -1) {
+        refreshDirectoryIndex();
+    }
+}
+
+static double getVisitRank(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return (now.tv_sec + now.tv_nsec / 1e9) / DIRECTORY_HALF_LIFE;
+}
+
+static bool matchesDirectory(char *path, char **patterns, bool isCaseless) {
+    char *curr = path;
+    for (int i = 0; patterns[i] != NULL; i++) {
+        char *match = isCaseless ? strcasestr(curr, patterns[i]) : strstr(curr, patterns[i]);
+        if (match == NULL) {
+            return false;
+        }
+        curr = match + strlen(patterns[i]);
+    }
+    return true;
+}
+
+static int compareDirectoryRanks(const void *a, const void *b) {
+    const struct visitedDirectory *x = *(struct visitedDirectory **) a;
+    const struct visitedDirectory *y = *(struct visitedDirectory **) b;
+    return (x->rank < y->rank) - (x->rank > y->rank);
+}
+
+// ===================== SUBSET 26 =====================
+
+static void findFusedLinks(char ***stages, struct processSettings *settings, int numberOfStages, 
+                           bool *isFused) {
+    struct filter filter;
+    bool isLastFilter = false;
+    for (int i = 0; i < numberOfStages; i++) {
+        // Each stage is checked with the settings spawnProgram will see
+        commandLimits.settings = settings[i];
+        // Subset 29: a parallel stage's copies are fed by the shell, not 
+        // through a ring
+        bool isFilter = settings[i].copies < 2 && isRunAsFilter(stages[i], &filter);
+        if (i > 0) {
+            isFused[i - 1] = isLastFilter && isFilter;
+        }
+        isLastFilter = isFilter;
+    }
+    memset(&commandLimits.settings, 0, sizeof(struct processSettings));
+}
+
+static struct filterRing *createFilterRing(void) {
+    struct filterRing *ring = calloc(1, sizeof(struct filterRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->users = 2;
+    return ring;
+}
+
+static void closeRingWriter(struct filterRing *ring) {
+    __atomic_store_n(&ring->isWriterDone, true, __ATOMIC_SEQ_CST);
+    wakeRingSide(&ring->readerEvents, &ring->isReaderWaiting);
+    dropFilterRing(ring);
+}
+
+static void closeRingReader(struct filterRing *ring) {
+    __atomic_store_n(&ring->isReaderGone, true, __ATOMIC_SEQ_CST);
+    wakeRingSide(&ring->writerEvents, &ring->isWriterWaiting);
+    dropFilterRing(ring);
+}
+
+static void dropFilterRing(struct filterRing *ring) {
+    if (__atomic_sub_fetch(&ring->users, 1, __ATOMIC_ACQ_REL) > 0) {
+        return;
+    }
+    for (int i = 0; i < FILTER_RING_SLOTS; i++) {
+        free(ring->buffers[i]);
+    }
+    free(ring);
+}
+
+static bool takeRingBuffer(struct filterOutput *output) {
+    struct filterRing *ring = output->ring;
+    if (isRingReady(ring, false) == false) {
+        waitForRingSide(ring, &ring->writerEvents, &ring->isWriterWaiting, false);
+    }
+    if (__atomic_load_n(&ring->isReaderGone, __ATOMIC_ACQUIRE)) {
+        output->isBroken = true;
+        return false;
+    }
+    // A slot's buffer is made the first time it is written
+    int slot = ring->head % FILTER_RING_SLOTS;
+    if (ring->buffers[slot] == NULL) {
+        ring->buffers[slot] = malloc(FILTER_BUFFER_SIZE);
+    }
+    output->buffer = ring->buffers[slot];
+    output->used = 0;
+    return true;
+}
+
+static bool passRingBlock(struct filterOutput *output) {
+    struct filterRing *ring = output->ring;
+    if (__atomic_load_n(&ring->isReaderGone, __ATOMIC_ACQUIRE)) {
+        output->isBroken = true;
+        return false;
+    }
+    ring->lengths[ring->head % FILTER_RING_SLOTS] = output->used;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_SEQ_CST);
+    wakeRingSide(&ring->readerEvents, &ring->isReaderWaiting);
+    output->buffer = NULL;
+    output->used = 0;
+    return true;
+}
+
+static ssize_t takeRingBlock(struct filterInput *input) {
+    struct filterRing *ring = input->ring;
+    if (input->block != NULL) {
+        __atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_SEQ_CST);
+        wakeRingSide(&ring->writerEvents, &ring->isWriterWaiting);
+        input->block = NULL;
+    }
+    input->length = 0;
+    input->position = 0;
+    if (isRingReady(ring, true) == false) {
+        waitForRingSide(ring, &ring->readerEvents, &ring->isReaderWaiting, true);
+    }
+    // The writer being done only ends the input once its blocks are read
+    if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail) {
+        return 0;
+    }
+    int slot = ring->tail % FILTER_RING_SLOTS;
+    input->block = ring->buffers[slot];
+    input->length = ring->lengths[slot];
+    return input->length;
+}
+
+static ssize_t readRingLineBlock(struct lineReader *reader, char **block) {
+    struct filterInput *input = reader->input;
+    if (reader->consumed > 0) {
+        // The line gathered last time has been read
+        reader->used = 0;
+        reader->consumed = 0;
+    }
+    while (1) {
+        if (input->position == input->length && takeRingBlock(input) == 0) {
+            // Whatever is left is the last line
+            reader->consumed = reader->used;
+            *block = reader->buffer;
+            return reader->used;
+        }
+        char *start = input->block + input->position;
+        size_t length = input->length - input->position;
+        if (reader->used == 0) {
+            char *newline = memrchr(start, '\n', length);
+            if (newline != NULL) {
+                input->position += newline - start + 1;
+                *block = start;
+                return newline - start + 1;
+            }
+        } else {
+            char *newline = memchr(start, '\n', length);
+            if (newline != NULL) {
+                length = newline - start + 1;
+            }
+        }
+        // A line carrying on into the next block is gathered in the buffer
+        while (reader->used + length > reader->size) {
+            reader->size *= 2;
+            reader->buffer = realloc(reader->buffer, reader->size);
+        }
+        memcpy(reader->buffer + reader->used, start, length);
+        reader->used += length;
+        input->position += length;
+        if (reader->buffer[reader->used - 1] == '\n') {
+            reader->consumed = reader->used;
+            *block = reader->buffer;
+            return reader->used;
+        }
+    }
+}
+
+static void wakeRingSide(uint32_t *events, bool *isWaiting) {
+    __atomic_add_fetch(events, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(isWaiting, __ATOMIC_SEQ_CST)) {
+        syscall(SYS_futex, events, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+static void waitForRingSide(struct filterRing *ring, uint32_t *events, bool *isWaiting, bool isReader) {
+    for (int spins = 0; isRingReady(ring, isReader) == false; spins++) {
+        if (spins < FILTER_RING_SPINS) {
+#if defined(__x86_64__)
+            _mm_pause();
+#endif
+            continue;
+        }
+        // The events are read before saying so, so if the other side moves
+        // on after the check below, the futex sees them changed or it is 
+        // woken
+        uint32_t seen = __atomic_load_n(events, __ATOMIC_ACQUIRE);
+        __atomic_store_n(isWaiting, true, __ATOMIC_SEQ_CST);
+        if (isRingReady(ring, isReader) == false) {
+            syscall(SYS_futex, events, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+        }
+        __atomic_store_n(isWaiting, false, __ATOMIC_RELAXED);
+    }
+}
+
+static bool isRingReady(struct filterRing *ring, bool isReader) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    if (isReader) {
+        return head != tail || __atomic_load_n(&ring->isWriterDone, __ATOMIC_SEQ_CST);
+    }
+    return head - tail < FILTER_RING_SLOTS || __atomic_load_n(&ring->isReaderGone, __ATOMIC_SEQ_CST);
+}
+
+// ===================== SUBSET 27 =====================
+
+static bool parseCodec(char *text) {
+    // A format, and a level after a colon
+    char *colon = strchr(text, ':');
+    size_t nameLength = (colon != NULL) ? (size_t) (colon - text) : strlen(text);
+    int format;
+    int maxLevel;
+    if (nameLength == 4 && strncmp(text, "gzip", 4) == 0) {
+        format = CODEC_GZIP;
+        maxLevel = 9;
+    } else if (nameLength == 4 && strncmp(text, "zstd", 4) == 0) {
+        format = CODEC_ZSTD;
+        maxLevel = 19;
+    } else if (nameLength == 4 && strncmp(text, "none", 4) == 0) {
+        format = CODEC_NONE;
+        maxLevel = 0;
+    } else if (nameLength == 4 && strncmp(text, "auto", 4) == 0) {
+        format = CODEC_AUTO;
+        maxLevel = 0;
+    } else {
+        return false;
+    }
+    long level = 0;
+    if (colon != NULL) {
+        char *end;
+        level = strtol(colon + 1, &end, 10);
+        if (colon[1] == '\0' || *end != '\0' || level < 1 || level > maxLevel) {
+            return false;
+        }
+    }
+    commandLimits.codec = format;
+    commandLimits.codecLevel = level;
+    return true;
+}
+
+static int openProgramRedirection(char *fileName, int redirectOption) {
+    int fd = openRedirectionFile(fileName, redirectOption);
+    if (fd == -1) {
+        return -1;
+    }
+    int format = getCodecFormat(fd, fileName, redirectOption);
+    if (format == CODEC_NONE) {
+        return fd;
+    }
+    bool isCompressing = (redirectOption != REDIR_INPUT);
+    if (loadCodecLibrary(format) == false) {
+        char *library = (format == CODEC_GZIP) ? "zlib" : "libzstd";
+        if (isCompressing == false) {
+            // The program is given the file as it would have been before
+            fprintf(stderr, "%s: %s couldn't be loaded, so it is read as it is\n", fileName, library);
+            return fd;
+        }
+        close(fd);
+        errno = ELIBACC;
+        return -1;
+    }
+    int pipeFD = startCodec(fd, fileName, format, isCompressing);
+    if (pipeFD == -1) {
+        int error = errno;
+        close(fd);
+        errno = error;
+    }
+    return pipeFD;
+}
+
+static int getCodecFormat(int fd, char *fileName, int redirectOption) {
+    // Files are given to programs as they are unless a prefix asks, as 
+    // programs such as gunzip or sha256sum want the compressed bytes
+    if (redirectOption == REDIR_INPUT) {
+        if (commandLimits.isDecompressing == false) {
+            return CODEC_NONE;
+        }
+        // Input is known by its magic bytes, which a pipe or a terminal 
+        // can't be read for without taking them from the program
+        unsigned char magic[4];
+        ssize_t length = pread(fd, magic, sizeof(magic), 0);
+        return getMagicFormat(magic, (length > 0) ? length : 0);
+    }
+    if (commandLimits.codec != CODEC_AUTO) {
+        return commandLimits.codec;
+    }
+    size_t length = strlen(fileName);
+    if (length > 3 && strcmp(fileName + length - 3, ".gz") == 0) {
+        return CODEC_GZIP;
+    }
+    if (length > 4 && strcmp(fileName + length - 4, ".zst") == 0) {
+        return CODEC_ZSTD;
+    }
+    return CODEC_NONE;
+}
+
+static int getMagicFormat(unsigned char *data, size_t length) {
+    if (length >= 2 && data[0] == 0x1f && data[1] == 0x8b) {
+        return CODEC_GZIP;
+    }
+    if (length >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd) {
+        return CODEC_ZSTD;
+    }
+    return CODEC_NONE;
+}
+
+static bool loadCodecLibrary(int format) {
+    struct codecLibraries *libraries = &codecLibraries;
+    if (libraries->isLoaded == false) {
+        libraries->isLoaded = true;
+        void *zlib = dlopen("libz.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (zlib != NULL) {
+            libraries->zlibVersion = dlsym(zlib, "zlibVersion");
+            libraries->deflateInit2 = dlsym(zlib, "deflateInit2_");
+            libraries->deflate = dlsym(zlib, "deflate");
+            libraries->deflateEnd = dlsym(zlib, "deflateEnd");
+            libraries->inflateInit2 = dlsym(zlib, "inflateInit2_");
+            libraries->inflate = dlsym(zlib, "inflate");
+            libraries->inflateReset = dlsym(zlib, "inflateReset");
+            libraries->inflateEnd = dlsym(zlib, "inflateEnd");
+            libraries->hasZlib = (libraries->zlibVersion != NULL && libraries->deflateInit2 != NULL && 
+                                  libraries->deflate != NULL && libraries->deflateEnd != NULL && 
+                                  libraries->inflateInit2 != NULL && libraries->inflate != NULL && 
+                                  libraries->inflateReset != NULL && libraries->inflateEnd != NULL);
+        }
+        void *zstd = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+        if (zstd != NULL) {
+            libraries->createDContext = dlsym(zstd, "ZSTD_createDCtx");
+            libraries->decompressStream = dlsym(zstd, "ZSTD_decompressStream");
+            libraries->freeDContext = dlsym(zstd, "ZSTD_freeDCtx");
+            libraries->createCContext = dlsym(zstd, "ZSTD_createCCtx");
+            libraries->setCParameter = dlsym(zstd, "ZSTD_CCtx_setParameter");
+            libraries->compressStream2 = dlsym(zstd, "ZSTD_compressStream2");
+            libraries->freeCContext = dlsym(zstd, "ZSTD_freeCCtx");
+            libraries->isError = dlsym(zstd, "ZSTD_isError");
+            libraries->getErrorName = dlsym(zstd, "ZSTD_getErrorName");
+            libraries->hasZstd = (libraries->createDContext != NULL && libraries->decompressStream != NULL && 
+                                  libraries->freeDContext != NULL && libraries->createCContext != NULL && 
+                                  libraries->setCParameter != NULL && libraries->compressStream2 != NULL && 
+                                  libraries->freeCContext != NULL && libraries->isError != NULL && 
+                                  libraries->getErrorName != NULL);
+        }
+    }
+    return (format == CODEC_GZIP) ? libraries->hasZlib : libraries->hasZstd;
+}
+
+static int startCodec(int fileFD, char *fileName, int format, bool isCompressing) {
+    int slot = 0;
+    while (slot < CODEC_MAX_THREADS && codecThreads[slot].isUsed) {
+        slot++;
+    }
+    if (slot == CODEC_MAX_THREADS) {
+        errno = EAGAIN;
+        return -1;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        return -1;
+    }
+    // A big pipe lets the codec and the program each run a long way ahead
+    fcntl(fds[1], F_SETPIPE_SZ, CODEC_PIPE_SIZE);
+    struct codecThread *codec = &codecThreads[slot];
+    codec->format = format;
+    codec->level = commandLimits.codecLevel;
+    if (codec->level == 0) {
+        codec->level = (format == CODEC_GZIP) ? CODEC_GZIP_LEVEL : CODEC_ZSTD_LEVEL;
+    }
+    codec->isCompressing = isCompressing;
+    codec->fileFD = fileFD;
+    codec->pipeFD = isCompressing ? fds[0] : fds[1];
+    codec->fileName = strdup(fileName);
+    codec->firstBlock = NULL;
+    codec->firstLength = 0;
+    // As for filters, a program going away only fails the codec's writes
+    sigset_t allSignals;
+    sigset_t oldMask;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &oldMask);
+    int result = pthread_create(&codec->thread, NULL, runCodec, codec);
+    pthread_sigmask(SIG_SETMASK, &oldMask, NULL);
+    if (result != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        free(codec->fileName);
+        errno = result;
+        return -1;
+    }
+    codec->isUsed = true;
+    return isCompressing ? fds[1] : fds[0];
+}
+
+static void finishCodecs(void) {
+    for (int i = 0; i < CODEC_MAX_THREADS; i++) {
+        if (codecThreads[i].isUsed) {
+            pthread_join(codecThreads[i].thread, NULL);
+            free(codecThreads[i].fileName);
+            codecThreads[i].isUsed = false;
+        }
+    }
+}
+
+static void *runCodec(void *argument) {
+    struct codecThread *codec = argument;
+    bool isDone;
+    if (codec->isCompressing) {
+        // A program that compresses its own output, like gzip -c, has it 
+        // stored as it is rather than compressed twice
+        codec->firstBlock = malloc(CODEC_BUFFER_SIZE);
+        while (codec->firstLength < 4) {
+            ssize_t length = readCodecBlock(codec->pipeFD, codec->firstBlock + codec->firstLength, 
+                                            CODEC_BUFFER_SIZE - codec->firstLength);
+            if (length <= 0) {
+                break;
+            }
+            codec->firstLength += length;
+        }
+        if (getMagicFormat((unsigned char *) codec->firstBlock, codec->firstLength) != CODEC_NONE) {
+            isDone = storeFile(codec);
+        } else {
+            isDone = (codec->format == CODEC_GZIP) ? deflateFile(codec) : compressZstdFile(codec);
+        }
+        free(codec->firstBlock);
+    } else {
+        isDone = (codec->format == CODEC_GZIP) ? inflateFile(codec) : decompressZstdFile(codec);
+    }
+    // Closing the pipe is what ends the program's input
+    close(codec->pipeFD);
+    if (close(codec->fileFD) == -1 && isDone && codec->isCompressing) {
+        fprintf(stderr, "%s: %s\n", codec->fileName, strerror(errno));
+    }
+    return NULL;
+}
+
+static bool inflateFile(struct codecThread *codec) {
+    struct codecLibraries *libraries = &codecLibraries;
+    struct zlibStream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Gzip and zlib headers are both recognised
+    if (libraries->inflateInit2(&stream, ZLIB_ANY_WINDOW, libraries->zlibVersion(), sizeof(stream)) != ZLIB_OK) {
+        fprintf(stderr, "%s: couldn't start zlib\n", codec->fileName);
+        return false;
+    }
+    unsigned char *input = malloc(CODEC_BUFFER_SIZE);
+    unsigned char *output = malloc(CODEC_BUFFER_SIZE);
+    const char *error = NULL;
+    int result = ZLIB_OK;
+    // Set when the output filled up, so there may be more without reading
+    bool isFull = false;
+    while (1) {
+        ssize_t length = 0;
+        if (result == ZLIB_STREAM_END) {
+            // Another member can follow, as it does after appending
+            if (stream.availableIn == 0 && (length = readCodecBlock(codec->fileFD, input, CODEC_BUFFER_SIZE)) <= 0) {
+                error = (length == -1) ? strerror(errno) : NULL;
+                break;
+            }
+            libraries->inflateReset(&stream);
+            isFull = false;
+        } else if (stream.availableIn == 0 && isFull == false) {
+            length = readCodecBlock(codec->fileFD, input, CODEC_BUFFER_SIZE);
+            if (length <= 0) {
+                error = (length == -1) ? strerror(errno) : "unexpected end of file";
+                break;
+            }
+        }
+        if (length > 0) {
+            stream.nextIn = input;
+            stream.availableIn = length;
+        }
+        stream.nextOut = output;
+        stream.availableOut = CODEC_BUFFER_SIZE;
+        result = libraries->inflate(&stream, ZLIB_NO_FLUSH);
+        if (result != ZLIB_OK && result != ZLIB_STREAM_END && result != ZLIB_BUF_ERROR) {
+            error = (stream.message != NULL) ? stream.message : "invalid compressed data";
+            break;
+        }
+        isFull = (stream.availableOut == 0);
+        size_t produced = CODEC_BUFFER_SIZE - stream.availableOut;
+        if (produced > 0 && writeAll(codec->pipeFD, (char *) output, produced) == false) {
+            // The program has stopped reading, so the rest isn't wanted
+            break;
+        }
+    }
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", codec->fileName, error);
+    }
+    libraries->inflateEnd(&stream);
+    free(input);
+    free(output);
+    return error == NULL;
+}
+
+static bool decompressZstdFile(struct codecThread *codec) {
+    struct codecLibraries *libraries = &codecLibraries;
+    void *context = libraries->createDContext();
+    struct zstdBuffer input = {malloc(CODEC_BUFFER_SIZE), 0, 0};
+    char *output = malloc(CODEC_BUFFER_SIZE);
+    const char *error = NULL;
+    // 0 once a frame has ended, and frames can follow one another
+    size_t result = 0;
+    bool isFull = false;
+    while (1) {
+        if (input.position == input.size && isFull == false) {
+            ssize_t length = readCodecBlock(codec->fileFD, input.data, CODEC_BUFFER_SIZE);
+            if (length == -1) {
+                error = strerror(errno);
+            } else if (length == 0 && result != 0) {
+                error = "unexpected end of file";
+            }
+            if (length <= 0) {
+                break;
+            }
+            input.size = length;
+            input.position = 0;
+        }
+        struct zstdBuffer block = {output, CODEC_BUFFER_SIZE, 0};
+        result = libraries->decompressStream(context, &block, &input);
+        if (libraries->isError(result)) {
+            error = libraries->getErrorName(result);
+            break;
+        }
+        isFull = (block.position == block.size);
+        if (block.position > 0 && writeAll(codec->pipeFD, output, block.position) == false) {
+            break;
+        }
+    }
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", codec->fileName, error);
+    }
+    libraries->freeDContext(context);
+    free(input.data);
+    free(output);
+    return error == NULL;
+}
+
+static bool deflateFile(struct codecThread *codec) {
+    struct codecLibraries *libraries = &codecLibraries;
+    struct zlibStream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (libraries->deflateInit2(&stream, codec->level, ZLIB_DEFLATED, ZLIB_GZIP_WINDOW, 8, 0, 
+                                libraries->zlibVersion(), sizeof(stream)) != ZLIB_OK) {
+        fprintf(stderr, "%s: couldn't start zlib\n", codec->fileName);
+        return false;
+    }
+    unsigned char *input = malloc(CODEC_BUFFER_SIZE);
+    unsigned char *output = malloc(CODEC_BUFFER_SIZE);
+    bool isEnded = false;
+    bool isWritten = true;
+    while (isEnded == false && isWritten) {
+        // The program closing its end ends the file
+        ssize_t length = readCodecInput(codec, input, CODEC_BUFFER_SIZE);
+        isEnded = (length <= 0);
+        stream.nextIn = input;
+        stream.availableIn = (length > 0) ? length : 0;
+        int result;
+        do {
+            stream.nextOut = output;
+            stream.availableOut = CODEC_BUFFER_SIZE;
+            result = libraries->deflate(&stream, isEnded ? ZLIB_FINISH : ZLIB_NO_FLUSH);
+            size_t produced = CODEC_BUFFER_SIZE - stream.availableOut;
+            isWritten = (produced == 0 || writeAll(codec->fileFD, (char *) output, produced));
+        } while (isWritten && (stream.availableOut == 0 || (isEnded && result == ZLIB_OK)));
+    }
+    if (isWritten == false) {
+        fprintf(stderr, "%s: %s\n", codec->fileName, strerror(errno));
+    }
+    libraries->deflateEnd(&stream);
+    free(input);
+    free(output);
+    return isWritten;
+}
+
+static bool compressZstdFile(struct codecThread *codec) {
+    struct codecLibraries *libraries = &codecLibraries;
+    void *context = libraries->createCContext();
+    libraries->setCParameter(context, ZSTD_C_COMPRESSION_LEVEL, codec->level);
+    // Blocks are compressed on a worker per CPU. A libzstd built without
+    // threads refuses, and compresses on this thread instead
+    long numberOfCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numberOfCPUs > 1) {
+        libraries->setCParameter(context, ZSTD_C_NB_WORKERS, numberOfCPUs);
+    }
+    char *output = malloc(CODEC_BUFFER_SIZE);
+    struct zstdBuffer input = {malloc(CODEC_BUFFER_SIZE), 0, 0};
+    const char *error = NULL;
+    bool isEnded = false;
+    while (isEnded == false && error == NULL) {
+        ssize_t length = readCodecInput(codec, input.data, CODEC_BUFFER_SIZE);
+        isEnded = (length <= 0);
+        input.size = (length > 0) ? length : 0;
+        input.position = 0;
+        size_t remaining;
+        do {
+            struct zstdBuffer block = {output, CODEC_BUFFER_SIZE, 0};
+            remaining = libraries->compressStream2(context, &block, &input, isEnded ? ZSTD_E_END : ZSTD_E_CONTINUE);
+            if (libraries->isError(remaining)) {
+                error = libraries->getErrorName(remaining);
+            } else if (block.position > 0 && writeAll(codec->fileFD, output, block.position) == false) {
+                error = strerror(errno);
+            }
+        } while (error == NULL && (isEnded ? remaining != 0 : input.position < input.size));
+    }
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", codec->fileName, error);
+    }
+    libraries->freeCContext(context);
+    free(input.data);
+    free(output);
+    return error == NULL;
+}
+
+static bool storeFile(struct codecThread *codec) {
+    char *buffer = malloc(CODEC_BUFFER_SIZE);
+    bool isWritten = true;
+    ssize_t length;
+    while (isWritten && (length = readCodecInput(codec, buffer, CODEC_BUFFER_SIZE)) > 0) {
+        isWritten = writeAll(codec->fileFD, buffer, length);
+    }
+    if (isWritten == false) {
+        fprintf(stderr, "%s: %s\n", codec->fileName, strerror(errno));
+    }
+    free(buffer);
+    return isWritten;
+}
+
+static ssize_t readCodecBlock(int fd, void *buffer, size_t size) {
+    ssize_t length;
+    do {
+        length = read(fd, buffer, size);
+    } while (length == -1 && errno == EINTR);
+    return length;
+}
+
+static ssize_t readCodecInput(struct codecThread *codec, void *buffer, size_t size) {
+    if (codec->firstLength == 0) {
+        return readCodecBlock(codec->pipeFD, buffer, size);
+    }
+    // Every caller's buffer holds a whole block
+    size_t length = codec->firstLength;
+    memcpy(buffer, codec->firstBlock, length);
+    codec->firstLength = 0;
+    return length;
+}
+
+// ===================== SUBSET 28 =====================
+
+static void coproc(char **words, char **path, char **environment) {
+    if (words[1] == NULL) {
+        for (int i = 0; i < numberOfCoprocesses; i++) {
+            struct coprocess *coprocess = &coprocesses[i];
+            int pid = isCoprocessRunning(coprocess) ? coprocess->pid : -1;
+            printf("%s\t%d\t%d\t", coprocess->name, pid, coprocess->restarts);
+            for (int j = 0; coprocess->words[j] != NULL; j++) {
+                printf((j == 0) ? "%s" : " %s", coprocess->words[j]);
+            }
+            printf("\n");
+        }
+        return;
+    }
+    int i = 1;
+    char *delimiter = NULL;
+    bool isStopping = false;
+    if (strcmp(words[i], "-k") == 0) {
+        isStopping = true;
+        i++;
+    } else if (strcmp(words[i], "-d") == 0 && words[i + 1] != NULL) {
+        delimiter = words[i + 1];
+        i += 2;
+    }
+    if (words[i] == NULL || (isStopping == false && words[i + 1] == NULL) || (isStopping && words[i + 1] != NULL)) {
+        fprintf(stderr, "usage: coproc [-d DELIMITER] NAME COMMAND..., or coproc -k NAME\n");
+        lastExitStatus = 2;
+        return;
+    }
+    struct coprocess *coprocess = findCoprocess(words[i]);
+    if (coprocess != NULL) {
+        // Starting one under a name already used replaces it
+        stopCoprocess(coprocess);
+        free(coprocess->name);
+        freeStrings(coprocess->words);
+        free(coprocess->delimiter);
+        free(coprocess->pending.data);
+        *coprocess = coprocesses[numberOfCoprocesses - 1];
+        numberOfCoprocesses--;
+    } else if (isStopping) {
+        fprintf(stderr, "%s: %s: no such coprocess\n", words[0], words[i]);
+        lastExitStatus = 1;
+        return;
+    }
+    if (isStopping) {
+        return;
+    }
+    if (numberOfCoprocesses == COPROCESS_MAX) {
+        fprintf(stderr, "%s: at most %d coprocesses can run at once\n", words[0], COPROCESS_MAX);
+        lastExitStatus = 1;
+        return;
+    }
+    coprocess = &coprocesses[numberOfCoprocesses];
+    memset(coprocess, 0, sizeof(struct coprocess));
+    coprocess->words = copyStrings(&words[i + 1]);
+    if (startCoprocess(coprocess, path, environment) == false) {
+        freeStrings(coprocess->words);
+        lastExitStatus = 1;
+        return;
+    }
+    coprocess->name = strdup(words[i]);
+    coprocess->delimiter = (delimiter != NULL) ? strdup(delimiter) : NULL;
+    numberOfCoprocesses++;
+    if (coprocessOwner == 0) {
+        coprocessOwner = getpid();
+        atexit(stopCoprocesses);
+    }
+}
+
+static void stopCoprocesses(void) {
+    if (getpid() != coprocessOwner) {
+        return;
+    }
+    for (int i = 0; i < numberOfCoprocesses; i++) {
+        stopCoprocess(&coprocesses[i]);
+    }
+}
+
+static void ask(char **words, char **path, char **environment) {
+    struct capture response = {NULL, 0, 0};
+    if (askCoprocess(words, &response, path, environment) == false) {
+        if (lastExitStatus == 0) {
+            lastExitStatus = 1;
+        }
+    } else if (response.length > 0) {
+        fwrite(response.data, 1, response.length, stdout);
+    }
+    free(response.data);
+}
+
+static bool askCoprocess(char **words, struct capture *response, char **path, char **environment) {
+    if (words[1] == NULL) {
+        fprintf(stderr, "usage: ask NAME [REQUEST...]\n");
+        return false;
+    }
+    struct coprocess *coprocess = findCoprocess(words[1]);
+    if (coprocess == NULL) {
+        fprintf(stderr, "%s: %s: no such coprocess\n", words[0], words[1]);
+        return false;
+    }
+    struct capture request = {NULL, 0, 0};
+    for (int i = 2; words[i] != NULL; i++) {
+        size_t length = strlen(words[i]);
+        reserveCapture(&request, length + 1);
+        memcpy(request.data + request.length, words[i], length);
+        request.length += length;
+        request.data[request.length++] = (words[i + 1] != NULL) ? ' ' : '\n';
+    }
+    if (request.length == 0) {
+        reserveCapture(&request, 1);
+        request.data[request.length++] = '\n';
+    }
+    // A coprocess that exited since the last request is started again, and 
+    // one found gone while the request is written is given it again once
+    // restarted, as it can't have read it
+    bool isSent = false;
+    bool isStarted = true;
+    int writeError = 0;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (isCoprocessRunning(coprocess) == false) {
+            stopCoprocess(coprocess);
+            isStarted = startCoprocess(coprocess, path, environment);
+            if (isStarted == false) {
+                break;
+            }
+            coprocess->restarts++;
+        }
+        // SIGPIPE is only held off while writing, so the program isn't 
+        // started with it blocked
+        sigset_t pipeSignal;
+        sigset_t oldMask;
+        sigemptyset(&pipeSignal);
+        sigaddset(&pipeSignal, SIGPIPE);
+        sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+        isSent = writeAll(coprocess->requestFD, request.data, request.length);
+        writeError = errno;
+        struct timespec noWait = {0, 0};
+        while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+        sigprocmask(SIG_SETMASK, &oldMask, NULL);
+        if (isSent || writeError != EPIPE) {
+            break;
+        }
+        // It stopped reading without having exited yet
+        stopCoprocess(coprocess);
+    }
+    if (isSent == false && isStarted) {
+        fprintf(stderr, "%s: %s: %s\n", words[0], words[1], strerror(writeError));
+    }
+    free(request.data);
+    if (isSent == false) {
+        return false;
+    }
+    // The response is read as it arrives, for as long as a timeout prefix 
+    // allows
+    double deadline = (commandLimits.timeout > 0) ? getMonotonicTime() + commandLimits.timeout : 0;
+    size_t length;
+    size_t used;
+    while ((used = findResponseEnd(coprocess, &length)) == 0) {
+        int timeoutMS = -1;
+        if (deadline > 0) {
+            double remaining = deadline - getMonotonicTime();
+            timeoutMS = (remaining > 0) ? (int) (remaining * 1000) + 1 : 0;
+        }
+        struct pollfd pollFD = {coprocess->responseFD, POLLIN, 0};
+        int ready = poll(&pollFD, 1, timeoutMS);
+        if (ready == -1 && errno == EINTR) {
+            continue;
+        }
+        if (ready == 0) {
+            // A late response would be taken for the next one's, so the 
+            // coprocess is started afresh for that
+            fprintf(stderr, "%s: %s: timed out\n", words[0], words[1]);
+            stopCoprocess(coprocess);
+            lastExitStatus = TIMEOUT_EXIT_STATUS;
+            return false;
+        }
+        struct capture *pending = &coprocess->pending;
+        reserveCapture(pending, COPROCESS_READ_SIZE);
+        ssize_t bytesRead = read(coprocess->responseFD, pending->data + pending->length, COPROCESS_READ_SIZE);
+        if (bytesRead == -1 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead <= 0) {
+            fprintf(stderr, "%s: %s: exited before responding\n", words[0], words[1]);
+            stopCoprocess(coprocess);
+            return false;
+        }
+        pending->length += bytesRead;
+    }
+    struct capture *pending = &coprocess->pending;
+    reserveCapture(response, length);
+    memcpy(response->data + response->length, pending->data, length);
+    response->length += length;
+    response->data[response->length] = '\0';
+    memmove(pending->data, pending->data + used, pending->length - used);
+    pending->length -= used;
+    return true;
+}
+
+static struct coprocess *findCoprocess(char *name) {
+    for (int i = 0; i < numberOfCoprocesses; i++) {
+        if (strcmp(coprocesses[i].name, name) == 0) {
+            return &coprocesses[i];
+        }
+    }
+    return NULL;
+}
+
+static bool startCoprocess(struct coprocess *coprocess, char **path, char **environment) {
+    char *programPath = getPathToProgram(coprocess->words[0], path);
+    if (programPath == NULL || is_executable(programPath) == false) {
+        executionError(coprocess->words, programPath);
+        return false;
+    }
+    int requestPipe[2];
+    int responsePipe[2];
+    if (pipe2(requestPipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return false;
+    }
+    if (pipe2(responsePipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        close(requestPipe[0]);
+        close(requestPipe[1]);
+        return false;
+    }
+    struct spawnActions actions;
+    initSpawnActions(&actions);
+    addSpawnDup2(&actions, requestPipe[0], 0);
+    addSpawnDup2(&actions, responsePipe[1], 1);
+    // It gets a process group of its own, so ^C at the prompt leaves it be
+    int spawnResult = startProgram(&coprocess->pid, programPath, &actions, 0, coprocess->words, environment);
+    close(requestPipe[0]);
+    close(responsePipe[1]);
+    if (spawnResult != 0) {
+        errno = spawnResult;
+        perror("spawn:");
+        close(requestPipe[1]);
+        close(responsePipe[0]);
+        coprocess->pid = -1;
+        return false;
+    }
+    coprocess->pidFD = syscall(SYS_pidfd_open, coprocess->pid, 0);
+    coprocess->requestFD = requestPipe[1];
+    coprocess->responseFD = responsePipe[0];
+    coprocess->pending.length = 0;
+    return true;
+}
+
+static void stopCoprocess(struct coprocess *coprocess) {
+    if (coprocess->pid == -1) {
+        return;
+    }
+    close(coprocess->requestFD);
+    close(coprocess->responseFD);
+    if (coprocess->pidFD != -1) {
+        struct pollfd pollFD = {coprocess->pidFD, POLLIN, 0};
+        if (poll(&pollFD, 1, COPROCESS_STOP_MS) == 0) {
+            kill(coprocess->pid, SIGKILL);
+        }
+        close(coprocess->pidFD);
+    } else {
+        kill(coprocess->pid, SIGKILL);
+    }
+    // Something else may have reaped it already
+    waitpid(coprocess->pid, NULL, 0);
+    coprocess->pid = -1;
+}
+
+static bool isCoprocessRunning(struct coprocess *coprocess) {
+    if (coprocess->pid == -1) {
+        return false;
+    }
+    if (coprocess->pidFD != -1) {
+        struct pollfd pollFD = {coprocess->pidFD, POLLIN, 0};
+        return poll(&pollFD, 1, 0) == 0;
+    }
+    return waitpid(coprocess->pid, NULL, WNOHANG) == 0;
+}
+
+static size_t findResponseEnd(struct coprocess *coprocess, size_t *length) {
+    struct capture *pending = &coprocess->pending;
+    char *start = pending->data;
+    char *end = pending->data + pending->length;
+    if (coprocess->delimiter == NULL) {
+        char *newline = (pending->length > 0) ? memchr(start, '\n', pending->length) : NULL;
+        if (newline == NULL) {
+            return 0;
+        }
+        *length = newline + 1 - start;
+        return *length;
+    }
+    size_t delimiterLength = strlen(coprocess->delimiter);
+    char *line = start;
+    char *newline;
+    while (line < end && (newline = memchr(line, '\n', end - line)) != NULL) {
+        if ((size_t) (newline - line) == delimiterLength && memcmp(line, coprocess->delimiter, delimiterLength) == 0) {
+            // The delimiter's own line isn't part of the response
+            *length = line - start;
+            return newline + 1 - start;
+        }
+        line = newline + 1;
+    }
+    return 0;
+}
+
+// ===================== SUBSET 29 =====================
+
+static bool parseCopies(char *word, char *value, struct processSettings *settings) {
+    char *end;
+    long copies = strtol(value, &end, 10);
+    if (end == value || copies < 1 || copies > PARALLEL_MAX_COPIES) {
+        fprintf(stderr, "%s: expected 1 to %d copies\n", word, PARALLEL_MAX_COPIES);
+        return false;
+    }
+    if (strcmp(end, ",unordered") == 0) {
+        settings->isUnordered = true;
+    } else if (*end != '\0') {
+        fprintf(stderr, "%s: expected @par=N or @par=N,unordered\n", word);
+        return false;
+    }
+    settings->copies = copies;
+    return true;
+}
+
+static bool startParallelStage(struct parallelStage *stage, char **words, char *programPath, 
+                               struct processSettings *settings, int inputFD, int outputFD, 
+                               bool isToNextStage) {
+    memset(stage, 0, sizeof(struct parallelStage));
+    stage->words = words;
+    stage->programPath = programPath;
+    stage->settings = *settings;
+    // The stage's ends of its links are closed along with the others', so 
+    // it works on copies of them, as a filter does
+    stage->inputFD = fcntl((inputFD == -1) ? 0 : inputFD, F_DUPFD_CLOEXEC, 3);
+    stage->outputFD = fcntl((outputFD == -1) ? 1 : outputFD, F_DUPFD_CLOEXEC, 3);
+    if (stage->inputFD == -1 || stage->outputFD == -1) {
+        if (stage->inputFD != -1) {
+            close(stage->inputFD);
+        }
+        if (stage->outputFD != -1) {
+            close(stage->outputFD);
+        }
+        return false;
+    }
+    if (isToNextStage) {
+        // The next stage may be parallel as well, and so read by the shell,
+        // which can't then wait for room in the pipe
+        fcntl(stage->outputFD, F_SETFL, O_NONBLOCK);
+    }
+    stage->numberOfChunks = 2 * settings->copies;
+    stage->chunks = calloc(stage->numberOfChunks, sizeof(struct parallelChunk));
+    return true;
+}
+
+static void runParallelStages(struct parallelStage *stages, int numberOfStages, char **environment) {
+    // Copies and the next stage can stop reading at any time, which only 
+    // fails the write rather than raising SIGPIPE in the shell
+    sigset_t pipeSignal;
+    sigset_t oldMask;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+    int maxPollFDs = 1;
+    for (int i = 0; i < numberOfStages; i++) {
+        stages[i].signalMask = oldMask;
+        maxPollFDs += 2 + 2 * stages[i].numberOfChunks;
+    }
+    struct pollfd *pollFDs = malloc(sizeof(struct pollfd) * maxPollFDs);
+    // The stage and chunk, if any, each polled fd belongs to
+    struct parallelStage **pollStages = malloc(sizeof(struct parallelStage *) * maxPollFDs);
+    struct parallelChunk **pollChunks = malloc(sizeof(struct parallelChunk *) * maxPollFDs);
+    while (1) {
+        int numberOfPollFDs = 0;
+        int timeoutMS = -1;
+        bool isRunning = false;
+        for (int i = 0; i < numberOfStages; i++) {
+            struct parallelStage *stage = &stages[i];
+            while (startParallelChunk(stage, environment));
+            bool hasChunks = false;
+            for (int j = 0; j < stage->numberOfChunks; j++) {
+                struct parallelChunk *chunk = &stage->chunks[j];
+                hasChunks = hasChunks || chunk->isUsed;
+                if (chunk->requestFD != -1 && chunk->isUsed) {
+                    pollFDs[numberOfPollFDs] = (struct pollfd) {chunk->requestFD, POLLOUT, 0};
+                    pollStages[numberOfPollFDs] = stage;
+                    pollChunks[numberOfPollFDs++] = chunk;
+                }
+                if (chunk->responseFD != -1 && chunk->isUsed) {
+                    pollFDs[numberOfPollFDs] = (struct pollfd) {chunk->responseFD, POLLIN, 0};
+                    pollStages[numberOfPollFDs] = stage;
+                    pollChunks[numberOfPollFDs++] = chunk;
+                }
+            }
+            if (stage->inputFD == -1 && stage->pending.length == 0 && hasChunks == false) {
+                // Closing the output is the end of the next stage's input
+                if (stage->outputFD != -1) {
+                    close(stage->outputFD);
+                    stage->outputFD = -1;
+                }
+                continue;
+            }
+            isRunning = true;
+            // Input is read until there's a chunk's worth of whole lines 
+            // waiting for a copy
+            struct capture *pending = &stage->pending;
+            bool isChunkReady = pending->length >= PARALLEL_CHUNK_SIZE && 
+                                memrchr(pending->data, '\n', pending->length) != NULL;
+            if (stage->inputFD != -1 && isChunkReady == false) {
+                pollFDs[numberOfPollFDs] = (struct pollfd) {stage->inputFD, POLLIN, 0};
+                pollStages[numberOfPollFDs] = stage;
+                pollChunks[numberOfPollFDs++] = NULL;
+            }
+            struct parallelChunk *next = findNextOutput(stage);
+            if (stage->outputFD != -1 && next != NULL && next->outputWritten < next->output.length) {
+                pollFDs[numberOfPollFDs] = (struct pollfd) {stage->outputFD, POLLOUT, 0};
+                pollStages[numberOfPollFDs] = stage;
+                pollChunks[numberOfPollFDs++] = NULL;
+            }
+            int flushMS = getParallelFlushTimeout(stage);
+            if (flushMS != -1 && (timeoutMS == -1 || flushMS < timeoutMS)) {
+                timeoutMS = flushMS;
+            }
+        }
+        if (isRunning == false) {
+            break;
+        }
+        int timerIndex = -1;
+        if (commandLimits.timerFD != -1) {
+            timerIndex = numberOfPollFDs;
+            pollFDs[numberOfPollFDs++] = (struct pollfd) {commandLimits.timerFD, POLLIN, 0};
+        }
+        if (poll(pollFDs, numberOfPollFDs, timeoutMS) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            break;
+        }
+        if (timerIndex != -1 && (pollFDs[timerIndex].revents & POLLIN)) {
+            handleDeadline();
+        }
+        for (int n = 0; n < numberOfPollFDs; n++) {
+            if (pollFDs[n].revents == 0 || n == timerIndex) {
+                continue;
+            }
+            // No fd is opened while these are handled, so one closed by an
+            // earlier event can't be mistaken for another
+            struct parallelStage *stage = pollStages[n];
+            struct parallelChunk *chunk = pollChunks[n];
+            if (chunk != NULL && pollFDs[n].fd == chunk->requestFD) {
+                writeParallelChunk(chunk);
+            } else if (chunk != NULL && pollFDs[n].fd == chunk->responseFD) {
+                readParallelOutput(stage, chunk);
+            } else if (chunk == NULL && pollFDs[n].fd == stage->inputFD) {
+                readParallelInput(stage);
+            } else if (chunk == NULL && pollFDs[n].fd == stage->outputFD) {
+                writeParallelOutput(stage);
+            }
+        }
+        for (int i = 0; i < numberOfStages; i++) {
+            retireParallelChunks(&stages[i]);
+        }
+    }
+    for (int i = 0; i < numberOfStages; i++) {
+        struct parallelStage *stage = &stages[i];
+        for (int j = 0; j < stage->numberOfChunks; j++) {
+            free(stage->chunks[j].input.data);
+            free(stage->chunks[j].output.data);
+        }
+        free(stage->chunks);
+        free(stage->pending.data);
+    }
+    free(pollChunks);
+    free(pollStages);
+    free(pollFDs);
+    struct timespec noWait = {0, 0};
+    while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+static bool startParallelChunk(struct parallelStage *stage, char **environment) {
+    struct capture *pending = &stage->pending;
+    if (stage->running == stage->settings.copies || pending->length == 0) {
+        return false;
+    }
+    bool isEnded = (stage->inputFD == -1);
+    if (isEnded == false && pending->length < PARALLEL_CHUNK_SIZE && getParallelFlushTimeout(stage) != 0) {
+        return false;
+    }
+    // Chunks end at a line's end, except for the last line of the input 
+    size_t length = pending->length;
+    if (isEnded == false) {
+        char *newline = memrchr(pending->data, '\n', pending->length);
+        if (newline == NULL) {
+            return false;
+        }
+        length = newline + 1 - pending->data;
+    }
+    struct parallelChunk *chunk = NULL;
+    for (int i = 0; i < stage->numberOfChunks && chunk == NULL; i++) {
+        if (stage->chunks[i].isUsed == false) {
+            chunk = &stage->chunks[i];
+        }
+    }
+    if (chunk == NULL) {
+        return false;
+    }
+    int requestPipe[2];
+    int responsePipe[2];
+    if (pipe2(requestPipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        breakParallelStage(stage);
+        return false;
+    }
+    if (pipe2(responsePipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        close(requestPipe[0]);
+        close(requestPipe[1]);
+        breakParallelStage(stage);
+        return false;
+    }
+    // The whole chunk fits in the pipe, so it's usually written in one go
+    fcntl(requestPipe[1], F_SETPIPE_SZ, PARALLEL_CHUNK_SIZE);
+    fcntl(requestPipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(responsePipe[0], F_SETFL, O_NONBLOCK);
+    struct spawnActions actions;
+    initSpawnActions(&actions);
+    addSpawnDup2(&actions, requestPipe[0], 0);
+    addSpawnDup2(&actions, responsePipe[1], 1);
+    // Copies start with the shell's own signal mask, not with SIGPIPE held 
+    // off as it is while the shell writes to them
+    sigset_t pipeSignal;
+    sigset_t blockedMask;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    struct timespec noWait = {0, 0};
+    while (sigtimedwait(&pipeSignal, NULL, &noWait) == SIGPIPE);
+    sigprocmask(SIG_SETMASK, &stage->signalMask, &blockedMask);
+    commandLimits.settings = stage->settings;
+    int spawnResult = spawnProgram(&chunk->pid, stage->programPath, &actions, stage->words, environment);
+    memset(&commandLimits.settings, 0, sizeof(struct processSettings));
+    sigprocmask(SIG_SETMASK, &blockedMask, NULL);
+    close(requestPipe[0]);
+    close(responsePipe[1]);
+    if (spawnResult != 0) {
+        perror("spawn:");
+        close(requestPipe[1]);
+        close(responsePipe[0]);
+        breakParallelStage(stage);
+        return false;
+    }
+    // The chunk takes the buffer, and what is left of a line starts another
+    struct capture rest = {NULL, 0, 0};
+    if (length < pending->length) {
+        reserveCapture(&rest, pending->length - length);
+        memcpy(rest.data, pending->data + length, pending->length - length);
+        rest.length = pending->length - length;
+    }
+    chunk->isUsed = true;
+    chunk->sequence = stage->nextSequence++;
+    chunk->isLast = isEnded && length == pending->length;
+    chunk->requestFD = requestPipe[1];
+    chunk->responseFD = responsePipe[0];
+    chunk->input = *pending;
+    chunk->input.length = length;
+    chunk->inputWritten = 0;
+    chunk->output.length = 0;
+    chunk->outputWritten = 0;
+    *pending = rest;
+    stage->pendingSince = getMonotonicTime();
+    stage->running++;
+    return true;
+}
+
+static void readParallelInput(struct parallelStage *stage) {
+    struct capture *pending = &stage->pending;
+    if (pending->length == 0) {
+        stage->pendingSince = getMonotonicTime();
+    }
+    reserveCapture(pending, PARALLEL_READ_SIZE);
+    ssize_t bytesRead = read(stage->inputFD, pending->data + pending->length, PARALLEL_READ_SIZE);
+    if (bytesRead == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (bytesRead <= 0) {
+        close(stage->inputFD);
+        stage->inputFD = -1;
+        return;
+    }
+    pending->length += bytesRead;
+}
+
+static void writeParallelChunk(struct parallelChunk *chunk) {
+    struct capture *input = &chunk->input;
+    ssize_t written = write(chunk->requestFD, input->data + chunk->inputWritten, 
+                            input->length - chunk->inputWritten);
+    if (written == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (written > 0) {
+        chunk->inputWritten += written;
+    }
+    // A copy can stop reading before the end of its chunk, as head does
+    if (written == -1 || chunk->inputWritten == input->length) {
+        close(chunk->requestFD);
+        chunk->requestFD = -1;
+        free(input->data);
+        *input = (struct capture) {NULL, 0, 0};
+    }
+}
+
+static void readParallelOutput(struct parallelStage *stage, struct parallelChunk *chunk) {
+    struct capture *output = &chunk->output;
+    reserveCapture(output, PARALLEL_READ_SIZE);
+    ssize_t bytesRead = read(chunk->responseFD, output->data + output->length, PARALLEL_READ_SIZE);
+    if (bytesRead == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (bytesRead > 0) {
+        // Once nothing more can be written, the output is only drained
+        if (stage->outputFD != -1) {
+            output->length += bytesRead;
+        }
+        return;
+    }
+    close(chunk->responseFD);
+    chunk->responseFD = -1;
+    if (chunk->requestFD != -1) {
+        // It won't read the rest of its chunk now
+        close(chunk->requestFD);
+        chunk->requestFD = -1;
+        free(chunk->input.data);
+        chunk->input = (struct capture) {NULL, 0, 0};
+    }
+    int status = 0;
+    if (reapProgram(chunk->pid, &status, 0) == -1) {
+        perror("waitpid");
+    }
+    recordProgramExit(chunk->pid);
+    chunk->pid = -1;
+    stage->running--;
+    // A copy of grep without a match in its chunk hasn't failed the stage, 
+    // so statuses above 1 win, and otherwise the lowest does
+    int exitStatus = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    int stageStatus = WIFSIGNALED(stage->status) ? 128 + WTERMSIG(stage->status) : WEXITSTATUS(stage->status);
+    if (stage->hasStatus == false || 
+        (exitStatus > 1 && stageStatus <= 1) || 
+        (exitStatus <= 1 && stageStatus <= 1 && exitStatus < stageStatus)) {
+        stage->status = status;
+        stage->hasStatus = true;
+    }
+}
+
+static void writeParallelOutput(struct parallelStage *stage) {
+    struct parallelChunk *chunk = findNextOutput(stage);
+    if (chunk == NULL) {
+        return;
+    }
+    ssize_t written = write(stage->outputFD, chunk->output.data + chunk->outputWritten, 
+                            chunk->output.length - chunk->outputWritten);
+    if (written == -1 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    if (written == -1) {
+        breakParallelStage(stage);
+        return;
+    }
+    chunk->outputWritten += written;
+}
+
+static struct parallelChunk *findNextOutput(struct parallelStage *stage) {
+    if (stage->writing != NULL) {
+        return stage->writing;
+    }
+    for (int i = 0; i < stage->numberOfChunks; i++) {
+        struct parallelChunk *chunk = &stage->chunks[i];
+        if (chunk->isUsed == false) {
+            continue;
+        }
+        // In order, the next chunk's output is written as it comes. Out of 
+        // order, whichever finishes first is written whole, so no two are 
+        // mixed up
+        if (stage->settings.isUnordered == false && chunk->sequence == stage->nextOutput) {
+            stage->writing = chunk;
+        } else if (stage->settings.isUnordered && chunk->pid == -1 && 
+                   (chunk->isLast == false || chunk->sequence == stage->nextOutput)) {
+            stage->writing = chunk;
+        }
+        if (stage->writing != NULL) {
+            return chunk;
+        }
+    }
+    return NULL;
+}
+
+static void retireParallelChunks(struct parallelStage *stage) {
+    for (int i = 0; i < stage->numberOfChunks; i++) {
+        struct parallelChunk *chunk = &stage->chunks[i];
+        bool isWritten = (stage->outputFD == -1 || chunk->outputWritten == chunk->output.length);
+        if (chunk->isUsed == false || chunk->pid != -1 || isWritten == false) {
+            continue;
+        }
+        // Chunks are taken in order, so one still waiting to be written 
+        // keeps every later one waiting as well
+        if (stage->outputFD != -1 && chunk != findNextOutput(stage)) {
+            continue;
+        }
+        free(chunk->output.data);
+        chunk->output = (struct capture) {NULL, 0, 0};
+        chunk->isUsed = false;
+        if (chunk == stage->writing) {
+            stage->writing = NULL;
+            stage->nextOutput++;
+            // The chunk after it may be finished already
+            i = -1;
+        }
+    }
+}
+
+static void breakParallelStage(struct parallelStage *stage) {
+    if (stage->inputFD != -1) {
+        close(stage->inputFD);
+        stage->inputFD = -1;
+    }
+    if (stage->outputFD != -1) {
+        close(stage->outputFD);
+        stage->outputFD = -1;
+    }
+    stage->pending.length = 0;
+    for (int i = 0; i < stage->numberOfChunks; i++) {
+        stage->chunks[i].output.length = 0;
+        stage->chunks[i].outputWritten = 0;
+    }
+    stage->writing = NULL;
+    if (stage->hasStatus == false) {
+        stage->status = 1 << 8;
+        stage->hasStatus = true;
+    }
+}
+
+static int getParallelFlushTimeout(struct parallelStage *stage) {
+    struct capture *pending = &stage->pending;
+    if (stage->inputFD == -1 || pending->length == 0 || stage->running == stage->settings.copies) {
+        return -1;
+    }
+    bool hasFreeChunk = false;
+    for (int i = 0; i < stage->numberOfChunks; i++) {
+        hasFreeChunk = hasFreeChunk || stage->chunks[i].isUsed == false;
+    }
+    if (hasFreeChunk == false || memrchr(pending->data, '\n', pending->length) == NULL) {
+        return -1;
+    }
+    double waited = (getMonotonicTime() - stage->pendingSince) * 1000;
+    return (waited >= PARALLEL_FLUSH_MS) ? 0 : (int) (PARALLEL_FLUSH_MS - waited) + 1;
+}
+
+// ===================== SUBSET 30 =====================
+
+static void startFlightRecorder(void) {
+    stack_t signalStack = {flightSignalStack, 0, FLIGHT_STACK_SIZE};
+    sigaltstack(&signalStack, NULL);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleFlightSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART | SA_ONSTACK;
+    sigaction(SIGUSR1, &action, NULL);
+    // A fatal signal is raised again once the log is out, with the default
+    // action back in place, so the shell still dies of it
+    action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    int fatalSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+    for (size_t i = 0; i < sizeof(fatalSignals) / sizeof(fatalSignals[0]); i++) {
+        sigaction(fatalSignals[i], &action, NULL);
+    }
+}
+
+static void recordFlightEvent(int type, double seconds, int value, int extra, const char *name) {
+    // Claiming a slot is atomic, so an event recorded by a signal handler 
+    // never shares one with the event it interrupted
+    uint64_t index = __atomic_fetch_add(&flightRecorder.next, 1, __ATOMIC_RELAXED);
+    struct flightEvent *event = &flightRecorder.events[index & (FLIGHT_EVENTS - 1)];
+    __atomic_store_n(&event->type, 0, __ATOMIC_RELAXED);
+    event->time = getFlightTime();
+    double microseconds = seconds * 1e6;
+    event->microseconds = (microseconds >= UINT32_MAX) ? UINT32_MAX : (uint32_t) microseconds;
+    event->value = value;
+    event->extra = extra;
+    size_t length = 0;
+    if (name != NULL) {
+        while (length < FLIGHT_NAME_SIZE - 1 && name[length] != '\0' && name[length] != '\n') {
+            event->name[length] = name[length];
+            length++;
+        }
+    }
+    event->name[length] = '\0';
+    __atomic_store_n(&event->type, type, __ATOMIC_RELEASE);
+}
+
+static void recordFlightExit(pid_t pid, int status) {
+    int exitStatus = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+    for (int i = 0; i < numberOfRunningPrograms; i++) {
+        if (runningPrograms[i].pid != pid) {
+            continue;
+        }
+        char *programPath = programStats[runningPrograms[i].statsIndex].name;
+        char *programName = strrchr(programPath, '/');
+        double seconds = getMonotonicTime() - runningPrograms[i].startTime;
+        recordFlightEvent(FLIGHT_EXIT, seconds, pid, exitStatus, (programName != NULL) ? programName + 1 : programPath);
+        return;
+    }
+    recordFlightEvent(FLIGHT_EXIT, 0, pid, exitStatus, NULL);
+}
+
+static void flightlog(char **words) {
+    long maxEvents = 0;
+    if (words[1] != NULL) {
+        char *end;
+        maxEvents = strtol(words[1], &end, 10);
+        if (*end != '\0' || maxEvents <= 0 || words[2] != NULL) {
+            fprintf(stderr, "usage: flightlog [NUMBER OF EVENTS]\n");
+            lastExitStatus = 2;
+            return;
+        }
+    }
+    uint64_t first;
+    uint64_t count = findFlightEvents(maxEvents, &first);
+    uint64_t now = getFlightTime();
+    for (uint64_t i = first; i < first + count; i++) {
+        char line[256];
+        struct flightEvent *event = &flightRecorder.events[i & (FLIGHT_EVENTS - 1)];
+        size_t length = formatFlightEvent(event, now, line, sizeof(line));
+        fwrite(line, 1, length, stdout);
+    }
+}
+
+static void dumpFlightLog(int fd, long maxEvents) {
+    char line[256];
+    size_t length = 0;
+    uint64_t first;
+    uint64_t count = findFlightEvents(maxEvents, &first);
+    appendFlightText(line, sizeof(line), &length, "nautilus: flight log of the last ");
+    appendFlightNumber(line, sizeof(line), &length, count, 0);
+    appendFlightText(line, sizeof(line), &length, " events");
+    line[length++] = '\n';
+    if (write(fd, line, length) == -1) {
+        return;
+    }
+    uint64_t now = getFlightTime();
+    for (uint64_t i = first; i < first + count; i++) {
+        struct flightEvent *event = &flightRecorder.events[i & (FLIGHT_EVENTS - 1)];
+        length = formatFlightEvent(event, now, line, sizeof(line));
+        if (length > 0 && write(fd, line, length) == -1) {
+            return;
+        }
+    }
+}
+
+static uint64_t findFlightEvents(long maxEvents, uint64_t *first) {
+    uint64_t next = __atomic_load_n(&flightRecorder.next, __ATOMIC_ACQUIRE);
+    uint64_t count = (next < FLIGHT_EVENTS) ? next : FLIGHT_EVENTS;
+    if (maxEvents > 0 && (uint64_t) maxEvents < count) {
+        count = maxEvents;
+    }
+    *first = next - count;
+    return count;
+}
+
+static size_t formatFlightEvent(struct flightEvent *event, uint64_t now, char *buffer, size_t size) {
+    static const char *typeNames[] = {
+        NULL, "line", "parse", "lookup", "lookup", "spawn", "spawn", "exit", "kill", "signal", "done"
+    };
+    int type = __atomic_load_n(&event->type, __ATOMIC_ACQUIRE);
+    if (type <= 0 || type > FLIGHT_DONE) {
+        return 0;
+    }
+    size_t length = 0;
+    // When it happened, in seconds before now
+    uint64_t ago = (now > event->time) ? (now - event->time) / 1000 : 0;
+    appendFlightText(buffer, size, &length, "-");
+    appendFlightNumber(buffer, size, &length, ago / 1000000, 0);
+    appendFlightText(buffer, size, &length, ".");
+    appendFlightNumber(buffer, size, &length, ago % 1000000, 6);
+    appendFlightText(buffer, size, &length, "s  ");
+    appendFlightText(buffer, size, &length, typeNames[type]);
+    appendFlightText(buffer, size, &length, "  ");
+    switch (type) {
+        case FLIGHT_LINE:
+            appendFlightText(buffer, size, &length, event->name);
+            // value is the length of the whole line, with its newline
+            if ((size_t) event->value > strlen(event->name) + 1) {
+                appendFlightText(buffer, size, &length, "...");
+            }
+            break;
+        case FLIGHT_PARSE:
+            appendFlightNumber(buffer, size, &length, event->value, 0);
+            appendFlightText(buffer, size, &length, (event->value == 1) ? " word" : " words");
+            break;
+        case FLIGHT_LOOKUP_HIT:
+        case FLIGHT_LOOKUP_MISS:
+            appendFlightText(buffer, size, &length, event->name);
+            appendFlightText(buffer, size, &length, (type == FLIGHT_LOOKUP_HIT) ? " found" : " not found");
+            break;
+        case FLIGHT_SPAWN:
+        case FLIGHT_EXIT:
+            appendFlightText(buffer, size, &length, event->name);
+            // Filters run on the shell's threads have handles below -1
+            appendFlightText(buffer, size, &length, (event->value < -1) ? " filter " : " pid ");
+            appendFlightNumber(buffer, size, &length, event->value, 0);
+            if (type == FLIGHT_EXIT) {
+                appendFlightText(buffer, size, &length, " status ");
+                appendFlightNumber(buffer, size, &length, event->extra, 0);
+            }
+            break;
+        case FLIGHT_SPAWN_FAILED:
+            appendFlightText(buffer, size, &length, event->name);
+            appendFlightText(buffer, size, &length, " failed, errno ");
+            appendFlightNumber(buffer, size, &length, event->value, 0);
+            break;
+        case FLIGHT_KILL:
+            appendFlightText(buffer, size, &length, "signal ");
+            appendFlightNumber(buffer, size, &length, event->value, 0);
+            appendFlightText(buffer, size, &length, " to group ");
+            appendFlightNumber(buffer, size, &length, event->extra, 0);
+            break;
+        case FLIGHT_SIGNAL:
+            appendFlightText(buffer, size, &length, "received ");
+            appendFlightNumber(buffer, size, &length, event->value, 0);
+            break;
+        case FLIGHT_DONE:
+            appendFlightText(buffer, size, &length, "status ");
+            appendFlightNumber(buffer, size, &length, event->value, 0);
+            break;
+    }
+    if (event->microseconds > 0) {
+        appendFlightText(buffer, size, &length, "  ");
+        appendFlightDuration(buffer, size, &length, event->microseconds);
+    }
+    buffer[length++] = '\n';
+    return length;
+}
+
+static void appendFlightText(char *buffer, size_t size, size_t *length, const char *text) {
+    // The last byte is kept for the line's newline
+    while (*text != '\0' && *length < size - 1) {
+        buffer[(*length)++] = *text++;
+    }
+}
+
+static void appendFlightNumber(char *buffer, size_t size, size_t *length, int64_t number, int width) {
+    char digits[24];
+    int numberOfDigits = 0;
+    uint64_t magnitude = (number < 0) ? -(uint64_t) number : (uint64_t) number;
+    do {
+        digits[numberOfDigits++] = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude > 0);
+    while (numberOfDigits < width) {
+        digits[numberOfDigits++] = '0';
+    }
+    char text[26];
+    int textLength = 0;
+    if (number < 0) {
+        text[textLength++] = '-';
+    }
+    while (numberOfDigits > 0) {
+        text[textLength++] = digits[--numberOfDigits];
+    }
+    text[textLength] = '\0';
+    appendFlightText(buffer, size, length, text);
+}
+
+static void appendFlightDuration(char *buffer, size_t size, size_t *length, uint64_t microseconds) {
+    if (microseconds < 1000) {
+        appendFlightNumber(buffer, size, length, microseconds, 0);
+        appendFlightText(buffer, size, length, "us");
+    } else if (microseconds < 1000000) {
+        appendFlightNumber(buffer, size, length, microseconds / 1000, 0);
+        appendFlightText(buffer, size, length, ".");
+        appendFlightNumber(buffer, size, length, microseconds % 1000, 3);
+        appendFlightText(buffer, size, length, "ms");
+    } else {
+        appendFlightNumber(buffer, size, length, microseconds / 1000000, 0);
+        appendFlightText(buffer, size, length, ".");
+        appendFlightNumber(buffer, size, length, microseconds % 1000000 / 1000, 3);
+        appendFlightText(buffer, size, length, "s");
+    }
+}
+
+static uint64_t getFlightTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void handleFlightSignal(int signalNumber) {
+    int savedErrno = errno;
+    recordFlightEvent(FLIGHT_SIGNAL, 0, signalNumber, 0, NULL);
+    dumpFlightLog(STDERR_FILENO, 0);
+    errno = savedErrno;
+    if (signalNumber != SIGUSR1) {
+        raise(signalNumber);
+    }
+}
+
+// =================================================================
+
+static void do_exit(char **words) {
+    int exit_status = 0;
+    if (words[1] != NULL) {
+        if (words[2] != NULL) {
+            fprintf(stderr, "exit: too many arguments\n");
+        } else {
+            char *endptr;
+            exit_status = (int)strtol(words[1], &endptr, 10);
+            if (*endptr != '\0') {
+                fprintf(stderr, "exit: %s: numeric argument required\n",
+                        words[1]);
+            }
+        }
+    }
+    exit(exit_status);
+}
+
+// Check whether this process can execute a file.
+// Use this function when searching through the directories
+// in the path for an executable file
+static int is_executable(char *pathname) {
+    struct stat s;
+    lastExecutableExists = (stat(pathname, &s) == 0);
+    return
+        lastExecutableExists &&  
+        S_ISREG(s.st_mode) &&      
+        faccessat(AT_FDCWD, pathname, X_OK, AT_EACCESS) == 0; 
+}
+
+// Split a string 's' into pieces by any one of a set of separators.
+//
+// Returns an array of strings, with the last element being `NULL';
+// The array itself, and the strings, are allocated from the command arena,
+// so they are given back once the command has finished.
+static char **tokenize(char *s, char *separators, char *special_chars) {
+    size_t n_tokens = 0;
+    // array guaranteed to be big enough
+    char **tokens = arenaAlloc(&commandArena, (strlen(s) + 1) * sizeof *tokens);
+
+    while (*s != '\0') {
+        // We are pointing at zero or more of any of the separators.
+        // Skip leading instances of the separators.
+        s += strspn(s, separators);
+
+        // Now, `s' points at one or more characters we want to keep.
+        // The number of non-separator characters is the token length.
+        //
+        // Trailing separators after the last token mean that, at this
+        // point, we are looking at the end of the string, so:
+        if (*s == '\0') {
+            break;
+        }
+
+        size_t token_length = strcspn(s, separators);
+        size_t token_length_without_special_chars = strcspn(s, special_chars);
+        if (token_length_without_special_chars == 0) {
+            token_length_without_special_chars = 1;
+        }
+        if (token_length_without_special_chars < token_length) {
+            token_length = token_length_without_special_chars;
+        }
+        // The fan-out operator is the only special token of two characters
+        if (s[0] == '|' && s[1] == '+') {
+            token_length = 2;
+        }
+        // A $(...) substitution is kept as part of a single token, even when
+        // the command inside it contains separators or special characters
+        size_t substitution_length = getSubstitutionTokenLength(s, separators, special_chars);
+        if (substitution_length > token_length) {
+            token_length = substitution_length;
+        }
+        char *token = arenaStrndup(&commandArena, s, token_length);
+        s += token_length;
+
+        // Add this token.
+        tokens[n_tokens] = token;
+        n_tokens++;
+    }
+
+    tokens[n_tokens] = NULL;
+
+    return tokens;
+}
@@ -1,1455 +1,1243 @@
-// Date last modified: Wed 18 Dec 15:06:30 AEDT 2019
+// The nautilus program: the prompt, with its line editing and completion, 
+// and the options to run a single line, serve lines over a socket or send 
+// one to a server, check syscall budgets and replay recorded sessions. The
+// shell itself is in libnautilus.c
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
-#include <dirent.h>   
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
-#include <spawn.h>
-#include <glob.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/ptrace.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <limits.h>
+#include <termios.h>
+#include <ftw.h>
 #include <stdbool.h>
+#include <math.h>
+#include "nautilus.h"
 
-#define MAX_LINE_CHARS 1024 
+#define MAX_LINE_CHARS NAUTILUS_LINE_MAX
 #define INTERACTIVE_PROMPT "nautilus> "
-#define DEFAULT_PATH "/bin:/usr/bin"
 #define WORD_SEPARATORS " \t\r\n"
-#define DEFAULT_HISTORY_SHOWN 10
 
-// These characters are always returned as single words
-#define SPECIAL_CHARS "!><|"
+// Files the shell keeps in $HOME, which are cleared out of scratch homes
+#define HISTORY_FILE ".nautilus_history"
+#define DIRECTORY_INDEX_FILE ".nautilus_dirs"
 
-// Redirection flags
-#define NOT_REDIR 0 
-#define REDIR_OUTPUT 1
-#define REDIR_APPEND 2
-#define REDIR_INPUT 4
-
-// ===== Default functions ===== 
-static void execute_command(char **words, char **path, char **environment);
-static void do_exit(char **words);
-static int is_executable(char *pathname);
-static char **tokenize(char *s, char *separators, char *special_chars);
-static void free_tokens(char **tokens);
+// Server settings: how many connections are waited on per epoll_wait and 
+// the descriptors sent with each request (stdin, stdout, stderr and cwd)
+#define SERVER_EVENTS 64
+#define SERVER_REQUEST_FDS 4
+#define SERVER_BACKLOG 128
+// How often workers are checked on when pidfds aren't available
+#define DEADLINE_POLL_MS 10
 
 // ===== My helper functions ===== 
 
-// Returns true if the file at pathName exists
-static bool fileExists(char *pathName); 
-
-// Returns true if the file at pathName is a directory
-static bool isDirectory(char *pathName);  
-
-// Given an array of directory pathnames, search for a target file and return 
-// the full pathname to target
-static char *findInPath(char **paths, char *target);  
-
-// Given an array of arguments, concatenates them all together with a white 
-// space between each argument and return the final single string
-static char *formString(char **words);  
-
-// Given an array of arguments, counts and returns the number of non-NULL
-// arguments
-static int getWordCount(char **words);  
-
-// Given an array of arguments, counts and returns the total number of 
-// characters 
-static int getCharCount(char **words);  
-
-// Checks if the input string is numeric. Returns true if it is
-static bool isNumber(char *argument);  
-
-// Handles error message printing for programs that weren't executable
-static void executionError(char **words, char *programPath);
-
-// Given a program name and an array of paths to search, form the absolute path
-// and return it
-static char *getPathToProgram(char *program, char **path);
-
-// ===== Subset 0 - Builtin cd and pwd ===== 
-
-// Executes cd
-static void cd(char **words);
-
-// Executes pwd
-static void pwd(void);
-
-// ===== Subset 2 - History utilities ===== 
-
-// Opens $HOME/.nautilus_history in a given a mode, eg. "r", "w", etc. and 
-// returns the FILE *
-static FILE *openHistory(char *mode);  
-
-// Returns the number of lines in $HOME/.nautilus_history
-static int getHistoryLineCount(void); 
-
-// Prints the latest n entries in $HOME/.nautilus_history 
-static void printLatestHistory(int n); 
+// Returns the current time in seconds from an arbitrary fixed point
+static double getMonotonicTime(void);
 
-// Appends the given command to $HOME/.nautilus_history
-static void writeHistory(char **words);  
+// Writes all of a buffer, retrying short writes. Returns false on error
+static bool writeAll(int fd, char *data, size_t length);
 
-// Fetches the string corresponding to lineNumber in $HOME/.nautilus_history
-static char *getCommandFromHistory(int lineNumber); 
+// ===== Subset 10 - Line editing and tab completion ===== 
 
-// Called if ! or !n was typed. Retrieves the right command from history and 
-// tokenizes it before returning it 
-static char **getHistoryWords(char **words);  
+// Reads a line from the terminal with editing and tab completion. Returns 
+// NULL at end-of-file
+static char *readLine(char *prompt, char *line, int size);
 
-// ===== Subset 3 - Globbing utilities ===== 
+// Redraws the prompt and line with the cursor at the given position
+static void refreshLine(char *prompt, char *line, int length, int cursor);
+
+// Completes the word ending at the cursor. Returns the new cursor position
+static int completeWord(char *line, int *length, int cursor, int size);
 
-// Returns true if a wildcard symbol was found in line
-static bool hasWildcard(char *line);  
+// Prints possible completions under the line being edited
+static void listCompletions(char **names, int numberOfNames, int totalNames);
 
-// Given an array of strings, return the same array but with the string at 
-// the target index deleted
-static char **removeFromWords(char **words, int target);  
+// Compares two names for qsort
+static int compareNames(const void *a, const void *b);
 
-// Given an array of strings, a new string and a target index, return the 
-// same array of strings but with the new string inserted at target
-static char **injectIntoWords(char **words, char *newWord, int target);
+// ===== Subset 12 - Command server ===== 
 
-// Given an array of strings, return the same array but with all wildcards 
-// expanded out fully
-static char **expandWildcards(char **words);  
+// Sent back to a client once its command line has finished
+struct serverReply {
+    int32_t exitStatus;
+    int64_t userMicroseconds;
+    int64_t systemMicroseconds;
+    int64_t maxResidentKilobytes;
+};
 
-// ===== Subset 4 - I/O redirection ===== 
+// Kinds of descriptor the server waits on
+#define SERVER_LISTENER 0
+#define SERVER_SIGNALS 1
+#define SERVER_CLIENT 2
+#define SERVER_WORKER 3
 
-// Separately handles redirection commands by cases
-static void executeRedirection(char **words, char **path, char **environ);
+// Something the server is waiting on. A client becomes a worker once its 
+// request has been read, and is answered when the worker exits
+struct serverConnection {
+    int kind;
+    int fd;
+    int clientFD;
+    pid_t pid;
+    struct serverConnection *next;
+};
 
-// Returns true if the given argument is a builtin command
-static bool isBuiltin(char *argument); 
+// Handles the command line options. Returns the shell's exit status
+static int runOptions(int argc, char *argv[]);
 
-// Given an array of arguments, returns true if a redirection symbol is present
-static bool isRedirectionCommand(char **words);
+// Accepts command lines on a Unix socket and runs each in a worker process
+// forked from this one, until SIGINT or SIGTERM
+static int serveCommands(char *socketPath);
 
-// Returns true if the argument is a redirection symbol. This is useful for
-// checking if the redirection command string is valid
-static bool isRedirection(char *argument);
+// Reads a client's request and forks a worker to run it, turning the client
+// into that worker. Returns false if the client sent nothing usable
+static bool startRequest(struct serverConnection *connection, int *serverFDs, 
+                         int numberOfServerFDs, sigset_t *workerMask);
 
-// Returns true if the given command is determined to be a valid redirection
-// command
-static bool checkRedirValidity(char **words, int flags);
+// Reaps a finished worker and sends its client the exit status and rusage
+static void finishRequest(struct serverConnection *worker);
 
-// Returns an integer containing redirection flags REDIR_INPUT, REDIR_OUTPUT or
-// REDIR_APPEND if the given arguments form a valid I/O redirection command
-static int getRedirectionType(char **words);
+// Sends a command line to the server at socketPath to be run with this 
+// process' stdin, stdout, stderr and working directory. Returns its exit 
+// status
+static int runClient(char *socketPath, char *commandLine, bool showUsage);
 
-// Given an array of strings and a separator, returns a slice of that array
-// from argument 0 up to, but not including, the separator string
-// eg. leftPartition({"hello", "<", "world", NULL}, "<") returns {"hello", NULL}
-static char **leftPartition(char **words, char *separator);
+// ===== Subset 15 - Syscall budgets ===== 
 
-// Given an array of strings and a separator, returns a slice of that array
-// from argument 0 up to, but not including, the separator string
-// eg. rightPartition({"hello", "<", "world", NULL}, "<") returns {"world", NULL}
-static char **rightPartition(char **words, char *separator, bool stopLastOccurrence);
+// Runs each command line of a corpus file in a traced shell and compares the
+// system calls the shell makes for it with the line's budget. Returns 1 if 
+// any line is over its budget
+static int checkSyscallBudgets(char *corpusPath);
 
-// Exclusively handles commands of the form: "< filename command ..."
-static void executeRedirInput(char **words, char **path, char **environment);
+// Counts the system calls a shell makes running a command line, after it has
+// run the line once to warm up. Returns -1 if the shell can't be traced
+static long countCommandSyscalls(char *commandLine, char *home);
 
-// Exclusively handles commands of the form: "command ... > filename"
-static void executeRedirOutput(char **words, char **path, char **environment);
+// Removes the traced shells' home and whatever the commands left in it
+static void removeBudgetHome(char *home);
 
-// Exclusively handles commands of the form: "command ... >> filename"
-static void executeRedirAppend(char **words, char **path, char **environment);
+// Removes one file or emptied directory for removeBudgetHome
+static int removeBudgetFile(const char *path, const struct stat *s, int type, struct FTW *ftw);
 
-// Exclusively handles commands of the form: "< filename command ... > filename"
-static void executeRedirInputAndOutput(char **words, char **path, char **environment);
 
-// Exclusively handles commands of the form: "< filename command ... >> filename"
-static void executeRedirInputAndAppend(char **words, char **path, char **environment);
+// ===== Subset 21 - Session record and replay ===== 
 
-// ===== Subset 5 - Piping between processes ===== 
+// A line of a session record
+struct recordedLine {
+    double startTime;
+    double seconds;
+    double programSeconds;
+    int exitStatus;
+    char *cwd;
+    char *commandLine;
+};
 
-// Returns true if the given command was identified as a piping command
-static bool isPipeCommand(char **words);
-
-// Returns the number of pipes found in the command's arguments
-static int getNumberOfPipes(char **words);
-
-// Executes the piping command 
-static void executePiping(char **commandWords, char **path, char **environ);
-
-// Recursively pipe across multiple processes, with each call passing across
-// input arguments. 
-static void handlePiping(char **commandWords, char **path, char **environ, 
-                         char **inputArguments, int numberOfPipes, 
-                         int redirectOption, char *outputFilename);
-
-int main(void) {
-    setlinebuf(stdout);
-    extern char **environ;
-    char *pathp;  
-    if ((pathp = getenv("PATH")) == NULL) {
-        pathp = DEFAULT_PATH;  
+// Durations in microseconds of the lines a replay ran
+struct durations {
+    uint64_t *values;
+    long count;
+    long capacity;
+};
+
+// Parses a line of a session record, which is changed in place. Returns 
+// false for comments and lines that aren't valid
+static bool parseRecordedLine(char *text, struct recordedLine *record);
+
+// Replays a session record through the input loop of the given number of 
+// shells, as fast as they can take it or paced as it was recorded, then 
+// reports the throughput, latencies and peak memory. Returns 1 on error
+static int replaySession(char *recordPath, int numberOfShells, bool isPaced);
+
+// Starts a shell reading its input from the given fd and recording what it
+// runs in recordPath, with the given signal mask. Returns its pid, or -1 on
+// error
+static pid_t startReplayShell(int inputFD, char *home, char *recordPath, char *cwd, sigset_t *mask);
+
+// Adds a duration to a list of them
+static void addDuration(struct durations *durations, double seconds);
+
+// Returns the duration the given fraction of a sorted list are at or below
+static uint64_t getPercentile(struct durations *durations, double fraction);
+
+// Writes a duration in microseconds as text in the most readable unit
+static void formatDuration(char *text, size_t size, uint64_t microseconds);
+
+// Compares two durations for qsort
+static int compareDurations(const void *a, const void *b);
+
+int main(int argc, char *argv[]) {
+    nautilusStart();
+    // Subset 12:
+    if (argc > 1) {
+        return runOptions(argc, argv);
     }
-    char **path = tokenize(pathp, ":", "");
     char *prompt = NULL;
     if (isatty(1)) {  
         prompt = INTERACTIVE_PROMPT;
     }
+    // Lines typed at a terminal get editing and tab completion
+    bool isEditing = (prompt != NULL && isatty(0));
     while (1) { 
-        if (prompt) {
-            fputs(prompt, stdout);
-        }
         char line[MAX_LINE_CHARS];
-        if (fgets(line, MAX_LINE_CHARS, stdin) == NULL) {  
-            break;
-        }       
-        char **commandWords = tokenize(line, WORD_SEPARATORS, SPECIAL_CHARS);
-        // Make a copy the command arguments for history writing 
-        char **commandWordsCopy = tokenize(line, WORD_SEPARATORS, SPECIAL_CHARS);
-        
-        if (commandWords != NULL && commandWords[0] != NULL) {
-            if (isPipeCommand(commandWords)) {
-                writeHistory(commandWordsCopy); 
-                executePiping(commandWords, path, environ);
-            } else if (isRedirectionCommand(commandWords)) {
-                writeHistory(commandWordsCopy); 
-                executeRedirection(commandWords, path, environ);
-            } else if (strcmp(commandWords[0], "!") == 0) {
-                char **historyWords = getHistoryWords(commandWords);
-                if (historyWords != NULL) {
-                    writeHistory(historyWords);
-                    historyWords = expandWildcards(historyWords);
-                    execute_command(historyWords, path, environ);
-                    commandWords = expandWildcards(commandWords);
-                    free(historyWords);
-                }
-            } else {
-                commandWords = expandWildcards(commandWords);
-                execute_command(commandWords, path, environ);
-                writeHistory(commandWordsCopy);  
+        if (isEditing) {
+            if (readLine(prompt, line, MAX_LINE_CHARS) == NULL) {
+                break;
             }
-        }
-        free_tokens(commandWordsCopy);
-        free_tokens(commandWords);
-    }
-    free_tokens(path);
-    return 0;
-}
-    
-static void execute_command(char **words, char **path, char **environment) {
-    assert(words != NULL);
-    assert(path != NULL);
-    assert(environment != NULL);
-    char *program = words[0];
-    if (program == NULL) { return; }
-    if (strcmp(program, "exit") == 0) {
-        do_exit(words);
-        return; 
-    }
-    int argc = getWordCount(words);
-    // Subset 0:
-    if (strcmp(program, "cd") == 0) {
-        if (argc > 2) {
-            fprintf(stderr, "%s: too many arguments\n", program);
-        } else {
-            cd(words);
-        }
-        return;
-    }
-    if (strcmp(program, "pwd") == 0) {
-        if (argc > 1) {
-            fprintf(stderr, "%s: too many arguments\n", program);
         } else {
-            pwd();
-        }
-        return;
-    }
-    // Subset 2:
-    if (strcmp(program, "history") == 0) { 
-        if (argc == 1) {
-            printLatestHistory(DEFAULT_HISTORY_SHOWN);
-        } else if (argc == 2) {
-            if (isNumber(words[1])) {
-                printLatestHistory(atoi(words[1]));
-            } else {
-                fprintf(stderr, "%s: nonnumber: numeric argument required\n", program);
+            if (prompt) {
+                fputs(prompt, stdout);
             }
-        } else {
-            fprintf(stderr, "%s: too many arguments\n", program);
-        }
-        return;
-    }
-    // Run a non built-in program
-    char *programPath = getPathToProgram(words[0], path);
-    if (programPath != NULL && is_executable(programPath)) {
-        pid_t pid;
-        if (posix_spawn(&pid, programPath, NULL, NULL, words, environment) != 0) {
-            perror("spawn:");
-            return;
-        }
-        int exit_status;
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
-        }
-        exit_status = WEXITSTATUS(exit_status); 
-        printf("%s exit status = %d\n", programPath, exit_status);
-    } else {
-        executionError(words, programPath);
+            if (fgets(line, MAX_LINE_CHARS, stdin) == NULL) {  
+                break;
+            }
+        }       
+        nautilusExecute(line, NAUTILUS_REPORT_STATUS | NAUTILUS_RECORD_LINE);
     }
+    return 0;
 }
 
 // ================= Helper Functions =================
 
-static bool fileExists(char *pathName) {
-    struct stat s;
-    if (stat(pathName, &s) == 0) {
-        return true;
-    } else {
-        return false;
-    }
+static double getMonotonicTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
 }
 
-static bool isDirectory(char *pathName) {
-    if (fileExists(pathName)) {
-        struct stat s;
-        stat(pathName, &s);
-        if (S_ISDIR(s.st_mode)) {
-            return true;
-        } else {
+static bool writeAll(int fd, char *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written == -1 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
             return false;
         }
+        data += written;
+        length -= written;
     }
-    return false;    
+    return true;
 }
 
-static char *findInPath(char **paths, char *target) {
-    char *absPathToTarget = NULL;
-    char *path = NULL;
-    for (int i = 0; paths[i] != NULL; i++) {
-        path = paths[i];
-        struct dirent *dir;
-        // Open current directory
-        DIR *curr = opendir(path);  
-        if (curr != NULL) {
-            while ((dir = readdir(curr)) != NULL) {
-                if (strcmp(dir -> d_name, target) == 0) {
-                    int size = sizeof(char) * (strlen(path) + strlen(target)) + 1 + 1;
-                    absPathToTarget = malloc(size);
-                    strcpy(absPathToTarget, path);
-                    strcat(absPathToTarget, "/");
-                    strcat(absPathToTarget, target);
-                    return absPathToTarget;
+// ===================== SUBSET 10 =====================
+
+static char *readLine(char *prompt, char *line, int size) {
+    struct termios original;
+    if (tcgetattr(0, &original) != 0) {
+        // Not a terminal after all, so read the line as usual
+        fputs(prompt, stdout);
+        return fgets(line, size, stdin);
+    }
+    struct termios raw = original;
+    raw.c_iflag &= ~(ICRNL | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    fflush(stdout);
+    tcsetattr(0, TCSAFLUSH, &raw);
+
+    int length = 0;
+    int cursor = 0;
+    line[0] = '\0';
+    char *result = line;
+    refreshLine(prompt, line, length, cursor);
+    while (1) {
+        char c;
+        if (read(0, &c, 1) != 1) {
+            result = NULL;
+            break;
+        }
+        if (c == '\r' || c == '\n') {
+            break;
+        } else if (c == CTRL('D')) {
+            if (length == 0) {
+                result = NULL;
+                break;
+            }
+            if (cursor < length) {
+                memmove(&line[cursor], &line[cursor + 1], length - cursor);
+                length--;
+            }
+        } else if (c == CTRL('C')) {
+            // Abandon the line and start a fresh one
+            write(1, "^C\r\n", 4);
+            length = 0;
+            cursor = 0;
+        } else if (c == '\t') {
+            cursor = completeWord(line, &length, cursor, size);
+        } else if (c == 127 || c == CTRL('H')) {
+            if (cursor > 0) {
+                memmove(&line[cursor - 1], &line[cursor], length - cursor);
+                cursor--;
+                length--;
+            }
+        } else if (c == CTRL('A')) {
+            cursor = 0;
+        } else if (c == CTRL('E')) {
+            cursor = length;
+        } else if (c == CTRL('B')) {
+            cursor = (cursor > 0) ? cursor - 1 : 0;
+        } else if (c == CTRL('F')) {
+            cursor = (cursor < length) ? cursor + 1 : length;
+        } else if (c == CTRL('U')) {
+            memmove(line, &line[cursor], length - cursor);
+            length -= cursor;
+            cursor = 0;
+        } else if (c == CTRL('K')) {
+            length = cursor;
+        } else if (c == CTRL('W')) {
+            int start = cursor;
+            while (start > 0 && line[start - 1] == ' ') {
+                start--;
+            }
+            while (start > 0 && line[start - 1] != ' ') {
+                start--;
+            }
+            memmove(&line[start], &line[cursor], length - cursor);
+            length -= cursor - start;
+            cursor = start;
+        } else if (c == CTRL('L')) {
+            write(1, "\x1b[H\x1b[2J", 7);
+        } else if (c == '\x1b') {
+            // Arrow keys and friends arrive as escape sequences
+            char sequence[3];
+            if (read(0, &sequence[0], 1) != 1 || read(0, &sequence[1], 1) != 1) {
+                continue;
+            }
+            if (sequence[0] != '[') {
+                continue;
+            }
+            if (sequence[1] >= '0' && sequence[1] <= '9') {
+                if (read(0, &sequence[2], 1) == 1 && sequence[2] == '~' && sequence[1] == '3' && cursor < length) {
+                    memmove(&line[cursor], &line[cursor + 1], length - cursor);
+                    length--;
                 }
+            } else if (sequence[1] == 'C' && cursor < length) {
+                cursor++;
+            } else if (sequence[1] == 'D' && cursor > 0) {
+                cursor--;
+            } else if (sequence[1] == 'H') {
+                cursor = 0;
+            } else if (sequence[1] == 'F') {
+                cursor = length;
             }
+        } else if ((unsigned char) c >= ' ' && length < size - 2) {
+            memmove(&line[cursor + 1], &line[cursor], length - cursor);
+            line[cursor] = c;
+            cursor++;
+            length++;
         }
+        line[length] = '\0';
+        refreshLine(prompt, line, length, cursor);
     }
-    return absPathToTarget;
-}
-
-static char *formString(char **words) {
-    assert(words != NULL && words[0] != NULL);
-    int argc = getWordCount(words);
-    int charCount = getCharCount(words);
-    // String size calculation:
-    // charCount is the number of characters, not including spaces, '\n' and '\0'
-    // + (argc - 1) because that's how many spaces there are
-    // + 1 for \n and + 1 for the null terminator \0
-    char *result = malloc(sizeof(char) * (charCount + (argc - 1) + 1 + 1));  
-    strcpy(result, words[0]);
-    for (int i = 1; i < argc; i++) {
-        strcat(result, " ");
-        strcat(result, words[i]);
+    tcsetattr(0, TCSAFLUSH, &original);
+    write(1, "\r\n", 2);
+    if (result != NULL) {
+        line[length] = '\n';
+        line[length + 1] = '\0';
     }
-    strcat(result, "\n");
     return result;
 }
 
-static int getWordCount(char **words) {
-    int argc = 0;
-    assert(words != NULL);
-    while (words[argc] != NULL) {
-        argc++;
+static void refreshLine(char *prompt, char *line, int length, int cursor) {
+    // Build the whole redraw up front so it goes out in a single write
+    char buffer[MAX_LINE_CHARS * 2];
+    int promptLength = strlen(prompt);
+    int n = snprintf(buffer, sizeof(buffer), "\r%s%.*s\x1b[0K\r", prompt, length, line);
+    if (promptLength + cursor > 0 && n < (int) sizeof(buffer)) {
+        n += snprintf(buffer + n, sizeof(buffer) - n, "\x1b[%dC", promptLength + cursor);
+    }
+    if (n > (int) sizeof(buffer)) {
+        n = sizeof(buffer);
     }
-    return argc;
+    write(1, buffer, n);
 }
 
-static int getCharCount(char **words) {
-    int charCount = 0;
-    int i = 0;
-    while (words[i] != NULL) {
-        charCount += strlen(words[i]);
-        i++;
-    }
-    return charCount;
+static int completeWord(char *line, int *length, int cursor, int size) {
+    struct nautilusCompletion completion;
+    if (nautilusComplete(line, cursor, &completion) != 0) {
+        write(1, "\a", 1);
+        return cursor;
+    }
+    int extensionLength = strlen(completion.extension);
+    if (completion.numberOfMatches == 0) {
+        write(1, "\a", 1);
+    } else if (extensionLength > 0 && *length + extensionLength < size - 2) {
+        memmove(&line[cursor + extensionLength], &line[cursor], *length - cursor);
+        memcpy(&line[cursor], completion.extension, extensionLength);
+        *length += extensionLength;
+        cursor += extensionLength;
+    } else if (completion.numberOfMatches > 1) {
+        // Nothing more can be filled in, so show what the options are
+        listCompletions(completion.names, completion.numberOfNames, completion.numberOfMatches);
+    }
+    nautilusFreeCompletion(&completion);
+    line[*length] = '\0';
+    return cursor;
 }
 
-static bool isNumber(char *argument) {
-    for (int i = 0; i < strlen(argument); i++) {
-        char ch = argument[i];
-        if (ch == '-' && i == 0 && strlen(argument) > 1) {
-            // dash - indicates negative number when it's the first character of a string of more than 2 characters
-            // so ignore this iteration 
-            continue;  
+static void listCompletions(char **names, int numberOfNames, int totalNames) {
+    struct winsize window;
+    int width = 80;
+    if (ioctl(1, TIOCGWINSZ, &window) == 0 && window.ws_col > 0) {
+        width = window.ws_col;
+    }
+    int longest = 0;
+    for (int i = 0; i < numberOfNames; i++) {
+        int nameLength = strlen(names[i]);
+        if (nameLength > longest) {
+            longest = nameLength;
         }
-        if (!(ch >= '0' && ch <= '9')) {
-            return false;
+    }
+    int columnWidth = longest + 2;
+    int columns = width / columnWidth;
+    if (columns < 1) {
+        columns = 1;
+    }
+    qsort(names, numberOfNames, sizeof(char *), compareNames);
+    printf("\r\n");
+    for (int i = 0; i < numberOfNames; i++) {
+        printf("%-*s", columnWidth, names[i]);
+        if ((i + 1) % columns == 0 || i == numberOfNames - 1) {
+            printf("\r\n");
         }
     }
-    return true;
-}
-
-static void executionError(char **words, char *programPath) {
-    if (programPath != NULL && fileExists(programPath) == false) {
-        fprintf(stderr, "%s: command not found\n", programPath);
-    } else if (programPath == NULL) {
-        fprintf(stderr, "%s: command not found\n", words[0]);            
-    } else {
-        fprintf(stderr, "%s: Permission denied\n", programPath);
+    if (totalNames > numberOfNames) {
+        printf("... and %d more\r\n", totalNames - numberOfNames);
     }
+    fflush(stdout);
 }
 
-static char *getPathToProgram(char *program, char **path) {
-    char *programPath = program;
-    char *programName = NULL;
-    if ((programName = strrchr(programPath, '/')) == NULL) {
-        programPath = findInPath(path, program);  
-    }
-    return programPath;
+static int compareNames(const void *a, const void *b) {
+    return strcmp(*(char **) a, *(char **) b);
 }
 
-// ===================== SUBSET 0 =====================
-static void cd(char **words) {
-    bool noDirectory = false;
-    if (words[1] != NULL) {
-        // chdir returns 0 on success
-        if (chdir(words[1]) != 0) {
-            noDirectory = true;
-        }
-    } else {
-        char *homePath = getenv("HOME");
-        if (chdir(homePath) != 0) {
-            perror("chdir:");
+// ===================== SUBSET 12 =====================
+
+static int runOptions(int argc, char *argv[]) {
+    char *commandLine = NULL;
+    char *serveSocket = NULL;
+    char *clientSocket = NULL;
+    char *budgetCorpus = NULL;
+    char *replayRecord = NULL;
+    int numberOfShells = 1;
+    bool isPaced = false;
+    bool showUsage = false;
+    bool isValid = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            commandLine = argv[++i];
+        } else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveSocket = argv[++i];
+        } else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc) {
+            clientSocket = argv[++i];
+        } else if (strcmp(argv[i], "--syscall-budget") == 0 && i + 1 < argc) {
+            budgetCorpus = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayRecord = argv[++i];
+        } else if (strcmp(argv[i], "--shells") == 0 && i + 1 < argc) {
+            char *end;
+            numberOfShells = strtol(argv[++i], &end, 10);
+            isValid = isValid && (end != argv[i] && *end == '\0');
+        } else if (strcmp(argv[i], "--paced") == 0) {
+            isPaced = true;
+        } else if (strcmp(argv[i], "--rusage") == 0) {
+            showUsage = true;
+        } else {
+            isValid = false;
         }
-    }    
-    if (noDirectory) {
-        fprintf(stderr, "cd: %s: No such file or directory\n", words[1]);
-    } 
-}
-
-static void pwd(void) {
-    char *cwd = malloc(sizeof (char) * MAX_LINE_CHARS);
-    getcwd(cwd, MAX_LINE_CHARS);
-    printf("current directory is '%s'\n", cwd);
-    free(cwd);
-}
-
-// ===================== SUBSET 2 =====================
-
-static FILE *openHistory(char *mode) {
-    char *home = getenv("HOME");
-    char historyFilename[] = ".nautilus_history";
-    // + 1 for '/' and + 1 for '\0'
-    char *fullPath = malloc(sizeof(char) * (strlen(home) + strlen(historyFilename) + 1 + 1));  
-    strcpy(fullPath, home);
-    strcat(fullPath, "/");
-    strcat(fullPath, historyFilename);
-    FILE *historyFile = fopen(fullPath, mode);
-    free(fullPath);
-    return historyFile;
-}
-
-static int getHistoryLineCount() {
-    FILE *file = openHistory("r");
-    if (file == NULL) {
-        return 0;
     }
-    int lineCount = 0;
-    char buffer[BUFSIZ];
-    while(fgets(buffer, BUFSIZ, file) != NULL) {
-        lineCount++;
+    if (serveSocket != NULL && (commandLine != NULL || clientSocket != NULL)) {
+        isValid = false;
     }
-    fclose(file);
-    return lineCount;
-}
-
-static void printLatestHistory(int n) {
-    FILE *historyFile = openHistory("r");
-    if (historyFile == NULL) {
-        return;
+    if (serveSocket == NULL && commandLine == NULL && budgetCorpus == NULL && replayRecord == NULL) {
+        isValid = false;
     }
-    // Print lines (lineCount - n) to lineCount
-    int lineCount = getHistoryLineCount();
-    if (n > lineCount) { 
-        n = lineCount;
+    if ((numberOfShells != 1 || isPaced) && replayRecord == NULL) {
+        isValid = false;
     }
-    int currLine = 0;
-    char line[MAX_LINE_CHARS];
-    while (fgets(line, MAX_LINE_CHARS, historyFile) != NULL) {
-        if (currLine >= (lineCount - n) && currLine < lineCount) {
-            printf("%d: %s", currLine, line);
-        }
-        currLine++;
+    if (isValid == false || numberOfShells < 1) {
+        fprintf(stderr, "usage: %s [-c command] [--client socket [--rusage] -c command] [--serve socket] "
+                        "[--syscall-budget corpus] [--replay record [--paced] [--shells N]]\n", argv[0]);
+        return 2;
     }
-    fclose(historyFile);
-}
-
-static void writeHistory(char **words) {
-    char *inputText = formString(words);
-    FILE *historyFile = openHistory("a");
-    fputs(inputText, historyFile);
-    free(inputText);    
-    fclose(historyFile);
-}
-
-static char *getCommandFromHistory(int lineNumber) {
-    FILE *historyFile = openHistory("r");
-    if (historyFile == NULL) {
-        return NULL;  
+    if (replayRecord != NULL) {
+        return replaySession(replayRecord, numberOfShells, isPaced);
     }
-    int currLine = 0;
-    char line[BUFSIZ];  
-    while (fgets(line, BUFSIZ, historyFile) != NULL) { 
-        if (currLine == lineNumber) {
-            break;
-        }
-        currLine++;
+    if (budgetCorpus != NULL) {
+        return checkSyscallBudgets(budgetCorpus);
     }
-    // + 1 slot for NULL terminator '\0'
-    char *result = malloc(sizeof(char) * (strlen(line) + 1));  
-    strcpy(result, line); 
-    fclose(historyFile);
-    return result;
+    if (serveSocket != NULL) {
+        return serveCommands(serveSocket);
+    }
+    if (clientSocket != NULL) {
+        return runClient(clientSocket, commandLine, showUsage);
+    }
+    return nautilusExecute(commandLine, 0);
 }
 
-static char **getHistoryWords(char **words) {
-    int argc = getWordCount(words);
-    char **historyWords = NULL;
-    int lineCount = getHistoryLineCount();
-    if (argc == 1) {
-        if (lineCount > 0) { 
-            // -1 because history's lines are indexed starting from 0
-            char *command = getCommandFromHistory(lineCount - 1);  
-            printf("%s", command);
-            historyWords = tokenize(command, WORD_SEPARATORS, SPECIAL_CHARS);       
-            free(command);
-        } else {
-            fprintf(stderr, "%s: invalid history reference\n", words[0]);
+static int serveCommands(char *socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", socketPath);
+        return 1;
+    }
+    strcpy(address.sun_path, socketPath);
+    // A socket left behind by a server that didn't shut down cleanly is 
+    // replaced
+    struct stat s;
+    if (stat(socketPath, &s) == 0 && S_ISSOCK(s.st_mode)) {
+        unlink(socketPath);
+    }
+    int listenFD = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFD == -1 || 
+        bind(listenFD, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(listenFD, SERVER_BACKLOG) != 0) {
+        perror(socketPath);
+        if (listenFD != -1) {
+            close(listenFD);
+        }
+        return 1;
+    }
+    // SIGINT and SIGTERM are read from a signalfd so the socket is removed on
+    // the way out. Workers put the old mask back before running anything
+    sigset_t stopSignals;
+    sigset_t oldMask;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    sigprocmask(SIG_BLOCK, &stopSignals, &oldMask);
+    int signalFD = signalfd(-1, &stopSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int epollFD = epoll_create1(EPOLL_CLOEXEC);
+    struct serverConnection listener = {SERVER_LISTENER, listenFD, -1, 0, NULL};
+    struct serverConnection signals = {SERVER_SIGNALS, signalFD, -1, 0, NULL};
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = &listener};
+    epoll_ctl(epollFD, EPOLL_CTL_ADD, listenFD, &event);
+    event.data.ptr = &signals;
+    epoll_ctl(epollFD, EPOLL_CTL_ADD, signalFD, &event);
+    int serverFDs[] = {listenFD, signalFD, epollFD};
+
+    // PATH is read up front, so every worker starts with it already in the
+    // trie rather than reading it again
+    nautilusReadPath();
+    // Workers without a pidfd are checked on regularly instead
+    struct serverConnection *polledWorkers = NULL;
+    bool isRunning = true;
+    while (isRunning) {
+        struct epoll_event events[SERVER_EVENTS];
+        int timeout = (polledWorkers != NULL) ? DEADLINE_POLL_MS : -1;
+        int numberOfEvents = epoll_wait(epollFD, events, SERVER_EVENTS, timeout);
+        if (numberOfEvents == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
         }
-    } else if (argc == 2) {
-        if (isNumber(words[1])) {
-            int lineNumber = atoi(words[1]);
-            if (lineNumber > lineCount || lineNumber < 0) {
-                fprintf(stderr, "%s: invalid history reference\n", words[0]);
+        for (int i = 0; i < numberOfEvents; i++) {
+            struct serverConnection *connection = events[i].data.ptr;
+            if (connection->kind == SERVER_LISTENER) {
+                int clientFD;
+                while ((clientFD = accept4(listenFD, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+                    struct serverConnection *client = malloc(sizeof(struct serverConnection));
+                    *client = (struct serverConnection) {SERVER_CLIENT, clientFD, clientFD, 0, NULL};
+                    event.data.ptr = client;
+                    epoll_ctl(epollFD, EPOLL_CTL_ADD, clientFD, &event);
+                }
+            } else if (connection->kind == SERVER_SIGNALS) {
+                isRunning = false;
+            } else if (connection->kind == SERVER_CLIENT) {
+                epoll_ctl(epollFD, EPOLL_CTL_DEL, connection->fd, NULL);
+                if (startRequest(connection, serverFDs, 3, &oldMask) == false) {
+                    close(connection->fd);
+                    free(connection);
+                } else if (connection->fd != -1) {
+                    event.data.ptr = connection;
+                    epoll_ctl(epollFD, EPOLL_CTL_ADD, connection->fd, &event);
+                } else {
+                    connection->next = polledWorkers;
+                    polledWorkers = connection;
+                }
             } else {
-                char *command = getCommandFromHistory(lineNumber);
-                printf("%s", command);
-                historyWords = tokenize(command, WORD_SEPARATORS, SPECIAL_CHARS);
-                free(command);
+                epoll_ctl(epollFD, EPOLL_CTL_DEL, connection->fd, NULL);
+                finishRequest(connection);
+                free(connection);
             }
-        } else {
-            fprintf(stderr, "%s: %s: numeric argument required\n", words[0], words[1]);
         }
-    } else {
-        fprintf(stderr, "%s: too many arguments\n", words[0]);
-    }
-    return historyWords;
-}
-
-// ===================== SUBSET 3 =====================
-
-static bool hasWildcard(char *line) {
-    for (int n = 0; n < strlen(line); n++) {
-        if (line[n] == '*' ||
-            line[n] == '?' ||
-            line[n] == '[' ||
-            line[n] == ']' ||
-            line[n] == '~') {
-            return true;
+        struct serverConnection **link = &polledWorkers;
+        while (*link != NULL) {
+            struct serverConnection *worker = *link;
+            siginfo_t info;
+            info.si_pid = 0;
+            if (waitid(P_PID, worker->pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0 && info.si_pid != 0) {
+                *link = worker->next;
+                finishRequest(worker);
+                free(worker);
+            } else {
+                link = &worker->next;
+            }
         }
     }
-    return false;
-}
-
-static char **removeFromWords(char **words, int target) {
-    int argc = getWordCount(words);
-    int newSize = sizeof(char *) * argc;
-    char **newWords = malloc(newSize);
-    int n = 0;
-    for (int i = 0; i < argc; i++, n++) {
-        if (n == target) {
-            // Incremement n to skip copying the word that was deleted
-            n++;  
-        } 
-        newWords[i] = words[n];
-    }
-    assert(newWords[argc - 1] == NULL);
-    free(words);
-    return newWords;
+    close(epollFD);
+    close(signalFD);
+    close(listenFD);
+    unlink(socketPath);
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    return 0;
 }
 
-static char **injectIntoWords(char **words, char *newWord, int target) {
-    // Find size of words (number of pointers * 8)
-    int argc = getWordCount(words);
-    // + 1 because NULL should be the final entry
-    int wordsSize = sizeof(char *) * (argc + 1);
-    // Since we are adding just one additional entry to words  
-    int newSize = wordsSize + sizeof(char *);  
-    char **newWords = malloc(newSize);
-
-    // Copy over contents from words to newWords 
-    int n = 0;
-    for (int i = 0; i < argc + 1; i++, n++) {
-        if (i == target) {
-            newWords[i] = newWord;
-            n++;
+static bool startRequest(struct serverConnection *connection, int *serverFDs, 
+                         int numberOfServerFDs, sigset_t *workerMask) {
+    char line[MAX_LINE_CHARS];
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * SERVER_REQUEST_FDS)];
+    } control;
+    struct iovec vector = {line, MAX_LINE_CHARS - 1};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    ssize_t length = recvmsg(connection->fd, &message, MSG_CMSG_CLOEXEC);
+    int fds[SERVER_REQUEST_FDS];
+    int numberOfFDs = 0;
+    struct cmsghdr *header = (length > 0) ? CMSG_FIRSTHDR(&message) : NULL;
+    if (header != NULL && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS) {
+        numberOfFDs = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(header), sizeof(int) * numberOfFDs);
+    }
+    if (length <= 0 || numberOfFDs != SERVER_REQUEST_FDS || 
+        (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0) {
+        for (int i = 0; i < numberOfFDs; i++) {
+            close(fds[i]);
         }
-        newWords[n] = words[i];
+        return false;
     }
-    newWords[argc + 1] = NULL;
-    free(words);
-    return newWords;
-}
-
-static char **expandWildcards(char **words) {
-    for (int i = 0; i < getWordCount(words); i++) {
-        if (hasWildcard(words[i])) {
-            char *globArg = words[i];
-            glob_t matches;
-            int globResult = glob(globArg, GLOB_NOCHECK | GLOB_TILDE, NULL, &matches);    
-            if (globResult == 0) {  
-                // If globResult == 0, then glob has succeeded
-                for (int n = 0; n < matches.gl_pathc; n++) {
-                    if (n == 0) {
-                        words = removeFromWords(words, i);  // Remove on first iteration only
-                    }
-                    words = injectIntoWords(words, matches.gl_pathv[n], i + n);  // Insert match into words
-                }
+    line[length] = '\0';
+    // Catch up with any change to PATH here, so the server keeps the new 
+    // trie for later workers instead of each of them rebuilding it
+    nautilusReadPath();
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        for (int i = 0; i < numberOfServerFDs; i++) {
+            close(serverFDs[i]);
+        }
+        close(connection->fd);
+        sigprocmask(SIG_SETMASK, workerMask, NULL);
+        // The client's descriptors become the worker's stdin, stdout and 
+        // stderr, and its working directory this one's
+        for (int i = 0; i < 3; i++) {
+            dup2(fds[i], i);
+        }
+        if (fchdir(fds[3]) != 0) {
+            perror("fchdir");
+        }
+        for (int i = 0; i < SERVER_REQUEST_FDS; i++) {
+            if (fds[i] > 2) {
+                close(fds[i]);
             }
         }
+        int exitStatus = nautilusExecute(line, 0);
+        // The shell's atexit handlers are the server's, not the worker's
+        fflush(stdout);
+        _exit(exitStatus);
     }
-    return words;
-}
-
-// ===================== SUBSET 4 =====================
-
-static void executeRedirection(char **words, char **path, char **environ) {
-    // If the command attempts to redirect I/O, then handle the
-    // command by the appropriate cases below:
-    int flags = getRedirectionType(words);
-    int redirectTypes = (REDIR_APPEND | REDIR_INPUT | REDIR_OUTPUT);
-    words = expandWildcards(words);
-    if ((flags & redirectTypes) ==  REDIR_INPUT) {
-        executeRedirInput(words, path, environ);
-    } else if ((flags & redirectTypes) ==  REDIR_OUTPUT)  {
-        executeRedirOutput(words, path, environ);
-    } else if ((flags & redirectTypes) == REDIR_APPEND) {
-        executeRedirAppend(words, path, environ);
-    } else if ((flags & redirectTypes) ==  (REDIR_INPUT | REDIR_OUTPUT)) {
-        executeRedirInputAndOutput(words, path, environ);
-    } else if ((flags & redirectTypes) ==  (REDIR_INPUT | REDIR_APPEND)) {
-        executeRedirInputAndAppend(words, path, environ);
+    for (int i = 0; i < SERVER_REQUEST_FDS; i++) {
+        close(fds[i]);
     }
-}
-
-static bool isBuiltin(char *argument) {
-    if (strcmp(argument, "history") == 0 ||
-        strcmp(argument, "cd") == 0 ||
-        strcmp(argument, "pwd") == 0 ||
-        strcmp(argument, "!") == 0) {
-        fprintf(stderr, "%s: I/O redirection not permitted for builtin commands\n", argument);
-        return true;
-    } else {
+    if (pid == -1) {
+        perror("fork");
         return false;
     }
+    connection->kind = SERVER_WORKER;
+    connection->pid = pid;
+    connection->fd = syscall(SYS_pidfd_open, pid, 0);
+    return true;
 }
 
-static bool isRedirectionCommand(char **words) {
-    for (int i = 0; i < getWordCount(words); i++) {
-        if (strcmp(words[i], "<") == 0 ||
-            strcmp(words[i], ">") == 0) {
-            return true;
-        }
-    }
-    return false;
-}
-
-static bool isRedirection(char *argument) {
-    if (strcmp(argument, "<") == 0 ||
-        strcmp(argument, ">") == 0) {
-        return true;
+static void finishRequest(struct serverConnection *worker) {
+    int status = 0;
+    struct rusage usage;
+    memset(&usage, 0, sizeof(usage));
+    // The worker's usage includes every process it waited for
+    if (wait4(worker->pid, &status, 0, &usage) == -1) {
+        perror("wait4");
+    }
+    struct serverReply reply;
+    if (WIFSIGNALED(status)) {
+        reply.exitStatus = 128 + WTERMSIG(status);
     } else {
-        return false;
+        reply.exitStatus = WEXITSTATUS(status);
     }
-}
-
-static bool checkRedirValidity(char **words, int flags) {
-    int redirectTypes = (REDIR_APPEND | REDIR_INPUT | REDIR_OUTPUT);
-    int argc = getWordCount(words);
-    
-    switch (flags & redirectTypes) {
-        case 0:
-            fprintf(stderr, "invalid input redirection\n");
-            return false;
-        case REDIR_INPUT:
-            // If <, > or | is detected in the rest of the commands, then invalid redirection
-            for (int i = 1; i < argc; i++) {
-                if (isRedirection(words[i]) == true) {
-                    fprintf(stderr, "invalid input redirection\n");
-                    return false;
-                }
-            }
-            break;
-        case REDIR_OUTPUT:
-            // Last argument must not be <, > or |
-            if (isRedirection(words[argc - 1]) == true) {
-                fprintf(stderr, "invalid input redirection\n");
-                return false;
-            }
-            // If <, > or | is detected from words[0] to words[argc - 2], then invalid redirection
-            for (int i = 0; i < argc - 2; i++) {
-                if (isRedirection(words[i]) == true) {
-                    fprintf(stderr, "invalid input redirection\n");
-                    return false;
-                }
-            }
-            break;
-        case REDIR_APPEND:
-            // Last argument must not be <, > or |
-            if (isRedirection(words[argc - 1]) == true) {
-                fprintf(stderr, "invalid input redirection\n");
-                return false;
-            }
-            // If <, > or | is detected from words[0] to words[argc - 3], then invalid redirection
-            for (int i = 1; i < argc - 3; i++) {
-                if (isRedirection(words[i]) == true) {
-                    fprintf(stderr, "invalid input redirection\n");
-                    return false;
-                }
-            }
-            break;
-        case (REDIR_INPUT | REDIR_OUTPUT):
-            // Commands must have a minimum of 5 arguments to be valid
-            // Eg. shortest possible format: < file1 program > file2
-            if (argc < 5) {
-                fprintf(stderr, "invalid input redirection\n");
-                return false;
-            }
-            // Last argument must not be <, > or |
-            if (isRedirection(words[argc - 1]) == true) {
-                fprintf(stderr, "invalid input redirection\n");
-                return false;
-            }
-            // If <, > or | is detected from words[1] to words[argc - 2], then invalid redirection
-            for (int i = 1; i < argc - 2; i++) {
-                if (isRedirection(words[i]) == true) {
-                    fprintf(stderr, "invalid input redirection\n");
-                    return false;
-                }
-            }
-            break;
-        case (REDIR_INPUT | REDIR_APPEND):
-            // Commands must have a minimum of 6 arguments to be valid
-            // Eg. shortest possible format: < file1 program > > file2
-            if (argc < 6) {
-                fprintf(stderr, "invalid input redirection\n");
-                return false;
-            }
-            // Last argument must not be <, > or |
-            if (isRedirection(words[argc - 1]) == true) {
-                fprintf(stderr, "invalid input redirection\n");
-                return false;
-            }
-            // If <, > or | is detected from words[1] to words[argc - 3], then invalid redirection
-            for (int i = 1; i < argc - 3; i++) {
-                if (isRedirection(words[i]) == true) {
-                    fprintf(stderr, "invalid input redirection\n");
-                    return false;
-                }
-            }
-            break;
+    reply.userMicroseconds = usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec;
+    reply.systemMicroseconds = usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec;
+    reply.maxResidentKilobytes = usage.ru_maxrss;
+    // The client may have stopped waiting, in which case nobody needs it
+    send(worker->clientFD, &reply, sizeof(reply), MSG_NOSIGNAL);
+    close(worker->clientFD);
+    if (worker->fd != -1) {
+        close(worker->fd);
     }
-    return true;
 }
 
-static int getRedirectionType(char **words) {
-    assert(words != NULL && words[0] != NULL);
-    int argc = getWordCount(words);
-    int flags = 0;
-
-    if (argc <= 2) {
-        return NOT_REDIR;
-    }
-    if (strcmp(words[0], "<") == 0) {
-        flags = flags | REDIR_INPUT;
-    }
-    if (strcmp(words[argc - 3], ">") != 0 &&
-        strcmp(words[argc - 2], ">") == 0) {
-        flags = flags | REDIR_OUTPUT;
-    }
-    if (strcmp(words[argc - 3], ">") == 0 &&
-        strcmp(words[argc - 2], ">") == 0) {
-        flags = flags | REDIR_APPEND;
-    }
-
-    bool isValid = checkRedirValidity(words, flags);
-    if (isValid == true) {
-        return flags;
-    } else {
-        return 0;
-    }
+static int runClient(char *socketPath, char *commandLine, bool showUsage) {
+    size_t lineLength = strlen(commandLine);
+    if (lineLength == 0 || lineLength >= MAX_LINE_CHARS) {
+        fprintf(stderr, "%s: command line must be 1 to %d characters\n", socketPath, MAX_LINE_CHARS - 1);
+        return 2;
+    }
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", socketPath);
+        return 2;
+    }
+    strcpy(address.sun_path, socketPath);
+    int serverFD = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (serverFD == -1 || connect(serverFD, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        perror(socketPath);
+        if (serverFD != -1) {
+            close(serverFD);
+        }
+        return 2;
+    }
+    int cwdFD = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (cwdFD == -1) {
+        perror(".");
+        close(serverFD);
+        return 2;
+    }
+    // The command line goes in one message along with the descriptors the 
+    // command should use
+    int fds[SERVER_REQUEST_FDS] = {0, 1, 2, cwdFD};
+    union {
+        struct cmsghdr header;
+        char buffer[CMSG_SPACE(sizeof(int) * SERVER_REQUEST_FDS)];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec vector = {commandLine, lineLength};
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof(control.buffer);
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int) * SERVER_REQUEST_FDS);
+    memcpy(CMSG_DATA(header), fds, sizeof(int) * SERVER_REQUEST_FDS);
+    ssize_t sent = sendmsg(serverFD, &message, MSG_NOSIGNAL);
+    close(cwdFD);
+    if (sent == -1) {
+        perror(socketPath);
+        close(serverFD);
+        return 2;
+    }
+    struct serverReply reply;
+    ssize_t length;
+    do {
+        length = recv(serverFD, &reply, sizeof(reply), 0);
+    } while (length == -1 && errno == EINTR);
+    close(serverFD);
+    if (length != sizeof(reply)) {
+        fprintf(stderr, "%s: server closed the connection\n", socketPath);
+        return 2;
+    }
+    if (showUsage) {
+        fprintf(stderr, "user %.3fs system %.3fs max resident %lldK\n", 
+                reply.userMicroseconds / 1e6, reply.systemMicroseconds / 1e6, 
+                (long long) reply.maxResidentKilobytes);
+    }
+    return reply.exitStatus;
 }
 
-static char **leftPartition(char **words, char *separator) {
-    char **leftWords = NULL;
-    int argc = getWordCount(words);
-    int separatorIndex = 0;
-    bool separatorFound = false;
-    for (int i = 0; i < argc; i++) {
-        if (strcmp(words[i], separator) == 0) {
-            // Reached the separator string
-            separatorFound = true;
+// ===================== SUBSET 15 =====================
+
+static int checkSyscallBudgets(char *corpusPath) {
+    FILE *corpus = fopen(corpusPath, "r");
+    if (corpus == NULL) {
+        fprintf(stderr, "%s: No such file or directory\n", corpusPath);
+        return 2;
+    }
+    // Each traced shell starts with an empty history, kept out of the real one
+    char home[] = "/tmp/nautilus-budget-XXXXXX";
+    if (mkdtemp(home) == NULL) {
+        perror("mkdtemp");
+        fclose(corpus);
+        return 2;
+    }
+    char historyPath[PATH_MAX];
+    snprintf(historyPath, sizeof(historyPath), "%s/%s", home, HISTORY_FILE);
+    char indexPath[PATH_MAX];
+    snprintf(indexPath, sizeof(indexPath), "%s/%s", home, DIRECTORY_INDEX_FILE);
+    printf("%-20s %8s %8s  %s\n", "class", "budget", "calls", "command");
+    int numberOfCommands = 0;
+    int numberOfOver = 0;
+    bool isValid = true;
+    char line[MAX_LINE_CHARS];
+    int lineNumber = 0;
+    while (fgets(line, MAX_LINE_CHARS, corpus) != NULL) {
+        lineNumber++;
+        // Lines are "class budget command ...", with # starting a comment
+        char *s = line + strspn(line, WORD_SEPARATORS);
+        if (*s == '\0' || *s == '#') {
+            continue;
+        }
+        size_t classLength = strcspn(s, WORD_SEPARATORS);
+        char *className = s;
+        s += classLength;
+        s += strspn(s, WORD_SEPARATORS);
+        char *end;
+        long budget = strtol(s, &end, 10);
+        if (end == s || strchr(WORD_SEPARATORS, *end) == NULL) {
+            fprintf(stderr, "%s:%d: expected 'class budget command'\n", corpusPath, lineNumber);
+            isValid = false;
+            continue;
+        }
+        className[classLength] = '\0';
+        char *commandLine = end + strspn(end, WORD_SEPARATORS);
+        commandLine[strcspn(commandLine, "\n")] = '\0';
+        long calls = countCommandSyscalls(commandLine, home);
+        unlink(historyPath);
+        unlink(indexPath);
+        if (calls == -1) {
+            isValid = false;
             break;
         }
-        separatorIndex++;
-    }
-    if (separatorFound == false) {
-        // Return the same input if this function failed to find the separator
-        return words;
+        bool isOver = (calls > budget);
+        printf("%-20s %8ld %8ld  %s%s\n", className, budget, calls, commandLine, 
+               isOver ? "  (over budget)" : "");
+        numberOfCommands++;
+        if (isOver) {
+            numberOfOver++;
+        }
     }
-    // (separatorIndex + 1) gives the size of the array slice (including NULL)
-    leftWords = malloc(sizeof(char *) * (separatorIndex + 1));  
-    // Copy contents of words
-    for (int i = 0; i < separatorIndex; i++) {
-        leftWords[i] = words[i];
+    fclose(corpus);
+    removeBudgetHome(home);
+    printf("syscall budgets: %d commands, %d over budget\n", numberOfCommands, numberOfOver);
+    if (isValid == false) {
+        return 2;
     }
-    // Set last element to be NULL
-    leftWords[separatorIndex] = NULL;
-    return leftWords;
+    return (numberOfOver > 0) ? 1 : 0;
 }
 
-static char **rightPartition(char **words, char *separator, bool stopLastOccurrence) {
-    char **rightWords = NULL;
-    int argc = getWordCount(words);
-    int separatorIndex = 0;
-    bool separatorFound = false;
-    for (int i = 0; i < argc; i++) {
-        if (strcmp(words[i], separator) == 0) {
-            // Reached the separator string 
-            separatorFound = true;
-            separatorIndex = i;
-            if (stopLastOccurrence == false) {
-                break;
+static long countCommandSyscalls(char *commandLine, char *home) {
+    int inputPipe[2];
+    if (pipe2(inputPipe, O_CLOEXEC) != 0) {
+        perror("pipe");
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(inputPipe[0], 0);
+        int nullFD = open("/dev/null", O_WRONLY);
+        dup2(nullFD, 1);
+        dup2(nullFD, 2);
+        // Files the commands write are kept in the home, and removed with it
+        setenv("HOME", home, 1);
+        if (chdir(home) != 0) {
+            _exit(127);
+        }
+        unsetenv("NAUTILUS_RECORD");
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        execl("/proc/self/exe", "nautilus", (char *) NULL);
+        _exit(127);
+    }
+    close(inputPipe[0]);
+    if (pid == -1) {
+        perror("fork");
+        close(inputPipe[1]);
+        return -1;
+    }
+    // The shell stops once it has started running nautilus again
+    int status;
+    if (waitpid(pid, &status, 0) != pid || WIFSTOPPED(status) == false) {
+        fprintf(stderr, "syscall budget: couldn't start a traced shell\n");
+        close(inputPipe[1]);
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+    // Each read of stdin marks the end of one command. The line is sent once
+    // to warm up caches, then again with the shell's system calls counted 
+    // until it comes back for the next line
+    int readsOfInput = 0;
+    long calls = 0;
+    bool isCounting = false;
+    bool isTraceable = true;
+    ptrace(PTRACE_SYSCALL, pid, NULL, 0);
+    while (waitpid(pid, &status, 0) == pid) {
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            break;
+        }
+        int signal = 0;
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            struct __ptrace_syscall_info info;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0) {
+                fprintf(stderr, "syscall budget: PTRACE_GET_SYSCALL_INFO is not supported\n");
+                isTraceable = false;
+                kill(pid, SIGKILL);
+            } else if (info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                bool isReadOfInput = (info.entry.nr == SYS_read && info.entry.args[0] == 0);
+                if (isCounting) {
+                    calls++;
+                }
+                if (isReadOfInput) {
+                    readsOfInput++;
+                    if (readsOfInput <= 2) {
+                        // This read is the start of the command being run
+                        writeAll(inputPipe[1], commandLine, strlen(commandLine));
+                        writeAll(inputPipe[1], "\n", 1);
+                        isCounting = (readsOfInput == 2);
+                        calls = isCounting ? 1 : 0;
+                    } else if (isCounting) {
+                        // Not counting the read for the next line
+                        calls--;
+                        isCounting = false;
+                        close(inputPipe[1]);
+                        inputPipe[1] = -1;
+                    }
+                }
             }
+        } else if (WSTOPSIG(status) != SIGTRAP) {
+            signal = WSTOPSIG(status);
         }
+        ptrace(PTRACE_SYSCALL, pid, NULL, signal);
     }
-    if (separatorFound == false) {
-        // Return the same input if this function failed to find the separator
-        return words;
+    if (inputPipe[1] != -1) {
+        close(inputPipe[1]);
     }
-    // (argc - separatorIndex) gives the size of the array slice (including NULL)
-    int size = (argc - separatorIndex);
-    rightWords = malloc(sizeof (char *) * size); 
-    // Copy contents of words
-    for (int i = separatorIndex + 1, n = 0; i <= argc; i++, n++) {
-        rightWords[n] = words[i];
+    waitpid(pid, &status, WNOHANG);
+    if (isTraceable == false) {
+        return -1;
     }
-    // Set last element to be NULL
-    rightWords[size - 1] = NULL;
-    return rightWords;
+    return calls;
 }
 
-static void executeRedirInput(char **words, char **path, char **environment) {
-    assert(words != NULL && words[1] != NULL);
-    // Second argument is always supposed to be a filename
-    char *fileName = words[1]; 
-    // All arguments after the filename are for executing a program
-    char **rightWords = rightPartition(words, fileName, true);  
-    int pipeFDs[2]; 
-    pipe(pipeFDs);
-    posix_spawn_file_actions_t actions;
-    posix_spawn_file_actions_init(&actions);
-    posix_spawn_file_actions_adddup2(&actions, pipeFDs[0], 0);
-    posix_spawn_file_actions_addclose(&actions, pipeFDs[1]);
-
-    char *programName = rightWords[0];
-    char *programPath = getPathToProgram(programName, path);
-    if (isBuiltin(programName) == true) {
-        return;
-    }
-    if (programPath != NULL && is_executable(programPath)) {
-        FILE *inputFile = fopen(fileName, "r");
-        if (inputFile == NULL) {
-            fprintf(stderr, "%s: No such file or directory\n", fileName);
-            return;  
-        } 
-        pid_t pid;
-        posix_spawn(&pid, programPath, &actions, NULL, rightWords, environment);
-        close(pipeFDs[0]);        
-        FILE *programInput = fdopen(pipeFDs[1], "w");
-        
-        // Pipe in the lines from the input file into the program
-        char line[256];
-        while (fgets(line, 256, inputFile) != NULL) {
-            fputs(line, programInput);
-        }   
-        fclose(inputFile);
-        fclose(programInput);
-        int exit_status;
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
-        }
-        exit_status = WEXITSTATUS(exit_status);
-        printf("%s exit status = %d\n", programPath, exit_status);
-    } else {
-        executionError(rightWords, programPath);
-    }
+static void removeBudgetHome(char *home) {
+    nftw(home, removeBudgetFile, 16, FTW_DEPTH | FTW_PHYS);
 }
 
-static void executeRedirOutput(char **words, char **path, char **environment) {
-    int argc = getWordCount(words);
-    // A filename is always expected as the last argument
-    char *fileName = words[argc - 1];  
-    char **leftWords = leftPartition(words, ">");
-    int pipeFDs[2]; 
-    pipe(pipeFDs);
-    posix_spawn_file_actions_t actions;
-    posix_spawn_file_actions_init(&actions);
-    posix_spawn_file_actions_addclose(&actions, pipeFDs[0]);
-    posix_spawn_file_actions_adddup2(&actions, pipeFDs[1], 1);
-    
-    char *programName = leftWords[0];
-    char *programPath = getPathToProgram(programName, path);
-    if (isBuiltin(programName) == true) {
-        return;
-    }
-    if (programPath != NULL && is_executable(programPath)) {
-        if (isDirectory(fileName)) {
-            fprintf(stderr, "%s: Is a directory\n", fileName);
-            return;
-        }
-        pid_t pid;
-        posix_spawn(&pid, programPath, &actions, NULL, leftWords, environment);
-        close(pipeFDs[1]);
-        
-        // Pipe out lines from the program's output into the output file
-        FILE *outputFile = fopen(fileName, "w");
-        FILE *programOutput = fdopen(pipeFDs[0], "r");
-        char line[MAX_LINE_CHARS];
-        while (fgets(line, MAX_LINE_CHARS, programOutput) != NULL) {
-            fputs(line, outputFile);
-        }   
-        fclose(outputFile);
-        fclose(programOutput);
-        int exit_status;
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
-        }
-        exit_status = WEXITSTATUS(exit_status); 
-        printf("%s exit status = %d\n", programPath, exit_status);
-    } else {
-        executionError(leftWords, programPath);
+static int removeBudgetFile(const char *path, const struct stat *s, int type, struct FTW *ftw) {
+    (void) s;
+    (void) ftw;
+    if (((type == FTW_DP) ? rmdir(path) : unlink(path)) != 0) {
+        perror(path);
     }
+    return 0;
 }
 
-static void executeRedirAppend(char **words, char **path, char **environment) {
-    int argc = getWordCount(words);
-    // A filename is always expected as the last argument
-    char *fileName = words[argc - 1]; 
-    char **leftWords = leftPartition(words, ">");
-
-    int pipeFDs[2]; 
-    pipe(pipeFDs);
-    posix_spawn_file_actions_t actions;
-    posix_spawn_file_actions_init(&actions);
-    posix_spawn_file_actions_addclose(&actions, pipeFDs[0]);
-    posix_spawn_file_actions_adddup2(&actions, pipeFDs[1], 1);
-    
-    char *programName = leftWords[0];
-    char *programPath = getPathToProgram(programName, path);
-    if (isBuiltin(programName) == true) {
-        return;
-    }
-    if (programPath != NULL && is_executable(programPath)) {
-        if (isDirectory(fileName)) {
-            fprintf(stderr, "%s: Is a directory\n", fileName);
-            return;
-        }
-        pid_t pid;
-        posix_spawn(&pid, programPath, &actions, NULL, leftWords, environment);
-        close(pipeFDs[1]);  
-        
-        // Pipe out lines from the program's output into the output file
-        FILE *outputFile = fopen(fileName, "a");
-        FILE *programOutput = fdopen(pipeFDs[0], "r");
-        char line[MAX_LINE_CHARS];
-        while (fgets(line, MAX_LINE_CHARS, programOutput) != NULL) {
-            fputs(line, outputFile);
-        }   
-        fclose(outputFile);
-        fclose(programOutput);
-        int exit_status;
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
-        }
-        exit_status = WEXITSTATUS(exit_status);  
-        printf("%s exit status = %d\n", programPath, exit_status);
-    } else {
-        executionError(leftWords, programPath);
-    }
-}
+// ===================== SUBSET 21 =====================
 
-static void executeRedirInputAndOutput(char **words, char **path, char **environment) {
-    assert(words != NULL && words[1] != NULL);
-    int argc = getWordCount(words);
-    char *inputFileName = words[1]; 
-    char *outputFileName = words[argc - 1];
-    char **rightWords = rightPartition(words, inputFileName, true); 
-    // The actual command arguments are between '< inputfile' and '> outputfile'
-    char **commandWords = leftPartition(rightWords, ">"); 
-    
-    int pipeWriteFD[2];
-    int pipeReadFD[2]; 
-    pipe(pipeWriteFD);
-    pipe(pipeReadFD);
-    posix_spawn_file_actions_t actions;
-    posix_spawn_file_actions_init(&actions);
-    posix_spawn_file_actions_addclose(&actions, pipeWriteFD[1]);
-    posix_spawn_file_actions_adddup2(&actions, pipeWriteFD[0], 0);
-    posix_spawn_file_actions_addclose(&actions, pipeReadFD[0]);
-    posix_spawn_file_actions_adddup2(&actions, pipeReadFD[1], 1);
-
-    char *programName = commandWords[0];
-    char *programPath = getPathToProgram(programName, path);
-    if (isBuiltin(programName) == true) {
-        return;
-    }
-    if (programPath != NULL && is_executable(programPath)) {
-        FILE *inputFile = fopen(inputFileName, "r");
-        if (inputFile == NULL) {
-            fprintf(stderr, "%s: No such file or directory\n", inputFileName);
-            return;
-        }
-        if (isDirectory(outputFileName)) {
-            fprintf(stderr, "%s: Is a directory\n", outputFileName);
-            return;
-        }
-        pid_t pid;
-        posix_spawn(&pid, programPath, &actions, NULL, commandWords, environment);
-        close(pipeWriteFD[0]);
-        close(pipeReadFD[1]);
-        
-        FILE *programInput = fdopen(pipeWriteFD[1], "w");
-        FILE *outputFile = fopen(outputFileName, "w");
-        FILE *programOutput = fdopen(pipeReadFD[0], "r");
-
-        // Pipe in the lines from the input file into the program
-        char line[256];
-        while (fgets(line, 256, inputFile) != NULL) {
-            fputs(line, programInput);
-        }   
-        fclose(inputFile);
-        fclose(programInput);
-        
-        // Pipe out lines from the program's output into the output file
-        while (fgets(line, 256, programOutput) != NULL) {
-            fputs(line, outputFile);
-        }
-        fclose(outputFile);
-        fclose(programOutput);
-        int exit_status;
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
-        }
-        exit_status = WEXITSTATUS(exit_status);
-        printf("%s exit status = %d\n", programPath, exit_status);
-    } else {
-        executionError(commandWords, programPath);
+static bool parseRecordedLine(char *text, struct recordedLine *record) {
+    if (text[0] == '#') {
+        return false;
     }
+    text[strcspn(text, "\n")] = '\0';
+    // The line itself comes last, so it can have tabs of its own
+    char *fields[6];
+    fields[0] = text;
+    for (int i = 1; i < 6; i++) {
+        char *tab = strchr(fields[i - 1], '\t');
+        if (tab == NULL) {
+            return false;
+        }
+        *tab = '\0';
+        fields[i] = tab + 1;
+    }
+    char *end;
+    record->startTime = strtod(fields[0], &end);
+    bool isValid = (end != fields[0] && *end == '\0');
+    record->seconds = strtod(fields[1], &end);
+    isValid = isValid && (end != fields[1] && *end == '\0');
+    record->programSeconds = strtod(fields[2], &end);
+    isValid = isValid && (end != fields[2] && *end == '\0');
+    record->exitStatus = strtol(fields[3], &end, 10);
+    isValid = isValid && (end != fields[3] && *end == '\0');
+    record->cwd = fields[4];
+    record->commandLine = fields[5];
+    return isValid;
 }
 
-static void executeRedirInputAndAppend(char **words, char **path, char **environment) {
-    assert(words != NULL && words[1] != NULL);
-    int argc = getWordCount(words);
-    char *inputFileName = words[1]; 
-    char *outputFileName = words[argc - 1];
-    char **rightWords = rightPartition(words, inputFileName, true);
-    // The actual command arguments are between '< inputfile' and '>> outputfile' 
-    char **commandWords = leftPartition(rightWords, ">"); 
-
-    int pipeWriteFD[2];
-    int pipeReadFD[2]; 
-    pipe(pipeWriteFD);
-    pipe(pipeReadFD);
-    posix_spawn_file_actions_t actions;
-    posix_spawn_file_actions_init(&actions);
-    posix_spawn_file_actions_addclose(&actions, pipeWriteFD[1]);
-    posix_spawn_file_actions_adddup2(&actions, pipeWriteFD[0], 0);
-    posix_spawn_file_actions_addclose(&actions, pipeReadFD[0]);
-    posix_spawn_file_actions_adddup2(&actions, pipeReadFD[1], 1);
-
-    char *programName = commandWords[0];
-    char *programPath = getPathToProgram(programName, path);
-    if (isBuiltin(programName) == true) {
-        return;
-    }
-    if (programPath != NULL && is_executable(programPath)) {
-        FILE *inputFile = fopen(inputFileName, "r");
-        if (inputFile == NULL) {
-            fprintf(stderr, "%s: No such file or directory\n", inputFileName);
-            return;
-        }
-        if (isDirectory(outputFileName)) {
-            fprintf(stderr, "%s: Is a directory\n", outputFileName);
-            return;
-        }
-        pid_t pid;
-        posix_spawn(&pid, programPath, &actions, NULL, commandWords, environment);
-        close(pipeWriteFD[0]);
-        close(pipeReadFD[1]);
-        
-        FILE *programInput = fdopen(pipeWriteFD[1], "w");
-        FILE *outputFile = fopen(outputFileName, "a");
-        FILE *programOutput = fdopen(pipeReadFD[0], "r");
-        
-        // Pipe in the lines from the input file into the program
-        char line[256];
-        while (fgets(line, 256, inputFile) != NULL) {
-            fputs(line, programInput);
-        }   
-        fclose(inputFile);
-        fclose(programInput);
-        
-        // Pipe out lines from the program's output into the output file
-        while (fgets(line, 256, programOutput) != NULL) {
-            fputs(line, outputFile);
+static int replaySession(char *recordPath, int numberOfShells, bool isPaced) {
+    FILE *file = fopen(recordPath, "r");
+    if (file == NULL) {
+        perror(recordPath);
+        return 1;
+    }
+    int numberOfRecords = 0;
+    int capacity = 64;
+    struct recordedLine *records = malloc(sizeof(struct recordedLine) * capacity);
+    // The text each record was parsed from, which its fields point into
+    char **recordTexts = malloc(sizeof(char *) * capacity);
+    char *text = NULL;
+    size_t textSize = 0;
+    while (getline(&text, &textSize, file) != -1) {
+        if (numberOfRecords == capacity) {
+            capacity *= 2;
+            records = realloc(records, sizeof(struct recordedLine) * capacity);
+            recordTexts = realloc(recordTexts, sizeof(char *) * capacity);
         }
-        fclose(outputFile);
-        fclose(programOutput);
-        int exit_status;
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
+        recordTexts[numberOfRecords] = strdup(text);
+        if (parseRecordedLine(recordTexts[numberOfRecords], &records[numberOfRecords])) {
+            numberOfRecords++;
+        } else {
+            free(recordTexts[numberOfRecords]);
         }
-        exit_status = WEXITSTATUS(exit_status);
-        printf("%s exit status = %d\n", programPath, exit_status);
-    } else {
-        executionError(commandWords, programPath);
     }
-}
-
-// ===================== SUBSET 5 =====================
-
-static bool isPipeCommand(char **words) {
-    int argc = getWordCount(words);
-    for (int i = 0; i < argc; i++) {
-        if (strcmp(words[i], "|") == 0) {
-            return true;
+    free(text);
+    fclose(file);
+    if (numberOfRecords == 0) {
+        fprintf(stderr, "%s: no recorded lines\n", recordPath);
+        free(recordTexts);
+        free(records);
+        return 1;
+    }
+    // The shells start with an empty history, kept out of the real one
+    char home[] = "/tmp/nautilus-replay-XXXXXX";
+    if (mkdtemp(home) == NULL) {
+        perror("mkdtemp");
+        for (int i = 0; i < numberOfRecords; i++) {
+            free(recordTexts[i]);
         }
-    }
-    return false;
-}
-
-static int getNumberOfPipes(char **words) {
-    int count = 0;
-    for (int i = 0; i < getWordCount(words); i++) {
-        if (strcmp(words[i], "|") == 0) {
-            count++;
+        free(recordTexts);
+        free(records);
+        return 1;
+    }
+
+    // Unpaced shells each read the whole session from their own opening of
+    // one memfd, so none waits on another. Paced shells are fed each line 
+    // through a pipe when it was originally typed
+    int sessionFD = -1;
+    int *inputFDs = malloc(sizeof(int) * numberOfShells);
+    if (isPaced == false) {
+        sessionFD = memfd_create("nautilus-replay", MFD_CLOEXEC);
+        for (int i = 0; i < numberOfRecords && sessionFD != -1; i++) {
+            writeAll(sessionFD, records[i].commandLine, strlen(records[i].commandLine));
+            writeAll(sessionFD, "\n", 1);
         }
     }
-    return count;
-}
-
-static void executePiping(char **commandWords, char **path, char **environ) {
-    int argc = getWordCount(commandWords);
-    int numberOfPipes = getNumberOfPipes(commandWords);
-    int redirectOption = 0;
-    commandWords = expandWildcards(commandWords);
-    char **inputArguments = NULL;  
-    char *outputFilename = NULL;
-    if (isRedirectionCommand(commandWords) == true) {            
-        int flags = getRedirectionType(commandWords);
-        int redirTypes = REDIR_INPUT | REDIR_OUTPUT | REDIR_APPEND;
-        if ((flags & redirTypes) == 0) {
-            fprintf(stderr, "invalid input redirection\n");
-            return;
-        } 
-        if ((flags & REDIR_OUTPUT) == REDIR_OUTPUT) {
-            outputFilename = commandWords[argc - 1];
-            commandWords = leftPartition(commandWords, ">");
-            redirectOption = REDIR_OUTPUT;
+    sigset_t pipeSignal;
+    sigset_t oldMask;
+    sigemptyset(&pipeSignal);
+    sigaddset(&pipeSignal, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipeSignal, &oldMask);
+    pid_t *pids = malloc(sizeof(pid_t) * numberOfShells);
+    double startTime = getMonotonicTime();
+    int numberOfStarted = 0;
+    for (; numberOfStarted < numberOfShells; numberOfStarted++) {
+        int i = numberOfStarted;
+        char recordName[PATH_MAX];
+        snprintf(recordName, sizeof(recordName), "%s/record.%d", home, i);
+        int shellInput = -1;
+        if (isPaced) {
+            int inputPipe[2];
+            if (pipe2(inputPipe, O_CLOEXEC) == 0) {
+                shellInput = inputPipe[0];
+                inputFDs[i] = inputPipe[1];
+            }
+        } else if (sessionFD != -1) {
+            char fdPath[64];
+            snprintf(fdPath, sizeof(fdPath), "/proc/self/fd/%d", sessionFD);
+            shellInput = open(fdPath, O_RDONLY | O_CLOEXEC);
+            inputFDs[i] = -1;
         }
-        if ((flags & REDIR_APPEND) == REDIR_APPEND) {
-            outputFilename = commandWords[argc - 1];
-            commandWords = leftPartition(commandWords, ">");
-            redirectOption = REDIR_APPEND;
+        if (shellInput == -1) {
+            perror("replay");
+            break;
         }
-        if ((flags & REDIR_INPUT) == REDIR_INPUT) {
-            // If the command wants to pipe in lines from an input file, then
-            // create an array of strings storing each of the lines
-            inputArguments =  malloc(sizeof(char *) * 1);
-            char *inputFilename = commandWords[1];
-            FILE *inputFile = fopen(inputFilename, "r");
-            if (inputFile == NULL) {
-                fprintf(stderr, "%s: No such file or directory\n", inputFilename);
-                return;
+        pids[i] = startReplayShell(shellInput, home, recordName, records[0].cwd, &oldMask);
+        close(shellInput);
+        if (pids[i] == -1) {
+            if (inputFDs[i] != -1) {
+                close(inputFDs[i]);
             }
-            char inputLine[MAX_LINE_CHARS];
-            int lineCount = 0;
-            while(fgets(inputLine, MAX_LINE_CHARS, inputFile) != NULL) {
-                char *newEntry = malloc(sizeof (char) * (strlen(inputLine) + 1));  
-                strcpy(newEntry, inputLine);
-                inputArguments = realloc(inputArguments, sizeof(char *) * (lineCount + 1));
-                inputArguments[lineCount] = newEntry;
-                lineCount++;
-            }
-            fclose(inputFile);
-            inputArguments = realloc(inputArguments, sizeof(char *) * (lineCount + 1));
-            inputArguments[lineCount] = NULL;
-            commandWords = rightPartition(commandWords, commandWords[1], false);
+            break;
         }
     }
-    // Delegate to a recursive function to execute commands with one or more pipes
-    handlePiping(commandWords, path, environ, inputArguments, numberOfPipes, redirectOption, outputFilename);
-}
-
-static void handlePiping(char **commandWords, char **path, char **environ, 
-                         char **inputArguments, int numberOfPipes, 
-                         int redirectOption, char *outputFilename) {
-    // Each call to handlePiping deals with two processes and saves the output
-    // for the next call
-    char **rightChunk = rightPartition(commandWords, "|", false);
-    char **leftProcess = leftPartition(commandWords, "|");
-    char **rightProcess = leftPartition(rightChunk, "|");
-    if (leftProcess[0] == NULL || rightProcess[0] == NULL) {
-        printf("invalid pipe\n");
-        return;
-    }
-    char **leftProcessOutput = malloc(sizeof(char *) * 1); 
-    char **rightProcessOutput = malloc(sizeof(char *) * 1);
-    int lineCount = 0;
-    int outputLineCount = 0;
-    int exit_status;
-
-    int leftPipeInputFDs[2];
-    int leftPipeOutputFDs[2];
-    pipe(leftPipeInputFDs); 
-    pipe(leftPipeOutputFDs);
-    posix_spawn_file_actions_t leftActions;
-    posix_spawn_file_actions_init(&leftActions);
-    posix_spawn_file_actions_addclose(&leftActions, leftPipeOutputFDs[0]);
-    posix_spawn_file_actions_adddup2(&leftActions, leftPipeOutputFDs[1], 1);
-    posix_spawn_file_actions_addclose(&leftActions, leftPipeInputFDs[1]);
-    posix_spawn_file_actions_adddup2(&leftActions, leftPipeInputFDs[0], 0);
-    
-    // Executing left process
-    char *leftProgramName = leftProcess[0];
-    char *leftProgramPath = getPathToProgram(leftProgramName, path);
-    if (leftProgramPath != NULL && is_executable(leftProgramPath)) {
-        pid_t pid;
-        posix_spawn(&pid, leftProgramPath, &leftActions, NULL, leftProcess, environ);
-        close(leftPipeOutputFDs[1]);
-        close(leftPipeInputFDs[0]);
-
-        FILE *programOutput = fdopen(leftPipeOutputFDs[0], "r");
-        FILE *programInput = fdopen(leftPipeInputFDs[1], "w");
-        // Pipe in the given input arguments into the left program's input    
-        if (inputArguments != NULL) {
-            int k = 0;
-            while (inputArguments[k] != NULL) {
-                fputs(inputArguments[k], programInput);
-                k++;
+    if (isPaced) {
+        for (int n = 0; n < numberOfRecords; n++) {
+            double delay = startTime + (records[n].startTime - records[0].startTime) - getMonotonicTime();
+            if (delay > 0) {
+                struct timespec pause = {(time_t) delay, (long) ((delay - (time_t) delay) * 1e9)};
+                while (nanosleep(&pause, &pause) == -1 && errno == EINTR);
+            }
+            char *commandLine;
+            int length = asprintf(&commandLine, "%s\n", records[n].commandLine);
+            for (int i = 0; i < numberOfStarted && length != -1; i++) {
+                // A shell that has exited just stops taking lines
+                writeAll(inputFDs[i], commandLine, length);
+            }
+            if (length != -1) {
+                free(commandLine);
             }
         }
-        fclose(programInput);
-        
-        // Save the left program's input into leftProcessOutput
-        char outputLine[MAX_LINE_CHARS];
-        while (fgets(outputLine, MAX_LINE_CHARS, programOutput) != NULL) {
-            char *newEntry = malloc(sizeof (char) * (strlen(outputLine) + 1));
-            strcpy(newEntry, outputLine);
-            leftProcessOutput = realloc(leftProcessOutput, sizeof(char *) * (lineCount + 1));
-            leftProcessOutput[lineCount] = newEntry; 
-            lineCount++;            
-        }   
-        // Set last element to be NULL
-        leftProcessOutput = realloc(leftProcessOutput, sizeof(char *) * (lineCount + 1));
-        leftProcessOutput[lineCount] = NULL;
-        fclose(programOutput);
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
-        }
-    } else {
-        executionError(leftProcess, leftProgramPath);
-        return;
-    }
-
-    // Executing right process with left process' output
-    int rightPipeInputFDs[2]; 
-    int rightPipeOutputFDs[2]; 
-    pipe(rightPipeInputFDs);
-    pipe(rightPipeOutputFDs);
-    posix_spawn_file_actions_t rightActions;
-    posix_spawn_file_actions_init(&rightActions);
-    posix_spawn_file_actions_adddup2(&rightActions, rightPipeInputFDs[0], 0);
-    posix_spawn_file_actions_addclose(&rightActions, rightPipeInputFDs[1]);
-    posix_spawn_file_actions_adddup2(&rightActions, rightPipeOutputFDs[1], 1);
-    posix_spawn_file_actions_addclose(&rightActions, rightPipeOutputFDs[0]);
-
-    char *rightProgramName = rightProcess[0];
-    char *rightProgramPath = getPathToProgram(rightProgramName, path);
-    if (rightProgramPath != NULL && is_executable(rightProgramPath)) {
-        pid_t pid;
-        posix_spawn(&pid, rightProgramPath, &rightActions, NULL, rightProcess, environ);
-        close(rightPipeInputFDs[0]);
-        close(rightPipeOutputFDs[1]);
-
-        FILE *programInput = fdopen(rightPipeInputFDs[1], "w");
-        FILE *programOutput = fdopen(rightPipeOutputFDs[0], "r");
-        // Pipe in the output of the first process into the second process
-        for (int i = 0; i < lineCount; i++) {
-            char *inputLine = leftProcessOutput[i];
-            fputs(inputLine, programInput);
+        for (int i = 0; i < numberOfStarted; i++) {
+            close(inputFDs[i]);
         }
-        fclose(programInput);
-
-        // Save the right program's output into rightProcessOutput
-        char outputLine[MAX_LINE_CHARS];
-        while (fgets(outputLine, MAX_LINE_CHARS, programOutput) != NULL) {
-            char *newEntry = malloc(sizeof (char) * (strlen(outputLine) + 1));
-            strcpy(newEntry, outputLine);
-            rightProcessOutput = realloc(rightProcessOutput, sizeof(char *) * (outputLineCount + 1));
-            rightProcessOutput[outputLineCount] = newEntry; 
-            outputLineCount++;
+    }
+    long peakResident = 0;
+    for (int i = 0; i < numberOfStarted; i++) {
+        // ru_maxrss is in kilobytes on Linux
+        struct rusage usage;
+        int status;
+        while (wait4(pids[i], &status, 0, &usage) == -1 && errno == EINTR);
+        if (usage.ru_maxrss > peakResident) {
+            peakResident = usage.ru_maxrss;
         }
-        // Set last element to be NULL
-        rightProcessOutput = realloc(rightProcessOutput, sizeof(char *) * (outputLineCount + 1));
-        rightProcessOutput[outputLineCount] = NULL;  
-        fclose(programOutput);
-        if (waitpid(pid, &exit_status, 0) == -1) {
-            perror("waitpid");
-            return;
+    }
+    double seconds = getMonotonicTime() - startTime;
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+    if (sessionFD != -1) {
+        close(sessionFD);
+    }
+
+    // Each shell measured the lines it ran, without the time taken to pass 
+    // them to it
+    struct durations *durations = calloc(3, sizeof(struct durations));
+    long numberOfReplayed = 0;
+    long numberOfFailed = 0;
+    for (int i = 0; i < numberOfShells; i++) {
+        char recordName[PATH_MAX];
+        snprintf(recordName, sizeof(recordName), "%s/record.%d", home, i);
+        FILE *shellRecord = fopen(recordName, "r");
+        if (shellRecord == NULL) {
+            continue;
         }
-        exit_status = WEXITSTATUS(exit_status);
-    } else {
-        executionError(rightProcess, rightProgramPath);
-        return;
-    }
-    
-    if (numberOfPipes == 1) {
-        // This is the terminating case
-        if (redirectOption == 0) {
-            // No output redirection specified, print the output
-            for (int i = 0; i < outputLineCount; i++) {
-                printf("%s", rightProcessOutput[i]);
-            }
-        } else if ((redirectOption & REDIR_OUTPUT) == REDIR_OUTPUT) {
-            // Redirect output into a file in write mode
-            FILE *finalOutputFile = fopen(outputFilename, "w");
-            for (int i = 0; i < outputLineCount; i++) {
-                fputs(rightProcessOutput[i], finalOutputFile);
+        while (getline(&text, &textSize, shellRecord) != -1) {
+            struct recordedLine record;
+            if (parseRecordedLine(text, &record) == false) {
+                continue;
             }
-            fclose(finalOutputFile);
-        } else if ((redirectOption & REDIR_APPEND) == REDIR_APPEND) {
-            // Redirect output into a file in append mode
-            FILE *finalOutputFile = fopen(outputFilename, "a");
-            for (int i = 0; i < outputLineCount; i++) {
-                fputs(rightProcessOutput[i], finalOutputFile);
+            double shellSeconds = record.seconds - record.programSeconds;
+            addDuration(&durations[0], record.seconds);
+            addDuration(&durations[1], (shellSeconds > 0) ? shellSeconds : 0);
+            addDuration(&durations[2], record.programSeconds);
+            numberOfReplayed++;
+            if (record.exitStatus != 0) {
+                numberOfFailed++;
             }
-            fclose(finalOutputFile);
         }
-        printf("%s exit status = %d\n", rightProgramPath, exit_status);    
-    } else {
-        handlePiping(rightChunk, path, environ, rightProcessOutput, numberOfPipes - 1, redirectOption, outputFilename);
-    }
+        fclose(shellRecord);
+        unlink(recordName);
+    }
+    free(text);
+    char historyPath[PATH_MAX];
+    snprintf(historyPath, sizeof(historyPath), "%s/%s", home, HISTORY_FILE);
+    unlink(historyPath);
+    snprintf(historyPath, sizeof(historyPath), "%s/%s", home, DIRECTORY_INDEX_FILE);
+    unlink(historyPath);
+    if (rmdir(home) != 0) {
+        fprintf(stderr, "replay: left behind what the session wrote to %s\n", home);
+    }
+
+    printf("replayed %ld commands on %d shell%s in %.3fs: %.1f commands/s, %ld failed\n", 
+           numberOfReplayed, numberOfStarted, (numberOfStarted == 1) ? "" : "s", seconds, 
+           numberOfReplayed / seconds, numberOfFailed);
+    printf("%-10s %8s %8s %8s %8s\n", "latency", "p50", "p90", "p99", "max");
+    char *names[] = {"total", "shell", "programs"};
+    double fractions[] = {0.50, 0.90, 0.99};
+    for (int n = 0; n < 3; n++) {
+        qsort(durations[n].values, durations[n].count, sizeof(uint64_t), compareDurations);
+        char texts[4][16];
+        for (int p = 0; p < 3; p++) {
+            formatDuration(texts[p], 16, getPercentile(&durations[n], fractions[p]));
+        }
+        formatDuration(texts[3], 16, getPercentile(&durations[n], 1.0));
+        printf("%-10s %8s %8s %8s %8s\n", names[n], texts[0], texts[1], texts[2], texts[3]);
+        free(durations[n].values);
+    }
+    printf("peak resident set: %ldK\n", peakResident);
+    free(durations);
+    free(pids);
+    free(inputFDs);
+    for (int i = 0; i < numberOfRecords; i++) {
+        free(recordTexts[i]);
+    }
+    free(recordTexts);
+    free(records);
+    return (numberOfStarted == numberOfShells) ? 0 : 1;
 }
 
-// =================================================================
-
-static void do_exit(char **words) {
-    int exit_status = 0;
-    if (words[1] != NULL) {
-        if (words[2] != NULL) {
-            fprintf(stderr, "exit: too many arguments\n");
-        } else {
-            char *endptr;
-            exit_status = (int)strtol(words[1], &endptr, 10);
-            if (*endptr != '\0') {
-                fprintf(stderr, "exit: %s: numeric argument required\n",
-                        words[1]);
-            }
+static pid_t startReplayShell(int inputFD, char *home, char *recordPath, char *cwd, sigset_t *mask) {
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(inputFD, 0);
+        int nullFD = open("/dev/null", O_WRONLY);
+        dup2(nullFD, 1);
+        dup2(nullFD, 2);
+        // The session starts where it was recorded, if that is still there
+        if (chdir(cwd) != 0 && chdir(home) != 0) {
+            _exit(127);
         }
+        setenv("HOME", home, 1);
+        setenv("NAUTILUS_RECORD", recordPath, 1);
+        sigprocmask(SIG_SETMASK, mask, NULL);
+        execl("/proc/self/exe", "nautilus", (char *) NULL);
+        _exit(127);
     }
-    exit(exit_status);
-}
-
-// Check whether this process can execute a file.
-// Use this function when searching through the directories
-// in the path for an executable file
-static int is_executable(char *pathname) {
-    struct stat s;
-    return
-        stat(pathname, &s) == 0 &&  
-        S_ISREG(s.st_mode) &&      
-        faccessat(AT_FDCWD, pathname, X_OK, AT_EACCESS) == 0; 
+    if (pid == -1) {
+        perror("fork");
+    }
+    return pid;
 }
 
-// Split a string 's' into pieces by any one of a set of separators.
-//
-// Returns an array of strings, with the last element being `NULL';
-// The array itself, and the strings, are allocated with `malloc(3)';
-// the provided `free_token' function can deallocate this.
-static char **tokenize(char *s, char *separators, char *special_chars) {
-    size_t n_tokens = 0;
-    // malloc array guaranteed to be big enough
-    char **tokens = malloc((strlen(s) + 1) * sizeof *tokens);
-
-    while (*s != '\0') {
-        // We are pointing at zero or more of any of the separators.
-        // Skip leading instances of the separators.
-        s += strspn(s, separators);
-
-        // Now, `s' points at one or more characters we want to keep.
-        // The number of non-separator characters is the token length.
-        //
-        // Trailing separators after the last token mean that, at this
-        // point, we are looking at the end of the string, so:
-        if (*s == '\0') {
-            break;
-        }
-
-        size_t token_length = strcspn(s, separators);
-        size_t token_length_without_special_chars = strcspn(s, special_chars);
-        if (token_length_without_special_chars == 0) {
-            token_length_without_special_chars = 1;
-        }
-        if (token_length_without_special_chars < token_length) {
-            token_length = token_length_without_special_chars;
-        }
-        char *token = strndup(s, token_length);
-        assert(token != NULL);
-        s += token_length;
 
-        // Add this token.
-        tokens[n_tokens] = token;
-        n_tokens++;
+static void addDuration(struct durations *durations, double seconds) {
+    if (durations->count == durations->capacity) {
+        durations->capacity = (durations->capacity == 0) ? 64 : durations->capacity * 2;
+        durations->values = realloc(durations->values, sizeof(uint64_t) * durations->capacity);
     }
+    durations->values[durations->count] = seconds * 1e6;
+    durations->count++;
+}
 
-    tokens[n_tokens] = NULL;
-    // shrink array to correct size
-    tokens = realloc(tokens, (n_tokens + 1) * sizeof *tokens);
-
-    return tokens;
+static uint64_t getPercentile(struct durations *durations, double fraction) {
+    if (durations->count == 0) {
+        return 0;
+    }
+    long index = (long) ceil(fraction * durations->count) - 1;
+    return durations->values[(index > 0) ? index : 0];
 }
 
-// Free an array of strings as returned by `tokenize'.
-static void free_tokens(char **tokens) {
-    for (int i = 0; tokens[i] != NULL; i++) {
-        free(tokens[i]);
+static void formatDuration(char *text, size_t size, uint64_t microseconds) {
+    if (microseconds < 1000) {
+        snprintf(text, size, "%luus", (unsigned long) microseconds);
+    } else if (microseconds < 1000000) {
+        snprintf(text, size, "%.1fms", microseconds / 1e3);
+    } else {
+        snprintf(text, size, "%.2fs", microseconds / 1e6);
     }
-    free(tokens);
+}
+
+static int compareDurations(const void *a, const void *b) {
+    uint64_t first = *(uint64_t *) a;
+    uint64_t second = *(uint64_t *) b;
+    return (first > second) - (first < second);
 }
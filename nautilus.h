@@ -0,0 +1,86 @@
+// Nautilus as a library, for programs that run command lines without 
+// starting a shell for each one. A context keeps the shell warm: its 
+// environment, working directory and the programs in its PATH are read 
+// once, and each line runs in a worker forked from the calling process. 
+// Different contexts can be used from different threads at once.
+
+#ifndef NAUTILUS_H
+#define NAUTILUS_H
+
+#include <sys/resource.h>
+
+// A warm shell, made by nautilusCreate
+struct nautilusContext;
+
+// What a command line left behind once it finished
+struct nautilusResult {
+    // As the shell's exit status would be, 128 plus the signal's number if 
+    // the worker was killed
+    int exitStatus;
+    // Including every process the line waited for
+    struct rusage usage;
+};
+
+// Returns a context that runs command lines with a copy of the given 
+// environment, or of the process' if it is NULL, in the given directory, or 
+// the current one if it is NULL. Returns NULL with errno set on error
+struct nautilusContext *nautilusCreate(char *const environment[], const char *directory);
+
+// Runs a command line with fds[0], fds[1] and fds[2] as its stdin, stdout 
+// and stderr, and waits for it. The result may be NULL. Returns 0, or -1 
+// with errno set if it couldn't be run. The line's worker is waited for by
+// its pid, so SIGCHLD mustn't be ignored
+int nautilusRun(struct nautilusContext *context, const char *line, const int fds[3], 
+                struct nautilusResult *result);
+
+// Frees a context
+void nautilusDestroy(struct nautilusContext *context);
+
+// The shell can also run lines in the calling process itself, as the 
+// nautilus program does at its prompt, so that cd and the rest last from 
+// one line to the next. These share the process' state, so only one thread
+// may use them
+
+// The longest a command line can be, including its terminating null
+#define NAUTILUS_LINE_MAX 1024
+
+// Flags for nautilusExecute: print each program's exit status, and add the 
+// line to the session record NAUTILUS_RECORD names
+#define NAUTILUS_REPORT_STATUS 1
+#define NAUTILUS_RECORD_LINE 2
+
+// What the word before the cursor could be completed to
+struct nautilusCompletion {
+    // What every match adds to the word, with a space after it if there is
+    // only one match and it isn't a directory
+    char *extension;
+    int numberOfMatches;
+    // Some of the matches in full, for listing
+    char **names;
+    int numberOfNames;
+};
+
+// Sets up the shell in this process: reads PATH, and starts the program 
+// statistics, the flight recorder and the session record. Call it once, 
+// before the functions below
+void nautilusStart(void);
+
+// Returns the words a command line is split into, NULL terminated, or NULL
+// if out of memory. Free them with nautilusFreeWords
+char **nautilusParse(const char *line);
+void nautilusFreeWords(char **words);
+
+// Runs a command line, with any of the flags above, and returns its exit 
+// status
+int nautilusExecute(const char *line, int flags);
+
+// Reads the programs in PATH again if it has changed, so processes forked 
+// afterwards start with them
+void nautilusReadPath(void);
+
+// Works out the completions of the word that ends at the cursor. Returns 0,
+// or -1 if out of memory. Free them with nautilusFreeCompletion
+int nautilusComplete(const char *line, int cursor, struct nautilusCompletion *completion);
+void nautilusFreeCompletion(struct nautilusCompletion *completion);
+
+#endif